@@ -3,21 +3,40 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include <deque>
+#include <string>
 #include "rdma.h"
+#include "transport.h"
 #include "structure.h"
 
 class Server;   //前向声明，在定义类之前引用它
 
-//TODO: consider to replace Client by RdmaContext
+/*
+ * credit-based flow control between a pair of endpoints
+ *
+ * the peer reserves grant recv slots for us, at most window (= the size of
+ * our send ring). Every msg we send takes one credit, and the peer gives the
+ * credits back in the imm of its own msgs once it has processed the msgs and
+ * re-posted the recv slots, or with an empty msg if it has nothing to send
+ * for a while. The peer grows our grant by giving back more credits than we
+ * used, and shrinks it by keeping some, as its share of recv slots changes
+ * (see TransportResource::RecvWindow).
+ * The last SEND_CREDIT_RESERVE credits are kept for such empty msgs so that
+ * two peers can never be stuck waiting for each other.
+ */
+#define SEND_CREDIT_RESERVE 1
+#define CREDIT_RETURN_THRESHOLD(grant) ((grant) / 2)  //return credits explicitly once so many are pending
+
+//TODO: consider to replace Client by TransportContext
 class Client{
     private:
 //        union{
 //            int fd;             /* unix socket (local clients) NOT USED */
-            RdmaContext *ctx;   /* remote client */ //指向RDMA上下文的指针，用于远程客户端    
+            TransportContext *ctx;   /* remote client */ //指向RDMA上下文的指针，用于远程客户端    
 //        };
 
         int lastMsgTime;    //记录最后一条消息的时间
-        RdmaResource* resource; //指向RDMA资源的指针
+        TransportResource* resource; //指向传输资源的指针(RDMA或共享内存)
         char* connstr = nullptr;    //连接字符串
 
         //remote worker info
@@ -26,15 +45,51 @@ class Client{
          * otherwise, it's the id of the remote pair
          */
         int wid;    //工作节点ID
+        bool connected = false;  //the remote conn param is set, so msgs can be sent
         Size size;  //总内存大小
         Size free;  //空闲内存大小
 
+        //flow control
+        int window;  //the most recv slots the peer may reserve for us
+        int credits;  //msgs we can still send to the peer
+        int grant;  //recv slots we reserve for the peer
+        uint32_t to_return = 0;  //recv slots consumed and re-posted, not yet returned to the peer
+        uint32_t consumed = 0;  //msgs received in the current poll round
+
+        struct PendingSend {  //a non-slot msg waiting for credits/slots
+          const char* buf;
+          size_t len;
+          unsigned int id;
+          bool signaled;
+        };
+        std::deque<PendingSend> pending_sends;
+
+        //instrumentation of the stalls
+        long stall_start = 0;  //when the current stall begins (0: not stalled)
+        uint64_t stalls = 0;  //number of stalls
+        uint64_t stall_time = 0;  //total stall time in ns
+        size_t max_queue = 0;  //max number of msgs waiting for credits
+
+        /*
+         * the exchange of conn params in flight (see ExchConnParamAsync):
+         * connecting -> our conn string sent -> the peer's one read
+         */
+        int exch_fd = -1;
+        Server* exch_server = nullptr;
+        std::string exch_buf;
+
+        void Stall();
+        ssize_t Post(const void* buf, size_t len, unsigned int id, bool signaled);
+        void FlushPending();
+
     public:
-        Client(RdmaResource* res, bool isForMaster, const char *rdmaConnStr = nullptr); //构造函数  //创建客户端
+        Client(TransportResource* res, bool isForMaster, const char *rdmaConnStr = nullptr); //构造函数  //创建客户端
         //Client(int fd); /* for local clients */
 
         //used only among workers
         int ExchConnParam(const char* ip, int port, Server* server);    //交换连接参数
+        int ExchConnParamAsync(const char* ip, int port, int wid, Server* server);  //在server的事件循环中非阻塞地交换连接参数
+        void ProcessExchEvent(int mask);  //ExchConnParamAsync的socket事件
         const char* GetConnString(int workerid = 0);    //获取连接字符串
         int SetRemoteConnParam(const char *conn);   //设置远程连接参数
 
@@ -42,7 +97,8 @@ class Client{
         	return ctx->IsMaster();
         }
         inline int GetWorkerId() {return wid;}  //获取工作节点ID
-        inline void SetMemStat(int size, int free) {this->size = size; this->free = free;}  //设置内存状态
+        inline bool IsConnected() {return connected;}
+        inline void SetMemStat(Size size, Size free) {this->size = size; this->free = free;}  //设置内存状态
         inline Size GetFreeMem() {return this->free;}   //获取空闲内存大小
         inline Size GetTotalMem() {return this->size;}  //获取总内存大小
         inline void* ToLocal(GAddr addr) {return TO_LOCAL(addr, ctx->GetBase());}   //将全局地址转换为本地地址
@@ -56,22 +112,51 @@ class Client{
 
         inline uint32_t GetQP() {return ctx->GetQP();}  //获取队列对号
 
-        inline ssize_t Send(const void* buf, size_t len, unsigned int id = 0, bool signaled = false) {  //发送消息数据
-        	return ctx->Send(buf, len, id, signaled);
-        }
+        /*
+         * send a msg to the peer, taking a credit;
+         * a msg not in a send slot is queued (and -1 returned) when we are
+         * out of credits or slots, and sent once they come back
+         */
+        ssize_t Send(const void* buf, size_t len, unsigned int id = 0, bool signaled = false);
         inline ssize_t Write(raddr dest, raddr src, size_t len, unsigned int id = 0, bool signaled = false) {   //写消息数据    
         	return ctx->Write(dest, src, len, id, signaled);
         }
         inline ssize_t WriteWithImm(raddr dest, raddr src, size_t len, uint32_t imm, unsigned int id = 0, bool signaled = false) {  //带立即数的写消息数据？写数据并发送立即数据
         	return ctx->WriteWithImm(dest, src, len, imm, id, signaled);
         }
+        inline ssize_t Read(raddr dest, raddr src, size_t len, unsigned int id = 0, bool signaled = false) {   //单边读远程内存(dest为本地缓冲区，src为远程地址)
+        	return ctx->Read(dest, src, len, id, signaled);
+        }
 
+        inline int AddRemoteRegion(uint64_t off, size_t size, uint32_t key) {return ctx->AddRemoteRegion(off, size, key);}  //a region grown by the peer
         inline int PostRecv(int n) {return ctx->PostRecv(n);}   //向共享接收队列发布接收请求
 
-        inline char* GetFreeSlot() {return ctx->GetFreeSlot();} //获取空闲槽
+        char* GetFreeSlot(); //获取空闲槽(没有信用时返回nullptr)
         inline char* RecvComp(ibv_wc& wc) {return ctx->RecvComp(wc);}   //处理接收完成事件
-        inline unsigned int SendComp(ibv_wc& wc) {return ctx->SendComp(wc);}    //处理发送完成事件
-        inline unsigned int WriteComp(ibv_wc& wc) {return ctx->WriteComp(wc);}  //处理写完成事件
+        unsigned int SendComp(ibv_wc& wc);    //处理发送完成事件
+        unsigned int WriteComp(ibv_wc& wc);  //处理写完成事件
+
+        /*
+         * flow control on the receiving side:
+         * AddCredits() for the credits carried by a received msg, return true if
+         * we were out of credits (so that the pending work can be resumed);
+         * Consume() for every received msg, return true for the first one in a poll round;
+         * Rebalance() before the recv slots of the round are re-posted, return
+         * how many more (or fewer) slots than the msgs received are re-posted;
+         * ReturnCredits() after the recv slots of the round are re-posted
+         */
+        bool AddCredits(uint32_t n);
+        inline bool Consume() {return ++consumed == 1;}
+        int Rebalance();
+        void ReturnCredits();
+
+        inline void RecordQueueDepth(size_t n) {if (n > max_queue) max_queue = n;}
+        inline int GetCredits() {return credits;}
+        inline int GetWindow() {return window;}
+        inline int GetGrant() {return grant;}
+        inline uint64_t GetStalls() {return stalls;}
+        inline uint64_t GetStallTime() {return stall_time;}
+        inline size_t GetMaxQueueDepth() {return max_queue;}
 
         ~Client();  //析构函数，释放资源
 };
@@ -20,12 +20,19 @@ class Farm {
         TxnContext* tx_; //TxnContext的普通指针，用于指向当前事务上下文
         Worker* w_; //Worker的原始指针，用于当前Worker
 
+        int kv_many(Work op, KVItem* items, int n); //kv_get_many/kv_put_many
+
     public:
         Farm(Worker*); //构造函数，接受一个Worker指针，用于初始化Farm对象
         int txBegin(); //开始事务
         GAddr txAlloc(size_t size, GAddr a = 0); //分配事务内存
+        int txAllocMany(size_t size, int n, GAddr* out, GAddr a = 0); //一次分配n个事务内存对象，返回分配的个数
+        GAddr txAllocGroup(size_t size, uint64_t group); //在亲和组group所在的工作节点上分配(同一组的对象放在一起)
         void txFree(GAddr); //释放事务内存
         osize_t txRead(GAddr, char*, osize_t); //事务读取
+        int txReadMany(const GAddr*, int n); //并行读取n个对象到读集合(之后的txRead直接命中)，返回可读的个数
+        version_t txVersion(GAddr); //事务读到的对象版本，未读过返回0
+        int txCachedRead(GAddr, const char*, osize_t, version_t); //把应用缓存的对象副本加入读集合(不读取)，提交时按版本验证
         osize_t txWrite(GAddr, const char*, osize_t);  //事务写入
         osize_t txPartialRead(GAddr, osize_t, char*, osize_t); //部份事务读取
         osize_t txPartialWrite(GAddr, osize_t, const char*, osize_t); //部份事务写入
@@ -46,5 +53,15 @@ class Farm {
         int get(uint64_t key, void* value) ; //获取键值对
         int kv_put(uint64_t key, const void* value, size_t count, int node_id) ; //存储键值对到指定节点
         int kv_get(uint64_t key, void* value, int node_id) ; //从指定节点获取键值对
+        int kv_get_many(KVItem* items, int n); //并行获取n个键值对(发往同一节点的请求合并发送)，返回获取到的个数
+        int kv_put_many(KVItem* items, int n); //并行存储n个键值对，返回存储成功的个数
+        int barrier(int nthreads = 1); //集群屏障：本节点的nthreads个线程和其他所有节点都到达后返回
+        //弹性成员：新节点接管节点wid的n个区域(返回迁入的区域数)；本节点把所有区域迁走后退出集群
+        int take_over(int wid, int n);
+        int leave();
+        //协调服务(由主节点提供，不需要轮询)
+        int coord_barrier(uint64_t name, int participants); //命名屏障：participants个调用(来自任意节点/线程)都到达后返回
+        int watch(uint64_t key, void* value, uint64_t& version, int timeout_ms = 0); //等待key被PUT出比version更新的值
+        int64_t fetch_add(uint64_t key, int64_t delta); //原子计数器，返回加之前的值
 };
 #endif
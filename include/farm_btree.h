@@ -0,0 +1,162 @@
+// Copyright (c) 2018 The GAM Authors
+
+#ifndef FARM_BTREE_H_
+#define FARM_BTREE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+
+#include "farm.h"
+
+/*
+ * FarmBTree: a B+-tree of uint64_t keys and values of vsize bytes whose nodes
+ * are Farm objects spread over the workers given to Create.
+ *
+ * layout (Farm objects; the nodes are of node_size bytes):
+ *   meta:     [FarmBTreeMeta]
+ *   internal: [FarmBTreeHdr][uint64_t key[icap]][GAddr child[icap + 1]]
+ *   leaf:     [FarmBTreeHdr][uint64_t key[lcap]][value[lcap] of vsize bytes]
+ * child i of an internal node keeps the keys in [key[i-1], key[i]); the
+ * nodes of a level are linked by next, so that scans can go right.
+ *
+ * Get/Put/Remove and the iterators run in the txn of the caller. The meta and
+ * the internal nodes are cached in a FarmBTreeCache (to be shared by the
+ * threads of a worker) and put into the txn by Farm::txCachedRead without
+ * being read, so a lookup only reads its leaf; the commit validates the
+ * versions of the cached nodes as if they were read. A txn using the tree
+ * shall be committed by FarmBTree::Commit, which drops the cached nodes of a
+ * failed txn so that the retry reads them again.
+ * Nodes are never merged or freed: Remove leaves the leaf underfull.
+ */
+#define FARM_BTREE_MAGIC 0x45455254  //"TREE"
+#define FARM_BTREE_NODE_SIZE 4096  //default bytes of a node
+#define FARM_BTREE_MAX_WIDS 64
+#define FARM_BTREE_SCAN_BATCH 16  //leaves read at once by an iterator
+
+struct FarmBTreeMeta {
+  uint32_t magic;
+  uint32_t vsize;
+  uint32_t node_size;
+  uint32_t height;  //1: the root is a leaf
+  GAddr root;
+  uint32_t nwids;
+  uint16_t wids[FARM_BTREE_MAX_WIDS];  //where new nodes are put, round-robin
+};
+
+struct FarmBTreeHdr {
+  uint32_t level;  //0: leaf
+  uint32_t count;  //#keys
+  GAddr next;  //the right sibling, Gnullptr for the last one
+};
+
+/*
+ * cached copies of the meta and the internal nodes, shared by the FarmBTree
+ * handles of a worker (one per thread)
+ */
+class FarmBTreeCache {
+  private:
+    std::mutex lock_;
+    std::unordered_map<GAddr, std::pair<version_t, std::string>> nodes_;
+  public:
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    bool Get(GAddr a, std::string& buf, version_t& v);
+    void Put(GAddr a, version_t v, const std::string& buf);
+    void Drop(GAddr a);
+};
+
+class FarmBTreeIterator;
+
+/* a node on the path from the root */
+struct FarmBTreeStep {
+  GAddr addr;
+  std::string buf;
+  int idx;  //the child taken
+};
+
+class FarmBTree {
+  friend class FarmBTreeIterator;
+  private:
+    Farm* f_;
+    FarmBTreeCache* cache_;
+    std::unique_ptr<FarmBTreeCache> own_cache_;
+    GAddr meta_ = Gnullptr;
+    uint32_t vsize_ = 0;
+    uint32_t node_size_ = 0;
+    uint32_t icap_ = 0;  //keys of an internal node
+    uint32_t lcap_ = 0;  //keys of a leaf
+    std::vector<uint16_t> wids_;
+    uint32_t place_ = 0;
+    std::vector<GAddr> used_;  //cached nodes put into the current txn
+
+    void Init(GAddr meta, const FarmBTreeMeta& m);
+    bool Fetch(GAddr a, std::string& buf, bool cached);
+    int Traverse(uint64_t key, std::vector<FarmBTreeStep>& path, uint32_t level = 0);
+    GAddr NewNode();
+    void Write(GAddr a, const std::string& buf, bool internal);
+    int Split(std::vector<FarmBTreeStep>& path, uint64_t sep, GAddr right);
+    void LeafInsert(char* n, int pos, uint64_t key, const void* value);
+    void InnerInsert(char* n, int pos, uint64_t key, GAddr right);  //right: the child after key
+
+    inline FarmBTreeHdr* Hdr(char* n) {return (FarmBTreeHdr*)n;}
+    inline uint64_t* Keys(char* n) {return (uint64_t*)(n + sizeof(FarmBTreeHdr));}
+    inline GAddr* Children(char* n) {return (GAddr*)(Keys(n) + icap_);}
+    inline char* Values(char* n) {return (char*)(Keys(n) + lcap_);}
+
+  public:
+    //cache: shared by the handles of a worker, or private to this one if null
+    FarmBTree(Farm* f, FarmBTreeCache* cache = nullptr);
+
+    //create an empty tree with nodes spread over the workers wids (the local
+    //worker if empty), return its meta to be passed to Open, or Gnullptr
+    GAddr Create(uint32_t vsize, const std::vector<uint16_t>& wids = std::vector<uint16_t>(),
+        uint32_t node_size = FARM_BTREE_NODE_SIZE);
+    int Open(GAddr meta);  //0 on success
+
+    /* in the txn of the caller */
+    int Get(uint64_t key, void* value);  //0 if found, -1 otherwise
+    int Put(uint64_t key, const void* value);  //insert or update, 0 on success
+    int Remove(uint64_t key);  //0 on success, -1 if not found
+    int Commit();  //commit the txn of the caller (see above)
+    int Abort();
+
+    inline GAddr GetMeta() {return meta_;}
+    inline uint32_t GetValueSize() {return vsize_;}
+};
+
+/*
+ * the keys in [from, to] in order, in the txn of the caller:
+ *   for (FarmBTreeIterator it(&t, from, to); it.Valid(); it.Next()) ...
+ * the leaves are read FARM_BTREE_SCAN_BATCH at a time with Farm::txReadMany,
+ * their addresses taken from the (cached) parents
+ */
+class FarmBTreeIterator {
+  private:
+    FarmBTree* t_;
+    uint64_t to_;
+    std::deque<GAddr> leaves_;  //to be read
+    int ahead_ = 0;  //leaves at the front of leaves_ already read by txReadMany
+    GAddr pnext_ = Gnullptr;  //the next parent to take leaves from
+    std::string leaf_;
+    int pos_ = 0;
+    bool valid_ = false;
+
+    void AddLeaves(char* parent, int from);
+    bool NextLeaf();
+    void Settle();
+
+  public:
+    FarmBTreeIterator(FarmBTree* t, uint64_t from, uint64_t to = UINT64_MAX);
+    inline bool Valid() {return valid_;}
+    void Next();
+    inline uint64_t Key() {return t_->Keys(&leaf_[0])[pos_];}
+    inline const char* Value() {return t_->Values(&leaf_[0]) + pos_ * t_->vsize_;}
+};
+
+#endif
@@ -0,0 +1,110 @@
+// Copyright (c) 2018 The GAM Authors
+
+#ifndef FARM_HASH_H_
+#define FARM_HASH_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "farm.h"
+
+/*
+ * FarmHash: a distributed hash table of uint64_t keys and values of up to
+ * vsize bytes, in the style of the hopscotch table of FaRM.
+ *
+ * table layout (all Farm objects):
+ *   root:     [FarmHashMeta][GAddr dir[ndir]]
+ *   dir page: [GAddr bucket[FARM_HASH_DIR_FANOUT]]
+ *   bucket:   [uint32_t hop][uint32_t reserved][slots x FarmHashEntry]
+ *   entry:    [uint64_t key][int32_t len (-1: empty)][uint32_t reserved][value of vsize bytes]
+ *
+ * the buckets are spread over the workers given to Create. A key is kept in
+ * its home bucket or one of the FARM_HASH_HOP buckets after it; bit d of the
+ * hop of the home bucket tells whether bucket home+d may keep keys of it, so
+ * a lookup reads the home bucket and only the neighbours with their bit set.
+ * Inserts move entries closer to their home (hopscotch displacement) to make
+ * room within the neighbourhood.
+ *
+ * Get/MultiGet/Put/Remove run in the txn of the caller (txBegin ... txCommit):
+ * lookups are lock-free txReads of the buckets, validated by the versions at
+ * commit, and updates are written back at commit like any other object.
+ * The bucket directory is immutable and cached by Create/Open, which run txns
+ * of their own.
+ */
+#define FARM_HASH_MAGIC 0x48534148  //"HASH"
+#define FARM_HASH_HOP 8  //neighbourhood of a home bucket, at most 32 (bits of hop)
+#define FARM_HASH_SLOTS 4  //default entries per bucket
+#define FARM_HASH_PROBE 128  //buckets searched for a free slot by an insert
+#define FARM_HASH_DIR_FANOUT 512  //bucket addresses per dir page
+#define FARM_HASH_BUCKET_HDR (2 * sizeof(uint32_t))
+#define FARM_HASH_ENTRY_HDR (sizeof(uint64_t) + 2 * sizeof(uint32_t))
+//the largest object that can be read remotely in one msg
+#define FARM_HASH_OBJECT_MAX (MAX_REQUEST_SIZE - FARM_MSG_HDR_SIZE - FARM_OBJECT_HEADER_SIZE)
+
+struct FarmHashMeta {
+  uint32_t magic;
+  uint32_t nbuckets;
+  uint32_t slots;
+  uint32_t vsize;
+  uint32_t ndir;
+  uint32_t reserved;
+};
+
+class FarmHash {
+  private:
+    Farm* f_;
+    GAddr root_ = Gnullptr;
+    uint32_t nbuckets_ = 0;
+    uint32_t slots_ = 0;
+    uint32_t vsize_ = 0;
+    uint32_t hop_ = 0;  //min(FARM_HASH_HOP, nbuckets_)
+    osize_t bsize_ = 0;  //bytes of a bucket
+    std::vector<GAddr> buckets_;
+
+    //the buckets touched by the current operation, and the ones it changed
+    std::unordered_map<uint32_t, std::string> cache_;
+    std::unordered_set<uint32_t> dirty_;
+
+    void Init(GAddr root, const FarmHashMeta& m);
+    uint32_t Home(uint64_t key);
+    char* Load(uint32_t b);
+    void Flush();
+    int Find(uint64_t key, uint32_t& b);  //the slot of key in bucket b, -1 if not found
+    bool HasHomed(char* bucket, uint32_t home);  //whether bucket keeps a key of home
+    bool Displace(uint32_t& b, int& i);  //move the free slot i of bucket b closer to the homes
+
+    inline uint32_t& Hop(char* bucket) {return *(uint32_t*)bucket;}
+    inline char* Entry(char* bucket, int i) {
+      return bucket + FARM_HASH_BUCKET_HDR + i * (FARM_HASH_ENTRY_HDR + vsize_);
+    }
+    inline uint64_t& Key(char* e) {return *(uint64_t*)e;}
+    inline int32_t& Len(char* e) {return *(int32_t*)(e + sizeof(uint64_t));}
+    inline char* Value(char* e) {return e + FARM_HASH_ENTRY_HDR;}
+
+  public:
+    FarmHash(Farm* f): f_(f) {}
+
+    //create a table of nbuckets buckets spread over the workers wids (the local
+    //worker if empty), return its root to be passed to Open, or Gnullptr
+    GAddr Create(uint32_t nbuckets, uint32_t vsize,
+        const std::vector<uint16_t>& wids = std::vector<uint16_t>(),
+        uint32_t slots = FARM_HASH_SLOTS);
+    int Open(GAddr root);  //0 on success
+
+    /* in the txn of the caller */
+    int Get(uint64_t key, void* value);  //length of the value, -1 if not found
+    //look up n keys with the buckets read in parallel; the value of keys[i] is
+    //put at values + i * vsize and its length (-1 if not found) into lens[i].
+    //return the number of keys found
+    int MultiGet(int n, const uint64_t* keys, void* values, int* lens);
+    int Put(uint64_t key, const void* value, uint32_t len);  //0 on success, -1 if full or too long
+    int Remove(uint64_t key);  //0 on success, -1 if not found
+
+    inline GAddr GetRoot() {return root_;}
+    inline uint32_t GetValueSize() {return vsize_;}
+};
+
+#endif
@@ -11,6 +11,7 @@
 #include "structure.h"
 #include "workrequest.h"
 #include "chars.h"
+#include "region_map.h"
 
 typedef int32_t osize_t;
 
@@ -19,6 +20,13 @@ typedef int32_t osize_t;
 版本号：占用低56位，用于存储实际的版本号。
 锁信息：占用高8位，用于存储锁状态(读锁和写锁)*/
 typedef uint64_t version_t;
+#define FARM_OBJECT_HEADER_SIZE (sizeof(version_t) + sizeof(osize_t))  //[version][size] in front of the data
+/*
+ * an object whose data is moved to the second tier (see tier.h) keeps a tombstone
+ * of [version][FARM_OBJECT_DEMOTED][uint64_t file offset][osize_t size] in its chunk
+ */
+#define FARM_OBJECT_DEMOTED -2
+#define FARM_TOMBSTONE_SIZE (FARM_OBJECT_HEADER_SIZE + sizeof(uint64_t) + sizeof(osize_t))
 #define VBITS 56  //定义了版本号中用于存储实际版本号的位数
 #define MAX_VERSION ((1UL << VBITS) - 1) //用于表示版本号的最大值
 #define UNLOCK 0x0 
@@ -207,6 +215,29 @@ class TxnContext{
         std::unordered_map<uint16_t, std::unordered_map<GAddr, std::shared_ptr<Object>>> read_set_;
         //用于存储事务相关的缓冲区
         std::string buffer_; 
+        //并行读(Farm::txReadMany)时每个在途的远程读占用一个子上下文，由worker线程创建并复用
+        std::vector<std::unique_ptr<TxnContext>> readers_;
+        /*
+         * the objects are grouped by the worker owning them: by the region
+         * map of the coordinator (see RegionMap), or all by bucket_ in a
+         * participant, which only gets the objects it owns.
+         * The owner is the one when the object is first put in a set, and is
+         * kept in owners_ so that the object is still found if its region
+         * moves meanwhile (the txn then fails at that owner).
+         */
+        RegionMap* regions_ = nullptr;
+        uint16_t bucket_ = 0;
+        std::unordered_map<GAddr, uint16_t> owners_;
+        inline uint16_t widOf(GAddr a) {
+            if (bucket_) return bucket_;
+            if (!regions_) return WID(a);
+            auto it = owners_.find(a);
+            return it != owners_.end() ? it->second : regions_->Owner(a);
+        }
+        inline uint16_t bindOwner(GAddr a) {  //the owner of a from now on in this txn
+            if (bucket_ || !regions_) return widOf(a);
+            return owners_.emplace(a, regions_->Owner(a)).first->second;
+        }
 
 
     public:
@@ -223,13 +254,18 @@ class TxnContext{
         Object* createWritableObject(GAddr);//创建可写对象
         Object* getWritableObject(GAddr);//获取可写对象
         inline bool containWritable(GAddr a) { //检查写集合中是否包含指定地址的对象
-            return this->write_set_[WID(a)].count(a) > 0;
+            return this->write_set_[widOf(a)].count(a) > 0;
         }
 
         inline void rmReadableObject(GAddr a) {//从读集合中移除指定地址的对象
-            this->read_set_[WID(a)].erase(a);
+            uint16_t wid = widOf(a);
+            this->read_set_[wid].erase(a);
+            if (!write_set_[wid].count(a)) owners_.erase(a);
         }
 
+        inline void setRegions(RegionMap* regions) {regions_ = regions;}  //the coordinator routes by the region map
+        inline void setBucket(uint16_t wid) {bucket_ = wid;}  //a participant keeps all its objects under its wid
+
         int generatePrepareMsg(uint16_t wid, char* msg, int len, int& nobj );//生成准备消息
         int generateValidateMsg(uint16_t wid, char* msg, int len, int& nobj ); //生成验证消息
         int generateCommitMsg(uint16_t wid, char* msg, int len);//生成提交消息
@@ -260,6 +296,7 @@ class TxnContext{
 
         void reset();//重置事务上下文
 
+        TxnContext* getReader(int i);  //第i个并行读的子上下文，不存在时创建
 };
 
 #endif
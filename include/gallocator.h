@@ -22,6 +22,7 @@ class GAlloc{
 public:
 	GAddr Malloc(const Size size, Flag flag = 0); //分配内存
 	GAddr AlignedMalloc(const Size size, Flag flag = 0); //分配对齐的内存
+	int MallocMany(const Size size, int n, GAddr* out, GAddr placement = 0); //一次分配n个对象，返回分配的个数
     int Read(const GAddr addr, void* buf, const Size count, Flag flag = 0); //读取数据
 	int Read(const GAddr addr, const Size offset, void* buf, const Size count, Flag flag = 0); //带偏移量读取数据
 	int Write(const GAddr addr, void* buf, const Size count, Flag flag = 0);//写入数据
@@ -33,9 +34,12 @@ public:
 
 	void txBegin(); //开始事务
     GAddr txAlloc(size_t size, GAddr a = 0); //分配内存事务
+    int txAllocMany(size_t size, int n, GAddr* out, GAddr a = 0); //一次分配n个对象的事务
+    GAddr txAllocGroup(size_t size, uint64_t group); //在亲和组所在的工作节点上分配
     void txFree(GAddr); //释放内存事务
     int txRead(GAddr, void*, osize_t); //事务读取
     int txRead(GAddr, const Size, void*, osize_t);//带偏移量的事务读取
+    int txReadMany(const GAddr*, int n); //并行读取n个对象
     int txWrite(GAddr, void*, osize_t); //事务写入
     int txWrite(GAddr, const Size, void*, osize_t);//带偏移量的事务写入
     int txAbort();//中止事务
@@ -45,6 +49,12 @@ public:
    	int txKVPut(uint64_t key, const void* value, size_t count, int node_id); //事务存储键值对
    	int KVGet(uint64_t key, void *value, int node_id);//获取键值对
    	int KVPut(uint64_t key, const void* value, size_t count, int node_id); //存储键值对
+   	int KVGetMany(KVItem* items, int n); //并行获取多个键值对，返回获取到的个数
+   	int KVPutMany(KVItem* items, int n); //并行存储多个键值对，返回存储成功的个数
+   	int Barrier(int nthreads = 1); //集群屏障，本节点需要nthreads个线程调用
+   	int Barrier(uint64_t name, int participants); //命名屏障，集群内共participants个调用
+   	int Watch(uint64_t key, void* value, uint64_t& version, int timeout_ms = 0); //等待key的新值
+   	int64_t FetchAdd(uint64_t key, int64_t delta); //原子计数器
 
     GAlloc(Worker* w) { //构造函数， 接受一个Worker指针，用于初始化Farm对象
         farm = new Farm(w); //初始化farm
@@ -0,0 +1,81 @@
+// Copyright (c) 2018 The GAM Authors
+/*文件定义了工作节点(和master)上的键值存储：开放寻址的索引，值放在给定分配器(工作节点的slab区域)分配的块中*/
+
+#ifndef INCLUDE_KV_STORE_H_
+#define INCLUDE_KV_STORE_H_
+
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+#include "structure.h"
+
+#define KV_STORE_MIN_CAPACITY 64  //initial slots of the index
+
+/*
+ * the key-value pairs of the KV API
+ *
+ * the index is an open-addressing table (linear probing, backward-shift
+ * deletion, so no tombstones) of 16-byte [key][block] entries, grown to
+ * twice the slots at 3/4 load. A value lives in a block of the allocator:
+ *   [uint64_t 0][Size size][value]
+ * the leading zero word makes a block of the slab region look like a
+ * never-written Farm object, which the tier leaves alone (see
+ * Worker::FarmTierDemoteObject).
+ *
+ * a Put reuses the block of the old value if the new one fits and fills at
+ * least half of it, otherwise the old block is freed.
+ * Not thread-safe: only used by the worker (master) thread.
+ */
+class KVStore {
+ public:
+  typedef std::function<void*(size_t)> AllocFunc;
+  typedef std::function<void(void*)> FreeFunc;
+  typedef std::function<size_t(void*)> UsableFunc;  //usable bytes of a block
+
+ private:
+  struct Entry {
+    uint64_t key;
+    char* block;  //nullptr for an empty slot
+  };
+
+  AllocFunc alloc_;
+  FreeFunc free_;
+  UsableFunc usable_;
+  std::vector<Entry> table_;
+  size_t mask_;
+  size_t count_ = 0;
+  size_t bytes_ = 0;  //of the values
+
+  size_t Find(uint64_t key);  //the slot of key, or the empty slot ending its probe
+  void Grow();
+  char* NewBlock(Size size);
+
+ public:
+  KVStore(AllocFunc alloc, FreeFunc free, UsableFunc usable);
+  ~KVStore();
+
+  /*the value of key and its size, nullptr if not found*/
+  char* Get(uint64_t key, Size& size);
+  /*room for a value of size bytes under key, to be filled by the caller; nullptr if out of memory*/
+  char* Put(uint64_t key, Size size);
+  int Put(uint64_t key, const void* value, Size size);  //0 on success
+  bool Remove(uint64_t key);
+
+  /*
+   * a value not yet under any key (e.g., being received in chunks):
+   * Alloc the room for it, and then either Install it under a key (replacing
+   * the old value) or Release it
+   */
+  char* Alloc(Size size);
+  void Install(uint64_t key, char* value);
+  void Release(char* value);
+
+  /*the blocks of the values under a key, so that they are told apart from the objects around them*/
+  void GetBlocks(std::unordered_set<void*>& out);
+
+  inline size_t GetCount() {return count_;}
+  inline size_t GetBytes() {return bytes_;}
+};
+
+#endif /* INCLUDE_KV_STORE_H_ */
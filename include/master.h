@@ -3,39 +3,87 @@
 #ifndef INCLUDE_MASTER_H_
 #define INCLUDE_MASTER_H_
 
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <queue>
+#include <vector>
 #include "ae.h"
 #include "settings.h"
 #include "log.h"
 #include "server.h"
+#include "kv_store.h"
 
 class Master: public Server {	//Master类继承自Server类，表示主节点服务器
 	//the service thread
 	thread* st;	//服务线程	
 
-	//worker list: ip:port,ip:port
-	string worker_ips;	//工作节点列表，格式为“ip:port,ip:port”	
+	//worker list: wid -> ip:port, sent to a joining worker as "wid:ip:port,wid:ip:port"
+	map<int, string> worker_addrs;	//工作节点列表
 
 	//worker counter
 	int workers;	//工作节点计数器
 
-	queue<Client*> unsynced_workers;	//未同步的工作节点队列
-	unordered_map<uint64_t, pair<void*, Size>> kvs;	//键值对存储
+	/*
+	 * mem stats are disseminated as deltas: only the workers whose stats changed
+	 * since the last broadcast are sent, at most once per conf->stats_interval
+	 * (or when unsynced_th of them changed), and every msg carries a new epoch,
+	 * so that a worker missing one asks for the whole picture again
+	 */
+	unordered_set<int> unsynced_workers;	//未同步的工作节点ID
+	uint64_t stats_epoch = 0;	//epoch of the last BROADCAST_MEM_STATS
+	long last_broadcast = 0;	//ns
+	void BroadcastMemStats();
+	static int MemStatsBroadcaster(struct aeEventLoop *eventLoop, long long id, void *clientData);
+
+	//barrier round -> workers entered it, released in one broadcast once all the conf->no_node workers entered
+	unordered_map<uint32_t, int> barriers;
+	KVStore kvs;	//键值对存储
 
 	unordered_map<uint64_t, queue<pair<Client*, WorkRequest*>>> to_serve_kv_request;	//待服务的键值对请求队列
 
+	/*
+	 * coordination service: named barriers, watches on the kvs and atomic
+	 * counters. The callers are parked here until they can be answered, so
+	 * no worker has to poll the master
+	 */
+	struct Waiter {
+		Client* client;
+		WorkRequest* wr;
+		long deadline;	//ns, 0 to wait forever
+	};
+	unordered_map<uint64_t, vector<pair<Client*, WorkRequest*>>> coord_barriers;	//name -> arrived participants
+	unordered_map<uint64_t, uint64_t> kv_versions;	//key -> number of PUTs to it
+	unordered_map<uint64_t, vector<Waiter>> watches;	//key -> parked WATCHes
+	int timed_watches = 0;	//parked WATCHes with a deadline
+	unordered_map<uint64_t, int64_t> counters;	//FETCH_ADD counters
+	void CoordReply(Client* client, WorkRequest* wr, uint64_t result,
+			const void* value = nullptr, Size size = 0, Status status = SUCCESS);
+	void ServeWatches(uint64_t key);
+	static int WatchSweeper(struct aeEventLoop *eventLoop, long long id, void *clientData);
+
+	/*
+	 * owners of the moved regions (see RegionMap): region -> (wid, seq of its
+	 * last move). Every change is broadcast as a REGION_MAP delta with a new
+	 * epoch, so that a worker missing one asks for the whole map again
+	 */
+	map<uint64_t, pair<int, uint32_t>> region_owners;
+	uint64_t region_epoch = 0;
+	void SendRegionMap(Client* client);
+
 public:
 	Master(const Conf& conf);	//构造函数，初始化主节点服务器
 	inline void Join() {st->join();}	//等待服务线程结束
+	inline uint64_t GetStatsEpoch() {return stats_epoch;}	//epoch of the last mem stats broadcast
 
 	inline bool IsMaster() {return true;}	//判断是否为主节点，返回true
 	inline int GetWorkerId() {return 0;}	//获取工作节点ID，主节点的ID为0
 
-	void Broadcast(const char* buf, size_t len);	//广播消息给所有工作节点
+	void Broadcast(const char* buf, size_t len, Client* except = nullptr);	//广播消息给所有工作节点(except除外)
 
   void FarmProcessRemoteRequest(Client* client, const char* msg, uint32_t size);	//处理远程请求
   void FarmResumeTxn(Client*){}	//恢复事务(未实现)
+  void FarmProcessRdmaRead(Client*, unsigned int){}	//master不发起单边读
 
     void ProcessRequest(Client* client, WorkRequest* wr);	//处理客户端请求
     //some post process after accepting a TCP connection (e.g., send the worker list)
@@ -23,6 +23,9 @@ int dsmWrite(GAddr addr, void* buf, Size count);
 // 释放内存
 void dsmFree(GAddr addr);
 
+// 集群屏障：所有节点都到达后返回，每个节点需要nthreads个线程调用
+int dsmBarrier(int nthreads = 1);
+
 void dsm_finalize();
 
 #ifdef __cplusplus
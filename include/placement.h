@@ -0,0 +1,42 @@
+// Copyright (c) 2018 The GAM Authors
+/*文件定义了没有地址提示的内存分配放在哪个工作节点上的策略(Conf::alloc_policy)*/
+
+#ifndef INCLUDE_PLACEMENT_H_
+#define INCLUDE_PLACEMENT_H_
+
+#include <vector>
+#include "structure.h"
+
+/*
+ * a worker allocations can be placed at, as seen by this worker
+ */
+struct PlacementTarget {
+  int wid;
+  Size total;
+  Size free;  //as last known from Master, less the bytes placed there since (see Worker::FarmPlace)
+  size_t load;  //requests queued to it and not sent yet
+};
+
+/*
+ * where an allocation made without an address goes; targets[0] is always
+ * this worker. A policy only picks among the targets, keeping the view of
+ * them up to date is left to the worker, so that they are not rebuilt for
+ * every allocation.
+ */
+class Placement {
+ public:
+  virtual ~Placement() {}
+  /*the index of the target to allocate size bytes at, -1 if none has the room*/
+  virtual int Place(const std::vector<PlacementTarget>& targets, Size size) = 0;
+
+  /*
+   * the target of an affinity group by rendezvous hashing: the one with the
+   * highest hash of (group, wid) among those with the room, so that the
+   * workers knowing the same set of workers agree on it without talking
+   */
+  static int PlaceGroup(const std::vector<PlacementTarget>& targets, uint64_t group, Size size);
+
+  static Placement* Create(const Conf& conf);
+};
+
+#endif /* INCLUDE_PLACEMENT_H_ */
@@ -15,12 +15,12 @@
 #include <queue>
 #include "settings.h"
 #include "log.h"
+#include "transport.h"
 
 /*这些前向声明用于在定义类之前引用它们*/
 class RdmaResource;
 class RdmaContext;
-/*定义了一个类型raddr，表示注册的地址*/
-typedef void* raddr; //raddr means registered addr
+extern int MAX_RDMA_INLINE_SIZE;
 
 /*这些宏定义了与RDMA连接字符串长度、位掩码、接收槽步长和其他计算相关的常量和宏*/
 #define MASTER_RDMA_CONN_STRLEN 22 /** 4 bytes for lid + 8 bytes qpn
@@ -28,7 +28,7 @@ typedef void* raddr; //raddr means registered addr
                                     * seperated by 2 colons */
 
 
-#define WORKER_RDMA_CONN_STRLEN (MASTER_RDMA_CONN_STRLEN + 8 + 16 + 2)
+#define WORKER_RDMA_CONN_STRLEN (MASTER_RDMA_CONN_STRLEN + 8 + 16 + 16 + 3)  //+ rkey:vaddr:size
 
 #define MAX_CONN_STRLEN (WORKER_RDMA_CONN_STRLEN+4+1) //4: four-digital wid, 1: ':', 1: \0
 
@@ -50,7 +50,7 @@ struct RdmaConnection {          /* information of IB conn */
 };
 
 /*这个类包含了RDMA资源的成员变量和方法，用于管理RDMA资源*/
-class RdmaResource{
+class RdmaResource: public TransportResource {
         ibv_device *device;        /* 指向RDMA设备的指针 */
         ibv_context *context;      /*RDMA设备的上下文*/
         ibv_comp_channel *channel;  /*完成事件通道*/
@@ -68,12 +68,17 @@ class RdmaResource{
         void* base; //the base addr for the local memory   /*本地内存的基地址*/
         size_t size;    //the size of the local memory  /*本地内存的大小*/
         struct ibv_mr *bmr;     //the memory region for the local memory  /*本地内存的内存区域*/
+        std::vector<struct ibv_mr*> mrs;  //the regions added to the local memory at runtime
 
         //node-wide communication buf used for receive request
         std::vector<struct ibv_mr*> comm_buf;   //the memory region for the comm buf /*通信缓冲区的内存区域，用于接收请求的通信缓冲区*/
         //size_t buf_size; buf_size = slots.size() * MAX_REQUEST_SIZE
         int slot_head; //current slot head     /*当前槽头*/
         int slot_inuse; //number of slots in use    /* 正在使用的槽的数量 */
+        int srq_depth;  //recv WRs the SRQ holds, the slots of all the connections together
+        int slot_promised;  //recv slots promised to the peers (their credit windows)
+        int slot_spare;  //posted slots promised to nobody, left by the peers gone
+        int expected_peers;  //the cluster size the credit windows are sized for
         /*
          * TODO: check whether head + tail is enough
          */
@@ -93,9 +98,12 @@ class RdmaResource{
         //int regHtableMemory(const void *htable, size_t size);
         
         inline ibv_cq* GetCompQueue() const {return cq;}    //获取完成队列
+        inline int PollCompletion(int n, ibv_wc* wc) {return ibv_poll_cq(cq, n, wc);} //轮询完成队列
         inline int GetChannelFd() const {return channel->fd;}   //获取完成事件通道的文件描述符
         bool GetCompEvent() const; //获取完成事件
         int RegLocalMemory(void *base, size_t sz);  //注册本地内存
+        ibv_mr* FindMR(const void* addr, size_t len);  //the local memory region containing [addr, addr+len)
+        uint32_t GetRegionKey(const void* addr);
 
         int RegCommSlot(int); //注册通信槽
         char* GetSlot(int s); //get the starting addr of the slot   //获取槽的起始地址
@@ -103,8 +111,16 @@ class RdmaResource{
         //int ClearRecv(int low, int high);
         inline void ClearSlot(int s) {slots.at(s) = false;} //清除槽状态
         
+        int InitialWindow(bool isForMaster) {return CREDIT_WINDOW_MIN;}
+        int RecvWindow(bool isForMaster);
+        int Reserve(int n);
+        void Release(int n);
+        inline void SetExpectedPeers(int n) {expected_peers = n;}
+
         RdmaContext* NewRdmaContext(bool isForMaster); //创建新的RdmaContext
         void DeleteRdmaContext(RdmaContext* ctx); //删除RdmaContext
+        TransportContext* NewContext(bool isForMaster);
+        void DeleteContext(TransportContext* ctx);
         inline int GetCounter() {return rdma_context_counter;} //获取RdmaContext计数器
 
 };
@@ -120,8 +136,14 @@ struct RdmaRequest {
 	uint64_t oldval;
 	uint64_t newval;
 };
+/*a region registered by the peer after the connection*/
+struct RdmaRegion {
+	uint64_t addr;  //remote vaddr
+	size_t size;
+	uint32_t rkey;
+};
 /*这个类包含了RDMA上下文的成员变量和方法，用于管理RDMA操作*/
-class RdmaContext{
+class RdmaContext: public TransportContext {
 private:
 	ibv_qp *qp; //队列对    
 	ibv_mr* send_buf; //send buf //发送缓冲区
@@ -131,6 +153,9 @@ private:
 
 	uint64_t vaddr = 0; /* for remote rdma read/write */ //远程RDMA读写的地址
 	uint32_t rkey = 0; //远程密钥
+	uint64_t size = 0; //size of the remote region covered by rkey (0 if unknown: all the addrs)
+	std::vector<RdmaRegion> regions; //the remote regions added at runtime
+	bool RemoteKey(uint64_t addr, size_t len, uint32_t& key); //the rkey covering [addr, addr+len)
 
 	RdmaResource *resource; //指向RdmaResource资源的指针
 	bool isForMaster;   //是否用于Master节点
@@ -167,14 +192,17 @@ public:
 		return qp->qp_num;
 	}
 	inline void* GetBase() {return (void*)vaddr;}   //获取基地址
+	int AddRemoteRegion(uint64_t off, size_t size, uint32_t rkey);
 
 	unsigned int SendComp(ibv_wc& wc);  //处理发送完成事件
 	unsigned int WriteComp(ibv_wc& wc); //处理写完成事件
 	char* RecvComp(ibv_wc& wc); //处理接收完成事件
     char* GetFreeSlot();    //获取空闲槽
     bool IsRegistered(const void* addr);    //判断地址是否已注册
+	inline bool IsFull() {return pending_msg >= max_pending_msg;}   //发送队列是否已满
 
 	ssize_t Send(const void* ptr, size_t len, unsigned int id = 0, bool signaled = false);  //发送消息数据
+	ssize_t SendWithImm(const void* ptr, size_t len, uint32_t imm, unsigned int id = 0, bool signaled = false);  //发送消息数据并携带立即数
 	inline int PostRecv(int n) {    //发布接收请求
 		return resource->PostRecv(n);
 	}
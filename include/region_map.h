@@ -0,0 +1,133 @@
+// Copyright (c) 2018 The GAM Authors
+/*文件定义了地址间接层：全局地址所在的区域(region)当前由哪个工作节点持有，用于工作节点的动态加入/退出和在线的数据迁移*/
+
+#ifndef INCLUDE_REGION_MAP_H_
+#define INCLUDE_REGION_MAP_H_
+
+#include <pthread.h>
+#include <atomic>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "structure.h"
+
+/*
+ * a region is a REGION_SIZE slice of the address space of a worker, named by
+ * the high bits of its GAddrs ([wid][offset >> REGION_SHIFT]); it is the unit
+ * an object address is routed and migrated by
+ */
+#define REGION_SHIFT 24  //16MB
+#define REGION_SIZE (1L << REGION_SHIFT)
+#define REGION_OF(gaddr) ((uint64_t)(gaddr) >> REGION_SHIFT)
+#define REGION_BASE(region) ((GAddr)(region) << REGION_SHIFT)
+
+/*
+ * the owner of each region, as known by a worker
+ *
+ * a region is owned by the worker of its GAddrs until it is moved (see
+ * Worker::FarmMigrateNext); every move bumps the sequence number of the
+ * region, and an owner only replaces the one of an older sequence, so that
+ * the moves told by Master, by the source of a move and by a stale owner
+ * (a MOVED reply) can come in any order.
+ *
+ * the objects of a region moved to this worker are put in slab chunks of
+ * their own, looked up by their offsets in the region, and go back to the
+ * slab when freed here. The home worker frees the chunks of a region once it
+ * is moved away, and gives them out again under the next reuse epoch of
+ * their memory (see EPOCH_SHIFT), so that the old addresses still route to
+ * the new owner. A region is frozen (no new locks) while it is being moved.
+ *
+ * thread-safe: routed in the app threads as well. The map is empty until the
+ * first move, and then nothing is looked up.
+ */
+class RegionMap {
+ public:
+  struct Region {
+    int owner = 0;
+    uint32_t seq = 0;  //moves of the region, 0 if never moved
+    bool frozen = false;
+    bool held = false;  //moved here
+    std::map<uint32_t, uint32_t> objects;  //of a region moved here: offset -> allocated size
+    std::map<uint32_t, char*> chunks;  //offset -> the chunk of the object
+  };
+
+ private:
+  pthread_rwlock_t lock_;
+  std::atomic<size_t> count_;  //of regions_, so that an empty map is not locked
+  std::atomic<int> guards_;  //app threads in a Guard
+  std::atomic<bool> holding_;  //a move waits for the guards to leave (see TryHold)
+  std::unordered_map<uint64_t, Region> regions_;
+  std::unordered_set<char*> chunks_;  //of the regions moved here
+  alignas(64) char hole_[64];  //zeros: what is at an offset of a region moved here with no object
+
+  inline const Region* Find(GAddr a) const {
+    auto it = regions_.find(REGION_OF(a));
+    return it == regions_.end() ? nullptr : &it->second;
+  }
+  void Prune(uint64_t region);  //drop the entry of a region never moved and no longer frozen
+  /*
+   * no app thread is in a Guard; otherwise new ones are held off, and the
+   * worker retries on its next loop tick instead of waiting for them
+   */
+  bool TryHold();
+  inline void Release() {holding_.store(false);}
+
+ public:
+  RegionMap();
+  ~RegionMap();
+
+  /*
+   * hold off the moves in an app thread: a commit always takes it, so that no
+   * region is frozen between its lock checks and its locks; a read only once
+   * something has been moved, so that the block it reads is not freed.
+   * A move waiting for the guards blocks new ones, so that it is not starved
+   * by the commits of many threads.
+   */
+  class Guard {
+    RegionMap* m_;
+   public:
+    explicit Guard(RegionMap& m, bool always = true):
+      m_(always || !m.Empty() ? &m : nullptr) {
+      if (m_) m_->Enter();
+    }
+    ~Guard() {if (m_) m_->guards_.fetch_sub(1);}
+  };
+  void Enter();
+
+  inline bool Empty() const {return count_.load(std::memory_order_acquire) == 0;}
+
+  int Owner(GAddr a);
+  uint32_t Seq(uint64_t region);
+  bool Moved(GAddr a);  //the objects of the region are no longer at their home offsets
+  bool Frozen(GAddr a);
+  /*owned by wid and not frozen: an object of it can be locked there*/
+  bool Writable(GAddr a, int wid);
+  /*the local address of an object owned here: in its chunk if its region is moved here, or at base*/
+  char* Translate(GAddr a, void* base);
+  /*allocated size of an object of a region moved here, -1 if the region is not here*/
+  long AllocSize(GAddr a);
+  bool IsChunk(void* p);  //p is the chunk of an object of a region moved here
+  /*the object at a of a region moved here is freed: return its chunk (to be freed), nullptr if none*/
+  char* Free(GAddr a);
+
+  /*the owner of region from Master or a MOVED reply, ignored if older than the one known*/
+  bool SetOwner(uint64_t region, int wid, uint32_t seq);
+  /*false if an app thread is in a Guard: retry on the next loop tick*/
+  bool Freeze(uint64_t region);
+  void Unfreeze(uint64_t region);
+  /*a region moved here: owned by wid (this worker) and frozen until the source is done with it*/
+  void Install(uint64_t region, int wid, uint32_t seq, std::map<uint32_t, uint32_t>& objects,
+      std::map<uint32_t, char*>& chunks);
+  /*
+   * the region moved to wid; its chunks are no longer looked up, and are
+   * freed by the caller. false if an app thread is in a Guard, as Freeze
+   */
+  bool MoveOut(uint64_t region, int wid);
+  /*a copy of the region, false if not known*/
+  bool Get(uint64_t region, Region& out);
+  /*the regions moved here*/
+  void GetHeld(std::vector<uint64_t>& out);
+};
+
+#endif /* INCLUDE_REGION_MAP_H_ */
@@ -8,6 +8,7 @@
 #include "client.h"
 #include "settings.h"
 #include "rdma.h"
+#include "transport.h"
 #include "workrequest.h"
 #include "structure.h"
 #include "ae.h"
@@ -21,8 +22,9 @@ class Server{
   private:
     unordered_map<uint32_t, Client*> qpCliMap; /* rdma clients */ //map from qpn to region存储RDMA客户端的映射  /*从qpn到区域的映射*/   
     unordered_map<int, Client*> widCliMap; //map from worker id to region //从worker id到区域的映射   从worker ID到客户端的映射
+    size_t widmap_clients = 0; //size of qpCliMap when widCliMap was last updated
     //unordered_map<int, std::string> workerRdmaParams; //worker RDMA参数映射  存储worker的RDMA参数映射  //从worker ID到RDMA参数的映射
-    RdmaResource* resource; //RDMA资源 指向RDMA资源的指针
+    TransportResource* resource; //传输资源(RDMA或共享内存)
     aeEventLoop* el;  //event loop 事件循环
     int sockfd; //socket fd  socket文件描述符
     const Conf* conf; //配置指针  指向配置的指针  
@@ -46,7 +48,10 @@ class Server{
 
     Client* FindClient(uint32_t qpn); //查找客户端  根据QP号查找客户端
     void UpdateWidMap();  //更新WidMap 更新worker ID的映射
-    Client* FindClientWid(int wid); //查找客户端  根据worker ID查找客户端
+    Client* FindClientWid(int wid, bool connect = true); //查找客户端  根据worker ID查找客户端，connect: 没有连接时按需建立
+    virtual Client* ConnectWorker(int wid) {return nullptr;} //开始建立到工作节点wid的连接(见Client::ExchConnParamAsync)
+    virtual int PostConnectWorker(Client*) {return 0;} //与另一个工作节点交换完连接参数之后
+    inline aeEventLoop* GetEventLoop() {return el;}
 
     void ProcessRdmaRequest();  //处理RDMA请求
     virtual int PostAcceptWorker(int, void*) {return 0;}  //接受工作者连接的虚函数
@@ -54,6 +59,7 @@ class Server{
     virtual void ProcessRequest(Client* client, WorkRequest* wr) = 0; //处理请求的纯虚函数
     virtual void FarmProcessRemoteRequest(Client* client, const char* msg, uint32_t size) = 0;  //处理远程请求的纯虚函数
     virtual void FarmResumeTxn(Client*) = 0;  //恢复事务的纯虚函数
+    virtual void FarmProcessRdmaRead(Client*, unsigned int id) = 0;  //处理单边读完成事件的纯虚函数
     virtual void ProcessRequest(Client* client, unsigned int id) {};  //处理请求的虚函数
     virtual void CompletionCheck(unsigned int id) {}; //完成检查的虚函数
 
@@ -22,7 +22,6 @@ using namespace std;
 //#define USE_BOOST_QUEUE
 //#define USE_BUF_ONLY
 
-//#define USE_HUGEPAGE
 
 #ifdef USE_PIPE_H_TO_W
 #define USE_LOCAL_TIME_EVENT
@@ -39,6 +38,34 @@ using namespace std;
 #define RDMA_CONTEXT_EXCEPTION 2
 #define SERVER_NOT_EXIST_EXCEPTION 3
 #define SERVER_ALREADY_EXIST_EXCEPTION 4
+#define SHM_RESOURCE_EXCEPTION 5
+#define TCP_RESOURCE_EXCEPTION 6
+#define TIER_EXCEPTION 7
+
+/*
+ * transport backends (Conf::transport)
+ */
+#define TRANSPORT_RDMA 0
+#define TRANSPORT_SHM 1 //in-process shared memory, all the workers live in the same address space
+#define TRANSPORT_TCP 2 //non-blocking tcp, for ethernet clusters and loopback runs
+
+//backing of the worker region (Conf::hugepage)
+#define HUGEPAGE_NONE 0 //4KB pages
+#define HUGEPAGE_THP 1 //transparent hugepages (madvise)
+#define HUGEPAGE_2M 2 //hugetlb pages, fall back to THP if none are reserved
+#define HUGEPAGE_1G 3 //hugetlb pages, fall back to 2MB
+#define HUGEPAGE_2M_SIZE (2 * 1024 * 1024L)
+#define HUGEPAGE_1G_SIZE (1024 * 1024 * 1024L)
+#define NUMA_MAX_NODES 64
+
+//placement of the allocations made without an address (Conf::alloc_policy, see placement.h)
+#define ALLOC_LOCAL 0 //here until the region is full, then the remote worker with the most free memory (the behavior before the policies)
+#define ALLOC_LOCAL_FIRST 1 //here while the free memory is above Conf::cache_th of the region, then by two choices among the others
+#define ALLOC_TWO_CHOICES 2 //the better of two random workers (this one included) by free memory and queued requests
+
+//how the mem stats of the workers are spread (Conf::stats_mode)
+#define STATS_MASTER 0 //sent to Master, which broadcasts the changed ones
+#define STATS_GOSSIP 1 //piggybacked on the FaRM msgs and gossiped to random peers, Master only sees the joins
 
 #define MIN_RESERVED_FDS 32
 #define EVENTLOOP_FDSET_INCR (MIN_RESERVED_FDS+96)
@@ -49,25 +76,42 @@ using namespace std;
 
 #define MAX_CQ_EVENTS 1024
 
-#define MAX_NUM_WORKER 20
 #define MAX_MASTER_PENDING_MSG 512
 #define MAX_UNSIGNALED_MSG 256
 
 #define MAX_WORKER_PENDING_MSG 512 
-#define MASTER_RDMA_SRQ_RX_DEPTH \
-    (MAX_MASTER_PENDING_MSG * MAX_NUM_WORKER)
-#define WORKER_RDMA_SRQ_RX_DEPTH \
-    (MAX_WORKER_PENDING_MSG * (MAX_NUM_WORKER-1) + MAX_MASTER_PENDING_MSG)
+/*
+ * the recv slots of a node are shared by all its connections, the SRQ takes
+ * as many as the device allows. A peer is given a credit window of them
+ * (see Client): MAX_RECV_SLOTS (or the SRQ depth if smaller) over the
+ * expected number of peers, between CREDIT_WINDOW_MIN and MAX_*_PENDING_MSG,
+ * and the windows are rebalanced as peers join, so that the pinned recv
+ * slots stay bounded whatever the cluster size. Only the SRQ depth limits
+ * the peers, to depth / CREDIT_WINDOW_MIN (see RdmaResource::RecvWindow)
+ */
+#define MAX_SRQ_RX_DEPTH (1 << 20)
+#define MAX_RECV_SLOTS 8192
+#define CREDIT_WINDOW_MIN 32
 
 #define MAX_REQUEST_SIZE 8192
 #define WORKER_BUFFER_SIZE (MAX_WORKER_PENDING_MSG * MAX_REQUEST_SIZE)
 #define MASTER_BUFFER_SIZE (MAX_MASTER_PENDING_MSG * MAX_REQUEST_SIZE)
 
 #define MAX_IPPORT_STRLEN 21 //192.168.154.154:12345
-#define MAX_WORKERS_STRLEN (MAX_NUM_WORKER*MAX_IPPORT_STRLEN+MAX_NUM_WORKER-1)  //192.168.154.154:12345,
 
 #define INIT_WORKQ_SIZE 2000
 
-#define MAX_MEM_STATS_SIZE  43 //8+16+16+3
+//mem stats are sent as fixed-width records of [int wid][Size total][Size free]
+#define MEM_STATS_RECORD_SIZE (sizeof(int) + 2 * sizeof(size_t))
+#define MAX_MEM_STATS_RECORDS ((MAX_REQUEST_SIZE - 64) / MEM_STATS_RECORD_SIZE)  //records per msg
+
+//gossiped stats are records of [int wid][uint64_t version][Size total][Size free][uint32_t load]
+#define GOSSIP_RECORD_SIZE (sizeof(int) + sizeof(uint64_t) + 2 * sizeof(size_t) + sizeof(uint32_t))
+#define MAX_GOSSIP_RECORDS ((MAX_REQUEST_SIZE - 64) / GOSSIP_RECORD_SIZE)  //records per GOSSIP msg
+#define GOSSIP_PIGGYBACK 2  //records carried by a FaRM batch: the sender's and one more
+
+//owners of the moved regions (see RegionMap) are records of [uint64_t region][int wid][uint32_t seq]
+#define REGION_RECORD_SIZE (sizeof(uint64_t) + sizeof(int) + sizeof(uint32_t))
+#define MAX_REGION_RECORDS ((MAX_REQUEST_SIZE - 64) / REGION_RECORD_SIZE)  //records per REGION_MAP msg
 
 #endif /* INCLUDE_SETTINGS_H_ */
@@ -0,0 +1,131 @@
+// Copyright (c) 2018 The GAM Authors
+/*文件定义了进程内共享内存传输后端，用于同一进程内的多个工作节点之间的通信(测试和单机部署)*/
+
+#ifndef INCLUDE_SHM_H_
+#define INCLUDE_SHM_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include "transport.h"
+#include "settings.h"
+#include "log.h"
+
+class ShmContext;
+
+/*
+ * in-process shared-memory transport
+ *
+ * scope: the workers and Master of one process only (tests and single-host
+ * deployments that run all the workers in one process); the contexts find
+ * their peers in a static registry, so that workers in separate processes
+ * on the same host cannot use it and have to use the tcp backend.
+ *
+ * all the endpoints live in the same address space, so that a send is a
+ * memcpy into a recv slot of the peer resource followed by a RECV completion
+ * pushed into the peer's completion queue. The completion queue is signaled
+ * through an eventfd registered to the event loop, the same way as the
+ * comp channel fd of RdmaResource.
+ *
+ * the conn strings keep the RDMA format ("lid:qpn:psn[:rkey:vaddr]") with
+ * lid = psn = rkey = 0, so that the tcp exchange is untouched.
+ */
+class ShmResource: public TransportResource {
+  bool isForMaster;  //是否用于Master节点
+  int efd;  //eventfd used as the completion channel
+
+  void* base;  //the base addr for the local memory
+  size_t size;  //the size of the local memory
+
+  std::mutex lock_;  //protect cq and slots (accessed by the peers' threads)
+  std::deque<ibv_wc> cq;  //completion queue
+  RecvSlots slots;  //recv slots
+  int context_counter;
+
+  /*
+   * msgs that found no recv slot, delivered in order once slots are posted
+   * (what an RDMA sender does on RNR), instead of being dropped
+   */
+  struct Pending {
+    uint32_t qpn;
+    uint32_t imm;
+    std::string data;
+  };
+  std::deque<Pending> backlog;
+
+  void Notify();
+  bool Fill(uint32_t qpn, const void* src, size_t len, uint32_t imm);  //into a free slot, lock_ held
+
+ public:
+  ShmResource(bool isForMaster);
+  ~ShmResource();
+  inline bool IsMaster() const {return isForMaster;}
+  inline int GetChannelFd() const {return efd;}
+  bool GetCompEvent() const;
+  int PollCompletion(int n, ibv_wc* wc);
+  int RegLocalMemory(void *base, size_t sz);
+  inline void* GetBase() {return base;}
+  int PostRecv(int n);
+  char* GetSlot(int s);
+  void ClearSlot(int s);
+
+  /*
+   * called by the sending peer (in its own thread)
+   * copy the msg into a free recv slot and signal a RECV completion for context qpn;
+   * queued in the backlog if there is no free slot
+   */
+  int Deliver(uint32_t qpn, const void* src, size_t len, uint32_t imm);
+  void PushCompletion(const ibv_wc& wc);
+
+  TransportContext* NewContext(bool isForMaster);
+  void DeleteContext(TransportContext* ctx);
+  inline int GetCounter() {return context_counter;}
+};
+
+class ShmContext: public TransportContext {
+  ShmResource* resource;
+  bool isForMaster;
+  uint32_t qpn;  //unique id among all the shm contexts of the process
+  ShmContext* peer = nullptr;  //the remote endpoint
+
+  SendRing ring;  //send slots and selective signaling
+
+  uint64_t vaddr = 0;  //base addr of the remote memory
+  char* msg = nullptr;  //conn string
+  std::deque<std::pair<std::string, uint32_t>> unsent;  //msgs sent before the peer is known, with their imm
+
+  static std::mutex registry_lock;
+  static std::unordered_map<uint32_t, ShmContext*> registry;  //qpn -> context
+  static uint32_t qpn_counter;
+
+  void Complete(unsigned int id, bool signaled, bool slot, ibv_wc_opcode op = IBV_WC_SEND);  //signal the finished op if needed
+
+ public:
+  ShmContext(ShmResource* res, bool isForMaster);
+  ~ShmContext();
+  inline bool IsMaster() {return isForMaster;}
+  const char* GetRdmaConnString();
+  int SetRemoteConnParam(const char *remConn);
+  inline uint32_t GetQP() {return qpn;}
+  inline void* GetBase() {return (void*)vaddr;}
+
+  inline unsigned int SendComp(ibv_wc& wc) {return ring.SendComp(wc);}
+  inline unsigned int WriteComp(ibv_wc& wc) {return ring.SendComp(wc);}
+  char* RecvComp(ibv_wc& wc);
+  inline char* GetFreeSlot() {return ring.GetFreeSlot();}
+  inline bool IsRegistered(const void* addr) {return ring.IsRegistered(addr);}
+  inline bool IsFull() {return ring.IsFull();}
+
+  inline ssize_t Send(const void* ptr, size_t len, unsigned int id = 0, bool signaled = false) {
+    return SendWithImm(ptr, len, 0, id, signaled);
+  }
+  ssize_t SendWithImm(const void* ptr, size_t len, uint32_t imm, unsigned int id = 0, bool signaled = false);
+  inline int PostRecv(int n) {return resource->PostRecv(n);}
+  ssize_t Write(raddr dest, raddr src, size_t len, unsigned int id = 0, bool signaled = false);
+  ssize_t WriteWithImm(raddr dest, raddr src, size_t len, uint32_t imm, unsigned int id = 0, bool signaled = false);
+  ssize_t Read(raddr dest, raddr src, size_t len, unsigned int id = 0, bool signaled = false);
+};
+
+#endif /* INCLUDE_SHM_H_ */
@@ -4,14 +4,17 @@
 //文件定义了一个用于内存分配的SlabAllocator类及其相关数据结构和方法
 //这些头文件提供了互斥锁、无序映射、标准整数类型和项目中其他模块的功能
 #include <mutex>
+#include <atomic>
+#include <vector>
+#include <map>
 #include <unordered_map>
 #include <cstdint>
 #include "log.h"
 #include "settings.h"
-#include "hashtable.h"
 #include "lockwrapper.h"
 
 #define ITEM_SIZE_MAX (1024*1024) //定义了项目的最大大小
+#define SLAB_PAGE_SHIFT 20  //log2(ITEM_SIZE_MAX), slab pages are ITEM_SIZE_MAX each
 
 /* Slab sizing definitions. */
 #define POWER_SMALLEST 1  //最小幂次  定义了最小的slab类
@@ -21,9 +24,36 @@
 #define STAT_KEY_LEN 128  //统计键长度  定义了统计键的长度
 #define STAT_VAL_LEN 128  //统计值长度  定义了统计值的长度
 
-#define ITEM_SLABBED 4  //定义了项目被分配的标志
-#define ITEM_LINKED 1 //定义了项目被链接的标志
-#define ITEM_CAS 2  //定义了项目的CAS标志
+/*
+ * per-thread magazines: each thread caches up to SLAB_MAGAZINE_SIZE free chunks
+ * per slab class, and refills from/spills to the central freelist by half a
+ * magazine, so that sb_malloc/sb_free only take the lock once every so many calls.
+ * Chunks larger than SLAB_MAGAZINE_MAX_CHUNK are not cached (too much memory to hoard).
+ */
+#define SLAB_MAGAZINE_SIZE 32
+#define SLAB_MAGAZINE_MAX_CHUNK (64*1024)
+
+/*
+ * slab mover: pages whose chunks are all free are taken from the classes
+ * with the most spare chunks (keeping SLAB_REBALANCE_KEEP_PAGES pages worth
+ * of free chunks in every class) and given back to the page pool, from which
+ * the starving classes (and large objects) get new pages.
+ * The mover only runs in the background, to keep SLAB_REBALANCE_RESERVE pages
+ * in the pool; a class that finds the pool empty grows the region if allowed,
+ * or fails and is given a page by the next pass.
+ */
+#define SLAB_REBALANCE_RESERVE 4
+#define SLAB_REBALANCE_KEEP_PAGES 1
+
+/*
+ * a free chunk is linked into its freelist through the last two words of the chunk,
+ * so that the object header at the beginning (e.g., the version read by
+ * one-sided reads) is still zero after the chunk is freed.
+ * The list is doubly linked, so that the slab mover unlinks the chunks
+ * of a page without walking the freelist.
+ */
+#define SLAB_LINK(ptr, size) (*(void**)((char*)(ptr) + (size) - sizeof(void*)))
+#define SLAB_PREV(ptr, size) (*(void**)((char*)(ptr) + (size) - 2 * sizeof(void*)))
 //这些宏定义了用于内存分配和日志记录的宏
 #define MEMCACHED_SLABS_ALLOCATE(arg0, arg1, arg2, arg3)  //定义了内存分配的宏
 #define MEMCACHED_SLABS_ALLOCATE_ENABLED() (0)  //定义了内存分配是否启用的宏
@@ -37,15 +67,11 @@
 #define MEMCACHED_SLABS_SLABCLASS_ALLOCATE_FAILED_ENABLED() (0) //定义了slab类分配失败是否启用的宏
 
 #define dbprintf(fmt, ...) _epicLog ((char*)__FILE__, (char*)__func__, __LINE__, LOG_DEBUG, fmt, ## __VA_ARGS__)
-//#define ITEM_key(item) (((char*)&((item)->data)) \
-//         + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0))
-#define ITEM_key(item) ((item)->data)
-
 typedef struct {
   unsigned int size; /* sizes of items */ //项目的大小
   unsigned int perslab; /* how many items per slab */ //每个slab中有多少项目
 
-  void *slots; /* list of item ptrs */  //项目指针列表  指向项目指针的列表
+  void *slots; /* list of free chunks (linked by SLAB_LINK and SLAB_PREV) */  //空闲块链表
   unsigned int sl_curr; /* total free items in list */  //列表中的空闲项目总数
 
   unsigned int slabs; /* how many slabs were allocated for this class */  //为这个类分配了多少个slab
@@ -54,6 +80,8 @@ typedef struct {
   unsigned int list_size; /* size of prev array */  //前一个数组的大小
 
   unsigned int killing; /* index+1 of dying slab, or zero if none */  //死亡slab的索引+1，如果没有则为零
+  unsigned int starved; /* times a new page was not available since the last rebalance */
+  unsigned int moved; /* pages moved away by the slab mover */
 #ifdef FINE_SLAB_LOCK
   atomic<size_t> requested; /* The number of requested bytes */
   mutex lock_;  //互斥锁，用于保护slab分配器的访问
@@ -68,17 +96,19 @@ typedef struct {
 #endif
 } slabclass_t;
 
-/**
- * Structure for storing items within memcached.
- */
-typedef struct _stritem {
-  struct _stritem *next;  //下一个项目  指向下一个项目的指针
-  struct _stritem *prev;  //前一个项目  指向前一个项目的指针
-  int size; //项目大小  项目的大小
-  uint8_t it_flags; /* ITEM_* above */  //项目标志  项目标志
-  uint8_t slabs_clsid;/* which slab class we're in */ //我们所在的slab类
-  void* data; //项目数据  项目数据
-} item;
+class SlabAllocator;
+
+typedef struct {
+  unsigned int n;  //number of cached chunks
+  void* chunks[SLAB_MAGAZINE_SIZE];
+} slab_magazine_t;
+
+/*the magazines of one thread for one allocator*/
+struct SlabThreadCache {
+  std::atomic<SlabAllocator*> owner;  //nullptr once the allocator is destroyed
+  slab_magazine_t* mags;  //one for each slab class
+  std::atomic<long> allocated;  //bytes allocated - freed through the magazines, only written by the thread
+};
 
 /*SlabAllocator类是一个内存分配器，专门用于高效地管理和分配内存块。它采用了slab分配算法，这种算法
 常用于操作系统和高性能应用中，以减少内存碎片并提高内存分配和释放的效率。
@@ -92,6 +122,21 @@ class SlabAllocator {
   int power_largest;  //最大幂次  最大幂次  （GPT：最大的slab类）最大的slab类索引
 
   char *mem_base = NULL;  //基地址  内存基地址
+  void* map_base = nullptr;  //the mapping returned by mmap (before the alignment)
+  size_t map_size = 0;
+  int backing = HUGEPAGE_NONE;  //the pages actually backing the region
+
+  /*
+   * runtime growth: the address space up to mem_max is reserved by mmap_malloc
+   * (without any memory behind it), and backed part by part when the region runs
+   * out of pages, so that mem_base and the offsets to it never change.
+   */
+  size_t mem_max = 0;  //mem_limit can grow up to it
+  size_t grow_step = 0;  //bytes added at least at a time
+  char* map_end = nullptr;  //end of the backed part of the reservation
+  int map_hugepage = HUGEPAGE_NONE;  //the backing asked for, kept for the growth
+  int map_numa_node = -1;
+  std::vector<std::pair<char*, size_t>> regions;  //the initial region and the grown parts, in order
 #ifdef FINE_SLAB_LOCK
   atomic<char *> mem_current;  // = NULL; //当前内存  当前内存地址
   atomic<size_t> mem_avail; // = 0; //可用内存  可用内存大小
@@ -104,19 +149,6 @@ class SlabAllocator {
 
   int SB_PREFIX_SIZE = 0;  //sizeof(item);  //项目前缀大小  项目前缀大小
 
-#ifdef FINE_SLAB_LOCK
-  HashTable<void*, item*> stats_map;  //统计映射，
-#else
-  unordered_map<void*, item*> stats_map;  //统计映射，用于记录内存分配的统计信息
-#endif
-
-#ifdef DHT
-	/*
-	 * FIXME: not support free for now
-	 */
-	unordered_map<void*, size_t> bigblock_map;    //大块映射，用于记录大块内存的分配情况
-#endif
-
   //TODO: no init func
   int chunk_size = 48;  //块大小  块大小
   int item_size_max = ITEM_SIZE_MAX;  //项目最大大小  项目最大大小
@@ -127,6 +159,85 @@ class SlabAllocator {
   LockWrapper lock_;  //互斥锁，用于保护slab分配器的访问
 #endif
 
+  /*
+   * page descriptors, indexed by (ptr - mem_base) >> SLAB_PAGE_SHIFT, as slab pages
+   * are item_size_max each and carved from mem_base in order.
+   * The only per-chunk metadata is the requested size (0 if free) and a reference
+   * bit, so that a chunk is found with two array lookups and without the lock.
+   */
+  typedef struct {
+    unsigned int id;  //slab class of the page (0 if not a slab page)
+    uint32_t nfree;  //chunks of the page in the freelist of the class
+    uint32_t* sizes;  //requested size of each chunk
+    uint64_t* refs;  //bitmap of the chunks touched since the last pass of scan_cold
+    size_t large;  //requested size of the large object starting at the page (0 if none)
+    uint8_t ref;  //the large object touched since the last pass of scan_cold
+  } slab_page_t;
+  slab_page_t* pages = nullptr;
+  size_t npages = 0;
+  size_t clock_hand = 0;  //next page of scan_cold
+  unsigned int clock_chunk = 0;  //next chunk of scan_cold in that page
+
+  std::vector<SlabThreadCache*> caches;  //thread caches of this allocator, protected by lock_
+
+  inline slab_page_t& page_of(void* ptr) {
+    return pages[((char*)ptr - mem_base) >> SLAB_PAGE_SHIFT];
+  }
+  inline slab_page_t& chunk_page(void* ptr) {
+    slab_page_t& pg = pages[((char*)ptr - mem_base) >> SLAB_PAGE_SHIFT];
+    epicAssert(pg.sizes);
+    return pg;
+  }
+  inline uint32_t& chunk_req_size(void* ptr) {  //requested size of the chunk
+    slab_page_t& pg = chunk_page(ptr);
+    return pg.sizes[(((char*)ptr - mem_base) & (item_size_max - 1)) / slabclass[pg.id].size];
+  }
+  //the freelist of a class, with the lock held
+  inline void freelist_push(slabclass_t* p, void* ptr) {
+    SLAB_LINK(ptr, p->size) = p->slots;
+    SLAB_PREV(ptr, p->size) = 0;
+    if (p->slots) SLAB_PREV(p->slots, p->size) = ptr;
+    p->slots = ptr;
+    p->sl_curr++;
+    page_of(ptr).nfree++;
+  }
+  inline void freelist_unlink(slabclass_t* p, void* ptr) {
+    void* next = SLAB_LINK(ptr, p->size);
+    void* prev = SLAB_PREV(ptr, p->size);
+    if (next) SLAB_PREV(next, p->size) = prev;
+    if (prev) SLAB_LINK(prev, p->size) = next;
+    else p->slots = next;
+    SLAB_LINK(ptr, p->size) = 0;
+    SLAB_PREV(ptr, p->size) = 0;
+    p->sl_curr--;
+    page_of(ptr).nfree--;
+  }
+  SlabThreadCache* get_cache();
+  void cache_refill(SlabThreadCache* c, unsigned int id);  //move half a magazine from the freelist
+  void cache_spill(SlabThreadCache* c, unsigned int id, unsigned int n);  //move n chunks back to the freelist
+  void* cache_alloc(size_t size, unsigned int id);
+  void cache_free(void* ptr, unsigned int id);
+
+  /*
+   * large objects (> item_size_max) take extents of whole pages.
+   * Free extents are kept by address (to coalesce the neighbours) and by
+   * length (for best fit); slab pages are taken from them as well, and an
+   * extent freed at the end of the carved area goes back to mem_current.
+   */
+  std::map<char*, size_t> free_extents;  //start -> pages
+  std::multimap<size_t, char*> free_extents_by_len;  //pages -> start
+  size_t large_objects = 0;  //number of large objects
+  size_t large_pages = 0;  //pages taken by the large objects
+  char* page_alloc(size_t n);  //n contiguous pages
+  void page_free(char* ptr, size_t n);
+  void add_extent(char* start, size_t n);
+  void del_extent(std::map<char*, size_t>::iterator it);
+  void* large_alloc(size_t size);
+  size_t large_free(void* ptr);
+
+  size_t slabs_reclaim(size_t want);  //move up to want free pages to the pool
+  size_t slabs_evacuate(unsigned int id, size_t max);  //release up to max fully free pages of class id
+
   /**
    * Access to the slab allocator is protected by this lock
    */
@@ -136,11 +247,14 @@ class SlabAllocator {
   void do_slabs_free(void *ptr, const size_t size, unsigned int id);  //释放内存  释放slab
   void* do_slabs_alloc(const size_t size, unsigned int id); //分配内存  分配slab
   int do_slabs_newslab(const unsigned int id);  //创建新的slab  创建新的slab
+  char* newslab_page(unsigned int id);  //a new page for class id, from the pool or by growing the region
   void split_slab_page_into_freelist(char *ptr, const unsigned int id); //将slab页面分割为空闲列表  将slab页面分割为空闲列表
   int grow_slab_list(const unsigned int id);  //增加slab列表  增加slab列表
   void* memory_allocate(size_t size); //分配内存  分配内存
   void slabs_preallocate(const unsigned int maxslabs);    //预分配slab  预分配slab
-  void* mmap_malloc(size_t size); //分配内存  使用mmap分配内存
+  void* mmap_malloc(size_t size, size_t reserve, int hugepage = HUGEPAGE_NONE, int numa_node = -1); //分配内存  使用mmap分配内存(可选大页和NUMA绑定)
+  int mmap_range(char* start, size_t size);  //back a part of the reservation, return the backing or -1
+  bool slabs_grow(size_t size);  //grow the region by at least size bytes
   void mmap_free(void* ptr);  //释放内存  使用mmap释放内存
 
   /** Allocate object of given length. 0 on error *//*@null@*/
@@ -178,19 +292,90 @@ class SlabAllocator {
    size equal to the previous slab's chunk size times this factor.
    3rd argument specifies if the slab allocator should allocate all memory
    up front (if true), or allocate memory in chunks as it is needed (if false)
+   4th argument is the backing of the preallocated memory (one of HUGEPAGE_*),
+   and the 5th one is the NUMA node to bind it to (-1 for no binding).
+   The region grows by step bytes (at least) up to max_limit when it runs out
+   of pages (0 for no growth).
    */
   void* slabs_init(const size_t limit, const double factor,
-                   const bool prealloc);  //初始化slab  初始化slab分配器
+                   const bool prealloc, int hugepage = HUGEPAGE_NONE, int numa_node = -1,
+                   size_t max_limit = 0, size_t step = 0);  //初始化slab  初始化slab分配器
   size_t get_avail(); //获取可用内存  获取可用内存
+  inline size_t get_limit() {return mem_limit;}  //the current size of the region
+  inline size_t get_max_limit() {return mem_max;}
+  std::vector<std::pair<char*, size_t>> get_regions();  //the parts of the region (to be registered to the transport)
+  inline int get_backing() {return backing;}  //one of HUGEPAGE_*
 
   void *sb_calloc(size_t count, size_t size); //分配内存  分配内存并初始化为0 分配并清零内存
   void *sb_malloc(size_t size); //分配内存  分配内存
+  int sb_malloc_many(size_t size, int n, void** out);  //n objects in one pass, return the number allocated
   void* sb_aligned_malloc(size_t size, size_t block = BLOCK_SIZE);  //分配内存  分配对齐内存
   void* sb_aligned_calloc(size_t count, size_t size, size_t block = BLOCK_SIZE);  //分配内存  分配对齐内存并初始化为0
   void *sb_realloc(void * ptr, size_t size);  //重新分配内存  重新分配内存
   size_t sb_free(void * ptr);   //释放内存  释放内存
   bool is_free(void* ptr);  //检查是否释放  检查内存是否已释放
   size_t get_size(void* ptr); //获取内存大小  获取内存大小
+  size_t get_chunk_size(void* ptr);  //size of the chunk (the slab class size, or the large object size)
+  void release_cache(SlabThreadCache* c);  //spill all the chunks of a thread cache (at thread exit)
+  size_t get_metadata();  //bytes used by the allocator metadata
+
+  /*stats of the large-object tier, in pages of item_size_max*/
+  struct ExtentStats {
+    size_t objects;  //allocated large objects
+    size_t used_pages;  //pages taken by them
+    size_t free_extents;  //number of free extents
+    size_t free_pages;  //pages in the free extents
+    size_t largest_free;  //pages in the largest free extent
+    size_t unused_pages;  //pages never carved from the region
+  };
+  ExtentStats get_extent_stats();
+
+  /*occupancy of a slab class*/
+  struct SlabClassStats {
+    unsigned int id;
+    unsigned int size;  //chunk size
+    unsigned int pages;
+    size_t used;  //allocated chunks
+    size_t free;  //chunks in the freelist
+    size_t cached;  //free chunks in the thread caches
+    unsigned int starved;  //times the class found no free page since the last rebalance
+    unsigned int moved;  //pages moved away from the class
+  };
+  std::vector<SlabClassStats> get_class_stats();  //the classes with pages
+
+  /*
+   * access recency for the second tier (see Worker::FarmTierDemote):
+   * touch sets the reference bit of the object at ptr (an allocated chunk or
+   * large object), and scan_cold is a CLOCK pass over the objects page by page,
+   * giving the touched ones a second chance and putting the others (of at least
+   * min_size bytes) in out, until it holds max of them.
+   * Return the number of pages passed.
+   */
+  inline void touch(void* ptr) {
+    slab_page_t& pg = page_of(ptr);
+    if (!pg.sizes) {
+      if (!__atomic_load_n(&pg.ref, __ATOMIC_RELAXED))
+        __atomic_store_n(&pg.ref, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    size_t j = (((char*)ptr - mem_base) & (item_size_max - 1)) / slabclass[pg.id].size;
+    uint64_t bit = 1UL << (j % 64);
+    if (!(__atomic_load_n(&pg.refs[j / 64], __ATOMIC_RELAXED) & bit))
+      __atomic_fetch_or(&pg.refs[j / 64], bit, __ATOMIC_RELAXED);
+  }
+  size_t scan_cold(size_t min_size, size_t max, std::vector<void*>& out);
+
+  /*
+   * the allocated chunks starting in [start, start + len) with their sizes (as
+   * get_chunk_size), e.g., the objects of a part of the region being moved
+   */
+  void scan_range(void* start, size_t len, std::vector<std::pair<void*, size_t>>& out);
+
+  /*
+   * the background slab mover, called periodically (see Worker::SlabRebalancer);
+   * return the number of pages moved
+   */
+  size_t slabs_rebalance();
 
   ~SlabAllocator();   //析构函数  销毁slab分配器
 
@@ -45,7 +45,15 @@ typedef uint64_t GAddr;	//定义GAddr为uint64_t类型
 #define BLOCK_ALIGNED(x) (!((x) & ~BLOCK_MASK))	//判断地址是否为块对齐
 #define BADD(addr, i) TOBLOCK((addr) + (i)*BLOCK_SIZE) //return an addr	//块地址加上偏移
 #define BMINUS(i, j) (((i)-(j))>>BLOCK_POWER)	//两个块地址相减
-#define TO_LOCAL(gaddr, base)  (void*)(OFF(gaddr) + (ptr_t)(base))	//将全局地址转换为本地地址
+/*
+ * the offset bits above EPOCH_SHIFT are the reuse epoch of the memory: the
+ * chunks of a region moved away are given out again under the next epoch,
+ * so that the old addresses keep routing to the new owner (see RegionMap)
+ */
+#define EPOCH_SHIFT 40  //at most 1TB of memory per worker
+#define LOCAL_OFF_MASK ((1L << EPOCH_SHIFT) - 1)
+#define MAX_EPOCH ((1L << (48 - EPOCH_SHIFT)) - 1)
+#define TO_LOCAL(gaddr, base)  (void*)(((gaddr) & LOCAL_OFF_MASK) + (ptr_t)(base))	//将全局地址转换为本地地址(去掉复用的epoch)
 #define Gnullptr 0	//全局空指针
 
 struct Conf {
@@ -58,9 +66,19 @@ struct Conf {
 	//std::string worker_bindaddr;	//工作节点绑定地址
 	std::string worker_ip = "localhost";	//工作节点IP地址
 	Size size = 1024*1024L*512; //per-server size of memory pre-allocated	//每个服务器预分配的内存大小
+	Size size_max = 0; //the region grows up to it when it runs out of memory, 0 for no growth	//内存区域可增长到的上限
+	Size size_step = 1024*1024L*128; //bytes added to the region at a time	//每次增长的大小
+	int region_sync_interval = 100; //ms, period to register and announce the grown regions	//注册并通告新增区域的周期（毫秒）
+	std::string tier_path = ""; //file of the second tier where cold objects are moved to, empty to disable	//二级存储文件(为空时不启用)
+	double tier_th = 0.9; //move cold objects out when the data kept in DRAM is above tier_th * size	//触发降级的DRAM占用比例
+	Size tier_min_size = 4096; //smaller objects are never moved out	//可降级的最小对象大小
+	int tier_interval = 100; //ms, period of the cold object scan	//冷对象扫描周期（毫秒）
 	Size ghost_th = 1024*1024;	//幽灵阈值
 	double cache_th = 0.15; //if free mem is below this threshold, we start to allocate memory from remote nodes	//缓存阈值，如果空闲内存低于此阈值，我们将开始从远程节点分配内存
 	int unsynced_th = 1;//未同步阈值	
+	int stats_interval = 10; //ms, min interval between two broadcasts of the changed mem stats	//内存统计广播的最小间隔（毫秒）
+	int stats_mode = STATS_MASTER; //how the mem stats are spread, one of STATS_*	//内存统计信息的传播方式
+	int gossip_interval = 50; //ms, period to gossip the known stats to a random worker (STATS_GOSSIP)	//gossip周期（毫秒）
 	double factor = 1.25;	//增长因子
 	int maxclients = 1024;	//最大客户端数
 	int no_thread = 1;	//实际线程数
@@ -69,6 +87,12 @@ struct Conf {
 	int loglevel = LOG_DEBUG;	//日志级别
 	std::string* logfile = nullptr;	//日志文件
 	int timeout = 10; //ms	//超时时间（毫秒）
+	int transport = TRANSPORT_RDMA; //transport backend, one of TRANSPORT_*	//传输后端
+	int slab_rebalance_interval = 1000; //ms, 0 to disable	//后台slab迁移的周期（毫秒）
+	int hugepage = HUGEPAGE_NONE; //backing of the worker region, one of HUGEPAGE_*	//工作节点内存区域的页面类型
+	int numa_node = -1; //NUMA node for the region and the worker thread, -1 for no binding	//绑定的NUMA节点
+	bool lazy_connect = false; //connect to another worker only when it is first used, instead of at the join	//按需建立工作节点之间的连接
+	int alloc_policy = ALLOC_LOCAL; //where the allocations without an address go, one of ALLOC_*	//无地址提示的分配放置策略
 };
 
 typedef int PostProcessFunc(int, void*);
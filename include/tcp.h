@@ -20,6 +20,8 @@
  */
 
 aeFileProc AcceptTcpClientHandle;
+aeFileProc ReadConnParamHandle;  //the accepted connection is readable
+aeFileProc ExchConnParamHandle;  //see Client::ExchConnParamAsync
 aeFileProc ProcessRdmaRequestHandle;
 
 #endif
@@ -0,0 +1,165 @@
+// Copyright (c) 2018 The GAM Authors
+/*文件定义了基于非阻塞TCP的传输后端，用于没有RDMA网卡的以太网集群和本机回环测试*/
+
+#ifndef INCLUDE_TCP_TRANSPORT_H_
+#define INCLUDE_TCP_TRANSPORT_H_
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include "transport.h"
+#include "settings.h"
+#include "ae.h"
+#include "log.h"
+
+class TcpContext;
+
+#define TCP_FRAME_HDR_SIZE 8  //uint32_t payload length and uint32_t imm, in network byte order
+#define TCP_RECV_BUF_SIZE (4 * (MAX_REQUEST_SIZE + TCP_FRAME_HDR_SIZE))
+#define TCP_MAX_BATCH 64  //max frames per sendmsg; a send flushes eagerly when reaching it
+
+/*
+ * message transport over non-blocking TCP
+ *
+ * every context owns two one-way streams: the one it connects to the peer's
+ * data port (send) and the one the peer connects to ours (recv), so that no
+ * tie-break is needed when both ends call SetRemoteConnParam.
+ * A msg is a frame of [len][imm][payload]. Sends are queued and flushed with sendmsg
+ * when the socket gets writable (or when TCP_MAX_BATCH frames are queued),
+ * so that all the msgs generated in one event-loop round go out together.
+ * A send slot is only given back (through the selectively signaled
+ * IBV_WC_SEND completion) after its frame is fully written, which keeps the
+ * same backpressure as the RDMA send queue.
+ *
+ * all the sockets are file events of the ae loop of the server (see
+ * SetEventLoop), and nothing blocks in it: the send stream is connected and
+ * the recv stream accepted as state machines driven by their events. The
+ * frames read are queued as completions, and an eventfd, the channel fd,
+ * tells the server to poll them. A stream that fails is closed, and the
+ * frames queued to it fail with IBV_WC_WR_FLUSH_ERR completions.
+ *
+ * conn strings keep the RDMA format ("lid:qpn:psn[:rkey:vaddr]"),
+ * with lid = data port, qpn = context id, psn = IPv4 addr, rkey = 0.
+ */
+class TcpResource: public TransportResource {
+  bool isForMaster;  //是否用于Master节点
+  aeEventLoop* el = nullptr;  //the loop of the server the sockets are watched by
+  int efd;  //eventfd signaled when completions are queued, used as the channel fd
+  int lfd;  //listening socket for the data streams
+  int port;  //data port
+  uint32_t ip;  //IPv4 addr of the data port (network byte order)
+
+  void* base;  //the base addr for the local memory
+  size_t size;  //the size of the local memory
+
+  std::deque<ibv_wc> cq;  //completion queue
+  RecvSlots slots;  //recv slots
+  std::unordered_map<uint32_t, TcpContext*> contexts;  //id -> context
+  uint32_t id_counter;
+  int context_counter;
+
+  /*an accepted stream, until it tells which context it is for*/
+  struct Hello {
+    uint32_t target;
+    size_t got = 0;
+  };
+  std::unordered_map<int, Hello> accepting;  //fd -> the hello read so far
+
+  void Notify();
+
+ public:
+  TcpResource(bool isForMaster, const std::string& ip);
+  ~TcpResource();
+  inline bool IsMaster() const {return isForMaster;}
+  inline int GetChannelFd() const {return efd;}
+  void SetEventLoop(aeEventLoop* el);
+  bool GetCompEvent() const;
+  int PollCompletion(int n, ibv_wc* wc);
+  int RegLocalMemory(void *base, size_t sz);
+  inline void* GetBase() {return base;}
+  inline int GetPort() {return port;}
+  inline uint32_t GetIP() {return ip;}
+  int PostRecv(int n);
+  inline char* GetSlot(int s) {return slots.Addr(s);}
+  inline void ClearSlot(int s) {slots.Clear(s);}
+  int Receive(uint32_t qpn, const char* src, size_t len, uint32_t imm);  //copy a received frame into a recv slot
+  void PushCompletion(const ibv_wc& wc);
+  int Watch(int fd, int mask, aeFileProc* proc, void* data);  //add an event of fd to the loop
+  void Unwatch(int fd, int mask);
+  void Accept();  //the listening socket is readable
+  void ReadHello(int fd);  //an accepted stream is readable
+
+  TransportContext* NewContext(bool isForMaster);
+  void DeleteContext(TransportContext* ctx);
+  inline int GetCounter() {return context_counter;}
+};
+
+/*a queued frame*/
+struct TcpFrame {
+  uint32_t hdr[2];  //payload length and imm (network byte order)
+  const char* data;
+  size_t len;
+  size_t off;  //bytes of hdr+data already written
+  bool owned;  //zfree data after it is written
+  bool slot;  //data occupies a send slot
+  bool signaled;
+  unsigned int id;
+};
+
+class TcpContext: public TransportContext {
+  TcpResource* resource;
+  bool isForMaster;
+  uint32_t id;  //unique in the resource
+  int sfd = -1;  //send stream
+  int rfd = -1;  //recv stream
+  bool connecting = false;  //sfd is connecting, or sending the hello
+  size_t hello_off = 0;  //bytes of the hello already sent
+  uint32_t hello;  //the peer's context id (network byte order)
+  bool want_write = false;  //the writable event of sfd is armed
+  bool broken = false;  //the send stream failed, nothing can be sent any more
+
+  SendRing ring;  //send slots and selective signaling
+  std::deque<TcpFrame> outq;  //frames not yet (fully) written
+
+  char* rbuf;  //partially received frames
+  size_t rlen = 0;
+
+  uint64_t vaddr = 0;  //base addr of the remote memory
+  char* msg = nullptr;  //conn string
+
+  void Complete(const TcpFrame& f, bool ok = true);
+  void WantWrite(bool want);
+  void Fail();  //close the send stream and fail the queued frames
+
+ public:
+  TcpContext(TcpResource* res, bool isForMaster, uint32_t id);
+  ~TcpContext();
+  inline bool IsMaster() {return isForMaster;}
+  const char* GetRdmaConnString();
+  int SetRemoteConnParam(const char *remConn);
+  inline uint32_t GetQP() {return id;}
+  inline void* GetBase() {return (void*)vaddr;}
+
+  inline unsigned int SendComp(ibv_wc& wc) {return ring.SendComp(wc);}
+  inline unsigned int WriteComp(ibv_wc& wc) {return ring.SendComp(wc);}
+  char* RecvComp(ibv_wc& wc);
+  inline char* GetFreeSlot() {return ring.GetFreeSlot();}
+  inline bool IsRegistered(const void* addr) {return ring.IsRegistered(addr);}
+  inline bool IsFull() {return ring.IsFull();}
+
+  inline ssize_t Send(const void* ptr, size_t len, unsigned int id = 0, bool signaled = false) {
+    return SendWithImm(ptr, len, 0, id, signaled);
+  }
+  ssize_t SendWithImm(const void* ptr, size_t len, uint32_t imm, unsigned int id = 0, bool signaled = false);
+  inline int PostRecv(int n) {return resource->PostRecv(n);}
+  ssize_t Write(raddr dest, raddr src, size_t len, unsigned int id = 0, bool signaled = false);
+  ssize_t WriteWithImm(raddr dest, raddr src, size_t len, uint32_t imm, unsigned int id = 0, bool signaled = false);
+  ssize_t Read(raddr dest, raddr src, size_t len, unsigned int id = 0, bool signaled = false);
+
+  int Flush();  //send the queued frames, return -1 on error
+  void OnWritable();  //the send stream is connected, or has room
+  int OnReadable();  //read and dispatch the complete frames, return -1 on error/eof
+  void SetRecvFd(int fd);
+};
+
+#endif /* INCLUDE_TCP_TRANSPORT_H_ */
@@ -0,0 +1,56 @@
+// Copyright (c) 2018 The GAM Authors
+/*文件定义了工作节点的二级存储：冷对象的数据被移到本地磁盘上的文件中，DRAM中只保留对象头(墓碑)*/
+
+#ifndef INCLUDE_TIER_H_
+#define INCLUDE_TIER_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+
+#define TIER_BLOCK_SIZE 4096  //space of the file is allocated in blocks
+
+/*
+ * file-backed second tier of a worker
+ *
+ * the data of a demoted object is put at an extent of whole blocks of the
+ * file (pwrite/pread), and the object keeps a tombstone in its DRAM chunk
+ * (see FARM_OBJECT_DEMOTED in farm_txn.h). Free extents are kept by address
+ * (to coalesce the neighbours) and by length (for best fit), as the large
+ * objects of SlabAllocator.
+ *
+ * the file is unlinked once opened, so that nothing is left behind.
+ * All the methods are thread-safe (promotions happen in the app threads).
+ */
+class TierStore {
+  int fd = -1;
+  std::mutex lock_;
+  std::map<off_t, size_t> free_extents;  //start -> blocks
+  std::multimap<size_t, off_t> free_extents_by_len;  //blocks -> start
+  off_t end = 0;  //end of the used part of the file
+
+  size_t objects = 0;  //objects in the file
+  size_t bytes = 0;  //data bytes of them
+
+  off_t alloc(size_t n);  //n contiguous blocks
+  void add_extent(off_t start, size_t n);
+  void del_extent(std::map<off_t, size_t>::iterator it);
+
+ public:
+  TierStore(const std::string& path);
+  ~TierStore();
+
+  /*write len bytes to a new extent, return its offset or -1 on error*/
+  off_t Put(const char* data, size_t len);
+  /*read len bytes at off, return 0 or -1 on error (e.g. an extent that is gone)*/
+  int Get(off_t off, char* buf, size_t len);
+  /*give back the extent of len bytes at off*/
+  void Release(off_t off, size_t len);
+
+  inline size_t GetObjects() {return objects;}
+  inline size_t GetBytes() {return bytes;}  //data bytes moved out of DRAM
+  inline size_t GetFileSize() {return end;}
+};
+
+#endif /* INCLUDE_TIER_H_ */
@@ -0,0 +1,156 @@
+// Copyright (c) 2018 The GAM Authors
+/*文件定义了传输层的抽象接口，RDMA和共享内存等后端都实现这套接口*/
+
+#ifndef INCLUDE_TRANSPORT_H_
+#define INCLUDE_TRANSPORT_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <sys/types.h>
+#include <infiniband/verbs.h>
+#include "settings.h"
+#include "structure.h"
+
+class TransportContext;
+struct aeEventLoop;
+typedef void* raddr; //raddr means registered addr
+
+/*
+ * node-wide transport state (the counterpart of RdmaResource)
+ *
+ * completions of every backend are reported as ibv_wc records:
+ * - qp_num: the id of the local context (GetQP()) the completion belongs to
+ * - opcode: IBV_WC_SEND / IBV_WC_RECV (/ IBV_WC_RDMA_READ ...)
+ * - wr_id: the same encoding as RdmaContext uses for selective signaling,
+ *          or the recv slot for IBV_WC_RECV
+ * so that Server::ProcessRdmaRequest dispatches all the backends in the same way.
+ */
+class TransportResource {
+ public:
+  virtual bool IsMaster() const = 0;  //是否用于Master节点
+  virtual int GetChannelFd() const = 0;  //fd registered to the event loop, readable when there are new completions
+  virtual void SetEventLoop(aeEventLoop* el) {}  //the loop of the server, for the backends that watch fds of their own
+  virtual bool GetCompEvent() const = 0;  //consume the notification and re-arm it
+  virtual int PollCompletion(int n, ibv_wc* wc) = 0;  //poll at most n completions, return the number of polled ones or <0 on error
+  virtual int RegLocalMemory(void *base, size_t sz) = 0;  //注册本地内存(later calls add the regions grown at runtime)
+  virtual uint32_t GetRegionKey(const void* addr) {return 0;}  //the key peers need to access the region containing addr
+  virtual int PostRecv(int n) = 0;  //give back n recv slots
+  /*
+   * credit windows (see Client): a peer starts with InitialWindow() credits,
+   * and the window we give it is moved towards RecvWindow() as its msgs
+   * arrive. Reserve() promises n more recv slots to a peer (n < 0: n fewer,
+   * which are then not re-posted) and returns how many it could; Release()
+   * gives up the n slots promised to a peer that is gone, which stay posted.
+   * The backends that grow their slots on demand keep a fixed window.
+   */
+  virtual int InitialWindow(bool isForMaster) {return isForMaster ? MAX_MASTER_PENDING_MSG : MAX_WORKER_PENDING_MSG;}
+  virtual int RecvWindow(bool isForMaster) {return InitialWindow(isForMaster);}
+  virtual int Reserve(int n) {return n;}
+  virtual void Release(int n) {}
+  virtual void SetExpectedPeers(int n) {}  //the cluster size the windows are sized for
+  virtual TransportContext* NewContext(bool isForMaster) = 0;  //创建新的连接上下文
+  virtual void DeleteContext(TransportContext* ctx) = 0;  //删除连接上下文
+  virtual int GetCounter() = 0;  //number of created contexts
+  virtual ~TransportResource() {}
+};
+
+/*
+ * per-connection transport state (the counterpart of RdmaContext)
+ *
+ * contract shared by all the backends:
+ * - GetFreeSlot() hands out a MAX_REQUEST_SIZE buffer from the send ring,
+ *   which is given back when the (selectively) signaled send completion is polled
+ * - Send() of a buffer not obtained from GetFreeSlot() and longer than
+ *   MAX_RDMA_INLINE_SIZE takes its ownership (it will be zfree-ed)
+ * - the buffer returned by RecvComp() stays valid until the resource's PostRecv()
+ * - SendWithImm() delivers imm along with the msg, which shows up in the
+ *   peer's RECV completion as imm_data (network byte order) with IBV_WC_WITH_IMM
+ * - Read(dest, src) is a one-sided read of the remote addr src into the local
+ *   buffer dest (a send slot or the registered local memory), completed with
+ *   IBV_WC_RDMA_READ through WriteComp(); a backend without it returns -1,
+ *   and -2 means the read cannot be done (now), so that the caller falls back to a msg
+ * - the remote memory is contiguous from GetBase(); the regions the peer grows
+ *   after the connection are told through AddRemoteRegion() before they are read
+ */
+class TransportContext {
+ public:
+  virtual bool IsMaster() = 0;  //判断是否为主节点
+  virtual const char* GetRdmaConnString() = 0;  //获取连接字符串
+  virtual int SetRemoteConnParam(const char *remConn) = 0;  //设置远程连接参数
+  virtual uint32_t GetQP() = 0;  //id of the connection, unique in the resource
+  virtual void* GetBase() = 0;  //base addr of the remote memory
+  virtual int AddRemoteRegion(uint64_t off, size_t size, uint32_t key) {return 0;}  //a region grown by the peer, at GetBase() + off
+
+  virtual unsigned int SendComp(ibv_wc& wc) = 0;  //处理发送完成事件
+  virtual unsigned int WriteComp(ibv_wc& wc) = 0;  //处理写完成事件
+  virtual char* RecvComp(ibv_wc& wc) = 0;  //处理接收完成事件
+  virtual char* GetFreeSlot() = 0;  //获取空闲槽
+  virtual bool IsRegistered(const void* addr) = 0;  //addr是否位于发送槽中
+  virtual bool IsFull() = 0;  //no more op can be posted until some completes
+
+  virtual ssize_t Send(const void* ptr, size_t len, unsigned int id = 0, bool signaled = false) = 0;
+  virtual ssize_t SendWithImm(const void* ptr, size_t len, uint32_t imm, unsigned int id = 0, bool signaled = false) = 0;
+  virtual int PostRecv(int n) = 0;
+  virtual ssize_t Write(raddr dest, raddr src, size_t len, unsigned int id = 0, bool signaled = false) = 0;
+  virtual ssize_t WriteWithImm(raddr dest, raddr src, size_t len, uint32_t imm, unsigned int id = 0, bool signaled = false) = 0;
+  virtual ssize_t Read(raddr dest, raddr src, size_t len, unsigned int id = 0, bool signaled = false) = 0;
+  virtual ~TransportContext() {}
+};
+
+/*
+ * send ring of MAX_REQUEST_SIZE slots with selective signaling,
+ * the same bookkeeping as RdmaContext, for the backends that emulate the NIC (shm, tcp)
+ */
+class SendRing {
+  char* send_buf;
+  int buf_size;
+  int slot_head;
+  int slot_tail;
+  bool full;
+  int max_pending_msg;
+  int max_unsignaled_msg;
+  int pending_msg = 0;
+  int pending_send_msg = 0;
+  int to_signaled_send_msg = 0;
+  int to_signaled_w_r_msg = 0;
+
+ public:
+  SendRing(bool isForMaster);
+  ~SendRing();
+  char* GetFreeSlot();
+  bool IsRegistered(const void* addr);
+  inline bool IsFull() {return pending_msg >= max_pending_msg;}
+  /*
+   * account a finished op (slot: whether it occupies a send slot)
+   * return true if it has to be signaled, with the wr_id of the completion
+   */
+  bool Complete(unsigned int id, bool signaled, bool slot, uint64_t& wr_id);
+  unsigned int SendComp(ibv_wc& wc);
+};
+
+/*
+ * recv slots of the backends that copy incoming msgs into local buffers (shm, tcp)
+ * grown on demand by RECV_SLOT_STEP slots; not thread-safe
+ */
+class RecvSlots {
+  std::vector<char*> comm_buf;
+  std::vector<int> free_slots;  //slots ready to receive
+  std::vector<int> cleared_slots;  //slots consumed by RecvComp, recycled by PostRecv
+
+ public:
+  ~RecvSlots();
+  int Get();  //-1 if out of memory
+  char* Addr(int s);
+  inline void Clear(int s) {cleared_slots.push_back(s);}
+  void Recycle(int n);
+};
+
+/*根据Conf::transport创建传输资源*/
+class TransportResourceFactory {
+ public:
+  static TransportResource* getMasterResource(const Conf& conf);
+  static TransportResource* getWorkerResource(const Conf& conf);
+};
+
+#endif /* INCLUDE_TRANSPORT_H_ */
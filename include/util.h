@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <sstream>
+#include <pthread.h>
 #include "settings.h"
 #include "structure.h"
 
@@ -38,6 +39,8 @@ inline string get_local_ip(const string iface = "") {return get_local_ip(iface.e
 
 long get_time();
 
+int bind_to_numa_node(pthread_t thread, int node);
+
 #define atomic_add(v, i) __sync_fetch_and_add((v), (i))
 #define atomic_read(v) __sync_fetch_and_add((v), (0))
 
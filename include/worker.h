@@ -13,6 +13,7 @@
 #include <mutex>
 #include <atomic>
 #include <list>
+#include <deque>
 #include "settings.h"
 #include "structure.h"
 #include "client.h"
@@ -22,6 +23,11 @@
 #include "slabs.h"
 
 #include "farm_txn.h"
+#include "region_map.h"
+#include "tier.h"
+#include "kv_store.h"
+#include "placement.h"
+#include "chars.h"
 
 /*该结构体的设计意义在于管理和跟踪分布式事务的提交状态，它在分布式系统中用于协调多个工作节点之间的事务提交过程
 在分布式事务中，常用的提交协议是两阶段提交协议，TxnCommitStatus可以很好地支持这一协议：
@@ -33,6 +39,54 @@ struct TxnCommitStatus{
   int success;  //事务是否成功标志
   bool local; //是否为本地事务的标志
 };
+/*
+ * state of a one-sided remote read (see Worker::FarmSubmitRemoteRead)
+ * the object is fetched in three dependent rdma reads, which mirrors the
+ * lock-free read of the local path. A single read gives no order between
+ * the bytes it fetches, so the versions are read in their own reads, one
+ * issued before the data read and one after it:
+ * HEADER: version and size (the "before" version)
+ * DATA: the data
+ * VERIFY: version again (the "after" version)
+ * MSG: the object is write-locked, in the owner's second tier, or keeps
+ *   changing under the reads: read it with a FARM_READ msg, which the owner
+ *   serves once the object is unlocked, instead of spinning on it
+ */
+enum FarmRemoteReadStage {
+  FARM_RREAD_HEADER,
+  FARM_RREAD_DATA,
+  FARM_RREAD_VERIFY,
+  FARM_RREAD_MSG
+};
+#define FARM_RREAD_MAX_RETRY 2  //torn one-sided reads before a FARM_READ msg is used
+
+/*
+ * a KV value moved in several msgs (see Worker::FarmGenerateMsg): values
+ * larger than a send slot go in chunks, the next one in the next msg
+ */
+struct KVTransfer {
+  Size offset = 0;  //bytes sent (or received) so far
+  char* value = nullptr;  //the value received by KVStore::Alloc, or a copy of the one being sent
+};
+
+struct FarmRemoteRead {
+  FarmRemoteReadStage stage = FARM_RREAD_HEADER;
+  version_t version = 0;  //the "before" version with the read lock bit cleared
+  osize_t size = 0;  //object size got in the HEADER stage
+  int retries = 0;  //torn reads so far
+  char* slot = nullptr;  //the send slot the current read lands in
+  char* buf = nullptr;  //[version][size][data] copied out in the DATA stage
+};
+
+/*
+ * objects pre-allocated for us by a remote worker (see Worker::FarmProcessLocalMalloc),
+ * from which the remote txAlloc of one size class is served locally
+ */
+struct FarmLease {
+  std::vector<GAddr> addrs;
+  long last_used = 0;  //ns
+};
+
 //这些宏定义了请求的类型和标志
 #define REQUEST_WRITE_IMM 1
 #define REQUEST_SEND 1 << 1
@@ -41,6 +95,102 @@ struct TxnCommitStatus{
 #define REQUEST_NO_ID 1 << 4
 #define ADD_TO_PENDING 1 << 5
 
+/*
+ * msgs to a worker are coalesced into one send slot (see Worker::FarmSubmitBatch):
+ * [FARM_BATCH][n] followed by n [uint32_t len][msg]
+ * ([FARM_BATCH_GOSSIP][n][uint32_t k][k gossip records] with STATS_GOSSIP)
+ */
+#define FARM_BATCH_HDR_SIZE (sizeof(wtype) + sizeof(uint32_t))
+#define FARM_MSG_HDR_SIZE 64  //upper bound of a serialized WorkRequest without its payload
+#define FARM_KV_MIN_CHUNK 1024  //a KV value is not cut into chunks smaller than this at the end of a batch
+#define FARM_TIER_BATCH 64  //cold objects taken by one call of SlabAllocator::scan_cold
+
+/*
+ * remote allocations of up to FARM_LEASE_MAX_SIZE bytes are rounded up to a
+ * size class and served from a lease of FARM_LEASE_BATCH objects per remote worker;
+ * the objects of a lease unused for FARM_LEASE_IDLE_TIME are given back to
+ * that worker in a FARM_FREE msg (see Worker::FarmReturnLeases)
+ */
+#define FARM_LEASE_BATCH 64
+#define FARM_LEASE_MAX_SIZE 4096
+#define FARM_LEASE_IDLE_TIME (1000 * 1000 * 1000L)  //ns
+#define FARM_LEASE_RETURN_INTERVAL 500  //ms
+#define FARM_LEASE_KEY(wid, size) ((uint64_t)(wid) << 32 | (uint32_t)(size))
+
+/*
+ * a FARM_MALLOC asks for (WorkRequest::counter) objects; when more than one,
+ * the reply carries [osize_t size][GAddr]* so that it must fit in one msg
+ */
+#define FARM_MALLOC_MANY_MAX 512
+
+/*
+ * the objects of a region being moved go in MIGRATE msgs of records
+ * [uint32_t offset][uint32_t allocated size][uint32_t pos][uint32_t n][n bytes]:
+ * n bytes at pos of the object ([version][size][data]) at offset in the region,
+ * so that an object larger than a msg goes in several of them
+ */
+#define FARM_MIGRATE_RECORD_HDR (4 * sizeof(uint32_t))
+#define FARM_MIGRATE_MIN_CHUNK 256  //a record is not cut smaller than this at the end of a batch
+#define FARM_MIGRATE_INTERVAL 1  //ms, of Worker::Migrator
+
+/*
+ * a move of regions away from this worker (see Worker::FarmMigrateNext):
+ * the n regions pulled by a new worker, or all of them when this one leaves.
+ * One region is moved at a time, the fields below active are of that one.
+ */
+struct FarmMigration {
+  bool leave = false;
+  int to = 0;  //the puller, 0 to place each region (leave)
+  int n = -1;  //regions to move, -1 for all
+  int moved = 0;
+  std::unordered_set<uint64_t> failed;  //regions that cannot be moved, not picked again
+  Client* client = nullptr;  //of the puller
+  TxnContext* reply = nullptr;  //the MIGRATE_PULL to reply
+
+  bool active = false;
+  uint64_t region = 0;
+  int dest = 0;
+  Client* dest_client = nullptr;
+  uint32_t seq = 0;  //of the move
+  size_t extent = 0;  //bytes of the objects
+  std::map<uint32_t, uint32_t> objects;  //offset -> allocated size
+  std::map<uint32_t, char*> chunks;  //offset -> the chunk of the object here, freed once moved
+  bool home = false;  //a region of the memory here, not one moved here before
+  std::deque<uint32_t> deferred;  //objects locked (or in the second tier) when last looked at
+  std::deque<uint32_t> ready;  //objects to send
+  uint32_t pos = 0;  //bytes of ready.front() sent
+  bool queued = false;  //the MIGRATE msg is in the tasks of dest_client
+  bool waiting = false;  //all sent, for the MIGRATE_REPLY
+  /*
+   * the region is to be frozen, or handed over (the MIGRATE_REPLY is got),
+   * once no app thread is in a RegionMap::Guard: retried by Migrator
+   */
+  bool freezing = false;
+  bool handing = false;
+};
+
+/*a region being moved here: a chunk of each object is filled by the MIGRATE msgs*/
+struct FarmIncoming {
+  size_t extent = 0;  //bytes of the objects
+  std::map<uint32_t, uint32_t> objects;
+  std::map<uint32_t, char*> chunks;
+  bool failed = false;  //no room for it
+};
+
+/*
+ * a single msg of a move to Master (to = 0) or to another worker, sent in
+ * order by Worker::FarmSendNotices
+ */
+struct FarmNotice {
+  Work op;
+  int to;
+  uint64_t key;
+  int counter;
+  uint32_t seq;
+  Flag flag;
+  uint32_t id;
+};
+
 class Worker: public Server { //Worker类继承自Server类，表示工作节点服务器  
 
   //the handle to the worker thread
@@ -74,7 +224,48 @@ class Worker: public Server { //Worker类继承自Server类，表示工作节点
 
   void* base; //base addr 基地址
   Size size;  //大小
+  size_t nregions = 1;  //parts of the region (see SlabAllocator::get_regions) registered to the transport
+  unordered_map<int, size_t> announced_regions;  //wid -> parts of the region told to the worker
 
+  /*
+   * the other workers known from Master (in the list got at the join and by
+   * WORKER_JOIN later), so that they can be connected on demand
+   * (conf->lazy_connect); their mem stats are kept here until then
+   */
+  struct Peer {
+    string ip;
+    int port = 0;
+    Size total = 0;
+    Size free = 0;
+  };
+  unordered_map<int, Peer> peers;
+  void AddPeer(int wid, string ipport);
+
+  uint64_t stats_epoch = 0;  //epoch of the last mem stats got from Master (see Master::BroadcastMemStats)
+
+  /*
+   * the stats of the workers spread by gossip (conf->stats_mode == STATS_GOSSIP):
+   * a worker bumps the version of its own record whenever it changes, and a
+   * record only replaces an older version of it. The records go with the
+   * batches of FaRM msgs (GOSSIP_PIGGYBACK of them) and, every
+   * conf->gossip_interval, all of them to a random worker, so Master is
+   * only told of the joins.
+   */
+  struct GossipStats {
+    uint64_t version = 0;
+    Size total = 0;
+    Size free = 0;
+    uint32_t load = 0;  //txns in flight at the worker
+  };
+  unordered_map<int, GossipStats> gossip_stats_;  //wid -> the latest record known, this worker included
+  std::vector<int> gossip_wids_;  //the workers of gossip_stats_, in the order they are known
+  size_t gossip_next_ = 0;  //the next one of gossip_wids_ to piggyback
+  int FarmAppendGossip(char* buf, int wid);  //the record of wid, return its size
+  int FarmAppendPiggyback(char* buf);  //the GOSSIP_PIGGYBACK records of a batch, return their size
+  void FarmMergeGossip(const char* p, int n);
+  void FarmGossip();  //all the known records to a random worker
+  void FarmSyncStats();  //the local allocations passed conf->ghost_th
+  void FarmUpdateMemStats(int wid, Size total, Size free);
   Size ghost_size; //the locally allocated size that is not synced with Master  本地分配但未与主节点同步的大小
 
 #ifndef USE_BOOST_QUEUE
@@ -99,11 +290,46 @@ class Worker: public Server { //Worker类继承自Server类，表示工作节点
   std::unordered_map<uint64_t, std::unique_ptr<TxnContext>> remote_txns_;//远程事务上下文映射
   std::unordered_map<uint64_t, uint32_t> nobj_processed;  //处理的对象数量映射
 
-  unordered_map<uint64_t, pair<void*, Size>> kvs; //键值存储
+  KVStore kvs; //键值存储，值放在slab区域中
+  /* work request -> its KV value moved in chunks */
+  std::unordered_map<WorkRequest*, KVTransfer> kv_transfers_;
+
+  /*
+   * one-sided reads in flight, indexed by the id of the work request;
+   * farm_rdma_read is turned off when the transport does not support it,
+   * and then remote reads fall back to FARM_READ msgs
+   */
+  std::unordered_map<uint32_t, FarmRemoteRead> farm_rreads_;
+  bool farm_rdma_read = true;
+
+  /* clients whose msgs are held back by FarmDeferResume */
+  std::unordered_set<Client*> farm_deferred_clients_;
+  int farm_defer_resume_ = 0;
+
+  /* FARM_LEASE_KEY(wid, size class) -> objects leased from that worker */
+  std::unordered_map<uint64_t, FarmLease> farm_leases_;
+  /* wr id -> where to put the objects of a remote txAllocMany */
+  std::unordered_map<uint32_t, GAddr*> farm_bulk_allocs_;
+
+  /*
+   * where the allocations without an address go (see Worker::FarmPlace);
+   * the targets are rebuilt only when the mem stats or the known workers
+   * change, and the free memory of a remote target is lowered by what is
+   * placed there in between, so that it is not picked again and again
+   */
+  std::unique_ptr<Placement> placement_;
+  std::vector<PlacementTarget> placement_targets_;
+  std::vector<Client*> placement_clients_;  //of the targets, nullptr for this worker and the workers not connected
+  bool placement_dirty_ = true;
+  size_t placement_nclients_ = 0;  //size of widCliMap when the targets were built
 //这些方法用于处理事务的提交、验证、提交或中止、远程请求处理、内存分配等
   int FarmSubmitRequest(Client* cli, WorkRequest* wr);  //提交工作请求给客户端cli
+  int FarmGenerateMsg(Client* cli, WorkRequest* wr, char* buf, int room, int& len);  //生成工作请求对应的消息
+  int FarmSubmitBatch(Client* cli);  //将发往cli的多个消息合并到一个发送槽中发送
 
   void FarmAddTask(Client*, TxnContext*); //添加任务到客户端的任务列表
+  void FarmDeferResume();  //暂缓发送新加入的任务，以便合并
+  void FarmFlushResume();  //发送暂缓的任务
 
   /* prepare local transaction */
   void FarmPrepare(TxnContext*, TxnCommitStatus*);  //准备事务上下文和提交状态
@@ -132,14 +358,22 @@ class Worker: public Server { //Worker类继承自Server类，表示工作节点
   void FarmProcessAcknowledge(Client*, TxnContext*);  //处理确认消息事务
   void FarmProcessMalloc(Client*, TxnContext*); //处理内存分配请求
   void FarmProcessMallocReply(Client*, TxnContext*);  //处理内存分配请求的回复
+  void FarmReturnLeases();  //give the idle leased objects back to their workers
+  void FarmProcessFree(WorkRequest* wr);  //free the leased objects given back by a remote worker
   void FarmProcessRead(Client*, TxnContext*); //处理读取请求
   void FarmProcessReadReply(Client*, TxnContext*);  //处理读取请求的回复
+  int FarmSubmitRemoteRead(Client*, WorkRequest*, char* sbuf);  //发起单边读(不经过对端CPU)
+  void FarmProcessRdmaRead(Client*, unsigned int id);  //处理单边读完成事件
   void FarmWrite(std::unordered_map<GAddr, std::shared_ptr<Object>>&);  //写入对象
 
   void FarmResumeTxn(Client*);  //恢复事务
 
   void FarmProcessPendingReads(TxnContext*);  //处理待处理的读取请求
   void FarmProcessPendingReads(WorkRequest*);
+  void FarmNotifyRead(WorkRequest*);  //唤醒读请求的发起方(并行读的最后一个子请求唤醒父请求)
+  int FarmGenerateKVChunk(WorkRequest*, int room);  //决定KV值的下一块
+  void FarmProcessKVPut(Client*, TxnContext*);  //处理远程节点的KV_PUT(一块)
+  void FarmProcessKVGet(Client*, TxnContext*);  //处理远程节点的KV_GET
 
   /* worker serves as the coodinator for local commit requests */
   int FarmCommit(WorkRequest*); //提交工作请求
@@ -152,13 +386,70 @@ class Worker: public Server { //Worker类继承自Server类，表示工作节点
   void FarmUnRLock(GAddr addr); //解除地址的读锁定
   void FarmUnWLock(GAddr addr); //解除地址的写锁定
 
-  void* FarmMalloc(osize_t, osize_t = 1); //分配内存
+  void* FarmMalloc(osize_t, bool aligned = false); //分配内存，aligned时对齐到cache line
+  int FarmMallocMany(osize_t, int n, GAddr* out);  //一次分配n个对象，返回分配的个数
+  char* FarmInitObject(char* addr);  //zero the [version][size] header, return the object
   void FarmFree(GAddr); //释放内存
-  inline osize_t FarmAllocSize(char* addr) {  //获取分配内存大小
-    return *(osize_t*)(addr - sizeof(osize_t));
+  inline osize_t FarmAllocSize(char* addr) {  //获取分配内存大小(由所在的slab类决定)
+    return sb.get_chunk_size(addr);
+  }
+  inline osize_t FarmAllocSize(GAddr a, char* local) {  //of an object in the block of a region moved here as well
+    long s = regions.AllocSize(a);
+    return s >= 0 ? s : sb.get_chunk_size(local);
+  }
+  Status FarmReadObject(GAddr a, char* buf, int& len);  //[version][size][data] of a local object into buf
+  inline bool FarmOneSided(WorkRequest* wr) {  //the objects of a moved region are not at their home offsets
+    return wr->op == FARM_READ && farm_rdma_read && !regions.Moved(wr->addr);
   }
 
   void FarmAllocateTxnId(WorkRequest*); //分配事务ID
+  void FarmUpdatePlacementTargets();
+  void FarmUpdatePlacementLoads();  //current stats of this worker and queue depths of the others
+  int FarmPlace(Size size, bool remote_only = false);  //the worker to allocate size bytes at, 0 if none
+  int FarmPlaceGroup(uint64_t group, Size size);  //the worker of an affinity group
+
+  /*
+   * elastic membership: a new worker pulls regions from a loaded one, and a
+   * leaving worker pushes all of its regions away before it exits (see
+   * RegionMap). A region is frozen, its objects are sent to the new owner
+   * in MIGRATE msgs once they are not locked, and it is handed over when
+   * the new owner has them all; Master then tells all the workers.
+   */
+  std::deque<FarmMigration> farm_migrations_;  //the first one is being done
+  std::unique_ptr<TxnContext> farm_mtx_;  //of the MIGRATE msgs
+  std::unordered_map<uint64_t, FarmIncoming> farm_incoming_;  //region -> being moved here
+  std::deque<FarmNotice> farm_notices_;
+  bool farm_migrator_ = false;  //Migrator is scheduled
+  std::unordered_set<int> left_;  //workers leaving or left, no longer allocated at
+  bool leaving_ = false;
+  WorkRequest* farm_leave_wr_ = nullptr;
+  uint64_t region_epoch_ = 0;  //of the last REGION_MAP got from Master
+  /*
+   * the reuse epoch of each REGION_SIZE of the memory here, bumped when the
+   * home region there is moved away and its chunks are freed (see EPOCH_SHIFT)
+   */
+  std::unique_ptr<uint8_t[]> farm_epochs_;
+  std::vector<char*> farm_held_chunks_;  //free chunks of a region being moved, given out once it is done
+  std::vector<GAddr> farm_frozen_frees_;  //objects freed while their region is being moved
+  void FarmMigrateSchedule();
+  void FarmPostNotice(Work op, int to, uint64_t key, int counter = 0, uint32_t seq = 0,
+      Flag flag = 0, uint32_t id = 0);
+  void FarmSendNotices();
+  uint64_t FarmPickRegion(const std::unordered_set<uint64_t>& skip);  //0 if none
+  bool FarmMigrateStart(FarmMigration& m, uint64_t region);
+  void FarmMigrateHandOver(FarmMigration& m, bool success);
+  void FarmMigrateReleaseChunks();
+  void FarmMigrateNext();
+  void FarmMigratePump(FarmMigration& m);
+  void FarmMigrateKick();
+  void FarmMigrateFinish();
+  int FarmGenerateMigrate(WorkRequest* wr, char* buf, int room);  //-1 if no room
+  void FarmProcessMigrate(Client*, TxnContext*);
+  void FarmProcessMigrateReply(Client*, TxnContext*);
+  void FarmProcessMigratePull(Client*, TxnContext*);
+  void FarmProcessRegionMap(WorkRequest*);
+  bool FarmRetired(char* chunk);  //a chunk of a region moved away (or being moved), not to be allocated
+  static int Migrator(struct aeEventLoop *eventLoop, long long id, void *clientData);
 
   public:
 
@@ -166,16 +457,39 @@ class Worker: public Server { //Worker类继承自Server类，表示工作节点
   void FarmProcessLocalRequest(WorkRequest*);  //处理本地请求
   void FarmProcessLocalMalloc(WorkRequest*);  //处理本地内存分配请求
   void FarmProcessLocalRead(WorkRequest*); //处理本地读取请求
+  void FarmProcessLocalReadMany(WorkRequest*);  //处理本地并行读取请求
+  void FarmProcessLocalKV(WorkRequest*);  //处理本地KV_PUT/KV_GET请求
+  void FarmProcessLocalKVMany(WorkRequest*);  //处理本地多键KV请求
   void FarmProcessLocalCommit(WorkRequest*);  //处理本地提交请求
+  void FarmProcessLocalMigratePull(WorkRequest*);  //move regions of worker [counter] here
+  void FarmProcessLocalLeave(WorkRequest*);  //move all the regions away
 
   SlabAllocator sb;
+  RegionMap regions;  //the owners of the moved regions
   /*
    * 1) init local address and register with the master
    * 2) get a cached copy of the whole picture about the global memory allocator
    */
-  Worker(const Conf& conf, RdmaResource* res = nullptr); //构造函数，初始化工作节点服务器
+  Worker(const Conf& conf, TransportResource* res = nullptr); //构造函数，初始化工作节点服务器
   inline void Join() {st->join();}  //等待服务线程结束
 
+  /*
+   * the second tier (see TierStore): the data of cold objects is moved to a
+   * local file and a tombstone is left in the chunk. Demotion only runs in the
+   * worker thread; promotion and read-through may run in the app threads.
+   */
+  TierStore* tier = nullptr;
+  size_t FarmTierDemote();  //move cold objects out until DRAM is below tier_th, return the bytes moved
+  size_t FarmTierDemoteObject(char* local);  //return the bytes moved
+  bool FarmTierPromote(char* local);  //bring the data back, false if a txn holds the object
+  int FarmTierRead(char* local, version_t& v, std::string& data);  //read through: 1 read, 0 not demoted, -1 error
+  void FarmTierRelease(char* local);  //drop the data of a demoted object (it is wlocked)
+  inline bool FarmTierDemoted(char* local) {
+    osize_t s;
+    readInteger(local + sizeof(version_t), s);
+    return s == FARM_OBJECT_DEMOTED;
+  }
+
   inline bool IsMaster() {return false;}  //判断是否为主节点，返回false
   inline int GetWorkerId() {return master->GetWorkerId();}  //获取工作节点ID
 
@@ -203,6 +517,8 @@ class Worker: public Server { //Worker类继承自Server类，表示工作节点
 
   //post process after connect to master
   int PostConnectMaster(int fd, void* data); //连接到主节点后的处理
+  Client* ConnectWorker(int wid); //开始建立到工作节点wid的连接
+  int PostConnectWorker(Client* c); //与工作节点交换完连接参数后的处理
   void RegisterMemory(void* addr, Size s);//注册内存
 
   /*
@@ -210,13 +526,37 @@ class Worker: public Server { //Worker类继承自Server类，表示工作节点
    * otherwise, return the client for the worker maintaining the addr
    */
   Client* GetClient(GAddr addr = Gnullptr); //获取客户端
-  inline bool IsLocal(GAddr addr) {return WID(addr) == GetWorkerId();} //判断地址是否为本地地址
-  inline void* ToLocal(GAddr addr) {epicAssert(IsLocal(addr)); return TO_LOCAL(addr, base);}  //将全局地址转化为本地地址
-  inline GAddr ToGlobal(void* ptr) {return TO_GLOB(ptr, base, GetWorkerId());} //将本地地址转换为全局地址
+  inline bool IsLocal(GAddr addr) {return regions.Owner(addr) == GetWorkerId();} //判断地址是否为本地地址(所在区域由本节点持有)
+  inline void* ToLocal(GAddr addr) {return regions.Translate(addr, base);}  //将全局地址转化为本地地址
+  inline GAddr ToGlobal(void* ptr) {  //将本地地址转换为全局地址(带上该段内存当前的复用epoch)
+    ptr_t off = (ptr_t)ptr - (ptr_t)base;
+    return TO_GLOB(ptr, base, GetWorkerId())
+      + ((GAddr)__atomic_load_n(&farm_epochs_[off >> REGION_SHIFT], __ATOMIC_RELAXED) << EPOCH_SHIFT);
+  }
 
   void SyncMaster(Work op = UPDATE_MEM_STATS, WorkRequest* parent = nullptr);//与主节点同步
 
   static int LocalRequestChecker(struct aeEventLoop *eventLoop, long long id, void *clientData); //本地请求检查器
+  static int SlabRebalancer(struct aeEventLoop *eventLoop, long long id, void *clientData); //后台slab迁移
+  static int RegionSyncer(struct aeEventLoop *eventLoop, long long id, void *clientData); //注册并通告运行时新增的内存区域
+  void FarmSyncRegions();
+  static int TierDemoter(struct aeEventLoop *eventLoop, long long id, void *clientData); //把冷对象移到二级存储
+  static int LeaseReturner(struct aeEventLoop *eventLoop, long long id, void *clientData); //归还空闲的租约对象
+  static int Gossiper(struct aeEventLoop *eventLoop, long long id, void *clientData); //周期性地向随机的工作节点gossip内存统计信息
+
+  /*
+   * cluster barrier (see Farm::barrier): this worker enters a round once the
+   * nthreads local callers of it arrived and it is connected to all the other
+   * no_node-1 workers, and Master releases the round in one broadcast once
+   * all the no_node workers entered it
+   */
+  uint32_t barrier_round = 0;  //rounds entered
+  uint32_t barrier_sent = 0;  //rounds told to Master
+  std::vector<WorkRequest*> barrier_waiters;  //local callers of the current round
+  bool barrier_checking = false;  //BarrierChecker is scheduled
+  void FarmProcessLocalBarrier(WorkRequest*);
+  bool FarmSubmitBarrier();  //false if the round cannot be told to Master yet
+  static int BarrierChecker(struct aeEventLoop *eventLoop, long long id, void *clientData);
 
   int Notify(WorkRequest* wr); //通知请求
 
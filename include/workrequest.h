@@ -12,7 +12,7 @@ enum Work { //定义工作类型，定义了各种工作请求类型，包括内
   BROADCAST_MEM_STATS,
   PUT,
   GET,
-  KV_PUT,
+  KV_PUT,  //[key][size] of the value, its chunk of [counter] bytes at [offset] in [ptr]
   KV_GET,
   FARM_MALLOC,
   FARM_READ,
@@ -20,6 +20,26 @@ enum Work { //定义工作类型，定义了各种工作请求类型，包括内
   VALIDATE,
   COMMIT,
   ABORT,
+  FARM_BATCH,  //several msgs coalesced into one
+  ADD_REGION,  //a region grown by the sender: [id = key][addr = offset][size]
+  BARRIER,  //the sender entered barrier round [id]
+  BARRIER_RELEASE,  //all the workers entered barrier round [id]
+  WORKER_JOIN,  //worker [id] joined, listening at the ip:port of [size] bytes
+  COORD_BARRIER,  //named barrier [key = name][size = participants]
+  WATCH,  //wait for a PUT to [key] newer than version [size], [counter = timeout in ms, 0 forever]
+  FETCH_ADD,  //add [size] (as int64_t) to counter [key]
+  FARM_READ_MANY,  //read the [size] objects of the GAddr array [ptr] in parallel (app -> local worker only)
+  KV_GET_MANY,  //get the [size] KVItems of [ptr] in parallel (app -> local worker only)
+  KV_PUT_MANY,  //put the [size] KVItems of [ptr] in parallel (app -> local worker only)
+  FARM_BATCH_GOSSIP,  //a FARM_BATCH with gossiped stats in front of its msgs (see Worker::FarmSubmitBatch)
+  GOSSIP,  //stats of [size] workers, records of GOSSIP_RECORD_SIZE
+  MIGRATE,  //objects of region [key] moved here: [offset = extent][counter = records][pid = seq of the move][flag], REQUEST_DONE on the last msg
+  MIGRATE_DONE,  //the source of the move of region [key] is done with it
+  MIGRATE_PULL,  //move [size] regions of the receiver to the sender (app -> local worker: of worker [counter])
+  REGION_MOVE,  //region [key] is moved to worker [counter] by move [offset = seq]
+  REGION_MAP,  //owners of [size] regions, records of REGION_RECORD_SIZE, [key = epoch] (Master -> workers)
+  WORKER_LEAVE,  //worker [id] leaves, REQUEST_DONE once its regions are moved away
+  FARM_FREE,  //free the [size] never written objects of the GAddr array [ptr] (idle leases given back)
   //set the value of REPLY so that we can test op & REPLY
   //to check whether it is a reply workrequest or not
   REPLY = 1 << 16,  //REPLY及其后续值用于标识恢复类型的工作请求。
@@ -31,6 +51,10 @@ enum Work { //定义工作类型，定义了各种工作请求类型，包括内
   FETCH_MEM_STATS_REPLY,
   GET_REPLY,
   PUT_REPLY,
+  COORD_REPLY,  //[key = result][size][status][value of size bytes for a WATCH]
+  KV_GET_REPLY,  //[key][size][status], and a chunk of [counter] bytes at [offset] of the value
+  MIGRATE_REPLY,  //[key = region][status]
+  MIGRATE_PULL_REPLY,  //[counter = regions moved][status]
 };
 
 enum Status {//定义了各种状态码，用于表示工作请求的结果
@@ -44,10 +68,24 @@ enum Status {//定义了各种状态码，用于表示工作请求的结果
   PREPARE_FAILED,
   VALIDATE_FAILED,
   COMMIT_FAILED,
-  NOT_EXIST
+  NOT_EXIST,
+  MOVED  //FARM_READ_REPLY: the object is owned by worker [wid] since move [counter] of its region
 };
 
 
+/*
+ * a pair of a multi-key KV operation (see Farm::kv_get_many/kv_put_many):
+ * key, node_id and value (size bytes to put, or the buffer to get into) are
+ * given, size (of a get) and status are returned
+ */
+struct KVItem {
+  uint64_t key;
+  int node_id;
+  int status;
+  void* value;
+  Size size;
+};
+
 class TxnContext; //类的前向声明
 using wtype = std::underlying_type<Work>::type;//分别定义为Work和Status枚举的底层类型
 using stype = std::underlying_type<Status>::type;
@@ -65,6 +103,7 @@ using Flag = int; //定义Flag为int类型
 #define TRY_LOCK 1 << 7
 #define TO_SERVE 1 << 8
 #define ALIGNED 1 << 9
+#define AFFINITY 1 << 10 //FARM_MALLOC: wr->key is an affinity group instead of an address
 
 #define MASK_ID 1 << 0 //定义了一些掩码，用于标识工作请求的属性
 #define MASK_OP 1 << 1
@@ -110,6 +149,7 @@ struct WorkRequest {
     Size free;
   };
   Size size;  //大小
+  Size offset;  //of the chunk of a value moved in several msgs (KV_PUT, KV_GET_REPLY)
   int status; //状态码
 
   Flag flag;  //标志
@@ -132,7 +172,7 @@ struct WorkRequest {
   WorkRequest* next; //下一个工作请求，指向下一个工作请求的指针
 
   //构造函数，初始化工作请求，初始化WorkRequest对象的成员变量
-  WorkRequest(): fd(), id(-1), pid(), pwid(), op(), addr(), size(), status(),
+  WorkRequest(): fd(), id(-1), pid(), pwid(), op(), addr(), size(), offset(), status(),
   flag(), ptr(), wid(), counter(), parent(), next() {
 #if !(defined(USE_PIPE_H_TO_W) && defined(USE_PIPE_W_TO_H))
     notify_buf = nullptr;
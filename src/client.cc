@@ -4,12 +4,17 @@
 #include <cstring>
 #include <unistd.h>
 #include <cerrno>
+#include <algorithm>
 #include "rdma.h"
 #include "anet.h"
 #include "log.h"
 #include "client.h"
 #include "server.h"
 #include "zmalloc.h"
+#include "util.h"
+#include "kernel.h"
+#include "tcp.h"
+#include <sys/socket.h>
 
 /* 将resource用在Client对象的初始化中，主要考虑：
 共享RDMA资源：
@@ -37,9 +42,12 @@
   ctx提供了管理连接参数的方法，例如：SetRemoteConnParam用于设置远程连接参数；GetRdmaConnString用于获取本地连接字符串。
 
 */
-Client::Client(RdmaResource* res, bool isForMaster, const char* rdmaConnStr): lastMsgTime(0), resource(res) {
+Client::Client(TransportResource* res, bool isForMaster, const char* rdmaConnStr): lastMsgTime(0), resource(res) {
   wid = free = size = 0;
-  this->ctx = res->NewRdmaContext(isForMaster);
+  //the peer reserves at most as many recv slots for us as our send ring holds (see MAX_RECV_SLOTS)
+  window = isForMaster ? MAX_MASTER_PENDING_MSG : MAX_WORKER_PENDING_MSG;
+  credits = grant = res->InitialWindow(isForMaster);
+  this->ctx = res->NewContext(isForMaster);
   if(rdmaConnStr) this->SetRemoteConnParam(rdmaConnStr);
 }
 /*函数的主要功能是与远程服务器交换连接参数。它通过TCP连接到远程服务器，发送本地连接参数，并接收远程服务器的连接参数*/
@@ -77,6 +85,89 @@ int Client::ExchConnParam(const char* ip, int port, Server* server) {
   return 0;
 }
 
+/*
+ * the non-blocking counterpart of ExchConnParam for the connections to other
+ * workers, driven by the event loop of server (see ProcessExchEvent), so that
+ * the connections to all the workers are made in parallel;
+ * server->PostConnectWorker() is called once the conn params are exchanged,
+ * until then the client is not connected and nothing can be sent
+ */
+int Client::ExchConnParamAsync(const char* ip, int port, int wid, Server* server) {
+  char neterr[ANET_ERR_LEN];
+  int fd = anetTcpNonBlockConnect(neterr, const_cast<char *>(ip), port);
+  if (fd < 0) {
+    epicLog(LOG_WARNING, "Connecting to %s:%d %s", ip, port, neterr);
+    return -1;
+  }
+  this->wid = wid;  //the same as in the conn string of the peer
+  exch_fd = fd;
+  exch_server = server;
+  //writable once connected
+  if (aeCreateFileEvent(server->GetEventLoop(), fd, AE_WRITABLE, ExchConnParamHandle, this) == AE_ERR) {
+    epicLog(LOG_WARNING, "Unable to create the file event for %s:%d", ip, port);
+    close(fd);
+    exch_fd = -1;
+    return -1;
+  }
+  return 0;
+}
+
+void Client::ProcessExchEvent(int mask) {
+  aeEventLoop* el = exch_server->GetEventLoop();
+  char msg[MAX_CONN_STRLEN+1];
+  int n, conn_len;
+
+  if (mask & AE_WRITABLE) { //连接已建立(或失败)，发送本地连接参数
+    int err = 0;
+    socklen_t elen = sizeof(err);
+    if (getsockopt(exch_fd, SOL_SOCKET, SO_ERROR, &err, &elen) || err) {
+      epicLog(LOG_WARNING, "Connecting to worker %d (%s)", wid, strerror(err));
+      goto fail;
+    }
+    const char* conn_str = GetConnString(exch_server->GetWorkerId());
+    conn_len = strlen(conn_str);
+    if (anetWrite(exch_fd, const_cast<char*>(conn_str), conn_len) != conn_len) {
+      epicLog(LOG_WARNING, "Unable to send conn string to worker %d (%s)", wid, strerror(errno));
+      goto fail;
+    }
+    aeDeleteFileEvent(el, exch_fd, AE_WRITABLE);
+    if (aeCreateFileEvent(el, exch_fd, AE_READABLE, ExchConnParamHandle, this) == AE_ERR) {
+      epicLog(LOG_WARNING, "Unable to create the file event for worker %d", wid);
+      goto fail;
+    }
+    return;
+  }
+
+  //the peer answers with a conn string of the same length
+  conn_len = strlen(connstr);
+  n = read(exch_fd, msg, conn_len - exch_buf.length());
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+  if (n <= 0) {
+    epicLog(LOG_WARNING, "Failed to read conn param from worker %d (%s; read %d bytes)\n", wid, strerror(errno), n);
+    goto fail;
+  }
+  exch_buf.append(msg, n);
+  if ((int)exch_buf.length() < conn_len) return;
+
+  aeDeleteFileEvent(el, exch_fd, AE_READABLE);
+  close(exch_fd);
+  exch_fd = -1;
+  epicLog(LOG_INFO, "received conn string %s\n", exch_buf.c_str());
+  if (SetRemoteConnParam(exch_buf.c_str())) {
+    epicLog(LOG_WARNING, "Unable to connect to worker %d", wid);
+    exit(1);
+  }
+  exch_buf.clear();
+  exch_server->PostConnectWorker(this);
+  return;
+
+fail:
+  aeDeleteFileEvent(el, exch_fd, AE_READABLE | AE_WRITABLE);
+  close(exch_fd);
+  exch_fd = -1;
+  exit(1);  //as ExchConnParam does
+}
+
 int Client::SetRemoteConnParam(const char *conn) {
   const char* p = conn;
   if(resource->IsMaster()) { //in the Master thread, connected to worker
@@ -90,7 +181,10 @@ int Client::SetRemoteConnParam(const char *conn) {
   }
   p = strchr(conn, ':'); //查找连接字符串中第一个':'字符的位置，返回值是一个指向冒号的指针，并将其赋值给p
   p++; //跳过worker ID部分,定为到RDMA连接字符串的起始位置。
-  return ctx->SetRemoteConnParam(p);//ctx是当前客户端的RDMA上下文对象，将解析出RDMA连接字符串p传递给RDMA上下文对象的SetRemoteConnParam方法
+  //ctx是当前客户端的RDMA上下文对象，将解析出RDMA连接字符串p传递给RDMA上下文对象的SetRemoteConnParam方法
+  int ret = ctx->SetRemoteConnParam(p);
+  connected = (ret == 0);
+  return ret;
 }
 
 const char* Client::GetConnString(int workerid) {
@@ -117,5 +211,138 @@ const char* Client::GetConnString(int workerid) {
 }
 
 Client::~Client() {
-  resource->DeleteRdmaContext(ctx);
+  resource->Release(grant);
+  resource->DeleteContext(ctx);
+}
+
+void Client::Stall() {
+  if (!stall_start) {
+    stall_start = get_time();
+    stalls++;
+  }
+}
+
+ssize_t Client::Post(const void* buf, size_t len, unsigned int id, bool signaled) {
+  uint32_t imm = to_return;
+  to_return = 0;
+  credits--;
+  ssize_t ret = ctx->SendWithImm(buf, len, imm, id, signaled);
+  if (unlikely(ret < 0)) {
+    credits++;
+    to_return += imm;
+    return ret;
+  }
+  if (stall_start) {
+    stall_time += get_time() - stall_start;
+    stall_start = 0;
+  }
+  return ret;
+}
+
+char* Client::GetFreeSlot() {
+  if (!pending_sends.empty() || credits <= SEND_CREDIT_RESERVE) {
+    epicLog(LOG_DEBUG, "out of credits to worker %d (credits = %d, queued = %lu)",
+        wid, credits, pending_sends.size());
+    Stall();
+    return nullptr;
+  }
+  char* s = ctx->GetFreeSlot();
+  if (!s) Stall();
+  return s;
+}
+
+ssize_t Client::Send(const void* buf, size_t len, unsigned int id, bool signaled) {
+  if (ctx->IsRegistered(buf)) {
+    //the slot was got from GetFreeSlot(), which makes sure we have a credit
+    epicAssert(credits > SEND_CREDIT_RESERVE);
+    return Post(buf, len, id, signaled);
+  }
+
+  char* s = nullptr;
+  if (pending_sends.empty() && credits > SEND_CREDIT_RESERVE)
+    s = ctx->GetFreeSlot();
+  if (!s) {
+    //take over the buffer as Send() of the transport does, and send it later
+    PendingSend p;
+    if (len > MAX_RDMA_INLINE_SIZE) {
+      p.buf = (const char*)buf;
+    } else {
+      char* copy = (char*)zmalloc(len ? len : 1);
+      memcpy(copy, buf, len);
+      p.buf = copy;
+    }
+    p.len = len;
+    p.id = id;
+    p.signaled = signaled;
+    pending_sends.push_back(p);
+    RecordQueueDepth(pending_sends.size());
+    Stall();
+    return -1;
+  }
+
+  memcpy(s, buf, len);
+  if (len > MAX_RDMA_INLINE_SIZE) zfree((void*)buf);
+  return Post(s, len, id, signaled);
+}
+
+void Client::FlushPending() {
+  while (!pending_sends.empty() && credits > SEND_CREDIT_RESERVE) {
+    char* s = ctx->GetFreeSlot();
+    if (!s) break;
+    PendingSend& p = pending_sends.front();
+    memcpy(s, p.buf, p.len);
+    zfree((void*)p.buf);
+    ssize_t ret = Post(s, p.len, p.id, p.signaled);
+    epicAssert(ret == p.len);
+    pending_sends.pop_front();
+  }
+}
+
+unsigned int Client::SendComp(ibv_wc& wc) {
+  unsigned int id = ctx->SendComp(wc);
+  FlushPending();
+  return id;
+}
+
+unsigned int Client::WriteComp(ibv_wc& wc) {
+  unsigned int id = ctx->WriteComp(wc);
+  FlushPending();
+  return id;
+}
+
+bool Client::AddCredits(uint32_t n) {
+  if (!n) return false;
+  bool stalled = credits <= SEND_CREDIT_RESERVE;
+  credits += n;
+  epicAssert(credits <= window);
+  FlushPending();
+  return stalled;
+}
+
+int Client::Rebalance() {
+  int target = resource->RecvWindow(ctx->IsMaster());
+  if (grant < target) {
+    //the new slots are posted by the resource, and given as extra credits
+    int n = resource->Reserve(target - grant);
+    grant += n;
+    to_return += n;
+  } else if (grant > target) {
+    //take credits back by keeping those of the msgs just received
+    int n = std::min<int>(consumed, grant - target);
+    resource->Reserve(-n);
+    grant -= n;
+    consumed -= n;
+    return -n;
+  }
+  return 0;
+}
+
+void Client::ReturnCredits() {
+  to_return += consumed;
+  consumed = 0;
+  //piggybacked on the next msg in most cases; send an empty msg if too many are pending
+  if (to_return >= CREDIT_RETURN_THRESHOLD(grant) && credits > 0 && !ctx->IsFull()) {
+    epicLog(LOG_DEBUG, "return %u credits to worker %d explicitly", to_return, wid);
+    Post(nullptr, 0, 0, false);
+  }
 }
@@ -7,6 +7,8 @@
 #include "kernel.h"
 
 #include <cstring>
+#include <algorithm>
+#include <unordered_set>
 
 using std::vector;
 using std::unique_ptr;
@@ -15,7 +17,9 @@ using std::unordered_map;
 
 #define vstring std::vector<std::string>
 
-Farm::Farm(Worker* w): w_(w), tx_(nullptr), wh_(new WorkerHandle(w)), rtx_(new TxnContext()) {}
+Farm::Farm(Worker* w): w_(w), tx_(nullptr), wh_(new WorkerHandle(w)), rtx_(new TxnContext()) {
+  rtx_->setRegions(&w->regions);  //objects are routed to the current owners of their regions
+}
 //构造函数，初始化Worker指针w_，事务指针tx_，WorkerHandle智能指针wh_和TxnContext智能指针rtx_
 int Farm::txBegin() {
   if (unlikely(tx_ != nullptr)) { //检查当前事务指针tx_是否为空，如果不为空，表示已经有事务在运行。则无法开始新事务
@@ -38,9 +42,10 @@ GAddr Farm::txAlloc(size_t size, GAddr addr){
 
   tx_->wr_->op = FARM_MALLOC;
   tx_->wr_->addr = addr;
+  tx_->wr_->counter = 1;
 
   // each object is associated with version and size
-  tx_->wr_->size = size + sizeof(version_t) + sizeof(osize_t);
+  tx_->wr_->size = size + FARM_OBJECT_HEADER_SIZE;
 
   wh_->SendRequest(tx_->wr_);//发送内存分配请求
 
@@ -62,6 +67,61 @@ GAddr Farm::txAlloc(size_t size, GAddr addr){
 }
 //分配事务内存，如果事务未开始则记录致命错误日志并返回空地址，否则发送分配请求并返回分配的地址
 
+/*
+ * allocate at the worker of affinity group (any id of the app's choosing,
+ * e.g., of a tree or a user), so that the objects of a group are accessed
+ * together at one worker; all the workers map a group to the same one, as
+ * long as it has the room (see Placement::PlaceGroup)
+ */
+GAddr Farm::txAllocGroup(size_t size, uint64_t group) {
+  if (unlikely(tx_ == nullptr)) {
+    epicLog(LOG_FATAL, "Call txBegin first before any transactional allocation/read/write/free");
+    return Gnullptr;
+  }
+  tx_->wr_->flag |= AFFINITY;  //the worker takes wr->key as the group and clears it
+  return txAlloc(size, group);
+}
+
+/*
+ * allocate n objects of size at the worker of addr (or anywhere if 0);
+ * each request carries up to FARM_MALLOC_MANY_MAX objects.
+ * return the number of objects put into out
+ */
+int Farm::txAllocMany(size_t size, int n, GAddr* out, GAddr addr) {
+  if (unlikely(tx_ == nullptr)) {
+    epicLog(LOG_FATAL, "Call txBegin first before any transactional allocation/read/write/free");
+    return 0;
+  }
+
+  int done = 0;
+  while (done < n) {
+    WorkRequest* wr = tx_->wr_;
+    wr->op = FARM_MALLOC;
+    wr->addr = addr;
+    wr->size = size + FARM_OBJECT_HEADER_SIZE;
+    wr->counter = std::min(n - done, FARM_MALLOC_MANY_MAX);
+    wr->ptr = out + done;
+    if (wr->counter == 1) {
+      //a single object goes through the lease of its worker
+      if (!(out[done] = txAlloc(size, addr))) break;
+      done++;
+      continue;
+    }
+
+    wh_->SendRequest(wr);
+    if (wr->status != SUCCESS || wr->counter == 0) break;
+
+    // the same as txAlloc: released on commit unless written
+    for (int i = done; i < done + wr->counter; i++) {
+      Object* o = tx_->createWritableObject(out[i]);
+      o->setVersion(0);
+      o->setSize(0);
+    }
+    done += wr->counter;
+  }
+  return done;
+}
+
 void Farm::txFree(GAddr addr) {
   if (tx_ == nullptr) {
     epicLog(LOG_FATAL, "Call txBegin first before any transactional allocation/read/write/free");
@@ -98,6 +158,9 @@ osize_t Farm::txRead(GAddr addr, char* buf, osize_t size) {
     goto success;
   }
 
+  {
+  //the region is not moved away (and its block freed) while it is read
+  RegionMap::Guard g(w_->regions, false);
   if (this->w_->IsLocal(addr)) {  //如果地址是本地的，则进行本地处理
     // process locally
     void* local = w_->ToLocal(addr); //将全局地址转换为本地地址
@@ -106,6 +169,8 @@ osize_t Farm::txRead(GAddr addr, char* buf, osize_t size) {
     version_t before, after;
     o = tx_->createReadableObject(addr);//创建一个可读对象o
     //o->deserialize((const char*)local);
+    if (unlikely(w_->tier != nullptr)) w_->sb.touch(local);
+retry:
     after = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE); //使用原子操作读取对象的版本号
     do {
       before = after; //将读取的版本号赋值给before
@@ -121,6 +186,20 @@ osize_t Farm::txRead(GAddr addr, char* buf, osize_t size) {
       after = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);//再次加载版本号after，如果版本号发生变化，则重新读取
     } while (is_version_diff(before, after));  //如果读取的版本号与当前版本号不一致，则重新读取
 
+    if (unlikely(o->getSize() == FARM_OBJECT_DEMOTED)) {
+      //the data is in the second tier: bring it back, or read it through if a txn holds the object
+      if (w_->FarmTierPromote((char*)local)) goto retry;
+      std::string data;
+      int ret = w_->FarmTierRead((char*)local, before, data);
+      if (ret == 0) goto retry;
+      if (ret < 0) {
+        tx_->rmReadableObject(addr);
+        goto fail;
+      }
+      o->setVersion(before);
+      o->setSize(data.size());
+      o->readEmPlace(data.data(), 0, data.size());
+    }
 
     if (o->getSize() == -1 || o->getVersion() == 0) { //如果对象的大小为-1或者版本为0，则表示对象未被写入，移除可读对象并跳转到fail标签
       // version == 0 means this object has not been written after being
@@ -130,6 +209,7 @@ osize_t Farm::txRead(GAddr addr, char* buf, osize_t size) {
     }
     goto success;
   }
+  }
   //如果地址不是本地的，则进行远程处理
   tx_->wr_->op = FARM_READ; //设置操作类型为FARM_READ，并设置地址
   tx_->wr_->addr = addr;
@@ -150,6 +230,83 @@ fail:
 }
 //读取事务数据，如果事务未开始则记录致命错误日志并返回-1.否则读取数据并返回读取的大小
 
+/*
+ * read n objects into the read set of the txn, so that the following txReads
+ * of them are served locally. The remote ones are all issued at once and
+ * coalesced per worker by the worker thread, instead of one round trip each.
+ * return the number of objects that can be read
+ */
+int Farm::txReadMany(const GAddr* addrs, int n) {
+  if (unlikely(tx_ == nullptr)) {
+    epicLog(LOG_FATAL, "Call txBegin first before any transactional allocation/read/write/free");
+    return -1;
+  }
+
+  vector<GAddr> remote;
+  std::unordered_set<GAddr> seen;
+  for (int i = 0; i < n; i++) {
+    if (tx_->getReadableObject(addrs[i]) != nullptr) continue;
+    if (this->w_->IsLocal(addrs[i])) {
+      txRead(addrs[i], nullptr, 0);
+    } else if (seen.insert(addrs[i]).second) {
+      remote.push_back(addrs[i]);
+    }
+  }
+
+  if (remote.size() == 1) {
+    txRead(remote[0], nullptr, 0);
+  } else if (remote.size() > 1) {
+    tx_->wr_->op = FARM_READ_MANY;
+    tx_->wr_->ptr = remote.data();
+    tx_->wr_->size = remote.size();
+    wh_->SendRequest(tx_->wr_);
+  }
+
+  int ret = 0;
+  for (int i = 0; i < n; i++) {
+    if (tx_->getReadableObject(addrs[i]) != nullptr) ret++;
+  }
+  return ret;
+}
+
+/*
+ * the version of the copy of @param addr read by the txn, 0 if not read
+ */
+version_t Farm::txVersion(GAddr addr) {
+  if (unlikely(tx_ == nullptr)) {
+    epicLog(LOG_FATAL, "Call txBegin first before any transactional allocation/read/write/free");
+    return 0;
+  }
+
+  Object* o = tx_->getReadableObject(addr);
+  return o ? o->getVersion() : 0;
+}
+
+/*
+ * use a copy of @param addr cached by the application (of @param version,
+ * got from txVersion earlier) as if it was read by the txn: no read is
+ * issued, and the commit fails if the object is no longer of that version.
+ * return -1 if the txn has already read another version of the object
+ */
+int Farm::txCachedRead(GAddr addr, const char* buf, osize_t size, version_t version) {
+  if (unlikely(tx_ == nullptr)) {
+    epicLog(LOG_FATAL, "Call txBegin first before any transactional allocation/read/write/free");
+    return -1;
+  }
+
+  Object* o = tx_->getReadableObject(addr);
+  if (o != nullptr) {
+    return is_version_diff(o->getVersion(), version) ? -1 : 0;
+  }
+
+  epicAssert(version != 0 && !is_version_locked(version));
+  o = tx_->createReadableObject(addr);
+  o->setVersion(version);
+  o->setSize(size);
+  o->readEmPlace(buf, 0, size);
+  return 0;
+}
+
 osize_t Farm::txPartialRead(GAddr addr, osize_t offset, char* buf, osize_t size) {
   if (unlikely(tx_ == nullptr)) {
     epicLog(LOG_FATAL, "Call txBegin first before any transactional allocation/read/write/free");
@@ -222,7 +379,11 @@ int Farm::txCommit() {
 
   if (txnIsLocal()){//检查事务是否是本地事务
     tx_->wr_->op = Work::FARM_READ; // a trick to indicate this is an app commit 设置操作类型为Worker::FARM_READ，这是一个技巧，用于标记当前事务是由应用程序线程发起的本地提交，在后续的FarmProcessLocalCommit函数中，系统会根据操作类型为FARM_READ的请求执行本地事务提交逻辑
-    this->w_->FarmProcessLocalCommit(tx_->wr_);//调用FarmProcessLocalCommit方法处理本地提交，该函数会检查事务的写集合、锁状态等，并决定提交或回滚事务
+    {
+      //no region is frozen between the lock checks and the locks (see RegionMap::Guard)
+      RegionMap::Guard g(w_->regions);
+      this->w_->FarmProcessLocalCommit(tx_->wr_);//调用FarmProcessLocalCommit方法处理本地提交，该函数会检查事务的写集合、锁状态等，并决定提交或回滚事务
+    }
     bool ret = (tx_->wr_->status == Status::SUCCESS) ? 0 : -1;  //根据提交结果设置返回值
     tx_ = nullptr;//清理事务上下文，将事务指针tx_设置为空，标识当前没有活跃的事务。
     return ret;
@@ -289,6 +450,145 @@ int Farm::get(uint64_t key, void* value) {
 }
 //获取键值对，开始事务，发送获取请求，提交事务并返回结果
 
+/*
+ * block until all the conf->no_node workers entered the barrier round; on each
+ * node the round is entered once nthreads threads called it, and the worker is
+ * connected to all the other workers, so the first round also tells that the
+ * cluster is ready
+ */
+int Farm::barrier(int nthreads) {
+  this->txBegin();
+  WorkRequest* wr = this->tx_->wr_;
+  wr->op = BARRIER;
+  wr->counter = nthreads;
+  int ret = 0;
+
+  if (wh_->SendRequest(wr)) {
+    epicLog(LOG_WARNING, "Barrier failed");
+    ret = -1;
+  }
+
+  this->txCommit();
+  return ret;
+}
+
+/*
+ * elastic membership (see Worker::FarmMigrateNext): a worker that joined
+ * takes over n regions of worker wid, the ones with the most live data;
+ * return the number of regions moved here, -1 on error
+ */
+int Farm::take_over(int wid, int n) {
+  this->txBegin();
+  WorkRequest* wr = this->tx_->wr_;
+  wr->op = MIGRATE_PULL;
+  wr->counter = wid;
+  wr->size = n;
+  int ret = -1;
+
+  if (wh_->SendRequest(wr)) {
+    epicLog(LOG_WARNING, "Take over from worker %d failed", wid);
+  } else {
+    ret = wr->counter;
+  }
+
+  this->txCommit();
+  return ret;
+}
+
+/*
+ * move all the regions of this worker to the others and leave the cluster;
+ * nothing is allocated here from then on. Return 0 once Master has dropped
+ * this worker, -1 if some region cannot be moved (the leave can be retried)
+ * or if KV pairs are stored here (they are not moved, so that they have to
+ * be put at another worker first)
+ */
+int Farm::leave() {
+  this->txBegin();
+  WorkRequest* wr = this->tx_->wr_;
+  wr->op = WORKER_LEAVE;
+  int ret = 0;
+
+  if (wh_->SendRequest(wr)) {
+    epicLog(LOG_WARNING, "Leave failed");
+    ret = -1;
+  }
+
+  this->txCommit();
+  return ret;
+}
+
+/*
+ * named barrier served by the master: return once `participants` calls of
+ * the same name arrived, from whatever nodes and threads; the name can be
+ * reused for the next round as soon as it is released
+ */
+int Farm::coord_barrier(uint64_t name, int participants) {
+  this->txBegin();
+  WorkRequest* wr = this->tx_->wr_;
+  wr->op = COORD_BARRIER;
+  wr->key = name;
+  wr->size = participants;
+  int ret = 0;
+
+  if (wh_->SendRequest(wr) || wr->status != SUCCESS) {
+    epicLog(LOG_WARNING, "Barrier %lu failed", name);
+    ret = -1;
+  }
+
+  this->txCommit();
+  return ret;
+}
+
+/*
+ * block until the value of key (set by put) is newer than version, or for at
+ * most timeout_ms (0 to wait forever). The value is copied into value, which
+ * must be large enough to hold it, and version is set to that of the value.
+ * Start with version 0 to get the first value put.
+ * return the size of the value, or -1 on timeout
+ */
+int Farm::watch(uint64_t key, void* value, uint64_t& version, int timeout_ms) {
+  this->txBegin();
+  WorkRequest* wr = this->tx_->wr_;
+  wr->op = WATCH;
+  wr->key = key;
+  wr->size = version;
+  wr->counter = timeout_ms;
+  wr->ptr = value;
+  int ret = -1;
+
+  if (wh_->SendRequest(wr)) {
+    epicLog(LOG_WARNING, "Watch failed");
+  } else if (wr->status == SUCCESS) {
+    version = wr->key;
+    ret = wr->size;
+  }
+
+  this->txCommit();
+  return ret;
+}
+
+/*
+ * atomically add delta to the counter of key (0 if never added), return the
+ * value before the addition
+ */
+int64_t Farm::fetch_add(uint64_t key, int64_t delta) {
+  this->txBegin();
+  WorkRequest* wr = this->tx_->wr_;
+  wr->op = FETCH_ADD;
+  wr->key = key;
+  wr->size = (Size)delta;
+  int64_t ret = 0;
+
+  if (wh_->SendRequest(wr)) {
+    epicLog(LOG_WARNING, "FetchAdd failed");
+  } else {
+    ret = (int64_t)wr->key;
+  }
+
+  this->txCommit();
+  return ret;
+}
+
 int Farm::kv_put(uint64_t key, const void* value, size_t count, int node_id) {
   bool newtx = false;
   if(likely(tx_ == nullptr)) newtx = true;
@@ -335,3 +635,47 @@ int Farm::kv_get(uint64_t key, void* value, int node_id) {
   return ret;
 }
 //从指定节点获取键值，如果事务未开始则开始事务，发送获取请求，提交事务并返回结果
+
+/*
+ * the items are served by reader contexts of the txn (see
+ * Worker::FarmProcessLocalKVMany), whose results are copied back here
+ */
+int Farm::kv_many(Work op, KVItem* items, int n) {
+  if (n <= 0) return 0;
+  bool newtx = false;
+  if(likely(tx_ == nullptr)) newtx = true;
+  if(newtx) this->txBegin();
+  WorkRequest* wr = this->tx_->wr_;
+  wr->op = op;
+  wr->ptr = items;
+  wr->size = n;
+
+  int ret = 0;
+  if (wh_->SendRequest(wr)) {
+    epicLog(LOG_INFO, "%s failed", workToStr(op));
+  } else {
+    for (int i = 0; i < n; i++) {
+      WorkRequest* r = tx_->getReader(i)->wr_;
+      items[i].status = r->status;
+      if (r->status != SUCCESS) continue;
+      if (op == KV_GET_MANY) items[i].size = r->size;
+      ret++;
+    }
+  }
+
+  if(newtx) this->txCommit();
+  return ret;
+}
+
+/*
+ * get the values of items[i].key from worker items[i].node_id into
+ * items[i].value (large enough for them), setting items[i].size and status
+ */
+int Farm::kv_get_many(KVItem* items, int n) {
+  return kv_many(KV_GET_MANY, items, n);
+}
+
+/* put items[i].size bytes of items[i].value to items[i].key, setting items[i].status */
+int Farm::kv_put_many(KVItem* items, int n) {
+  return kv_many(KV_PUT_MANY, items, n);
+}
@@ -0,0 +1,431 @@
+// Copyright (c) 2018 The GAM Authors
+
+#include "farm_btree.h"
+#include "log.h"
+#include "kernel.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+using std::vector;
+using std::string;
+
+//the largest object that can be read remotely in one msg
+#define FARM_BTREE_OBJECT_MAX (MAX_REQUEST_SIZE - FARM_MSG_HDR_SIZE - FARM_OBJECT_HEADER_SIZE)
+
+bool FarmBTreeCache::Get(GAddr a, string& buf, version_t& v) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto it = nodes_.find(a);
+  if (it == nodes_.end()) {
+    misses++;
+    return false;
+  }
+  hits++;
+  v = it->second.first;
+  buf = it->second.second;
+  return true;
+}
+
+void FarmBTreeCache::Put(GAddr a, version_t v, const string& buf) {
+  std::lock_guard<std::mutex> lock(lock_);
+  nodes_[a] = std::make_pair(v, buf);
+}
+
+void FarmBTreeCache::Drop(GAddr a) {
+  std::lock_guard<std::mutex> lock(lock_);
+  nodes_.erase(a);
+}
+
+FarmBTree::FarmBTree(Farm* f, FarmBTreeCache* cache): f_(f), cache_(cache) {
+  if (!cache_) {
+    own_cache_.reset(new FarmBTreeCache);
+    cache_ = own_cache_.get();
+  }
+}
+
+void FarmBTree::Init(GAddr meta, const FarmBTreeMeta& m) {
+  meta_ = meta;
+  vsize_ = m.vsize;
+  node_size_ = m.node_size;
+  icap_ = (node_size_ - sizeof(FarmBTreeHdr) - sizeof(GAddr)) / (sizeof(uint64_t) + sizeof(GAddr));
+  lcap_ = (node_size_ - sizeof(FarmBTreeHdr)) / (sizeof(uint64_t) + vsize_);
+  wids_.assign(m.wids, m.wids + m.nwids);
+  //so that the handles do not put their first nodes on the same worker
+  place_ = rand();
+}
+
+GAddr FarmBTree::Create(uint32_t vsize, const vector<uint16_t>& wids, uint32_t node_size) {
+  FarmBTreeMeta m;
+  memset(&m, 0, sizeof(m));
+  m.magic = FARM_BTREE_MAGIC;
+  m.vsize = vsize;
+  m.node_size = node_size;
+  m.height = 1;
+  m.nwids = std::min(wids.size(), (size_t)FARM_BTREE_MAX_WIDS);
+  std::copy(wids.begin(), wids.begin() + m.nwids, m.wids);
+
+  if (node_size > FARM_BTREE_OBJECT_MAX || node_size < sizeof(FarmBTreeHdr) + 4 * (sizeof(uint64_t) + vsize)) {
+    epicLog(LOG_WARNING, "cannot create a tree of %u-byte nodes with %u-byte values", node_size, vsize);
+    return Gnullptr;
+  }
+  Init(Gnullptr, m);
+
+  f_->txBegin();
+  //an empty leaf as the root
+  m.root = NewNode();
+  GAddr meta = f_->txAlloc(sizeof(m));
+  if (!m.root || !meta) {
+    f_->txAbort();
+    return Gnullptr;
+  }
+  Write(m.root, string(node_size_, 0), false);
+  f_->txWrite(meta, (const char*)&m, sizeof(m));
+  if (f_->txCommit()) return Gnullptr;
+
+  Init(meta, m);
+  epicLog(LOG_INFO, "created tree %lx of %u/%u keys per internal node/leaf over %u workers",
+      meta, icap_, lcap_, m.nwids);
+  return meta;
+}
+
+int FarmBTree::Open(GAddr meta) {
+  FarmBTreeMeta m;
+
+  f_->txBegin();
+  if (f_->txRead(meta, (char*)&m, sizeof(m)) != sizeof(m) || m.magic != FARM_BTREE_MAGIC) {
+    epicLog(LOG_WARNING, "%lx is not the meta of a tree", meta);
+    f_->txAbort();
+    return -1;
+  }
+  f_->txAbort();
+
+  Init(meta, m);
+  return 0;
+}
+
+/*
+ * read node @param a into @param buf in the txn. The meta and the internal
+ * nodes (@param cached) are taken from the cache if the txn has not read them,
+ * and put into the cache when read from their workers.
+ */
+bool FarmBTree::Fetch(GAddr a, string& buf, bool cached) {
+  version_t v = f_->txVersion(a);
+  if (cached && v == 0 && cache_->Get(a, buf, v)) {
+    if (f_->txCachedRead(a, buf.data(), buf.size(), v) == 0) {
+      used_.push_back(a);
+      return true;
+    }
+  }
+
+  //the copy of the txn, if any, may have been written by it: never cache it
+  bool fresh = (f_->txVersion(a) == 0);
+  buf.resize(node_size_);
+  osize_t n = f_->txRead(a, &buf[0], node_size_);
+  if (n <= 0) {
+    epicLog(LOG_WARNING, "cannot read node %lx", a);
+    return false;
+  }
+  buf.resize(n);
+  if (cached && fresh && (v = f_->txVersion(a)) != 0)
+    cache_->Put(a, v, buf);
+  return true;
+}
+
+/*
+ * the nodes from the root down to the one of @param level keeping @param key
+ * return the height of the tree, -1 on error
+ */
+int FarmBTree::Traverse(uint64_t key, vector<FarmBTreeStep>& path, uint32_t level) {
+  string mbuf;
+  if (!Fetch(meta_, mbuf, true)) return -1;
+  FarmBTreeMeta* m = (FarmBTreeMeta*)&mbuf[0];
+
+  path.clear();
+  GAddr a = m->root;
+  for (int l = m->height - 1; l >= (int)level; l--) {
+    path.emplace_back();
+    FarmBTreeStep& s = path.back();
+    s.addr = a;
+    s.idx = 0;
+    if (!Fetch(a, s.buf, l > 0)) return -1;
+
+    char* n = &s.buf[0];
+    if (unlikely(Hdr(n)->level != l)) {
+      //a stale cached node; the txn will not commit
+      epicLog(LOG_INFO, "node %lx is of level %u rather than %d", a, Hdr(n)->level, l);
+      return -1;
+    }
+    if (l == level) break;
+    s.idx = std::upper_bound(Keys(n), Keys(n) + Hdr(n)->count, key) - Keys(n);
+    a = Children(n)[s.idx];
+  }
+  return m->height;
+}
+
+GAddr FarmBTree::NewNode() {
+  uint16_t wid = wids_.empty() ? 0 : wids_[place_++ % wids_.size()];
+  return f_->txAlloc(node_size_, EMPTY_GLOB(wid));
+}
+
+void FarmBTree::Write(GAddr a, const string& buf, bool internal) {
+  f_->txWrite(a, buf.data(), buf.size());
+  //the others shall read the new version once committed
+  if (internal) cache_->Drop(a);
+}
+
+void FarmBTree::LeafInsert(char* n, int pos, uint64_t key, const void* value) {
+  uint64_t* k = Keys(n);
+  char* v = Values(n);
+  int cnt = Hdr(n)->count;
+  memmove(k + pos + 1, k + pos, (cnt - pos) * sizeof(uint64_t));
+  memmove(v + (pos + 1) * vsize_, v + pos * vsize_, (cnt - pos) * vsize_);
+  k[pos] = key;
+  memcpy(v + pos * vsize_, value, vsize_);
+  Hdr(n)->count++;
+}
+
+void FarmBTree::InnerInsert(char* n, int pos, uint64_t key, GAddr right) {
+  uint64_t* k = Keys(n);
+  GAddr* c = Children(n);
+  int cnt = Hdr(n)->count;
+  memmove(k + pos + 1, k + pos, (cnt - pos) * sizeof(uint64_t));
+  memmove(c + pos + 2, c + pos + 1, (cnt - pos) * sizeof(GAddr));
+  k[pos] = key;
+  c[pos + 1] = right;
+  Hdr(n)->count++;
+}
+
+/*
+ * insert the separator @param sep of a new node @param right into the parents
+ * on @param path, splitting the full ones, and grow a new root if the root
+ * is split
+ */
+int FarmBTree::Split(vector<FarmBTreeStep>& path, uint64_t sep, GAddr right) {
+  while (!path.empty()) {
+    FarmBTreeStep& s = path.back();
+    char* n = &s.buf[0];
+    uint32_t cnt = Hdr(n)->count;
+    if (cnt < icap_) {
+      InnerInsert(n, s.idx, sep, right);
+      Write(s.addr, s.buf, true);
+      return 0;
+    }
+
+    GAddr ra = NewNode();
+    if (!ra) return -1;
+    vector<uint64_t> ks(Keys(n), Keys(n) + cnt);
+    vector<GAddr> cs(Children(n), Children(n) + cnt + 1);
+    ks.insert(ks.begin() + s.idx, sep);
+    cs.insert(cs.begin() + s.idx + 1, right);
+
+    //keys [0, half) stay, key[half] goes up, and the rest go right
+    uint32_t half = ks.size() / 2;
+    string rbuf(node_size_, 0);
+    char* r = &rbuf[0];
+    Hdr(r)->level = Hdr(n)->level;
+    Hdr(r)->count = ks.size() - half - 1;
+    Hdr(r)->next = Hdr(n)->next;
+    std::copy(ks.begin() + half + 1, ks.end(), Keys(r));
+    std::copy(cs.begin() + half + 1, cs.end(), Children(r));
+    Hdr(n)->count = half;
+    Hdr(n)->next = ra;
+    std::copy(ks.begin(), ks.begin() + half, Keys(n));
+    std::copy(cs.begin(), cs.begin() + half + 1, Children(n));
+    Write(s.addr, s.buf, true);
+    Write(ra, rbuf, true);
+
+    sep = ks[half];
+    right = ra;
+    path.pop_back();
+  }
+
+  string mbuf;
+  if (!Fetch(meta_, mbuf, true)) return -1;
+  FarmBTreeMeta* m = (FarmBTreeMeta*)&mbuf[0];
+  GAddr na = NewNode();
+  if (!na) return -1;
+
+  string nbuf(node_size_, 0);
+  char* n = &nbuf[0];
+  Hdr(n)->level = m->height;
+  Hdr(n)->count = 1;
+  Hdr(n)->next = Gnullptr;
+  Keys(n)[0] = sep;
+  Children(n)[0] = m->root;
+  Children(n)[1] = right;
+  Write(na, nbuf, true);
+
+  m->root = na;
+  m->height++;
+  Write(meta_, mbuf, true);
+  epicLog(LOG_INFO, "tree %lx grows to height %u", meta_, m->height);
+  return 0;
+}
+
+int FarmBTree::Get(uint64_t key, void* value) {
+  vector<FarmBTreeStep> path;
+  if (Traverse(key, path) < 0) return -1;
+
+  char* n = &path.back().buf[0];
+  uint64_t* k = Keys(n);
+  int cnt = Hdr(n)->count;
+  int pos = std::lower_bound(k, k + cnt, key) - k;
+  if (pos == cnt || k[pos] != key) return -1;
+
+  if (value) memcpy(value, Values(n) + pos * vsize_, vsize_);
+  return 0;
+}
+
+int FarmBTree::Put(uint64_t key, const void* value) {
+  vector<FarmBTreeStep> path;
+  if (Traverse(key, path) < 0) return -1;
+
+  FarmBTreeStep& s = path.back();
+  char* n = &s.buf[0];
+  uint64_t* k = Keys(n);
+  uint32_t cnt = Hdr(n)->count;
+  int pos = std::lower_bound(k, k + cnt, key) - k;
+
+  if (pos < cnt && k[pos] == key) {
+    memcpy(Values(n) + pos * vsize_, value, vsize_);
+    Write(s.addr, s.buf, false);
+    return 0;
+  }
+
+  if (cnt < lcap_) {
+    LeafInsert(n, pos, key, value);
+    Write(s.addr, s.buf, false);
+    return 0;
+  }
+
+  //split the leaf: the upper half goes to a new right sibling
+  GAddr ra = NewNode();
+  if (!ra) return -1;
+  uint32_t half = cnt / 2;
+  string rbuf(node_size_, 0);
+  char* r = &rbuf[0];
+  Hdr(r)->level = 0;
+  Hdr(r)->count = cnt - half;
+  Hdr(r)->next = Hdr(n)->next;
+  memcpy(Keys(r), k + half, (cnt - half) * sizeof(uint64_t));
+  memcpy(Values(r), Values(n) + half * vsize_, (cnt - half) * vsize_);
+  Hdr(n)->count = half;
+  Hdr(n)->next = ra;
+
+  if (pos <= half)
+    LeafInsert(n, pos, key, value);
+  else
+    LeafInsert(r, pos - half, key, value);
+  Write(s.addr, s.buf, false);
+  Write(ra, rbuf, false);
+
+  uint64_t sep = Keys(r)[0];
+  path.pop_back();
+  return Split(path, sep, ra);
+}
+
+int FarmBTree::Remove(uint64_t key) {
+  vector<FarmBTreeStep> path;
+  if (Traverse(key, path) < 0) return -1;
+
+  FarmBTreeStep& s = path.back();
+  char* n = &s.buf[0];
+  uint64_t* k = Keys(n);
+  char* v = Values(n);
+  int cnt = Hdr(n)->count;
+  int pos = std::lower_bound(k, k + cnt, key) - k;
+  if (pos == cnt || k[pos] != key) return -1;
+
+  memmove(k + pos, k + pos + 1, (cnt - pos - 1) * sizeof(uint64_t));
+  memmove(v + pos * vsize_, v + (pos + 1) * vsize_, (cnt - pos - 1) * vsize_);
+  Hdr(n)->count--;
+  Write(s.addr, s.buf, false);
+  return 0;
+}
+
+int FarmBTree::Commit() {
+  int ret = f_->txCommit();
+  if (ret) {
+    //some cached node may be stale
+    for (GAddr a: used_)
+      cache_->Drop(a);
+  }
+  used_.clear();
+  return ret;
+}
+
+int FarmBTree::Abort() {
+  used_.clear();
+  return f_->txAbort();
+}
+
+FarmBTreeIterator::FarmBTreeIterator(FarmBTree* t, uint64_t from, uint64_t to): t_(t), to_(to) {
+  vector<FarmBTreeStep> path;
+  if (t_->Traverse(from, path) < 0) return;
+
+  if (path.size() > 1) {
+    FarmBTreeStep& p = path[path.size() - 2];
+    AddLeaves(&p.buf[0], p.idx + 1);
+  }
+  leaf_.swap(path.back().buf);
+  uint64_t* k = t_->Keys(&leaf_[0]);
+  pos_ = std::lower_bound(k, k + t_->Hdr(&leaf_[0])->count, from) - k;
+  Settle();
+}
+
+/*
+ * queue the children of @param parent from @param from on, up to the one
+ * keeping to_
+ */
+void FarmBTreeIterator::AddLeaves(char* parent, int from) {
+  uint64_t* k = t_->Keys(parent);
+  GAddr* c = t_->Children(parent);
+  uint32_t cnt = t_->Hdr(parent)->count;
+
+  pnext_ = t_->Hdr(parent)->next;
+  for (int i = from; i <= cnt; i++) {
+    if (i > 0 && k[i - 1] > to_) {
+      pnext_ = Gnullptr;
+      break;
+    }
+    leaves_.push_back(c[i]);
+  }
+}
+
+bool FarmBTreeIterator::NextLeaf() {
+  if (leaves_.empty()) {
+    string pbuf;
+    if (!pnext_ || !t_->Fetch(pnext_, pbuf, true)) return false;
+    AddLeaves(&pbuf[0], 0);
+    if (leaves_.empty()) return false;
+  }
+
+  if (ahead_ == 0) {
+    ahead_ = std::min(leaves_.size(), (size_t)FARM_BTREE_SCAN_BATCH);
+    vector<GAddr> batch(leaves_.begin(), leaves_.begin() + ahead_);
+    t_->f_->txReadMany(batch.data(), ahead_);
+  }
+
+  GAddr a = leaves_.front();
+  leaves_.pop_front();
+  ahead_--;
+  pos_ = 0;
+  return t_->Fetch(a, leaf_, false);
+}
+
+void FarmBTreeIterator::Settle() {
+  while (pos_ >= t_->Hdr(&leaf_[0])->count) {
+    if (!NextLeaf()) {
+      valid_ = false;
+      return;
+    }
+  }
+  valid_ = (Key() <= to_);
+}
+
+void FarmBTreeIterator::Next() {
+  if (!valid_) return;
+  pos_++;
+  Settle();
+}
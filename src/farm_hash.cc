@@ -0,0 +1,378 @@
+// Copyright (c) 2018 The GAM Authors
+
+#include "farm_hash.h"
+#include "log.h"
+
+#include <cstring>
+#include <algorithm>
+
+using std::vector;
+using std::string;
+
+//the finalizer of murmur3, so that sequential keys are spread over the buckets
+static inline uint64_t mix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+void FarmHash::Init(GAddr root, const FarmHashMeta& m) {
+  root_ = root;
+  nbuckets_ = m.nbuckets;
+  slots_ = m.slots;
+  vsize_ = m.vsize;
+  hop_ = std::min(nbuckets_, (uint32_t)FARM_HASH_HOP);
+  bsize_ = FARM_HASH_BUCKET_HDR + slots_ * (FARM_HASH_ENTRY_HDR + vsize_);
+}
+
+GAddr FarmHash::Create(uint32_t nbuckets, uint32_t vsize, const vector<uint16_t>& wids, uint32_t slots) {
+  FarmHashMeta m;
+  m.magic = FARM_HASH_MAGIC;
+  m.nbuckets = nbuckets;
+  m.slots = slots;
+  m.vsize = vsize;
+  m.ndir = (nbuckets + FARM_HASH_DIR_FANOUT - 1) / FARM_HASH_DIR_FANOUT;
+  m.reserved = 0;
+
+  size_t bsize = FARM_HASH_BUCKET_HDR + (size_t)slots * (FARM_HASH_ENTRY_HDR + vsize);
+  size_t msize = sizeof(m) + m.ndir * sizeof(GAddr);
+  if (nbuckets == 0 || slots == 0 || bsize > FARM_HASH_OBJECT_MAX || msize > FARM_HASH_OBJECT_MAX) {
+    epicLog(LOG_WARNING, "cannot create a table of %u buckets of %u slots of %u bytes",
+        nbuckets, slots, vsize);
+    return Gnullptr;
+  }
+
+  //an empty bucket: no hop, all the slots free
+  Init(Gnullptr, m);
+  string empty(bsize, 0);
+  for (int i = 0; i < slots_; i++)
+    Len(Entry(&empty[0], i)) = -1;
+
+  //EMPTY_GLOB(0) lets the local worker allocate
+  vector<uint16_t> places(wids);
+  if (places.empty()) places.push_back(0);
+  int np = places.size();
+
+  //one txn per dir page and its buckets
+  vector<GAddr> buckets(nbuckets), dir(m.ndir), out;
+  for (uint32_t p = 0; p < m.ndir; p++) {
+    uint32_t from = p * FARM_HASH_DIR_FANOUT;
+    uint32_t to = std::min(nbuckets, from + FARM_HASH_DIR_FANOUT);
+
+    f_->txBegin();
+    //bucket i is put at places[i % np]
+    for (int k = 0; k < np; k++) {
+      int cnt = 0;
+      for (uint32_t i = from; i < to; i++)
+        if (i % np == k) cnt++;
+      if (!cnt) continue;
+
+      out.resize(cnt);
+      if (f_->txAllocMany(bsize, cnt, out.data(), EMPTY_GLOB(places[k])) != cnt) {
+        epicLog(LOG_WARNING, "cannot allocate the buckets at worker %d", places[k]);
+        f_->txAbort();
+        return Gnullptr;
+      }
+      int j = 0;
+      for (uint32_t i = from; i < to; i++) {
+        if (i % np != k) continue;
+        buckets[i] = out[j++];
+        f_->txWrite(buckets[i], empty.data(), bsize);
+      }
+    }
+
+    dir[p] = f_->txAlloc((to - from) * sizeof(GAddr), EMPTY_GLOB(places[p % np]));
+    if (!dir[p]) {
+      f_->txAbort();
+      return Gnullptr;
+    }
+    f_->txWrite(dir[p], (const char*)&buckets[from], (to - from) * sizeof(GAddr));
+    if (f_->txCommit()) {
+      epicLog(LOG_WARNING, "cannot commit dir page %u of the table", p);
+      return Gnullptr;
+    }
+  }
+
+  string root(msize, 0);
+  memcpy(&root[0], &m, sizeof(m));
+  memcpy(&root[sizeof(m)], dir.data(), m.ndir * sizeof(GAddr));
+  f_->txBegin();
+  GAddr r = f_->txAlloc(msize);
+  if (!r) {
+    f_->txAbort();
+    return Gnullptr;
+  }
+  f_->txWrite(r, root.data(), msize);
+  if (f_->txCommit()) return Gnullptr;
+
+  Init(r, m);
+  buckets_.swap(buckets);
+  epicLog(LOG_INFO, "created table %lx of %u buckets over %d workers", r, nbuckets, np);
+  return r;
+}
+
+int FarmHash::Open(GAddr root) {
+  string buf(FARM_HASH_OBJECT_MAX, 0);
+  FarmHashMeta m;
+
+  f_->txBegin();
+  osize_t n = f_->txRead(root, &buf[0], buf.size());
+  memcpy(&m, buf.data(), sizeof(m));
+  if (n < (osize_t)sizeof(m) || m.magic != FARM_HASH_MAGIC
+      || n < (osize_t)(sizeof(m) + m.ndir * sizeof(GAddr))) {
+    epicLog(LOG_WARNING, "%lx is not the root of a table", root);
+    f_->txAbort();
+    return -1;
+  }
+
+  //the dir pages are read in parallel
+  GAddr* dir = (GAddr*)&buf[sizeof(m)];
+  f_->txReadMany(dir, m.ndir);
+  vector<GAddr> buckets(m.nbuckets);
+  for (uint32_t p = 0; p < m.ndir; p++) {
+    uint32_t from = p * FARM_HASH_DIR_FANOUT;
+    osize_t len = (std::min(m.nbuckets, from + FARM_HASH_DIR_FANOUT) - from) * sizeof(GAddr);
+    if (f_->txRead(dir[p], (char*)&buckets[from], len) != len) {
+      epicLog(LOG_WARNING, "cannot read dir page %u of table %lx", p, root);
+      f_->txAbort();
+      return -1;
+    }
+  }
+  //the dir never changes once created
+  f_->txCommit();
+
+  Init(root, m);
+  buckets_.swap(buckets);
+  return 0;
+}
+
+uint32_t FarmHash::Home(uint64_t key) {
+  return mix64(key) % nbuckets_;
+}
+
+/*
+ * the copy of bucket b in this operation; the first load of a bucket is a
+ * txRead, so it joins the read set and gets validated at commit
+ */
+char* FarmHash::Load(uint32_t b) {
+  auto it = cache_.find(b);
+  if (it != cache_.end()) return &it->second[0];
+
+  string s(bsize_, 0);
+  if (f_->txRead(buckets_[b], &s[0], bsize_) != bsize_) {
+    epicLog(LOG_WARNING, "cannot read bucket %u (%lx)", b, buckets_[b]);
+    return nullptr;
+  }
+  return &cache_.emplace(b, std::move(s)).first->second[0];
+}
+
+void FarmHash::Flush() {
+  for (uint32_t b: dirty_)
+    f_->txWrite(buckets_[b], cache_.at(b).data(), bsize_);
+  dirty_.clear();
+}
+
+int FarmHash::Find(uint64_t key, uint32_t& b) {
+  uint32_t h = Home(key);
+  char* hb = Load(h);
+  if (!hb) return -1;
+
+  for (uint32_t d = 0; d < hop_; d++) {
+    if (!(Hop(hb) & (1u << d))) continue;
+    uint32_t x = (h + d) % nbuckets_;
+    char* xb = Load(x);
+    if (!xb) return -1;
+    for (int i = 0; i < slots_; i++) {
+      char* e = Entry(xb, i);
+      if (Len(e) >= 0 && Key(e) == key) {
+        b = x;
+        return i;
+      }
+    }
+  }
+  return -1;
+}
+
+bool FarmHash::HasHomed(char* bucket, uint32_t home) {
+  for (int i = 0; i < slots_; i++) {
+    char* e = Entry(bucket, i);
+    if (Len(e) >= 0 && Home(Key(e)) == home) return true;
+  }
+  return false;
+}
+
+/*
+ * find an entry kept before bucket b whose home is within FARM_HASH_HOP of b,
+ * and move it into the free slot i of b; the slot it leaves becomes the free
+ * one (b and i are updated). Farthest homes are tried first, as they move the
+ * free slot the most.
+ */
+bool FarmHash::Displace(uint32_t& b, int& i) {
+  for (uint32_t dist = hop_ - 1; dist > 0; dist--) {
+    uint32_t c = (b + nbuckets_ - dist) % nbuckets_;
+    char* cb = Load(c);
+    if (!cb) return false;
+
+    for (uint32_t j = 0; j < dist; j++) {
+      if (!(Hop(cb) & (1u << j))) continue;
+      uint32_t x = (c + j) % nbuckets_;
+      char* xb = Load(x);
+      if (!xb) return false;
+
+      for (int k = 0; k < slots_; k++) {
+        char* e = Entry(xb, k);
+        if (Len(e) < 0 || Home(Key(e)) != c) continue;
+
+        memcpy(Entry(Load(b), i), e, FARM_HASH_ENTRY_HDR + vsize_);
+        Len(e) = -1;
+        Hop(cb) |= 1u << dist;
+        if (!HasHomed(xb, c)) Hop(cb) &= ~(1u << j);
+        dirty_.insert(c);
+        dirty_.insert(x);
+        dirty_.insert(b);
+        b = x;
+        i = k;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+int FarmHash::Get(uint64_t key, void* value) {
+  cache_.clear();
+  dirty_.clear();
+
+  uint32_t b;
+  int i = Find(key, b);
+  if (i < 0) return -1;
+
+  char* e = Entry(Load(b), i);
+  if (value) memcpy(value, Value(e), Len(e));
+  return Len(e);
+}
+
+/*
+ * the home buckets of all the keys are read in one txReadMany, and then the
+ * neighbours of the keys not in their home buckets in another one, so that
+ * the reads to a worker go in the same batch
+ */
+int FarmHash::MultiGet(int n, const uint64_t* keys, void* values, int* lens) {
+  cache_.clear();
+  dirty_.clear();
+
+  vector<GAddr> addrs;
+  for (int k = 0; k < n; k++)
+    addrs.push_back(buckets_[Home(keys[k])]);
+  f_->txReadMany(addrs.data(), addrs.size());
+
+  addrs.clear();
+  for (int k = 0; k < n; k++) {
+    uint32_t h = Home(keys[k]);
+    char* hb = Load(h);
+    if (!hb) continue;
+
+    int i;
+    for (i = 0; i < slots_; i++) {
+      char* e = Entry(hb, i);
+      if (Len(e) >= 0 && Key(e) == keys[k]) break;
+    }
+    if (i < slots_) continue;
+
+    for (uint32_t d = 1; d < hop_; d++) {
+      if (Hop(hb) & (1u << d))
+        addrs.push_back(buckets_[(h + d) % nbuckets_]);
+    }
+  }
+  if (addrs.size()) f_->txReadMany(addrs.data(), addrs.size());
+
+  int found = 0;
+  for (int k = 0; k < n; k++) {
+    uint32_t b;
+    int i = Find(keys[k], b);
+    if (i < 0) {
+      lens[k] = -1;
+      continue;
+    }
+    char* e = Entry(Load(b), i);
+    memcpy((char*)values + (size_t)k * vsize_, Value(e), Len(e));
+    lens[k] = Len(e);
+    found++;
+  }
+  return found;
+}
+
+int FarmHash::Put(uint64_t key, const void* value, uint32_t len) {
+  if (len > vsize_) {
+    epicLog(LOG_WARNING, "value of %u bytes is longer than %u", len, vsize_);
+    return -1;
+  }
+  cache_.clear();
+  dirty_.clear();
+
+  uint32_t b;
+  int i = Find(key, b);
+  if (i < 0) {
+    //a new key: take the first free slot after its home
+    uint32_t h = Home(key);
+    uint32_t probe = std::min(nbuckets_, (uint32_t)FARM_HASH_PROBE);
+    uint32_t d;
+    for (d = 0; d < probe; d++) {
+      b = (h + d) % nbuckets_;
+      char* bb = Load(b);
+      if (!bb) return -1;
+      for (i = 0; i < slots_ && Len(Entry(bb, i)) >= 0; i++);
+      if (i < slots_) break;
+    }
+    if (d == probe) {
+      epicLog(LOG_INFO, "no free slot within %u buckets of key %lu", probe, key);
+      return -1;
+    }
+
+    //and hop it back into the neighbourhood of the home
+    while (d >= hop_) {
+      if (!Displace(b, i)) {
+        //nothing is written: the moves made so far are dropped with cache_
+        epicLog(LOG_INFO, "the neighbourhood of key %lu is full", key);
+        return -1;
+      }
+      d = (b + nbuckets_ - h) % nbuckets_;
+    }
+
+    char* hb = Load(h);
+    Hop(hb) |= 1u << d;
+    dirty_.insert(h);
+  }
+
+  char* e = Entry(Load(b), i);
+  Key(e) = key;
+  Len(e) = len;
+  memcpy(Value(e), value, len);
+  dirty_.insert(b);
+  Flush();
+  return 0;
+}
+
+int FarmHash::Remove(uint64_t key) {
+  cache_.clear();
+  dirty_.clear();
+
+  uint32_t b;
+  int i = Find(key, b);
+  if (i < 0) return -1;
+
+  char* bb = Load(b);
+  Len(Entry(bb, i)) = -1;
+  dirty_.insert(b);
+
+  uint32_t h = Home(key);
+  if (!HasHomed(bb, h)) {
+    Hop(Load(h)) &= ~(1u << ((b + nbuckets_ - h) % nbuckets_));
+    dirty_.insert(h);
+  }
+  Flush();
+  return 0;
+}
@@ -164,37 +164,38 @@ int TxnContext::generateCommitMsg(uint16_t wid, char* buf, int len) {
 /*获取可读对象：首先检查读集合中是否存在给定地址的对象，如果存在则返回该对象。
 否则检查写集合中是否存在该对象，如果存在则返回该对象*/
 Object* TxnContext::getReadableObject(GAddr addr) {
-  //if (read_set_[WID(addr)].count(addr) == 0) {
+  //if (read_set_[widOf(addr)].count(addr) == 0) {
   //    //createReadableObject(addr);
   //    return nullptr;
   //}
 
   Object* o = nullptr;
 
-  if (read_set_[WID(addr)].count(addr) > 0)
-    o = read_set_[WID(addr)][addr].get();
-  else if (write_set_[WID(addr)].count(addr) > 0)
-    o = write_set_[WID(addr)][addr].get();
+  if (read_set_[widOf(addr)].count(addr) > 0)
+    o = read_set_[widOf(addr)][addr].get();
+  else if (write_set_[widOf(addr)].count(addr) > 0)
+    o = write_set_[widOf(addr)][addr].get();
 
   return o;
 }
 
 Object* TxnContext::createReadableObject(GAddr addr) {
-  epicAssert(read_set_[WID(addr)].count(addr) == 0 && write_set_[WID(addr)].count(addr) == 0 && WID(addr) > 0);
+  epicAssert(read_set_[widOf(addr)].count(addr) == 0 && write_set_[widOf(addr)].count(addr) == 0 && widOf(addr) > 0);
 
   epicLog(LOG_DEBUG, "Txn %d creates a readable object for address %lx", this->wr_->id, addr);
 
-  this->read_set_[WID(addr)][addr] =
+  uint16_t wid = bindOwner(addr);
+  this->read_set_[wid][addr] =
     std::shared_ptr<Object>(new Object(this->buffer_, addr));
 
-  return read_set_[WID(addr)][addr].get();
+  return read_set_[wid][addr].get();
 }
 
 Object* TxnContext::getWritableObject(GAddr addr) {
-  //if (write_set_[WID(addr)].count(addr) == 0)
+  //if (write_set_[widOf(addr)].count(addr) == 0)
   //    return nullptr;
 
-  return write_set_[WID(addr)].count(addr) > 0 ? write_set_[WID(addr)][addr].get() : nullptr;
+  return write_set_[widOf(addr)].count(addr) > 0 ? write_set_[widOf(addr)][addr].get() : nullptr;
 }
 /*createWritableObject函数是TxnContext类的一部分，用于在事务上下文中创建一个可写的对象，
 该函数检查给定地址的对象是否已经存在于写集合中，如果不存在，则根据读集合中的对象或创建一个新的对象，
@@ -202,19 +203,20 @@ Object* TxnContext::getWritableObject(GAddr addr) {
 通过在写集合中创建可写对象，确保事务的隔离性，每个事务在自己的上下文中操作对象，不会直接影响其他事务。
 只有在需要写操作时才创建对象，避免不必要的内存分配，提高性能。*/
 Object* TxnContext::createWritableObject(GAddr addr) {//GAddr addr——全局地址，用于标识对象的位置
-  epicAssert(WID(addr) > 0); //使用断言检查地址的有效性，确保WID(addr)大于0
-  if (write_set_[WID(addr)].count(addr) == 0) { //检查写集合中是否已经存在给定地址的对象。如果不存在，则继续执行创建过程。
-    if ( read_set_[WID(addr)].count(addr) > 0) { //如果读集合中存在给定地址的对象，则共享该对象的所有权，将其添加到写集合中，避免重复创建对象，提高内存利用率
+  epicAssert(widOf(addr) > 0); //使用断言检查地址的有效性，确保WID(addr)大于0
+  bindOwner(addr);
+  if (write_set_[widOf(addr)].count(addr) == 0) { //检查写集合中是否已经存在给定地址的对象。如果不存在，则继续执行创建过程。
+    if ( read_set_[widOf(addr)].count(addr) > 0) { //如果读集合中存在给定地址的对象，则共享该对象的所有权，将其添加到写集合中，避免重复创建对象，提高内存利用率
       /* share the ownership of object */
-      this->write_set_[WID(addr)][addr] = this->read_set_[WID(addr)][addr];
+      this->write_set_[widOf(addr)][addr] = this->read_set_[widOf(addr)][addr];
     } else {  //如果读集合中不存在给定地址的对象，则创建一个新的对象，并将其添加到写集合中
-      this->write_set_[WID(addr)][addr] =
+      this->write_set_[widOf(addr)][addr] =
         std::shared_ptr<Object>(new Object(this->buffer_, addr));
     }
     //记录日志，指示事务创建了一个可写的对象
     epicLog(LOG_DEBUG, "Txn %d creates a writable object for address %lx", this->wr_->id, addr);
   }
-  return write_set_[WID(addr)][addr].get(); //返回写集合中给定地址的对象指针
+  return write_set_[widOf(addr)][addr].get(); //返回写集合中给定地址的对象指针
 }
 
 void TxnContext::getWidForRobj(std::vector<uint16_t>& wid) {
@@ -242,6 +244,22 @@ void TxnContext::reset() {
 
   this->write_set_.clear();
   this->read_set_.clear();
+  this->owners_.clear();
   this->buffer_.clear();
   this->wr_->tx = this; //wr_是一个指向工作请求对象的指针，tx是工作请求对象中的事务指针。将当前事务上下文与工作请求对象关联起来，确保工作请求能够正确访问当前事务的上下文。
 }
+
+/*
+ * the reads of Farm::txReadMany are issued in parallel, each by a reader
+ * context of its own so that it has its own wr_ (and thus txn id) in flight;
+ * the objects read go into the read set of this context
+ */
+TxnContext* TxnContext::getReader(int i) {
+  while (readers_.size() <= i) {
+    TxnContext* r = new TxnContext;
+    r->reset();
+    r->regions_ = regions_;
+    readers_.push_back(std::unique_ptr<TxnContext>(r));
+  }
+  return readers_[i].get();
+}
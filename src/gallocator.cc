@@ -22,6 +22,16 @@ GAddr GAlloc::Malloc(const Size size, Flag flag){ //定义GAlloc类的Malloc成
     return addr; //返回分配的地址
 }
 
+int GAlloc::MallocMany(const Size size, int n, GAddr* out, GAddr placement){
+    int ret = 0;
+    while (1){
+        this->txBegin();
+        ret = this->txAllocMany(size, n, out, placement);
+        if (this->txCommit() == 0) break;
+    }
+    return ret;
+}
+
 GAddr GAlloc::AlignedMalloc(const Size size, Flag flag){ //定义GAlloc类的AlignedMalloc成员函数
     return this->Malloc(size, flag); //调用Malloc函数
 }
@@ -78,12 +88,21 @@ void GAlloc:: txBegin(){ //定义GAlloc类的txBegin成员函数
 GAddr GAlloc::txAlloc(size_t size, GAddr a){ //定义GAlloc类的txAlloc成员函数
 	return farm->txAlloc(size, a); //调用farm的txFree函数
 }
+int GAlloc::txAllocMany(size_t size, int n, GAddr* out, GAddr a){
+    return this->farm->txAllocMany(size, n, out, a);
+}
+GAddr GAlloc::txAllocGroup(size_t size, uint64_t group){
+    return this->farm->txAllocGroup(size, group);
+}
 void GAlloc::txFree(GAddr addr){ // 定义 GAlloc 类的 txFree 成员函数
 	farm->txFree(addr); // 调用 farm 的 txFree 函数
 }
 int GAlloc::txRead(GAddr addr, void* ptr, osize_t sz){ // 定义 GAlloc 类的 txRead 成员函数
 	return farm->txRead(addr, reinterpret_cast<char*>(ptr), sz); // 调用 farm 的 txRead 函数
 }
+int GAlloc::txReadMany(const GAddr* addrs, int n) {
+	return farm->txReadMany(addrs, n);
+}
 int GAlloc::txRead(GAddr addr, const Size offset, void* ptr, osize_t sz){// 定义 GAlloc 类的 txRead 成员函数
     return farm->txPartialRead(addr, offset, reinterpret_cast<char*>(ptr), sz); //调用farm的txPartialRead函数
 }
@@ -112,6 +131,22 @@ Size GAlloc::Get(uint64_t key, void* value) { //定义GAlloc类的Get成员函
     return farm->get(key, value); //调用farm的get函数
 }
 
+int GAlloc::Barrier(int nthreads) {
+    return farm->barrier(nthreads);
+}
+
+int GAlloc::Barrier(uint64_t name, int participants) {
+    return farm->coord_barrier(name, participants);
+}
+
+int GAlloc::Watch(uint64_t key, void* value, uint64_t& version, int timeout_ms) {
+    return farm->watch(key, value, version, timeout_ms);
+}
+
+int64_t GAlloc::FetchAdd(uint64_t key, int64_t delta) {
+    return farm->fetch_add(key, delta);
+}
+
 int GAlloc::txKVGet(uint64_t key, void* value, int node_id){// 定义 GAlloc 类的 txKVGet 成员函数
 	return farm->kv_get(key, value, node_id) < 0;// 调用 farm 的 kv_get 函数
 }
@@ -126,3 +161,10 @@ int GAlloc::KVPut(uint64_t key, const void* value, size_t count, int node_id){//
 	return farm->kv_put(key, value, count, node_id) < 0;// 调用 farm 的 kv_put 函数
 }
 
+int GAlloc::KVGetMany(KVItem* items, int n) {
+	return farm->kv_get_many(items, n);
+}
+int GAlloc::KVPutMany(KVItem* items, int n) {
+	return farm->kv_put_many(items, n);
+}
+
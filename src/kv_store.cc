@@ -0,0 +1,164 @@
+// Copyright (c) 2018 The GAM Authors
+
+#include <cstring>
+#include "kv_store.h"
+#include "log.h"
+#include "kernel.h"
+
+//[uint64_t 0][Size size] in front of a value
+#define KV_BLOCK_HDR_SIZE (sizeof(uint64_t) + sizeof(Size))
+
+static inline Size BlockSize(char* block) {
+  return *(Size*)(block + sizeof(uint64_t));
+}
+
+//murmur3 finalizer, the keys are often small integers in a row
+static inline uint64_t KVHash(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+KVStore::KVStore(AllocFunc alloc, FreeFunc free, UsableFunc usable)
+    : alloc_(alloc), free_(free), usable_(usable),
+    table_(KV_STORE_MIN_CAPACITY, Entry{0, nullptr}), mask_(KV_STORE_MIN_CAPACITY - 1) {
+}
+
+KVStore::~KVStore() {
+  for (Entry& e: table_) {
+    if (e.block) free_(e.block);
+  }
+}
+
+size_t KVStore::Find(uint64_t key) {
+  size_t i = KVHash(key) & mask_;
+  while (table_[i].block && table_[i].key != key)
+    i = (i + 1) & mask_;
+  return i;
+}
+
+void KVStore::Grow() {
+  std::vector<Entry> old;
+  old.swap(table_);
+  table_.assign(old.size() * 2, Entry{0, nullptr});
+  mask_ = table_.size() - 1;
+  for (Entry& e: old) {
+    if (e.block) table_[Find(e.key)] = e;
+  }
+  epicLog(LOG_DEBUG, "kv index grows to %lu slots for %lu keys", table_.size(), count_);
+}
+
+char* KVStore::NewBlock(Size size) {
+  char* block = (char*)alloc_(KV_BLOCK_HDR_SIZE + size);
+  if (unlikely(block == nullptr)) {
+    epicLog(LOG_WARNING, "no memory for a value of %lu bytes", size);
+    return nullptr;
+  }
+  *(uint64_t*)block = 0;
+  *(Size*)(block + sizeof(uint64_t)) = size;
+  return block;
+}
+
+char* KVStore::Get(uint64_t key, Size& size) {
+  Entry& e = table_[Find(key)];
+  if (!e.block) return nullptr;
+  size = BlockSize(e.block);
+  return e.block + KV_BLOCK_HDR_SIZE;
+}
+
+char* KVStore::Put(uint64_t key, Size size) {
+  size_t i = Find(key);
+  Entry& e = table_[i];
+  if (e.block) {
+    Size old = BlockSize(e.block);
+    Size room = usable_(e.block) - KV_BLOCK_HDR_SIZE;
+    if (size <= room && size * 2 >= room) {
+      //overwrite in place
+      *(Size*)(e.block + sizeof(uint64_t)) = size;
+      bytes_ = bytes_ - old + size;
+      return e.block + KV_BLOCK_HDR_SIZE;
+    }
+    char* block = NewBlock(size);
+    if (!block) return nullptr;
+    free_(e.block);
+    e.block = block;
+    bytes_ = bytes_ - old + size;
+    return block + KV_BLOCK_HDR_SIZE;
+  }
+
+  char* block = NewBlock(size);
+  if (!block) return nullptr;
+  if ((count_ + 1) * 4 > table_.size() * 3) {
+    Grow();
+    i = Find(key);
+  }
+  table_[i] = Entry{key, block};
+  count_++;
+  bytes_ += size;
+  return block + KV_BLOCK_HDR_SIZE;
+}
+
+int KVStore::Put(uint64_t key, const void* value, Size size) {
+  char* p = Put(key, size);
+  if (!p) return -1;
+  memcpy(p, value, size);
+  return 0;
+}
+
+bool KVStore::Remove(uint64_t key) {
+  size_t i = Find(key);
+  if (!table_[i].block) return false;
+  bytes_ -= BlockSize(table_[i].block);
+  free_(table_[i].block);
+  count_--;
+
+  //move back the entries after it whose probe passes slot i
+  size_t j = i;
+  while (true) {
+    j = (j + 1) & mask_;
+    if (!table_[j].block) break;
+    size_t k = KVHash(table_[j].key) & mask_;
+    bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+    if (stays) continue;
+    table_[i] = table_[j];
+    i = j;
+  }
+  table_[i].block = nullptr;
+  return true;
+}
+
+char* KVStore::Alloc(Size size) {
+  char* block = NewBlock(size);
+  return block ? block + KV_BLOCK_HDR_SIZE : nullptr;
+}
+
+void KVStore::Install(uint64_t key, char* value) {
+  char* block = value - KV_BLOCK_HDR_SIZE;
+  size_t i = Find(key);
+  if (table_[i].block) {
+    bytes_ -= BlockSize(table_[i].block);
+    free_(table_[i].block);
+  } else {
+    if ((count_ + 1) * 4 > table_.size() * 3) {
+      Grow();
+      i = Find(key);
+    }
+    table_[i].key = key;
+    count_++;
+  }
+  table_[i].block = block;
+  bytes_ += BlockSize(block);
+}
+
+void KVStore::Release(char* value) {
+  free_(value - KV_BLOCK_HDR_SIZE);
+}
+
+void KVStore::GetBlocks(std::unordered_set<void*>& out) {
+  for (auto& e : table_) {
+    if (e.block) out.insert(e.block);
+  }
+}
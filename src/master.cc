@@ -12,18 +12,25 @@
 #include "tcp.h"
 #include "settings.h"
 #include "structure.h"
+#include "chars.h"
+#include "util.h"
 
 Master* MasterFactory::server = nullptr;
 
-Master::Master(const Conf& conf): st(nullptr), workers(), unsynced_workers() {  //master的创建过程
+#define WATCH_SWEEP_INTERVAL 10 //ms, granularity of the WATCH timeouts
+
+Master::Master(const Conf& conf): st(nullptr), workers(), unsynced_workers(),
+    kvs(zmalloc, zfree, [](void* ptr) {return (size_t)zmalloc_size(ptr);}) {  //master的创建过程
 
   this->conf = &conf;
 
   //get the RDMA resource
-  resource = RdmaResourceFactory::getMasterRdmaResource();
+  resource = TransportResourceFactory::getMasterResource(conf);
+  resource->SetExpectedPeers(conf.no_node);  //the credit windows are sized for all the workers
 
   //create the event loop
   el = aeCreateEventLoop(conf.maxthreads+conf.maxclients+EVENTLOOP_FDSET_INCR);
+  resource->SetEventLoop(el);  //the sockets of the tcp transport are file events of the loop
 
   //open the socket for listening to the connections from workers to exch rdma resouces
   /*这段代码的作用是创建一个TCP服务器，并绑定到指定的地址和端口。如果绑定失败，则记录错误日志并退出程序，以下是代码的详细解释*/
@@ -82,6 +89,14 @@ Master::Master(const Conf& conf): st(nullptr), workers(), unsynced_workers() {
         resource->GetChannelFd(), AE_READABLE, ProcessRdmaRequestHandle, this) == AE_ERR) {
     epicPanic("Unrecoverable error creating sockfd file event.");
   }
+  //周期性地广播变化了的内存统计信息
+  if (aeCreateTimeEvent(el, conf.stats_interval, MemStatsBroadcaster, this, NULL) == AE_ERR) {
+    epicPanic("Unrecoverable error creating time event.");
+  }
+  //超时的WATCH
+  if (aeCreateTimeEvent(el, WATCH_SWEEP_INTERVAL, WatchSweeper, this, NULL) == AE_ERR) {
+    epicPanic("Unrecoverable error creating time event.");
+  }
   //epicLog函数记录一条信息日志，表示开始主事件循环
   epicLog(LOG_INFO, "start master eventloop\n");
   //create the Master thread to start service
@@ -113,33 +128,58 @@ Master::Master(const Conf& conf): st(nullptr), workers(), unsynced_workers() {
 //   return 0;
 // }
 
+/*
+ * tell the joining worker (data: its client) the workers joined before it,
+ * as [uint32_t len][wid:ip:port,...], and the owners of the moved regions, as
+ * [uint64_t epoch][uint32_t n][n region records], get the ip:port it listens
+ * at, and tell it to the others with a WORKER_JOIN msg. The list has no size limit.
+ */
 int Master::PostAcceptWorker(int fd, void* data) {
-  if(worker_ips.length() == 0) {
-    if(1 != write(fd, " ", 1)) {
-      epicLog(LOG_WARNING, "Unable to send worker ip list\n");
-      return -1;
-    }
-  } else {
-    if(worker_ips.length() != write(fd, worker_ips.c_str(), worker_ips.length())) {
-      epicLog(LOG_WARNING, "Unable to send worker ip list\n");
-      return -1;
-    }
-    epicLog(LOG_DEBUG, "send: %s", worker_ips.c_str());
+  Client* cli = (Client*)data;
+  string list;
+  for (auto& w : worker_addrs) {
+    if (list.length()) list.append(",");
+    list.append(to_string(w.first)).append(":").append(w.second);
+  }
+  uint32_t len = list.length();
+  if (anetWrite(fd, (char*)&len, sizeof(len)) != sizeof(len)
+      || anetWrite(fd, const_cast<char*>(list.c_str()), len) != (int)len) {
+    epicLog(LOG_WARNING, "Unable to send worker ip list\n");
+    return -1;
+  }
+  epicLog(LOG_DEBUG, "send: %s", list.c_str());
 
-    worker_ips.append(",");
+  uint32_t nregions = region_owners.size();
+  string owners(sizeof(uint64_t) + sizeof(uint32_t) + nregions * REGION_RECORD_SIZE, '\0');
+  char* p = &owners[0];
+  p += appendInteger(p, region_epoch, nregions);
+  for (auto& r : region_owners)
+    p += appendInteger(p, r.first, r.second.first, r.second.second);
+  if (anetWrite(fd, &owners[0], owners.length()) != (int)owners.length()) {
+    epicLog(LOG_WARNING, "Unable to send region owners\n");
+    return -1;
   }
 
-  char msg[MAX_WORKERS_STRLEN+1];
-  int n = read(fd, msg, MAX_WORKERS_STRLEN);
+  char msg[MAX_IPPORT_STRLEN+1];
+  int n = read(fd, msg, MAX_IPPORT_STRLEN);
   if(n <= 0) {
     epicLog(LOG_WARNING, "Unable to receive worker ip:port\n");
     return -2;
   }
-  worker_ips.append(msg, n);
   msg[n] = '\0';
+  worker_addrs[cli->GetWorkerId()] = msg;
+  epicLog(LOG_DEBUG, "received: %s from worker %d, now %lu workers\n",
+      msg, cli->GetWorkerId(), worker_addrs.size());
 
-  epicLog(LOG_DEBUG, "received: %s, now worker list is %s (len=%d)\n", 
-      msg, worker_ips.c_str(), worker_ips.length());
+  WorkRequest lwr{};
+  lwr.op = WORKER_JOIN;
+  lwr.id = cli->GetWorkerId();
+  lwr.size = n;
+  lwr.ptr = msg;
+  char send_buf[MAX_REQUEST_SIZE];
+  int slen = 0;
+  lwr.Ser(send_buf, slen);
+  Broadcast(send_buf, slen, cli);
   return 0;
 }
 
@@ -170,6 +210,116 @@ Master::~Master() {
   delete st;
 }
 
+static inline int AppendMemStats(char* buf, Client* c) {
+  return appendInteger(buf, (int)c->GetWorkerId(), (Size)c->GetTotalMem(), (Size)c->GetFreeMem());
+}
+
+int Master::MemStatsBroadcaster(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+  Master* m = (Master*)clientData;
+  if (!m->unsynced_workers.empty())
+    m->BroadcastMemStats();
+  return m->conf->stats_interval;
+}
+
+/*
+ * answer a parked coordination request with COORD_REPLY and release it
+ */
+void Master::CoordReply(Client* client, WorkRequest* wr, uint64_t result,
+    const void* value, Size size, Status status) {
+  wr->op = COORD_REPLY;
+  wr->key = result;
+  wr->ptr = const_cast<void*>(value);
+  wr->size = size;
+  wr->status = status;
+  char* send_buf = client->GetFreeSlot();
+  bool busy = false;
+  if(send_buf == nullptr) {
+    busy = true;
+    send_buf = (char *)zmalloc(MAX_REQUEST_SIZE);
+    epicLog(LOG_INFO, "We don't have enough slot buf, we use local buf instead");
+  }
+
+  int len = 0, ret;
+  wr->Ser(send_buf, len);
+  if((ret = client->Send(send_buf, len)) != len) {
+    epicAssert(ret == -1);
+    epicLog(LOG_INFO, "slots are busy");
+  }
+  epicAssert((busy && ret == -1) || !busy);
+  delete wr;
+}
+
+//wake up the WATCHes of key that are older than its current value
+void Master::ServeWatches(uint64_t key) {
+  auto it = watches.find(key);
+  if (it == watches.end())
+    return;
+  uint64_t version = kv_versions[key];
+  Size size;
+  char* value = kvs.Get(key, size);
+  for (Waiter& w : it->second) {
+    if (w.deadline)
+      timed_watches--;
+    CoordReply(w.client, w.wr, version, value, size);
+  }
+  watches.erase(it);
+}
+
+int Master::WatchSweeper(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+  Master* m = (Master*)clientData;
+  if (!m->timed_watches)
+    return WATCH_SWEEP_INTERVAL;
+  long now = get_time();
+  for (auto it = m->watches.begin(); it != m->watches.end();) {
+    auto& ws = it->second;
+    for (size_t i = 0; i < ws.size();) {
+      if (ws[i].deadline && ws[i].deadline <= now) {
+        Waiter w = ws[i];
+        ws[i] = ws.back();
+        ws.pop_back();
+        m->timed_watches--;
+        m->CoordReply(w.client, w.wr, m->kv_versions[it->first], nullptr, 0, NOT_EXIST);
+      } else {
+        i++;
+      }
+    }
+    if (ws.empty())
+      it = m->watches.erase(it);
+    else
+      ++it;
+  }
+  return WATCH_SWEEP_INTERVAL;
+}
+
+/*
+ * send the stats of the workers changed since the last broadcast to all the workers,
+ * in msgs of at most MAX_MEM_STATS_RECORDS records, each with an epoch of its own
+ */
+void Master::BroadcastMemStats() {
+  WorkRequest lwr{};
+  lwr.op = BROADCAST_MEM_STATS;
+  char buf[MAX_MEM_STATS_RECORDS * MEM_STATS_RECORD_SIZE];
+  char send_buf[MAX_REQUEST_SIZE];
+  auto it = unsynced_workers.begin();
+  while (it != unsynced_workers.end()) {
+    int n = 0;
+    for (; it != unsynced_workers.end() && n < MAX_MEM_STATS_RECORDS; ++it) {
+      Client* lc = FindClientWid(*it);
+      if (lc) AppendMemStats(buf + n++ * MEM_STATS_RECORD_SIZE, lc);
+    }
+    if (n == 0) break;
+    lwr.key = ++stats_epoch;
+    lwr.size = n;
+    lwr.ptr = buf;
+    int len = 0;
+    lwr.Ser(send_buf, len);
+    Broadcast(send_buf, len);
+    epicLog(LOG_DEBUG, "broadcast mem stats of %d workers (epoch %lu)", n, stats_epoch);
+  }
+  unsynced_workers.clear();
+  last_broadcast = get_time();
+}
+
 /* 功能：解析来自远程客户端的请求消息-将消息内容反序列化为工作请求对象-调用对应的处理函数处理请求
  * 参数：client：发送请求的客户端对象；msg：接收到的消息内容；size：消息大小
  * 数据结构和关键变量：WorkRequest：工作请求对象，包括操作类型、数据地址、大小等信息
@@ -195,42 +345,44 @@ void Master::FarmProcessRemoteRequest(Client* client, const char* msg, uint32_t
 void Master::ProcessRequest(Client* client, WorkRequest* wr) {
   switch(wr->op) { //根据工作请求的操作类型(op)执行不同的处理逻辑 
     case UPDATE_MEM_STATS: //处理更新内存统计信息的请求-更新客户端的内存统计信息-如果未同步的工作节点数达到阈值，广播内存统计信息给所有客户端  
-    /* 数据结构和关键变量：unsynced_workers-未同步的工作节点队列，存储所有未同步的工作节点
+    /* 数据结构和关键变量：unsynced_workers-统计信息变化了但尚未广播的工作节点集合
      * conf->unsynced_th：未同步的工作节点的阈值；buf：存储广播消息内容的缓冲区；send_buf：存储序列化后的消息内容的缓冲区
      * 
      */
       {
-        Size curr_free = client->GetFreeMem(); //获取客户端当前的空闲内存大小
-        client->SetMemStat(wr->size, wr->free); //更新客户端的内存统计信息，包括总内存大小和空闲内存大小
-        unsynced_workers.push(client); //将客户端添加到未同步的工作节点队列unsynced_workers中 
-
-        if(unsynced_workers.size() == conf->unsynced_th) { //如果未同步的工作节点数达到阈值conf->unsynced_th，广播内存信息给所有客户端
-          //构造广播消息
-          WorkRequest lwr{}; //创建一个新的工作请求对象lwr
-          lwr.op = BROADCAST_MEM_STATS; //设置操作类型为BROADCAST_MEM_STATS 
-          char buf[conf->unsynced_th*MAX_MEM_STATS_SIZE+1]; //op + list + \0  //定义缓冲区buf用于存储广播消息内容
-          char send_buf[MAX_REQUEST_SIZE]; //定义发送缓冲区send_buf用于序列化消息
-          //遍历未同步的工作节点
-          int n = 0;
-          while(!unsynced_workers.empty()) { //遍历未同步的工作节点队列unsynced_workers
-            Client* lc = unsynced_workers.front(); //获取队列头部的工作节点
-            n += sprintf(buf+n, "%d:%ld:%ld", lc->GetWorkerId(), lc->GetTotalMem(), lc->GetFreeMem()); //使用sprintf将工作节点的ID、总内存和空闲内存格式化为字符串并追加到缓冲区buf中
-            unsynced_workers.pop(); //从队列中移除已处理的工作节点
-          }
-          //设置广播消息的内容
-          lwr.size = conf->unsynced_th; //设置工作请求对象lwr的大小为未同步的工作节点数conf->unsynced_th
-          lwr.ptr = buf; //设置工作请求对象lwr的指针指向消息内容缓冲区buf
-          int len = 0; //定义一个变量len，用于存储序列化后的消息长度
-          lwr.Ser(send_buf, len); //调用WorkRequest::Ser方法，将工作请求对象lwr序列化到发送缓冲区send_buf中，并记录序列化后的长度
-          Broadcast(send_buf, len); //使用Broadcast函数将内存统计信息广播给所有客户端 
-          // 插入日志信息，记录广播成功
-          epicLog(LOG_INFO, "Successfully broadcasted memory stats to all clients.");
-        } //删除工作请求对象
+        //只记录变化了的工作节点，作为增量广播
+        if (client->GetTotalMem() != wr->size || client->GetFreeMem() != wr->free) {
+          client->SetMemStat(wr->size, wr->free); //更新客户端的内存统计信息，包括总内存大小和空闲内存大小
+          unsynced_workers.insert(client->GetWorkerId());
+        }
+
+        //未同步的工作节点数达到阈值且距上次广播超过stats_interval时立即广播，否则由MemStatsBroadcaster定时广播
+        if (unsynced_workers.size() >= conf->unsynced_th
+            && get_time() - last_broadcast >= conf->stats_interval * 1000000L) {
+          BroadcastMemStats();
+        }
         // 插入日志信息，记录更新内存统计信息成功
         epicLog(LOG_INFO, "Successfully updated memory stats for client %d.", client->GetWorkerId());
         delete wr; //删除当前处理的工作请求wr，释放内存
         break; //退出case UPDATE_MEM_STATS的处理逻辑
       }
+    case BARRIER: //工作节点进入了一轮屏障(它已与其他所有工作节点建立连接)，全部no_node个工作节点到齐后一次广播放行
+      {
+        int& n = barriers[wr->id];
+        epicLog(LOG_INFO, "worker %d entered barrier %u (%d/%d)", client->GetWorkerId(), wr->id, n + 1, conf->no_node);
+        if (++n >= conf->no_node) {
+          barriers.erase(wr->id);
+          WorkRequest lwr{};
+          lwr.op = BARRIER_RELEASE;
+          lwr.id = wr->id;
+          char send_buf[MAX_REQUEST_SIZE];
+          int len = 0;
+          lwr.Ser(send_buf, len);
+          Broadcast(send_buf, len);
+        }
+        delete wr;
+        break;
+      }
     case FETCH_MEM_STATS: //处理获取内存统计信息的请求-构造内存统计信息回复消息并发送给请求的客户端
     /* 数据结构和关键变量：widCliMap:工作节点映射，存储所有工作节点的ID和对应的客户端对象
      * buf：存储回复消息内容的缓冲区；send_buf：存储序列化后的消息内容的缓冲区
@@ -241,40 +393,40 @@ void Master::ProcessRequest(Client* client, WorkRequest* wr) {
         if(widCliMap.size() == 1) { //only have the info of the worker, who sends the request
           break; //如果工作节点映射中只有发送请求的工作节点，则无需回复，直接退出处理逻辑。避免发送冗余的内存统计信息
         }
-        //构造回复消息
+        //构造回复消息：其他所有工作节点的统计信息(当前epoch的完整快照)，每条消息最多MAX_MEM_STATS_RECORDS条记录
         WorkRequest lwr{};  //创建一个新的工作请求lwr，。构造内存统计信息回复消息并发送给请求的客户端
         lwr.op = FETCH_MEM_STATS_REPLY; //设置操作类型为FETCH_MEM_STATS_REPLY
-        char buf[(widCliMap.size()-1) * MAX_MEM_STATS_SIZE + 1]; //op + list + \0 //定义缓冲区buf用于存储回复消息内容，大小为其他工作节点的数量乘以每个工作节点的最大内存统计信息大小
-        char* send_buf = client->GetFreeSlot(); //获取客户端的空闲缓冲区槽send_buf，用于发送回复消息
-        bool busy = false; //定义一个布尔变量busy，初始化为false，表示缓冲区未被临时分配。
-        //检查缓冲区是否可用
-        if(send_buf == nullptr) {  //如果没有可用的发送缓冲区槽
-          busy = true; //设置busy标志为true，记录日志说明使用了临时缓冲区
-          send_buf = (char *)zmalloc(MAX_REQUEST_SIZE); //使用中zamalloc动态分配一个临时缓冲区send_buf，大小为MAX_REQUEST_SIZE
-          epicLog(LOG_INFO, "We don't have enough slot buf, we use local buf instead");
-        } 
-
-        int n = 0, i = 0;
-        for (auto entry: widCliMap) { //遍历工作节点映射widCliMap
-          if(entry.first == client->GetWorkerId()) continue; //跳过发送请求的工作节点
-          Client* lc = entry.second;
-          n += sprintf(buf + n, "%d:%ld:%ld:", lc->GetWorkerId(), //将每个工作节点的ID、总内存和空闲内存格式化为字符串并追加到缓冲区buf中
-              lc->GetTotalMem(), lc->GetFreeMem());
-          i++; //记录处理的工作节点数量i
-        } //生成内存统计信息的回复内容
-        //设置回复消息的内容
-        lwr.size = widCliMap.size()-1; //设置工作请求对象lwr的大小为工作节点数量减去1（排除发送请求的工作节点）
-        epicAssert(widCliMap.size()-1 == i); //使用断言检查处理的工作节点数量是否与预期一致
-        lwr.ptr = buf; //设置工作请求对象lwr的指针指向消息内容缓冲区buf
-        //序列化工作请求对象lwr到发送缓冲区send_buf中
-        int len = 0, ret;
-        lwr.Ser(send_buf, len); //调用WorkRequest::Ser方法，将工作请求对象lwr序列化到发送缓冲区send_buf中，并记录序列化后的长度len
-        if((ret = client->Send(send_buf, len)) != len) { //调用Client::Send方法，将序列化后的消息发送给客户端
-          epicAssert(ret == -1); //如果发送失败或部分发送，记录日志并断言发送失败的原因是缓冲区槽繁忙(ret==-1)
-          epicLog(LOG_INFO, "slots are busy");
+        lwr.key = stats_epoch;
+        char buf[MAX_MEM_STATS_RECORDS * MEM_STATS_RECORD_SIZE];
+        auto it = widCliMap.begin();
+        while (it != widCliMap.end()) {
+          int n = 0;
+          for (; it != widCliMap.end() && n < MAX_MEM_STATS_RECORDS; ++it) { //遍历工作节点映射widCliMap
+            if(it->first == client->GetWorkerId()) continue; //跳过发送请求的工作节点
+            AppendMemStats(buf + n++ * MEM_STATS_RECORD_SIZE, it->second);
+          }
+          if (n == 0) break;
+
+          char* send_buf = client->GetFreeSlot(); //获取客户端的空闲缓冲区槽send_buf，用于发送回复消息
+          bool busy = false; //定义一个布尔变量busy，初始化为false，表示缓冲区未被临时分配。
+          //检查缓冲区是否可用
+          if(send_buf == nullptr) {  //如果没有可用的发送缓冲区槽
+            busy = true; //设置busy标志为true，记录日志说明使用了临时缓冲区
+            send_buf = (char *)zmalloc(MAX_REQUEST_SIZE); //使用中zamalloc动态分配一个临时缓冲区send_buf，大小为MAX_REQUEST_SIZE
+            epicLog(LOG_INFO, "We don't have enough slot buf, we use local buf instead");
+          }
+          lwr.size = n;
+          lwr.ptr = buf; //设置工作请求对象lwr的指针指向消息内容缓冲区buf
+          //序列化工作请求对象lwr到发送缓冲区send_buf中
+          int len = 0, ret;
+          lwr.Ser(send_buf, len); //调用WorkRequest::Ser方法，将工作请求对象lwr序列化到发送缓冲区send_buf中，并记录序列化后的长度len
+          if((ret = client->Send(send_buf, len)) != len) { //调用Client::Send方法，将序列化后的消息发送给客户端
+            epicAssert(ret == -1); //如果发送失败或部分发送，记录日志并断言发送失败的原因是缓冲区槽繁忙(ret==-1)
+            epicLog(LOG_INFO, "slots are busy");
+          }
+          epicAssert((busy && ret == -1) || !busy); //断言发送结果是否符合预期：
+          //如果缓冲区是临时分配(busy==true)，发送失败(ret==-1)是可以接受的，如果缓冲区不是临时分配的(busy==false)，则发送应该成功(ret!=-1)。
         }
-        epicAssert((busy && ret == -1) || !busy); //断言发送结果是否符合预期：
-        //如果缓冲区是临时分配(busy==true)，发送失败(ret==-1)是可以接受的，如果缓冲区不是临时分配的(busy==false)，则发送应该成功(ret!=-1)。
         // 插入日志信息，记录内存统计信息回复成功
         epicLog(LOG_INFO, "Successfully sent memory stats reply to client %d.", client->GetWorkerId());
         delete wr; //删除当前处理的工作请求wr，释放内存
@@ -282,9 +434,9 @@ void Master::ProcessRequest(Client* client, WorkRequest* wr) {
       }
     case PUT: //键值存储PUT
       {
-        void* ptr = zmalloc(wr->size);
-        memcpy(ptr, wr->ptr, wr->size);
-        kvs[wr->key] = pair<void*, Size>(ptr, wr->size); //将键值对存储到kvs中
+        if (kvs.Put(wr->key, wr->ptr, wr->size)) //将键值对存储到kvs中(放得下时原地覆盖)
+          epicLog(LOG_FATAL, "cannot store key %lu of %lu bytes", wr->key, wr->size);
+        kv_versions[wr->key]++;
 
         //epicLog(LOG_WARNING, "key = %d, value = %lx", wr->key, *(GAddr*)kvs[wr->key].first);
 
@@ -319,14 +471,17 @@ void Master::ProcessRequest(Client* client, WorkRequest* wr) {
           epicAssert(to_serve_kv_request[wr->key].size() == 0);
           to_serve_kv_request.erase(wr->key);
         }
+        ServeWatches(wr->key);
         delete wr;
         break;
       }
     case GET: //键值存储GET
       {
-        if(kvs.count(wr->key)) { //如果键值存在，构造回复消息并发送给客户端
-          wr->ptr = kvs.at(wr->key).first;
-          wr->size = kvs.at(wr->key).second;
+        Size size;
+        char* value = kvs.Get(wr->key, size);
+        if(value) { //如果键值存在，构造回复消息并发送给客户端
+          wr->ptr = value;
+          wr->size = size;
           wr->op = GET_REPLY;
           wr->status = SUCCESS;
           char* send_buf = client->GetFreeSlot();
@@ -349,6 +504,103 @@ void Master::ProcessRequest(Client* client, WorkRequest* wr) {
           to_serve_kv_request[wr->key].push(pair<Client*, WorkRequest*>(client, wr));
         }
 
+        break;
+      }
+    case COORD_BARRIER: //命名屏障：同名的participants个调用到齐后一起放行
+      {
+        auto& arrived = coord_barriers[wr->key];
+        arrived.push_back(pair<Client*, WorkRequest*>(client, wr));
+        if (arrived.front().second->size != wr->size) {
+          epicLog(LOG_WARNING, "barrier %lu: %lu participants expected, but %lu by worker %d",
+              wr->key, arrived.front().second->size, wr->size, client->GetWorkerId());
+        }
+        if (arrived.size() >= arrived.front().second->size) {
+          uint64_t name = wr->key, n = arrived.size();
+          for (auto& p : arrived)
+            CoordReply(p.first, p.second, n);  //wr is released here
+          coord_barriers.erase(name);
+        }
+        break;
+      }
+    case WATCH: //已有比调用者更新的值则立即返回，否则挂起直到下一次PUT或超时
+      {
+        auto v = kv_versions.find(wr->key);
+        if (v != kv_versions.end() && v->second > wr->size) {
+          Size size;
+          char* value = kvs.Get(wr->key, size);
+          CoordReply(client, wr, v->second, value, size);
+        } else {
+          long deadline = wr->counter > 0 ? get_time() + wr->counter * 1000000L : 0;
+          if (deadline)
+            timed_watches++;
+          watches[wr->key].push_back(Waiter{client, wr, deadline});
+        }
+        break;
+      }
+    case FETCH_ADD:
+      {
+        int64_t& c = counters[wr->key];
+        int64_t old = c;
+        c += (int64_t)wr->size;
+        CoordReply(client, wr, (uint64_t)old);
+        break;
+      }
+    case REGION_MOVE: //区域key被迁移到工作节点counter，增量广播给所有工作节点(迁移源已知道，其余节点通过新的epoch发现遗漏)
+      {
+        auto& o = region_owners[wr->key];
+        if (wr->offset > o.second) {
+          o.first = wr->counter;
+          o.second = wr->offset;
+          char buf[REGION_RECORD_SIZE];
+          appendInteger(buf, wr->key, o.first, o.second);
+          WorkRequest lwr{};
+          lwr.op = REGION_MAP;
+          lwr.key = ++region_epoch;
+          lwr.size = 1;
+          lwr.ptr = buf;
+          char send_buf[MAX_REQUEST_SIZE];
+          int len = 0;
+          lwr.Ser(send_buf, len);
+          Broadcast(send_buf, len);
+          epicLog(LOG_INFO, "region %lx moved to worker %d (seq %u, epoch %lu)",
+              wr->key, o.first, o.second, region_epoch);
+        }
+        delete wr;
+        break;
+      }
+    case REGION_MAP: //工作节点发现漏掉了增量，发送完整的区域映射
+      {
+        SendRegionMap(client);
+        delete wr;
+        break;
+      }
+    case WORKER_LEAVE: //工作节点开始退出时通知其他节点不再向它分配；区域全部迁走(REQUEST_DONE)后从列表中移除并确认
+      {
+        char send_buf[MAX_REQUEST_SIZE];
+        int len = 0;
+        if (wr->flag & REQUEST_DONE) {
+          worker_addrs.erase(wr->id);
+          epicLog(LOG_INFO, "worker %d left, now %lu workers", wr->id, worker_addrs.size());
+          wr->Ser(send_buf, len);
+          char* buf = client->GetFreeSlot();
+          bool busy = false;
+          if (buf == nullptr) {
+            busy = true;
+            buf = (char *)zmalloc(MAX_REQUEST_SIZE);
+          }
+          memcpy(buf, send_buf, len);
+          int ret;
+          if ((ret = client->Send(buf, len)) != len) {
+            epicAssert(ret == -1);
+            epicLog(LOG_INFO, "slots are busy");
+          }
+          epicAssert((busy && ret == -1) || !busy);
+        } else {
+          epicLog(LOG_INFO, "worker %d is leaving", wr->id);
+          wr->Ser(send_buf, len);
+          Broadcast(send_buf, len, client);
+        }
+        delete wr;
         break;
       }
     default: //如果操作类型未知，记录警告日志
@@ -356,13 +608,47 @@ void Master::ProcessRequest(Client* client, WorkRequest* wr) {
       break;
   }
 }
+/*
+ * the whole region map to client, in msgs of at most MAX_REGION_RECORDS
+ * records, all of the current epoch (at least one msg, so that the epoch is told)
+ */
+void Master::SendRegionMap(Client* client) {
+  char buf[MAX_REGION_RECORDS * REGION_RECORD_SIZE];
+  WorkRequest lwr{};
+  lwr.op = REGION_MAP;
+  lwr.key = region_epoch;
+  auto it = region_owners.begin();
+  do {
+    int n = 0;
+    for (; it != region_owners.end() && n < MAX_REGION_RECORDS; ++it)
+      appendInteger(buf + n++ * REGION_RECORD_SIZE, it->first, it->second.first, it->second.second);
+    char* send_buf = client->GetFreeSlot();
+    bool busy = false;
+    if (send_buf == nullptr) {
+      busy = true;
+      send_buf = (char *)zmalloc(MAX_REQUEST_SIZE);
+      epicLog(LOG_INFO, "We don't have enough slot buf, we use local buf instead");
+    }
+    lwr.size = n;
+    lwr.ptr = buf;
+    int len = 0, ret;
+    lwr.Ser(send_buf, len);
+    if ((ret = client->Send(send_buf, len)) != len) {
+      epicAssert(ret == -1);
+      epicLog(LOG_INFO, "slots are busy");
+    }
+    epicAssert((busy && ret == -1) || !busy);
+  } while (it != region_owners.end());
+}
+
 /* 功能：将消息广播给所有客户端。通过遍历qpCliMap尝试使用客户端的空闲缓冲区发送消息。如果没有空闲缓冲区，则动态分配一个临时缓冲区
  * 参数：buf：要发送的消息内容；len：消息的长度
  * 数据结构和关键变量：qpCliMap：客户端映射表，存储所有客户端的连接信息
  * 函数包含了多种检查和断言，确保消息发送的正确性，并记录日志以便调试
  * */
-void Master::Broadcast(const char* buf, size_t len) {
+void Master::Broadcast(const char* buf, size_t len, Client* except) {
   for(auto entry: qpCliMap) {//遍历qpCliMap(一个unordered_map，存储了队列对编号qpn和对应客户端对象Client*的映射关系)中的每个客户端，对每个客户端执行广播操作
+    if (entry.second == except) continue;
     char* send_buf = entry.second->GetFreeSlot();// 调用客户端对象的GetFreeSlot方法获取一个可用的发送缓冲区，如果没有可用的发送缓冲区，则返回nullptr 
     bool busy = false; 
     if(send_buf == nullptr) {//检查是否成功获取到空闲的发送缓冲区槽
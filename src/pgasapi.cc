@@ -20,12 +20,13 @@ static std::unordered_map<std::thread::id, int> thread_to_alloc_map; //线程ID
 void InitSystem(const Conf* c){
     std::lock_guard<std::mutex> guard(init_lock);
     GAllocFactory::InitSystem(c);
-    sleep(10);
     no_thread = c->no_thread; //获取线程数
     alloc = new GAlloc*[no_thread];
     for (int i = 0; i < no_thread; ++i) {
         alloc[i] = GAllocFactory::CreateAllocator();
     }
+    //等待集群就绪：所有no_node个工作节点都已互相建立连接
+    alloc[0]->Barrier();
 }
 // 获取当前线程对应的分配器索引
 static int GetAllocIndexForThread() {
@@ -66,6 +67,11 @@ int dsmWrite(GAddr addr, void* buf, Size count) {
     return alloc[index]->Write(addr, buf, count);
 }
 
+int dsmBarrier(int nthreads) {
+    int index = GetAllocIndexForThread(); // 获取当前线程对应的分配器索引
+    return alloc[index]->Barrier(nthreads);
+}
+
 void dsmFree(GAddr addr) {
     int index = GetAllocIndexForThread(); // 获取当前线程对应的分配器索引 
     //thread_local GAlloc* allocator = GAllocFactory::CreateAllocator();
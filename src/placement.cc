@@ -0,0 +1,132 @@
+// Copyright (c) 2018 The GAM Authors
+
+#include <cstdlib>
+#include "placement.h"
+#include "settings.h"
+#include "log.h"
+#include "util.h"
+
+#define PLACEMENT_FREE_STEPS 64
+
+/*
+ * free memory in steps of 1/PLACEMENT_FREE_STEPS of the region per queued
+ * request: the stats of the others are only updated now and then, so the
+ * workers about as free are taken as equal instead of by a few stale bytes
+ */
+static inline double Score(const PlacementTarget& t) {
+  Size steps = t.total ? t.free * PLACEMENT_FREE_STEPS / t.total : 0;
+  return (double)steps / (1 + t.load);
+}
+
+/*the target in [from, targets.size()) with the most free memory and the room, -1 if none*/
+static int MostFree(const std::vector<PlacementTarget>& targets, Size size, size_t from) {
+  int best = -1;
+  for (size_t i = from; i < targets.size(); i++) {
+    if (targets[i].free >= size && (best < 0 || targets[i].free > targets[best].free))
+      best = i;
+  }
+  return best;
+}
+
+/*
+ * the better of two random targets in [from, targets.size()) that have the
+ * room (the first one on a tie); the most free one if neither of them has
+ * it. Two choices are enough to keep the workers from piling onto the same
+ * target between two mem stats broadcasts.
+ */
+static int TwoChoices(const std::vector<PlacementTarget>& targets, Size size, size_t from, unsigned int* seed) {
+  if (targets.size() <= from) return -1;
+  size_t n = targets.size() - from;
+  size_t a = from + rand_r(seed) % n;
+  size_t b = n > 1 ? from + (a - from + 1 + rand_r(seed) % (n - 1)) % n : a;
+
+  bool fa = targets[a].free >= size, fb = targets[b].free >= size;
+  if (fa && fb) return Score(targets[a]) >= Score(targets[b]) ? a : b;
+  if (fa) return a;
+  if (fb) return b;
+
+  return MostFree(targets, size, from);
+}
+
+/*
+ * here as long as there is the room, otherwise the most free of the others
+ */
+class LocalPlacement: public Placement {
+ public:
+  int Place(const std::vector<PlacementTarget>& targets, Size size) {
+    if (targets[0].free >= size) return 0;
+    return MostFree(targets, size, 1);
+  }
+};
+
+/*
+ * here while the free memory stays above cache_th of the region, elsewhere
+ * by two choices once below it (or here again if nobody else has the room)
+ */
+class LocalFirstPlacement: public Placement {
+  double th_;
+  unsigned int seed_;
+
+ public:
+  LocalFirstPlacement(double th): th_(th), seed_(get_time()) {}
+
+  int Place(const std::vector<PlacementTarget>& targets, Size size) {
+    const PlacementTarget& local = targets[0];
+    if (local.free >= size && local.free - size >= th_ * local.total) return 0;
+    int i = TwoChoices(targets, size, 1, &seed_);
+    if (i < 0 && local.free >= size) i = 0;
+    return i;
+  }
+};
+
+/*
+ * two choices among all the workers, this one included
+ */
+class TwoChoicesPlacement: public Placement {
+  unsigned int seed_;
+
+ public:
+  TwoChoicesPlacement(): seed_(get_time()) {}
+
+  int Place(const std::vector<PlacementTarget>& targets, Size size) {
+    return TwoChoices(targets, size, 0, &seed_);
+  }
+};
+
+static inline uint64_t GroupHash(uint64_t group, int wid) {
+  uint64_t k = group ^ ((uint64_t)wid * 0x9E3779B97F4A7C15ULL);
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+int Placement::PlaceGroup(const std::vector<PlacementTarget>& targets, uint64_t group, Size size) {
+  int best = -1;
+  uint64_t max = 0;
+  for (size_t i = 0; i < targets.size(); i++) {
+    if (targets[i].free < size) continue;
+    uint64_t h = GroupHash(group, targets[i].wid);
+    if (best < 0 || h > max) {
+      best = i;
+      max = h;
+    }
+  }
+  return best;
+}
+
+Placement* Placement::Create(const Conf& conf) {
+  switch (conf.alloc_policy) {
+    case ALLOC_LOCAL:
+      return new LocalPlacement();
+    case ALLOC_LOCAL_FIRST:
+      return new LocalFirstPlacement(conf.cache_th);
+    case ALLOC_TWO_CHOICES:
+      return new TwoChoicesPlacement();
+    default:
+      epicLog(LOG_FATAL, "unknown alloc policy %d", conf.alloc_policy);
+      return nullptr;
+  }
+}
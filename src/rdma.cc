@@ -5,6 +5,7 @@
 #include <cerrno>
 #include <cstring>
 #include <climits>
+#include <algorithm>
 #include <arpa/inet.h>
 
 #include "rdma.h"
@@ -21,9 +22,11 @@ int MAX_RDMA_INLINE_SIZE = 256;
 RdmaResource::RdmaResource (ibv_device *dev, bool master) :
   device (dev), isForMaster(master),
   base (nullptr), bmr(nullptr), size(0),
-  rdma_context_counter (0), slot_inuse(0), slot_head(0) {
+  rdma_context_counter (0), slot_inuse(0), slot_head(0),
+  slot_promised(0), slot_spare(0), expected_peers(0) {
 
   int rx_depth;
+  ibv_device_attr dev_attr;
 
   if (!(context = ibv_open_device(dev))) { //打开RDMA设备上下文
     epicLog(LOG_FATAL, "unable to get context for %s\n",
@@ -41,8 +44,17 @@ RdmaResource::RdmaResource (ibv_device *dev, bool master) :
     goto clean_channel;
   }
 
-  rx_depth = (isForMaster) ?  //根据是否是主节点设置接收深度
-    MASTER_RDMA_SRQ_RX_DEPTH : WORKER_RDMA_SRQ_RX_DEPTH;
+  //接收深度取设备允许的最大值，集群规模不再受编译期常量限制(接收槽只为实际建立的连接提交)
+  if (ibv_query_device(this->context, &dev_attr)) {
+    epicLog(LOG_FATAL, "Unable to query device %s\n", ibv_get_device_name (dev));
+    goto clean_pd;
+  }
+  rx_depth = MAX_SRQ_RX_DEPTH;
+  if (rx_depth > dev_attr.max_srq_wr) rx_depth = dev_attr.max_srq_wr;
+  if ((rx_depth << 1) + 1 > dev_attr.max_cqe) rx_depth = (dev_attr.max_cqe - 1) >> 1;
+  srq_depth = rx_depth;
+  epicLog(LOG_INFO, "srq depth = %d, i.e., at most %d peers", rx_depth,
+      rx_depth / CREDIT_WINDOW_MIN);
 
   if (!(cq = ibv_create_cq(this->context, //创建完成队列
           (rx_depth << 1) + 1, NULL, this->channel, 0))) {
@@ -105,6 +117,8 @@ RdmaResource::~RdmaResource () {
     ibv_dereg_mr (mr);
     zfree (mr->addr);
   }
+  for (auto mr: mrs)
+    ibv_dereg_mr (mr);
 }
 
 /*
@@ -119,11 +133,23 @@ int RdmaResource::RegLocalMemory(void *base, size_t sz) {
    * this->base检查是否已经有内存区域被注册，如果base不为空，说明已经注册过内存区域
    * this->bmr检查是否已经有内存区域被注册，如果bmr不为空，说明已经注册过内存区域 
    * isForMaster检查是否是主节点，如果是主节点，则不允许注册内存区域
+   * 已注册过时，新的内存区域是运行时增长的部分，单独注册为一个mr
    */
-  if (this->base || this->bmr || isForMaster) { 
-    epicLog(LOG_WARNING, "An mr has already be registered or I am a master\n");
+  if (isForMaster) {
+    epicLog(LOG_WARNING, "I am a master\n");
     return ret;
   }
+  if (this->base || this->bmr) {
+    ibv_mr* mr = ibv_reg_mr (this->pd, base, sz,
+        IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ);
+    if (!mr) {
+      epicLog(LOG_WARNING, "Unable to register mr for the region at %p with size %ld", base, sz);
+      return ret;
+    }
+    mrs.push_back(mr);
+    epicLog(LOG_INFO, "registered local memory region at %p with size %ld\n", base, sz);
+    return 0;
+  }
   //调用ibv_reg_mr函数将制定的内存区域注册为RDMA的本地内存区域
   bmr = ibv_reg_mr (this->pd, const_cast<void *>(base), sz, //保护域pd：用于管理RDMA资源；base：要注册的内存区域的起始地址；sz：要注册的内存区域的大小
       IBV_ACCESS_LOCAL_WRITE //允许本地写入
@@ -136,8 +162,25 @@ int RdmaResource::RegLocalMemory(void *base, size_t sz) {
   epicLog(LOG_INFO, "registered local memory region at %p with size %ld\n", base, sz);
 
   this->base = base;
+  this->size = sz;
   return 0;
 }
+
+ibv_mr* RdmaResource::FindMR(const void* addr, size_t len) {
+  uintptr_t a = (uintptr_t) addr;
+  if (bmr && a >= (uintptr_t)bmr->addr && a + len <= (uintptr_t)bmr->addr + bmr->length)
+    return bmr;
+  for (ibv_mr* mr : mrs) {
+    if (a >= (uintptr_t)mr->addr && a + len <= (uintptr_t)mr->addr + mr->length)
+      return mr;
+  }
+  return nullptr;
+}
+
+uint32_t RdmaResource::GetRegionKey(const void* addr) {
+  ibv_mr* mr = FindMR(addr, 1);
+  return mr ? mr->rkey : 0;
+}
 /*
  * 1.为RDMA通信分配和注册通信槽(communication slots)
  * 2.如果现有的槽数量不足，则动态分配更多的槽，并将其注册为RDMA的本地内存区域(Memory Region, MR)
@@ -351,14 +394,66 @@ bool RdmaResource::GetCompEvent() const {
   return true; //返回成功状态
 }
 
-RdmaContext* RdmaResource::NewRdmaContext(bool isForMaster) {
-  rdma_context_counter++;
+/*
+ * the credit window of every peer: the recv slots we may pin over the peers
+ * we expect (or have), so that the slots do not grow with the cluster
+ */
+int RdmaResource::RecvWindow(bool isForMaster) {
+  int peers = std::max(std::max(rdma_context_counter, expected_peers), 1);
+  int w = std::min(srq_depth, MAX_RECV_SLOTS) / peers;
+  int max = isForMaster ? MAX_MASTER_PENDING_MSG : MAX_WORKER_PENDING_MSG;
+  return std::max(CREDIT_WINDOW_MIN, std::min(w, max));
+}
 
-  int s = isForMaster ? MAX_MASTER_PENDING_MSG : MAX_WORKER_PENDING_MSG;
-  if (RegCommSlot(s)) {
+/*
+ * promise n more recv slots (n < 0: n fewer); the new ones are posted here,
+ * from the spare ones first, while the fewer ones are left to the caller not
+ * to re-post. Never more than the SRQ holds, so that a msg sent with a
+ * credit always finds a posted slot
+ */
+int RdmaResource::Reserve(int n) {
+  if (n <= 0) {
+    slot_promised += n;
+    return n;
+  }
+  n = std::min(n, srq_depth - slot_promised);
+  if (n <= 0) return 0;
+  slot_promised += n;
+  int spare = std::min(n, slot_spare);
+  slot_spare -= spare;
+  if (slot_promised + slot_spare > slot_inuse && RegCommSlot(slot_promised + slot_spare - slot_inuse)) {
     epicLog(LOG_WARNING, "unable to register more communication slots\n");
-    return nullptr;
+    slot_promised -= n;
+    slot_spare += spare;
+    return 0;
+  }
+  if (n > spare) {
+    int posted = PostRecv(n - spare);
+    epicAssert(posted == n - spare);
   }
+  return n;
+}
+
+void RdmaResource::Release(int n) {
+  slot_promised -= n;
+  slot_spare += n;
+}
+
+RdmaContext* RdmaResource::NewRdmaContext(bool isForMaster) {
+  int s = InitialWindow(isForMaster);
+  /*
+   * the peer starts with s credits; the SRQ is the only hard limit on the
+   * number of peers, a peer beyond it is refused and its join fails
+   */
+  int n = Reserve(s);
+  if (n < s) {
+    epicLog(LOG_FATAL, "srq of %d recv slots is exhausted (%d promised): "
+        "at most %d peers with %d credits each, refuse the connection",
+        srq_depth, slot_promised, srq_depth / CREDIT_WINDOW_MIN, CREDIT_WINDOW_MIN);
+    Release(n);
+    throw RDMA_CONTEXT_EXCEPTION;
+  }
+  rdma_context_counter++;
   epicLog(LOG_DEBUG, "new RdmaContext: %d\n", rdma_context_counter);
   return new RdmaContext(this, isForMaster);
 }
@@ -370,6 +465,14 @@ void RdmaResource::DeleteRdmaContext(RdmaContext* ctx) {
   delete ctx;
 }
 
+TransportContext* RdmaResource::NewContext(bool isForMaster) {
+  return NewRdmaContext(isForMaster);
+}
+
+void RdmaResource::DeleteContext(TransportContext* ctx) {
+  DeleteRdmaContext(static_cast<RdmaContext*>(ctx));
+}
+
 RdmaContext::RdmaContext(RdmaResource *res, bool master):
   resource (res), isForMaster(master), msg() {
   // check either master == true,
@@ -481,10 +584,12 @@ int RdmaContext::SetRemoteConnParam(const char *conn) {
     /* conn should be of the format "lid:qpn:psn" */
     sscanf (conn, "%x:%x:%x", &rlid, &rqpn, &rpsn); 
   } else {
-    /* conn should be of the format "lid:qpn:psn:rkey:vaddr" */
-    sscanf (conn, "%x:%x:%x:%x:%lx", &rlid, &rqpn, &rpsn, &rrkey, &rvaddr);
+    /* conn should be of the format "lid:qpn:psn:rkey:vaddr:size" (size is missing from older peers) */
+    uint64_t rsize = 0;
+    sscanf (conn, "%x:%x:%x:%x:%lx:%lx", &rlid, &rqpn, &rpsn, &rrkey, &rvaddr, &rsize);
     this->rkey = rrkey;
     this->vaddr = rvaddr;
+    this->size = rsize;
   }
   //根据解析的参数，修改本地队列对QP的状态，使其进入RTR和RTS状态 
   /* modify qp to RTR state */
@@ -533,7 +638,7 @@ int RdmaContext::SetRemoteConnParam(const char *conn) {
     }
   }
 
-  resource->PostRecv(max_pending_msg); //为接收操作预先发布接收请求，max_pending_msg表示最大刮起消息数
+  //the recv slots of its credit window were posted by RdmaResource::NewRdmaContext
   return 0; //如果所有操作成功，返回0，表示设置远程连接参数成功。
 }
 
@@ -558,10 +663,10 @@ const char* RdmaContext::GetRdmaConnString() {
     sprintf (msg, "%04x:%08x:%08x", this->resource->portAttribute.lid,
         this->qp->qp_num, this->resource->psn);
   } else {
-    sprintf (msg, "%04x:%08x:%08x:%08x:%016lx",
+    sprintf (msg, "%04x:%08x:%08x:%08x:%016lx:%016lx",
         this->resource->portAttribute.lid, this->qp->qp_num,
         this->resource->psn, this->resource->bmr->rkey,
-        (uintptr_t) this->resource->base);
+        (uintptr_t) this->resource->base, (uint64_t) this->resource->bmr->length);
   }
 out:
   epicLog(LOG_DEBUG, "msg = %s\n", msg);
@@ -605,15 +710,15 @@ char* RdmaContext::GetFreeSlot() {
 bool RdmaContext::IsRegistered(const void* addr) {
   return ( (uintptr_t)addr >= (uintptr_t)send_buf->addr) && ((uintptr_t)addr < (uintptr_t)send_buf->addr+send_buf->length);
 }
-/* Rdma函数是RDMA操作的核心实现，目前只支持一种RDMA操作(IBV_WR_SEND、)，它负责构造RDMA请求并将其提交到对列队QP
+/* Rdma函数是RDMA操作的核心实现，目前支持IBV_WR_SEND(_WITH_IMM)和单边读IBV_WR_RDMA_READ，它负责构造RDMA请求并将其提交到对列队QP
  * 参数说明：
  * op: RDMA操作类型，IBV_WR_SEND表示发送操作
  * src: 源数据缓冲区地址，表示要发送的数据
  * len: 源数据缓冲区的长度，表示要发送的数据长度
  * id: 工作请求的ID，用于标识该请求
  * signaled: 是否需要发送完成事件，表示是否需要在发送完成后通知应用程序
- * dest: 目标地址，表示数据要发送到的远程地址，仅用于写操作
- * imm: 立即数值，仅用于写操作，表示要发送的立即数
+ * dest: 目标地址，写操作时为远程地址；读操作时为本地缓冲区(src为远程地址)
+ * imm: 立即数值，用于IBV_WR_SEND_WITH_IMM和带立即数的写操作
  * oldval: 旧值，仅用于比较和交换操作，表示要比较的旧值
  * newval: 新值，仅用于比较和交换操作，表示要设置的新值
  * 返回值：
@@ -623,7 +728,7 @@ ssize_t RdmaContext::Rdma(ibv_wr_opcode op , const void* src, size_t len, unsign
     bool signaled, void* dest, uint32_t imm, uint64_t oldval, uint64_t newval) {
   epicAssert(pending_msg < max_pending_msg);  //确保当前挂起的消息数未超过允许的最大值
 
-  if (op == IBV_WR_SEND) { //检查操作类型，目前仅支持发送操作 
+  if (op == IBV_WR_SEND || op == IBV_WR_SEND_WITH_IMM) { //发送操作
     if (!IsRegistered(src) && len > MAX_RDMA_INLINE_SIZE) { //处理发送缓冲区：如果源缓冲区未注册且数据长度超过最大内联大小MAX_RDMA_INLINE_SIZE，则需要将数据复制到一个空闲的发送缓冲区
       if (len > MAX_REQUEST_SIZE) { //确保数据长度未超过允许的最大请求大小，如果超过，记录警告日志并触发断言
         epicLog(LOG_WARNING, "len = %d, MAX_REQUEST_SIZE = %d, src = %s\n", len, MAX_REQUEST_SIZE, src);
@@ -642,6 +747,25 @@ ssize_t RdmaContext::Rdma(ibv_wr_opcode op , const void* src, size_t len, unsign
     }
     sge_list.lkey = send_buf->lkey; //设置SGE列表的本地密钥sge_list.lkey为发送缓冲区的本地密钥
 
+  } else if (op == IBV_WR_RDMA_READ) { //单边读：src为远程地址(位于对端RegLocalMemory注册的区域)，dest为本地缓冲区
+    uint32_t key;
+    ibv_mr* mr;
+    if (!RemoteKey((uintptr_t)src, len, key)) { //对端新增的区域尚未通告过来，由调用者改用消息读取
+      epicLog(LOG_INFO, "no remote region known for %p (%lu bytes)", src, len);
+      return -2;
+    }
+    if (IsRegistered(dest)) { //读到发送缓冲区槽中，槽在完成事件到来时归还，与发送消息一样计数
+      sge_list.lkey = send_buf->lkey;
+      pending_send_msg++;
+    } else if ((mr = resource->FindMR(dest, len))) {
+      sge_list.lkey = mr->lkey; //读到本地已注册的内存区域
+    } else {
+      epicLog(LOG_WARNING, "the local buffer %p of rdma read is not registered", dest);
+      return -1;
+    }
+    sge_list.addr = (uintptr_t)dest;
+    wr.wr.rdma.remote_addr = (uintptr_t)src;
+    wr.wr.rdma.rkey = key;
   } else {
     epicLog(LOG_WARNING, "unsupported RDMA OP");
     return -1;
@@ -655,8 +779,9 @@ ssize_t RdmaContext::Rdma(ibv_wr_opcode op , const void* src, size_t len, unsign
   wr.num_sge = len == 0 ? 0 : 1;
   wr.next = nullptr;
   wr.send_flags = 0;
+  if (op == IBV_WR_SEND_WITH_IMM) wr.imm_data = htonl(imm);
   //如果数据长度小于等于最大内联大小，则设置发送标志为IBV_SEND_INLINE，表示使用内联发送
-  if (len <= MAX_RDMA_INLINE_SIZE) wr.send_flags = IBV_SEND_INLINE;
+  if (len <= MAX_RDMA_INLINE_SIZE && op != IBV_WR_RDMA_READ) wr.send_flags = IBV_SEND_INLINE; //inline不适用于读操作
 
   pending_msg++; //更新挂起消息计数，计算当前需要发送完成事件的消息数
   uint16_t curr_to_signaled_send_msg = pending_send_msg - to_signaled_send_msg;
@@ -665,7 +790,7 @@ ssize_t RdmaContext::Rdma(ibv_wr_opcode op , const void* src, size_t len, unsign
   if (curr_to_signaled_send_msg + curr_to_signaled_w_r_msg == max_unsignaled_msg || signaled) { //we signal msg for every max_unsignaled_msg
     //如果达到最大未发送完成事件的消息数，或者显示要求发送完成事件，则设置发送标志为IBV_SEND_SIGNALED
     wr.send_flags |= IBV_SEND_SIGNALED;
-    if (wr.opcode == IBV_WR_SEND) {
+    if (wr.opcode == IBV_WR_SEND || wr.opcode == IBV_WR_SEND_WITH_IMM) {
       epicLog(LOG_DEBUG, "signaled %s\n", (char*)sge_list.addr);
     } else {
       epicLog(LOG_INFO, "signaled, op = %d", wr.opcode);
@@ -702,6 +827,10 @@ ssize_t RdmaContext::Send(const void* ptr, size_t len, unsigned int id, bool sig
   return Rdma(IBV_WR_SEND, ptr, len, id, signaled);
 }
 
+ssize_t RdmaContext::SendWithImm(const void* ptr, size_t len, uint32_t imm, unsigned int id, bool signaled) {
+  return Rdma(IBV_WR_SEND_WITH_IMM, ptr, len, id, signaled, nullptr, imm);
+}
+
 int RdmaContext::Recv() {return 0;}
 
 ssize_t RdmaContext::Write (raddr dest, raddr src, size_t len, unsigned int id, bool signaled) {
@@ -716,6 +845,26 @@ ssize_t RdmaContext::Read(raddr dest, raddr src, size_t len, unsigned int id, bo
   return Rdma(IBV_WR_RDMA_READ, src, len, id, signaled, dest);
 }
 
+int RdmaContext::AddRemoteRegion(uint64_t off, size_t size, uint32_t rkey) {
+  regions.push_back(RdmaRegion {vaddr + off, size, rkey});
+  epicLog(LOG_INFO, "added remote region %lx of %lu bytes (rkey = %x)", vaddr + off, size, rkey);
+  return 0;
+}
+
+bool RdmaContext::RemoteKey(uint64_t addr, size_t len, uint32_t& key) {
+  if (!size || (addr >= vaddr && addr + len <= vaddr + size)) {
+    key = rkey;
+    return true;
+  }
+  for (RdmaRegion& r : regions) {
+    if (addr >= r.addr && addr + len <= r.addr + r.size) {
+      key = r.rkey;
+      return true;
+    }
+  }
+  return false;
+}
+
 ssize_t RdmaContext::Cas(raddr src, uint64_t oldval, uint64_t newval, unsigned int id, bool signaled) {
   return Rdma(IBV_WR_ATOMIC_CMP_AND_SWP, src, sizeof (uint64_t), id, signaled, nullptr, 0, oldval, newval);
 }
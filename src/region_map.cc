@@ -0,0 +1,239 @@
+// Copyright (c) 2018 The GAM Authors
+
+#include "region_map.h"
+#include "log.h"
+
+#include <sched.h>
+#include <string.h>
+
+RegionMap::RegionMap(): count_(0), guards_(0), holding_(false) {
+  pthread_rwlock_init(&lock_, nullptr);
+  memset(hole_, 0, sizeof(hole_));
+}
+
+RegionMap::~RegionMap() {
+  pthread_rwlock_destroy(&lock_);
+}
+
+void RegionMap::Enter() {
+  for (;;) {
+    guards_.fetch_add(1);
+    if (!holding_.load()) return;
+    guards_.fetch_sub(1);
+    while (holding_.load()) sched_yield();
+  }
+}
+
+bool RegionMap::TryHold() {
+  holding_.store(true);
+  return guards_.load() == 0;
+}
+
+void RegionMap::Prune(uint64_t region) {
+  auto it = regions_.find(region);
+  if (it != regions_.end() && it->second.seq == 0 && !it->second.frozen) {
+    regions_.erase(it);
+    count_.store(regions_.size(), std::memory_order_release);
+  }
+}
+
+int RegionMap::Owner(GAddr a) {
+  if (Empty()) return WID(a);
+  pthread_rwlock_rdlock(&lock_);
+  const Region* r = Find(a);
+  int wid = r ? r->owner : WID(a);
+  pthread_rwlock_unlock(&lock_);
+  return wid;
+}
+
+uint32_t RegionMap::Seq(uint64_t region) {
+  if (Empty()) return 0;
+  pthread_rwlock_rdlock(&lock_);
+  auto it = regions_.find(region);
+  uint32_t seq = it == regions_.end() ? 0 : it->second.seq;
+  pthread_rwlock_unlock(&lock_);
+  return seq;
+}
+
+bool RegionMap::Moved(GAddr a) {
+  if (Empty()) return false;
+  pthread_rwlock_rdlock(&lock_);
+  const Region* r = Find(a);
+  bool moved = r && r->seq;
+  pthread_rwlock_unlock(&lock_);
+  return moved;
+}
+
+bool RegionMap::Frozen(GAddr a) {
+  if (Empty()) return false;
+  pthread_rwlock_rdlock(&lock_);
+  const Region* r = Find(a);
+  bool frozen = r && r->frozen;
+  pthread_rwlock_unlock(&lock_);
+  return frozen;
+}
+
+bool RegionMap::Writable(GAddr a, int wid) {
+  if (Empty()) return WID(a) == wid;
+  pthread_rwlock_rdlock(&lock_);
+  const Region* r = Find(a);
+  bool w = r ? r->owner == wid && !r->frozen : WID(a) == wid;
+  pthread_rwlock_unlock(&lock_);
+  return w;
+}
+
+char* RegionMap::Translate(GAddr a, void* base) {
+  if (Empty()) return (char*)TO_LOCAL(a, base);
+  pthread_rwlock_rdlock(&lock_);
+  const Region* r = Find(a);
+  char* p;
+  if (r && r->held) {
+    //a is the start of an object, or in it
+    uint32_t off = a - REGION_BASE(REGION_OF(a));
+    auto it = r->chunks.upper_bound(off);
+    p = hole_;
+    if (it != r->chunks.begin()) {
+      --it;
+      if (off - it->first < r->objects.at(it->first)) p = it->second + (off - it->first);
+    }
+  } else {
+    p = (char*)TO_LOCAL(a, base);
+  }
+  pthread_rwlock_unlock(&lock_);
+  return p;
+}
+
+long RegionMap::AllocSize(GAddr a) {
+  if (Empty()) return -1;
+  long size = -1;
+  pthread_rwlock_rdlock(&lock_);
+  const Region* r = Find(a);
+  if (r && r->held) {
+    auto it = r->objects.find(a - REGION_BASE(REGION_OF(a)));
+    size = it == r->objects.end() ? 0 : it->second;
+  }
+  pthread_rwlock_unlock(&lock_);
+  return size;
+}
+
+bool RegionMap::IsChunk(void* p) {
+  if (Empty()) return false;
+  pthread_rwlock_rdlock(&lock_);
+  bool b = chunks_.count((char*)p);
+  pthread_rwlock_unlock(&lock_);
+  return b;
+}
+
+char* RegionMap::Free(GAddr a) {
+  if (Empty()) return nullptr;
+  char* chunk = nullptr;
+  pthread_rwlock_wrlock(&lock_);
+  auto it = regions_.find(REGION_OF(a));
+  if (it != regions_.end() && it->second.held) {
+    Region& r = it->second;
+    auto c = r.chunks.find(a - REGION_BASE(REGION_OF(a)));
+    if (c != r.chunks.end()) {
+      chunk = c->second;
+      chunks_.erase(chunk);
+      r.objects.erase(c->first);
+      r.chunks.erase(c);
+    }
+  }
+  pthread_rwlock_unlock(&lock_);
+  return chunk;
+}
+
+bool RegionMap::SetOwner(uint64_t region, int wid, uint32_t seq) {
+  bool set = false;
+  pthread_rwlock_wrlock(&lock_);
+  Region& r = regions_[region];
+  if (seq > r.seq) {
+    //a region still held here is only given away by MoveOut
+    epicAssert(!r.held);
+    r.owner = wid;
+    r.seq = seq;
+    set = true;
+  }
+  count_.store(regions_.size(), std::memory_order_release);
+  Prune(region);
+  pthread_rwlock_unlock(&lock_);
+  return set;
+}
+
+bool RegionMap::Freeze(uint64_t region) {
+  if (!TryHold()) return false;
+  pthread_rwlock_wrlock(&lock_);
+  auto it = regions_.find(region);
+  if (it == regions_.end()) {
+    //a home region, owned by the worker of its addresses
+    Region& r = regions_[region];
+    r.owner = WID(REGION_BASE(region));
+    count_.store(regions_.size(), std::memory_order_release);
+    it = regions_.find(region);
+  }
+  it->second.frozen = true;
+  pthread_rwlock_unlock(&lock_);
+  Release();
+  return true;
+}
+
+void RegionMap::Unfreeze(uint64_t region) {
+  pthread_rwlock_wrlock(&lock_);
+  auto it = regions_.find(region);
+  if (it != regions_.end()) {
+    it->second.frozen = false;
+    Prune(region);
+  }
+  pthread_rwlock_unlock(&lock_);
+}
+
+void RegionMap::Install(uint64_t region, int wid, uint32_t seq,
+    std::map<uint32_t, uint32_t>& objects, std::map<uint32_t, char*>& chunks) {
+  pthread_rwlock_wrlock(&lock_);
+  Region& r = regions_[region];
+  r.owner = wid;
+  if (seq > r.seq) r.seq = seq;
+  r.frozen = true;
+  r.held = true;
+  r.objects.swap(objects);
+  r.chunks.swap(chunks);
+  for (auto& c : r.chunks) chunks_.insert(c.second);
+  count_.store(regions_.size(), std::memory_order_release);
+  pthread_rwlock_unlock(&lock_);
+}
+
+bool RegionMap::MoveOut(uint64_t region, int wid) {
+  if (!TryHold()) return false;
+  pthread_rwlock_wrlock(&lock_);
+  Region& r = regions_[region];
+  r.owner = wid;
+  r.seq++;
+  r.frozen = false;
+  r.held = false;
+  for (auto& c : r.chunks) chunks_.erase(c.second);
+  r.objects.clear();
+  r.chunks.clear();
+  count_.store(regions_.size(), std::memory_order_release);
+  pthread_rwlock_unlock(&lock_);
+  Release();
+  return true;
+}
+
+bool RegionMap::Get(uint64_t region, Region& out) {
+  if (Empty()) return false;
+  pthread_rwlock_rdlock(&lock_);
+  auto it = regions_.find(region);
+  bool found = it != regions_.end();
+  if (found) out = it->second;
+  pthread_rwlock_unlock(&lock_);
+  return found;
+}
+
+void RegionMap::GetHeld(std::vector<uint64_t>& out) {
+  if (Empty()) return;
+  pthread_rwlock_rdlock(&lock_);
+  for (auto& r : regions_) {
+    if (r.second.held) out.push_back(r.first);
+  }
+  pthread_rwlock_unlock(&lock_);
+}
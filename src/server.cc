@@ -1,6 +1,7 @@
 // Copyright (c) 2018 The GAM Authors 
 
 #include <cstring>
+#include <vector>
 #include <arpa/inet.h>
 #include "server.h"
 #include "log.h"
@@ -49,10 +50,10 @@ void Server::ProcessRdmaRequest() {
   void *ctx;
   int ne; //记录接收事件的数量
   ibv_wc wc[MAX_CQ_EVENTS]; //定义一个工作完成结构体数组wc，用于存储从RDMA完成队列中轮询到的事件 wc:work completion工作完成项
-  ibv_cq *cq = resource->GetCompQueue(); //获取RDMA资源的完成队列
   Client *cli;  //定义一个指向Client对象的指针cli，用于指向触发事件的客户端对象
   uint32_t immdata, id;
   int recv_c = 0;
+  std::vector<Client*> consumers;  //clients whose msgs are received in this round, to return the credits
 
   epicLog(LOG_DEBUG, "received RDMA event\n"); //记录日志，表示收到RDMA事件
   /*
@@ -61,7 +62,7 @@ void Server::ProcessRdmaRequest() {
    */
   if (likely(resource->GetCompEvent())) { //检查是否有新的RDMA事件通知，如果有时间通知，进入处理逻辑
     do {
-      ne = ibv_poll_cq(cq, MAX_CQ_EVENTS, wc);  //调用ibv_poll_cq从完成队列中轮询事件，最多获取MAX_CQ_EVENTS个事件
+      ne = resource->PollCompletion(MAX_CQ_EVENTS, wc);  //从完成队列中轮询事件，最多获取MAX_CQ_EVENTS个事件
       if (unlikely(ne < 0)) { //如果轮询失败，记录错误日志并跳转到out标签 
         epicLog(LOG_FATAL, "Unable to poll cq\n");
         goto out;
@@ -99,10 +100,20 @@ void Server::ProcessRdmaRequest() {
 
               epicLog(LOG_DEBUG, "Get recv completion event"); //记录接收完成事件 
               char* data = cli->RecvComp(wc[i]); //调用Client::RecvComp方法处理接收完成事件，并获取接收到的数据指针 
-              FarmProcessRemoteRequest(cli, data, wc[i].byte_len); //调用FarmProcessRemoteRequest方法处理远程请求
+              //对端归还的信用随消息的imm捎带，信用耗尽时挂起的事务在此恢复
+              if ((wc[i].wc_flags & IBV_WC_WITH_IMM) && cli->AddCredits(ntohl(wc[i].imm_data)))
+                FarmResumeTxn(cli);
+              if (cli->Consume()) consumers.push_back(cli);
+              if (wc[i].byte_len) //空消息只用于归还信用
+                FarmProcessRemoteRequest(cli, data, wc[i].byte_len); //调用FarmProcessRemoteRequest方法处理远程请求
               recv_c++; //增加接收事件计数器，表示有新的接收请求
               break;
             }
+          case IBV_WC_RDMA_READ: //单边读完成事件，读到的数据仍在发送槽中，需在恢复事务(复用槽)之前处理
+            id = cli->WriteComp(wc[i]);
+            FarmProcessRdmaRead(cli, id);
+            FarmResumeTxn(cli);
+            break;
           //处理其他事件
           case IBV_WC_RDMA_WRITE:
           case IBV_WC_RECV_RDMA_WITH_IMM:
@@ -115,8 +126,12 @@ void Server::ProcessRdmaRequest() {
 
     if(recv_c) {//如果有接收事件
       //epicAssert(recv_c == resource->ClearRecv(low, high));
-      int n = resource->PostRecv(recv_c); //调用RdmaResource::PostRecv方法提交新的接收请求
+      //各对端的信用窗口随接收槽的份额调整，收回的信用对应的槽不再提交
+      for (Client* c : consumers) recv_c += c->Rebalance();
+      int n = recv_c ? resource->PostRecv(recv_c) : 0; //调用RdmaResource::PostRecv方法提交新的接收请求
       epicAssert(recv_c == n);//确保提交的接收请求数量与接收事件数量一致
+      //接收槽已重新提交，对应的信用可以归还给对端
+      for (Client* c : consumers) c->ReturnCredits();
     }
   }
 
@@ -139,43 +154,44 @@ Client* Server::FindClient(uint32_t qpn) {
  * 该函数的目的是确保widCliMap包含所有已知的工作节点ID和对应的客户端对象 
 */
 void Server::UpdateWidMap() {
-  //确定需要更新的工作几点数
-  /*如果当前服务器是主节点，则工作节点的数量等于qpCliMap.size()。
-    如果当前服务器是工作节点，则需要忽略与主节点的连接，因此工作节点的数量是qpCliMap.size()-1*/
-  int workers = IsMaster() ? qpCliMap.size() : qpCliMap.size()-1;
-  //检查是否需要更新widCliMap，如果widCliMap中映射数量小于实际的工作节点数量，则需要更新
-  //避免重复更新，只有在widCliMap不完整时才进行更新操作
-  if(widCliMap.size() < workers) {
-    //遍历qpCliMap中所有的队列对编号QP和对应的客户端对象
-    //从qpCliMap中提取客户端对象，并根据其工作节点ID更新widCliMap
-    for(auto it = qpCliMap.begin(); it != qpCliMap.end(); it++) {
-      int wid = it->second->GetWorkerId();//获取客户端对应的工作节点ID，确定当前客户端对象所属的工作节点
-      if(wid == GetWorkerId()) { //如果客户端的工作节点ID等于当前服务器的工作节点ID，则忽略该客户端，因为当前服务器不需要处理自己的连接
-        epicAssert(!IsMaster()); //避免将与主节点自身的连接加入到widCliMap中 
-        continue; //ignore the client to the master
-      }
-      if(!widCliMap.count(wid)) { //如果widCliMap中尚未包涵该工作节点ID的映射，则将该客户端对象添加到widCliMap中
-        widCliMap[wid] = it->second;
-      }
+  //只有qpCliMap有新的客户端时才需要更新(对同一个工作节点可能有两个连接，widCliMap只记录其中先出现的一个)
+  if(widmap_clients == qpCliMap.size()) return;
+  //遍历qpCliMap中所有的队列对编号QP和对应的客户端对象
+  //从qpCliMap中提取客户端对象，并根据其工作节点ID更新widCliMap
+  for(auto it = qpCliMap.begin(); it != qpCliMap.end(); it++) {
+    int wid = it->second->GetWorkerId();//获取客户端对应的工作节点ID，确定当前客户端对象所属的工作节点
+    if(wid == GetWorkerId() || wid == 0) { //如果客户端的工作节点ID等于当前服务器的工作节点ID，则忽略该客户端，因为当前服务器不需要处理自己的连接
+      continue; //ignore the client to the master (and the ones whose peer is not known yet)
+    }
+    if(!widCliMap.count(wid)) { //如果widCliMap中尚未包涵该工作节点ID的映射，则将该客户端对象添加到widCliMap中
+      widCliMap[wid] = it->second;
     }
-    epicAssert(widCliMap.size() == workers); //使用断言检查更新后的widCliMap的大小是否与实际工作节点数量一致 
   }
+  widmap_clients = qpCliMap.size();
 }
 
-Client* Server::FindClientWid(int wid) {
+/*
+ * a worker not connected yet is connected on demand (lazy connection, see
+ * Worker::ConnectWorker) if connect is set; the returned client is then not
+ * connected until the conn params are exchanged, but work can already be queued to it
+ */
+Client* Server::FindClientWid(int wid, bool connect) {
   UpdateWidMap();
 
-  Client* cli = nullptr;
-  try {
-    cli = widCliMap.at(wid);
-  } catch (const std::out_of_range& oor) {
-    epicLog(LOG_WARNING, "cannot find the client for worker %d (%s)", wid, oor.what());
-  }
+  auto it = widCliMap.find(wid);
+  if (likely(it != widCliMap.end()))
+    return it->second;
 
+  Client* cli = connect ? ConnectWorker(wid) : nullptr;
+  if (!cli && connect)
+    epicLog(LOG_WARNING, "cannot find the client for worker %d", wid);
   return cli;
 }
 
 void Server::RmClient(Client* c) {
   qpCliMap.erase(c->GetQP());
+  auto it = widCliMap.find(c->GetWorkerId());
+  if (it != widCliMap.end() && it->second == c)
+    widCliMap.erase(it);
 }
 
@@ -0,0 +1,301 @@
+// Copyright (c) 2018 The GAM Authors
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <thread>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+
+#include "shm.h"
+#include "rdma.h"
+#include "zmalloc.h"
+#include "kernel.h"
+#include "log.h"
+
+std::mutex ShmContext::registry_lock;
+std::unordered_map<uint32_t, ShmContext*> ShmContext::registry;
+uint32_t ShmContext::qpn_counter = 0;
+
+ShmResource::ShmResource(bool master)
+    : isForMaster(master), base(nullptr), size(0), context_counter(0) {
+  efd = eventfd(0, EFD_NONBLOCK);
+  if (efd < 0) {
+    epicLog(LOG_FATAL, "Unable to create eventfd (%d:%s)", errno, strerror(errno));
+    throw SHM_RESOURCE_EXCEPTION;
+  }
+  epicLog(LOG_DEBUG, "new shm resource\n");
+}
+
+ShmResource::~ShmResource() {
+  close(efd);
+}
+
+void ShmResource::Notify() {
+  uint64_t v = 1;
+  if (write(efd, &v, sizeof(v)) != sizeof(v)) {
+    //EAGAIN only happens when the counter overflows, which means the loop is already notified
+    epicLog(LOG_DEBUG, "eventfd write failed (%d:%s)", errno, strerror(errno));
+  }
+}
+
+/*
+ * the eventfd is level-triggered and reading it resets the counter,
+ * completions are always pushed before the notification,
+ * so a completion cannot be lost between the read and the poll
+ */
+bool ShmResource::GetCompEvent() const {
+  uint64_t v;
+  if (read(efd, &v, sizeof(v)) != sizeof(v) && errno != EAGAIN) {
+    epicLog(LOG_FATAL, "Failed to get shm event (%d:%s)\n", errno, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+int ShmResource::PollCompletion(int n, ibv_wc* wc) {
+  std::lock_guard<std::mutex> lock(lock_);
+  int i = 0;
+  while (i < n && !cq.empty()) {
+    wc[i++] = cq.front();
+    cq.pop_front();
+  }
+  return i;
+}
+
+int ShmResource::RegLocalMemory(void *base, size_t sz) {
+  if (isForMaster) {
+    epicLog(LOG_WARNING, "I am a master\n");
+    return -1;
+  }
+  if (this->base) {
+    //a region grown at runtime right after the registered ones, the peers read it through the same base
+    epicAssert((char*)base == (char*)this->base + this->size);
+    this->size += sz;
+  } else {
+    this->base = base;
+    this->size = sz;
+  }
+  epicLog(LOG_INFO, "registered local memory region at %p with size %ld\n", base, sz);
+  return 0;
+}
+
+bool ShmResource::Fill(uint32_t qpn, const void* src, size_t len, uint32_t imm) {
+  int s = slots.Get();
+  if (unlikely(s < 0)) return false;
+  memcpy(slots.Addr(s), src, len);
+
+  ibv_wc wc = {};
+  wc.wr_id = s;
+  wc.status = IBV_WC_SUCCESS;
+  wc.opcode = IBV_WC_RECV;
+  wc.byte_len = len;
+  wc.qp_num = qpn;
+  wc.wc_flags = IBV_WC_WITH_IMM;
+  wc.imm_data = htonl(imm);
+  cq.push_back(wc);
+  return true;
+}
+
+int ShmResource::Deliver(uint32_t qpn, const void* src, size_t len, uint32_t imm) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    //behind the backlog, so that the msgs of a peer stay in order
+    if (!backlog.empty() || !Fill(qpn, src, len, imm)) {
+      backlog.push_back(Pending{qpn, imm, std::string((const char*)src, len)});
+      epicLog(LOG_INFO, "no free recv slot, %lu msgs wait for one", backlog.size());
+      return 0;
+    }
+  }
+  Notify();
+  return 0;
+}
+
+void ShmResource::PushCompletion(const ibv_wc& wc) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    cq.push_back(wc);
+  }
+  Notify();
+}
+
+char* ShmResource::GetSlot(int s) {
+  std::lock_guard<std::mutex> lock(lock_);
+  return slots.Addr(s);
+}
+
+void ShmResource::ClearSlot(int s) {
+  std::lock_guard<std::mutex> lock(lock_);
+  slots.Clear(s);
+}
+
+int ShmResource::PostRecv(int n) {
+  bool filled = false;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    slots.Recycle(n);
+    while (!backlog.empty()) {
+      Pending& p = backlog.front();
+      if (!Fill(p.qpn, p.data.data(), p.data.size(), p.imm)) break;
+      backlog.pop_front();
+      filled = true;
+    }
+  }
+  if (filled) Notify();
+  return n;
+}
+
+TransportContext* ShmResource::NewContext(bool isForMaster) {
+  context_counter++;
+  epicLog(LOG_DEBUG, "new ShmContext: %d\n", context_counter);
+  return new ShmContext(this, isForMaster);
+}
+
+void ShmResource::DeleteContext(TransportContext* ctx) {
+  context_counter--;
+  epicLog(LOG_DEBUG, "delete ShmContext: %d\n", context_counter);
+  delete ctx;
+}
+
+ShmContext::ShmContext(ShmResource* res, bool master)
+    : resource(res), isForMaster(master), ring(master) {
+  epicAssert(IsMaster() || IsMaster() == res->IsMaster());
+
+  std::lock_guard<std::mutex> lock(registry_lock);
+  qpn = ++qpn_counter;
+  registry[qpn] = this;
+}
+
+ShmContext::~ShmContext() {
+  {
+    std::lock_guard<std::mutex> lock(registry_lock);
+    registry.erase(qpn);
+  }
+  zfree(msg);
+}
+
+const char* ShmContext::GetRdmaConnString() {
+  if (!msg) {
+    msg = (char *) zmalloc(
+        (IsMaster() ? MASTER_RDMA_CONN_STRLEN : WORKER_RDMA_CONN_STRLEN) + 1);
+    if (unlikely(!msg)) {
+      epicLog(LOG_WARNING, "Unable to allocate memory\n");
+      return nullptr;
+    }
+  }
+
+  if (IsMaster()) {
+    sprintf(msg, "%04x:%08x:%08x", 0, qpn, 0);
+  } else {
+    sprintf(msg, "%04x:%08x:%08x:%08x:%016lx", 0, qpn, 0, 0,
+        (uintptr_t)resource->GetBase());
+  }
+  epicLog(LOG_DEBUG, "msg = %s\n", msg);
+  return msg;
+}
+
+int ShmContext::SetRemoteConnParam(const char *conn) {
+  uint32_t rlid, rpsn, rqpn, rrkey;
+  uint64_t rvaddr;
+  if (IsMaster()) {
+    sscanf(conn, "%x:%x:%x", &rlid, &rqpn, &rpsn);
+  } else {
+    sscanf(conn, "%x:%x:%x:%x:%lx", &rlid, &rqpn, &rpsn, &rrkey, &rvaddr);
+    this->vaddr = rvaddr;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(registry_lock);
+    auto it = registry.find(rqpn);
+    if (unlikely(it == registry.end())) {
+      epicLog(LOG_WARNING, "cannot find the shm peer %u (not in the same process?)", rqpn);
+      return 1;
+    }
+    peer = it->second;
+  }
+
+  //the msgs sent before the connection is made
+  for (auto& m : unsent)
+    peer->resource->Deliver(peer->qpn, m.first.data(), m.first.size(), m.second);
+  unsent.clear();
+  return 0;
+}
+
+/*
+ * the op is already finished when we get here (memcpy),
+ * but we still signal selectively as RdmaContext::Rdma does
+ * so that the send ring and the resume path behave the same
+ */
+void ShmContext::Complete(unsigned int id, bool signaled, bool slot, ibv_wc_opcode op) {
+  uint64_t wr_id;
+  if (ring.Complete(id, signaled, slot, wr_id)) {
+    ibv_wc wc = {};
+    wc.wr_id = wr_id;
+    wc.status = IBV_WC_SUCCESS;
+    wc.opcode = op;
+    wc.qp_num = qpn;
+    resource->PushCompletion(wc);
+  }
+}
+
+ssize_t ShmContext::SendWithImm(const void* ptr, size_t len, uint32_t imm, unsigned int id, bool signaled) {
+  epicAssert(!ring.IsFull());
+  if (len > MAX_REQUEST_SIZE) {
+    epicLog(LOG_WARNING, "len = %d, MAX_REQUEST_SIZE = %d\n", len, MAX_REQUEST_SIZE);
+    epicAssert(false);
+  }
+  if (unlikely(!peer)) {
+    //delivered by SetRemoteConnParam
+    epicLog(LOG_INFO, "shm context %u is not connected yet", qpn);
+    unsent.push_back(std::make_pair(std::string((const char*)ptr, len), imm));
+  } else {
+    peer->resource->Deliver(peer->qpn, ptr, len, imm);
+  }
+
+  bool slot = ring.IsRegistered(ptr);
+  if (!slot && len > MAX_RDMA_INLINE_SIZE) zfree((void*)ptr);
+  Complete(id, signaled, slot);
+  return len;
+}
+
+ssize_t ShmContext::Write(raddr dest, raddr src, size_t len, unsigned int id, bool signaled) {
+  epicLog(LOG_WARNING, "unsupported RDMA OP");
+  return -1;
+}
+
+ssize_t ShmContext::WriteWithImm(raddr dest, raddr src, size_t len, uint32_t imm, unsigned int id, bool signaled) {
+  epicLog(LOG_WARNING, "unsupported RDMA OP");
+  return -1;
+}
+
+/*
+ * emulate a one-sided read: the remote memory is in our address space,
+ * so that the owner's thread is not involved at all.
+ * The copy races with the owner's writes exactly as a NIC read does,
+ * thus the caller has to validate the object versions itself.
+ * A NIC gives no order between the bytes of one read either, and its DMA
+ * takes time; the copy goes from the last cache line to the first, and
+ * lets the other threads run after the first line, so that a version and
+ * the data behind it fetched in the same read are not mistaken for ordered.
+ */
+ssize_t ShmContext::Read(raddr dest, raddr src, size_t len, unsigned int id, bool signaled) {
+  epicAssert(!ring.IsFull());
+  if (unlikely(!peer || !vaddr)) {
+    epicLog(LOG_WARNING, "shm context %u has no remote memory", qpn);
+    return -2;
+  }
+  for (size_t end = len; end > 0;) {
+    size_t off = end > 64 ? (end - 1) & ~(size_t)63 : 0;
+    memcpy((char*)dest + off, (char*)src + off, end - off);
+    if (end == len && off) std::this_thread::yield();
+    end = off;
+  }
+  Complete(id, signaled, ring.IsRegistered(dest), IBV_WC_RDMA_READ);
+  return len;
+}
+
+char* ShmContext::RecvComp(ibv_wc& wc) {
+  char* ret = resource->GetSlot(wc.wr_id);
+  resource->ClearSlot(wc.wr_id);
+  return ret;
+}
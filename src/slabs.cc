@@ -22,13 +22,29 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
 #include <unordered_map>
+#include <vector>
+#include <algorithm>
 
 #include "slabs.h"
 #include "settings.h"
 #include "log.h"
 #include "kernel.h"
 
+//older libc headers miss the hugetlb page size flags
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
 /*
  * Figures out which slab class (chunk size) is required to store an item of
  * a given size.
@@ -62,62 +78,130 @@ unsigned int SlabAllocator::slabs_clsid(const size_t size) {
 1.分配一块对其的内存
 2.支持大页内存(Huge Pages)分配(可选)
 3.确保分配的内存地址对齐到指定的块大小(BLOCK_SIZE).*/
-void* SlabAllocator::mmap_malloc(size_t size) { //size:需要分配的内存大小（以字节为单位）
+void* SlabAllocator::mmap_malloc(size_t size, size_t reserve, int hugepage, int numa_node) { //size:需要分配的内存大小（以字节为单位）
   static void *fixed_base = NULL;  //(void *) (0x7fc435400000); 静态变量，表示固定的内存基地址(默认为NULL)。如果需要分配固定地址的内存，可以设置fixed_base。当前代码中设置为NULL，则未使用固定地址。
-  epicLog(LOG_INFO, "mmap_malloc size  = %ld", size); //打印分配请求的大小
-  void* ret;
-  size_t aligned_size = size + BLOCK_SIZE; //预留额外的对齐空间，以防地址对齐后剩余空间不足所要求的预分配空间大小
-  if (aligned_size % BLOCK_SIZE) {//如果size不是块大小BLOCK_SIZE的整数倍，则将其对齐到最近的BLOCK_SIZE倍数
-    size_t old_size = aligned_size;
-    aligned_size = ALIGN(aligned_size, BLOCK_SIZE);//将size对齐到BLOCK_SIZE的倍数。假设BLOCK_SIZE为4096(4K)，则ALIGN(size, BLOCK_SIZE)会将size向上对齐到最接近的4K的倍数。5000-8192;4096-4096
-    epicLog(LOG_WARNING, "aligned the size from %lu to %lu", old_size, aligned_size);
-  }
-#ifdef USE_HUGEPAGE  //调用mmap系统调用分配内存  
-  ret = mmap(fixed_base, aligned_size, PROT_READ | PROT_WRITE,
-             MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0);
-#else
-/* 参数说明：
- * 1. fixed_base：指定分配内存的起始地址，如果为NULL，则由内核选择地址。
- * 2. size：要分配的内存大小。
- * 3. PROT_READ | PROT_WRITE：内存的访问权限，表示可读可写。
- * 4. MAP_PRIVATE | MAP_ANON：映射类型，MAP_PRIVATE表示私有映射，MAP_ANON表示匿名映射。
- * 5. MAP_HUGETLB：表示使用大页内存映射。
- * -1，0:表示不与文件关联
- * 返回值：成功时返回映射的内存地址，失败时返回MAP_FAILED。
- * 该函数用于分配一块内存，返回值为分配的内存地址。返回的内存地址是对齐到指定块大小的。 
- */
-  ret = mmap(fixed_base, aligned_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
-#endif
+  epicLog(LOG_INFO, "mmap_malloc size  = %ld, reserve = %ld, hugepage = %d, numa node = %d",
+      size, reserve, hugepage, numa_node); //打印分配请求的大小
+  /*
+   * 地址对齐：1GB大页对齐到1GB；2MB大页和透明大页对齐到2MB，使整个区域都能由大页支持；
+   * 其他情况对齐到BLOCK_SIZE。
+   * 先以PROT_NONE保留reserve大小的地址空间(不占用内存)，再用MAP_FIXED映射实际使用的部分，
+   * 以便之后在保留区间内原地增长。
+   */
+  size_t align = hugepage == HUGEPAGE_1G ? HUGEPAGE_1G_SIZE
+      : hugepage != HUGEPAGE_NONE ? HUGEPAGE_2M_SIZE : BLOCK_SIZE;
+  if (reserve < size) reserve = size;
+  size_t len = ALIGN(reserve, HUGEPAGE_2M_SIZE) + align;
+  void* ret = mmap(fixed_base, len, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
   if (ret == MAP_FAILED) {  //#define MAP_FAILED      ((void *)-1)
     perror("map failed");
     return NULL;//如果mmap返回MAP_FAILED，表示分配失败，打印错误信息并返回NULL
   }
+  map_base = ret;
+  map_size = len;
+  map_hugepage = hugepage;
+  map_numa_node = numa_node;
+
   uint64_t uret = (uint64_t) ret;
-  /*如果返回的内存地址不是块大小BLOCK_SIZE的整数倍，则将其向上对齐到最近的BLOCK_SIZE倍数。对齐的原因
-  1.确保分配的内存地址满足对齐要求，提高内存访问效率。
-  2.某些硬件或应用程序可能要求内存地址对齐到特定的边界。*/
-  if (uret % BLOCK_SIZE) {
-    uret += (BLOCK_SIZE - (uret % BLOCK_SIZE));
+  if (uret % align) {
+    uret += (align - (uret % align));
+  }
+  map_end = (char*) uret;
+  backing = mmap_range(map_end, size);
+  if (backing < 0) {
+    munmap(map_base, map_size);
+    map_base = nullptr;
+    return NULL;
   }
-  ret = (void*) uret;
 
 //	if(posix_memalign(&ret, BLOCK_SIZE, size)){
 //		epicLog(LOG_FATAL, "allocate memory %ld failed (%d:%s)", size, errno, strerror(errno));
 //	}
-  return ret;  //返回分配的内存地址。如果分配失败，返回NULL
+  return (void*) uret;  //返回分配的内存地址。如果分配失败，返回NULL
 }
 
-void SlabAllocator::mmap_free(void* ptr) {
-  uint64_t uptr = (uint64_t) ptr;
-  if (uptr % BLOCK_SIZE) {
-    uptr -= (BLOCK_SIZE - (uptr % BLOCK_SIZE));
+/*
+ * back [start, start + size) of the reservation with memory (rounded up to the
+ * page size of the backing) and extend map_end to its end.
+ * Return the backing (one of HUGEPAGE_*) or -1 on failure.
+ */
+int SlabAllocator::mmap_range(char* start, size_t size) {
+  char* end = (char*) map_base + map_size;
+  void* ret = MAP_FAILED;
+  int got = HUGEPAGE_NONE;
+  size_t len = 0;
+/* 参数说明：
+ * 1. start：保留区间内的起始地址(MAP_FIXED替换该处的PROT_NONE映射)。
+ * 2. len：要映射的内存大小。
+ * 3. PROT_READ | PROT_WRITE：内存的访问权限，表示可读可写。
+ * 4. MAP_PRIVATE | MAP_ANON：映射类型，MAP_PRIVATE表示私有映射，MAP_ANON表示匿名映射。
+ * 5. MAP_HUGETLB：表示使用大页内存映射(需要预留hugetlbfs页面，vm.nr_hugepages)。
+ * -1，0:表示不与文件关联
+ */
+  //explicit hugepages: 1GB falls back to 2MB, and 2MB to transparent hugepages
+  for (int hp = map_hugepage; hp >= HUGEPAGE_2M && ret == MAP_FAILED; hp--) {
+    size_t hsize = hp == HUGEPAGE_1G ? HUGEPAGE_1G_SIZE : HUGEPAGE_2M_SIZE;
+    len = ALIGN(size, hsize);
+    if ((uint64_t) start % hsize || start + len > end) continue;
+    ret = mmap(start, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED | MAP_HUGETLB
+        | (hp == HUGEPAGE_1G ? MAP_HUGE_1GB : MAP_HUGE_2MB), -1, 0);
+    if (ret == MAP_FAILED) {
+      epicLog(LOG_WARNING, "cannot map %lu bytes of %s hugepages (%d:%s), fall back",
+          len, hp == HUGEPAGE_1G ? "1GB" : "2MB", errno, strerror(errno));
+    } else {
+      got = hp;
+    }
   }
-  munmap((void*) uptr, mem_limit);
+  if (ret == MAP_FAILED) {
+    //transparent hugepages need 2MB aligned ranges
+    len = ALIGN(size, map_hugepage == HUGEPAGE_NONE ? (size_t) getpagesize() : HUGEPAGE_2M_SIZE);
+    ret = mmap(start, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0);
+    if (ret == MAP_FAILED) {
+      perror("map failed");
+      return -1;
+    }
+    if (map_hugepage != HUGEPAGE_NONE) {
+      if (madvise(ret, len, MADV_HUGEPAGE)) {
+        epicLog(LOG_WARNING, "madvise(MADV_HUGEPAGE) failed (%d:%s), use 4KB pages",
+            errno, strerror(errno));
+      } else {
+        got = HUGEPAGE_THP;
+      }
+    }
+  }
+
+  //bind the range before it is touched, so that all the pages come from the node
+  if (map_numa_node >= 0) {
+    unsigned long nodemask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = {};
+    if (map_numa_node >= NUMA_MAX_NODES) {
+      epicLog(LOG_WARNING, "numa node %d is out of range", map_numa_node);
+    } else {
+      nodemask[map_numa_node / (8 * sizeof(unsigned long))] |= 1UL << (map_numa_node % (8 * sizeof(unsigned long)));
+      if (syscall(SYS_mbind, ret, len, MPOL_BIND, nodemask, NUMA_MAX_NODES + 1, 0)) {
+        epicLog(LOG_WARNING, "cannot bind the region to numa node %d (%d:%s)",
+            map_numa_node, errno, strerror(errno));
+      }
+    }
+  }
+  map_end = start + len;
+  return got;
+}
+
+void SlabAllocator::mmap_free(void* ptr) {
+  //unmap the whole mapping, including the room used for the alignment
+  munmap(map_base, map_size);
   //free(ptr);
 }
 
 size_t SlabAllocator::get_avail() {
-  return mem_free;
+  //chunks allocated/freed through the thread caches are not counted in mem_free yet
+  lock();
+  long used = 0;
+  for (SlabThreadCache* c : caches)
+    used += c->allocated.load(std::memory_order_relaxed);
+  size_t ret = mem_free - used;
+  unlock();
+  return ret;
 }
 
 /**
@@ -134,24 +218,30 @@ const bool prealloc：是否预分配所有内存。如果为1，则预分配所
 2.灵活的内存分配策略：通过增长因子确定每个slab的块大小，支持灵活的内存分配策略。确保内存块的对齐，提高内存访问效率。
 3.内存统计和监控：提供内存分配的统计信息，方便监控和调试。支持测试套件的初始分配，方便测试和验证。*/
 void* SlabAllocator::slabs_init(const size_t limit, const double factor,
-                                const bool prealloc) {
-  epicLog(LOG_DEBUG, "limit = %ld, factor = %lf, prealloc = %d\n", limit,
-          factor, prealloc); //初始化日志
+                                const bool prealloc, int hugepage, int numa_node,
+                                size_t max_limit, size_t step) {
+  epicLog(LOG_DEBUG, "limit = %ld, factor = %lf, prealloc = %d, hugepage = %d, numa node = %d, max = %ld\n", limit,
+          factor, prealloc, hugepage, numa_node, max_limit); //初始化日志
   //初始化变量
   int i = POWER_SMALLEST - 1; //用于遍历slab类数组 
   unsigned int size = SB_PREFIX_SIZE + chunk_size; //初始化块大小，包括前缀大小和默认块大小
   unsigned int pre_size = size; //记录前一个块大小 
   mem_limit = limit; //设置最大内存限制
   mem_free = mem_limit; //初始化为mem_limit，表示当前可用内存 
+  mem_max = max_limit > limit ? max_limit : limit;  //可增长到的上限
+  grow_step = ALIGN(step ? step : item_size_max, item_size_max);
   //预分配内促
   if (prealloc) {
     /* Allocate everything in a big chunk with malloc */
     //hack by zh
-    mem_base = (char*) mmap_malloc(mem_limit); //如果prealloc为true，调用mmap_malloc分配一大块内存，mem_base指向分配的内存基地址
+    mem_base = (char*) mmap_malloc(mem_limit, mem_max, hugepage, numa_node); //如果prealloc为true，调用mmap_malloc分配一大块内存，mem_base指向分配的内存基地址
     if (mem_base != NULL) {
       dbprintf("allocate succeed\n");
       mem_current = mem_base; //指向当前可用内存的起始地址
       mem_avail = mem_limit; //记录当前可用内存大小
+      npages = mem_max / item_size_max + 1;  //cover the growth up front, as pages[] is not locked by the lookups
+      pages = (slab_page_t*) calloc(npages, sizeof(slab_page_t));
+      regions.push_back(std::make_pair(mem_base, mem_limit));
     } else { //如果分配失败，打印警告信息
       fprintf(stderr, "Warning: Failed to allocate requested memory in"
               " one large chunk.\nWill allocate in smaller chunks\n");
@@ -165,6 +255,14 @@ void* SlabAllocator::slabs_init(const size_t limit, const double factor,
     if (size % CHUNK_ALIGN_BYTES) //确保块大小是CHUNK_ALIGN_BYTES的倍数
       size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES); //如果不是，调整块大小以对齐
 
+    //小于BLOCK_SIZE时，为增长越过的每个cache line整数倍插入一个对齐的slab类
+    for (unsigned int a = ALIGN(pre_size + 1, HARDWARE_CACHE_LINE);
+        a < size && a < BLOCK_SIZE; a += HARDWARE_CACHE_LINE) {
+      slabclass[i].size = a;
+      slabclass[i].perslab = item_size_max / a;
+      i++;
+    }
+
     if ((int) (pre_size / BLOCK_SIZE) < (int) (size / BLOCK_SIZE) //初始化slab类描述符
         && (size % BLOCK_SIZE)) {
       slabclass[i].size = size / BLOCK_SIZE * BLOCK_SIZE; //当前slab类的块大小
@@ -173,6 +271,15 @@ void* SlabAllocator::slabs_init(const size_t limit, const double factor,
       i++;
     }
 
+    //大于BLOCK_SIZE时，在每个类下面插入一个cache line整数倍的类，使对齐的分配最多浪费一个增长因子
+    unsigned int cl = size / HARDWARE_CACHE_LINE * HARDWARE_CACHE_LINE;
+    if (size > BLOCK_SIZE && cl > pre_size && cl != size
+        && cl != size / BLOCK_SIZE * BLOCK_SIZE && i + 1 < POWER_LARGEST) {
+      slabclass[i].size = cl;
+      slabclass[i].perslab = item_size_max / cl;
+      i++;
+    }
+
     slabclass[i].size = size;//当前slab类的块大小
     slabclass[i].perslab = item_size_max / slabclass[i].size;//每个slab类中块的数量，计算公式如程序所示
     pre_size = size;
@@ -279,6 +386,13 @@ int SlabAllocator::grow_slab_list(const unsigned int id) {
 void SlabAllocator::split_slab_page_into_freelist(char *ptr, const unsigned int id) {
   slabclass_t *p = &slabclass[id]; //获取指定Slab类描述符，以便操作该Slab类的空闲列表 
   int x;
+  //register the page so that its chunks can be found by address without the lock
+  epicAssert(slab_reassign && (ptr - mem_base) % item_size_max == 0);
+  slab_page_t& pg = pages[(ptr - mem_base) >> SLAB_PAGE_SHIFT];
+  pg.id = id;
+  pg.nfree = 0;
+  pg.sizes = new uint32_t[p->perslab]();
+  pg.refs = new uint64_t[(p->perslab + 63) / 64]();
   /*遍历页面中的每个内存块，并将其加入空闲列表。
   p->perslab表示当前Slab类中每个页面包含的内存块数量。p->size表示当前Slab类中每个内存块的大小。*/
   for (x = 0; x < p->perslab; x++) { 
@@ -298,9 +412,9 @@ int SlabAllocator::do_slabs_newslab(const unsigned int id) {
   int len = slab_reassign ? item_size_max : p->size * p->perslab;//如果启用了slab_reassign，则分配的内存页面大小为item_size_max，否则为p->size * p->perslab ，即每个块的大小乘以每页的块数
   char *ptr;
   //检查内存分配限制和分配条件
-  if ((mem_limit && mem_malloced + len > mem_limit && p->slabs > 0)//内存限制；如果启用内存限制mem_limit，且当前已分配的内存(mem_malloced)加上新分配的内存(len)超过了限制，则分配失败；如果当前Slab类没有任何页面(p->slabs==0)，则允许分配。
-      || (grow_slab_list(id) == 0) //扩展Slab列表：调用grow_slab_list函数扩展Slab列表的容量。如果失败，则返回0
-      || ((ptr = (char *) memory_allocate((size_t) len)) == 0)) {//分配内存：分配新的内存页面。如果失败，则返回0
+  //内存限制在newslab_page中检查：如果已分配的内存(mem_malloced)加上新页面超过限制，则先从其他类迁移空闲页面
+  if ((grow_slab_list(id) == 0) //扩展Slab列表：调用grow_slab_list函数扩展Slab列表的容量。如果失败，则返回0
+      || ((ptr = newslab_page(id)) == 0)) {//分配内存：分配新的内存页面(优先复用空闲区间，必要时从其他类迁移)。如果失败，则返回0
 
     epicLog(LOG_WARNING, "new slab class %d failed", id); //如果任意条件不满足，记录日志并返回0，表示分配失败
     return 0;
@@ -317,6 +431,26 @@ int SlabAllocator::do_slabs_newslab(const unsigned int id) {
   return 1;
 }
 
+/*
+ * a page for class id: from the pool, or by growing the region if the pool
+ * is empty; with the lock held. The pages of the other classes are only
+ * moved by the background mover (slabs_rebalance), which gives the starved
+ * classes a page in advance.
+ */
+char* SlabAllocator::newslab_page(unsigned int id) {
+  slabclass_t* p = &slabclass[id];
+  char* ptr = nullptr;
+  //a class without any page is always allowed to get one
+  if (!mem_limit || mem_malloced + item_size_max <= mem_limit || p->slabs == 0)
+    ptr = page_alloc(1);
+  if (ptr)
+    return ptr;
+  p->starved++;
+  if (slabs_grow(item_size_max))
+    ptr = page_alloc(1);
+  return ptr;
+}
+
 /*@null@*/
 /*do_slabs_alloc是SlabAllocator类中用于从指定的Slab类分配内存块的核心函数。它的主要功能包括：
 1.从指定的Slab类中分配内存块。
@@ -328,7 +462,6 @@ int SlabAllocator::do_slabs_newslab(const unsigned int id) {
 void * SlabAllocator::do_slabs_alloc(const size_t size, unsigned int id) {
   slabclass_t *p;
   void *ret = NULL;
-  item *it = NULL;
   //检查Slab类ID是否在有效范围内
   if (id < POWER_SMALLEST || id > power_largest) {
     MEMCACHED_SLABS_ALLOCATE_FAILED(size, 0); //如果无效，记录分配失败的日志并返回NULL
@@ -340,8 +473,7 @@ void * SlabAllocator::do_slabs_alloc(const size_t size, unsigned int id) {
   p->lock();
 #endif
 
-  //printf("sl_curr = %d, ((item *)p->slots)->slabs_clsid = %d\n", p->sl_curr, ((item *)p->slots)->slabs_clsid);
-  assert(p->sl_curr == 0 || ((item * )p->slots)->slabs_clsid == 0);
+  assert(p->sl_curr == 0 || chunk_req_size(p->slots) == 0);
 
   /* fail unless we have space at the end of a recently allocated page,
    we have something on our freelist, or we could allocate a new page */
@@ -353,17 +485,9 @@ void * SlabAllocator::do_slabs_alloc(const size_t size, unsigned int id) {
     ret = NULL;  //如果没有可用的内存块且无法分配新的Slab页面，则返回NULL 
   } else if (p->sl_curr != 0) {  //从空闲列表中分配内存块
     /* return off our freelist */
-    it = (item *) p->slots; //从当前Slab类的空闲列表p->slots中获取一个内存块
-    p->slots = it->next; //更新空闲列表的头指针(p->slots)为下一个内存块 
-    if (it->next)
-      it->next->prev = 0;
-    //hack by zh
-    it->size = size; //设置分配的内存块的大小it->size
-    it->slabs_clsid = id; //设置分配的内存块的Slab类ID it->slabs_clsid
-
-    p->sl_curr--;  //减少空闲块计数
-    //ret = (void *)it; //sep
-    ret = it->data;  //sep  设置返回值为分配的内存块的地址
+    ret = p->slots; //从当前Slab类的空闲列表p->slots中获取一个内存块
+    freelist_unlink(p, ret); //更新空闲列表的头指针(p->slots)为下一个内存块，并减少空闲块计数
+    chunk_req_size(ret) = size; //记录分配的内存块的大小
   }
 #ifdef FINE_SLAB_LOCK
   p->unlock();
@@ -388,9 +512,7 @@ void * SlabAllocator::do_slabs_alloc(const size_t size, unsigned int id) {
 void SlabAllocator::do_slabs_free(void *ptr, const size_t size,
                                   unsigned int id) {
   slabclass_t *p;
-  item *it;
 
-  //assert(((item *)ptr)->slabs_clsid == 0); //sep
   assert(id >= POWER_SMALLEST && id <= power_largest);//检查Slab类ID的合法性
   if (id < POWER_SMALLEST || id > power_largest) //确保指定的slab类ID在有效范围内
     return; //如果ID不合法，直接返回，不执行后续操作
@@ -398,23 +520,7 @@ void SlabAllocator::do_slabs_free(void *ptr, const size_t size,
   MEMCACHED_SLABS_FREE(size, id, ptr); //调用MEMCACHED_SLABS_FREE宏函数记录内存释放事件 
   p = &slabclass[id]; //获取指定Slab类描述符，以便操作该Slab类的空闲列表
 
-  //it = (item *)ptr; //sep
-  if (stats_map.count(ptr)) { //检查stats_map中是否已存在内存块的元数据
-    it = stats_map.at(ptr);  //如果存在，，直接获取元数据
-  } else {
-    it = new item(); //如果不存在，创建新的item对象，并将其与内存块地址关联
-    stats_map[ptr] = it;
-  }
-  it->data = ptr;  //sep
-
-  it->it_flags |= ITEM_SLABBED;//标记内存块的标志位，表示该内存块已释放并可重用
-  it->prev = 0;
-  it->next = (struct _stritem *) p->slots; //将内存块插入到当前Slab类的空闲列表
-  if (it->next)
-    it->next->prev = it; 
-  p->slots = it; //更新空闲列表的头指针为当前内存块
-
-  p->sl_curr++; //增加当前Slab类的空闲块计数 
+  freelist_push(p, ptr); //将内存块插入到当前Slab类的空闲列表(链接存放在块的末尾)，并增加空闲块计数
   p->requested -= size; //减少当前Slab类的已分配内存统计信息 
   if (size) //如果size不为零
     mem_free += p->size; //增加全局的空闲内存统计信息 
@@ -426,23 +532,10 @@ void SlabAllocator::do_slabs_free(void *ptr, const size_t size,
  */
 void * SlabAllocator::sb_malloc(size_t size) {
 
-#ifdef DHT
-	/*
-	 * enable to allocate memory larger than 1M
-	 * FIXME: not support free of large block for now
-	 */
-	if(size > item_size_max) {
-		lock();
-		void* ret = memory_allocate(size);
-		epicLog(LOG_WARNING, "allocate memory %lu, larger than default max %d, at %lx", size, item_size_max, ret);
-		epicAssert(((uint64_t)ret % BLOCK_SIZE) == 0);
-		bigblock_map[ret] = size;
-		unlock();
-		return ret;
-	}
-#endif
+  //大于最大slab块的对象按页分配
+  if (size + SB_PREFIX_SIZE > item_size_max)
+    return large_alloc(size + SB_PREFIX_SIZE);
 
-  lock();
   /*
    * if the slab-allocator isn't initiated, we use the default malloc()!
    */
@@ -456,14 +549,43 @@ void * SlabAllocator::sb_malloc(size_t size) {
   unsigned int id = slabs_clsid(newsize);
   //item * ret = (item *)slabs_alloc(newsize, id); //sep
   //return ret == NULL ? NULL : ITEM_key(ret); //sep
-  void* ret = slabs_alloc(newsize, id);  //sep
-  epicAssert(ret);
-  unlock();
+  void* ret;
+  if (slabclass[id].size <= SLAB_MAGAZINE_MAX_CHUNK) {
+    ret = cache_alloc(newsize, id);
+  } else {
+    lock();
+    ret = slabs_alloc(newsize, id);  //sep
+    unlock();
+  }
+  //the class is starved until the slab mover moves a page to the pool
+  if (unlikely(!ret))
+    epicLog(LOG_DEBUG, "no free chunk of %lu bytes", newsize);
   return ret;
 }
+/*
+ * allocate n objects of the same size, taking the lock only once;
+ * return the number of objects allocated (less than n if out of memory)
+ */
+int SlabAllocator::sb_malloc_many(size_t size, int n, void** out) {
+  int i = 0;
+  if (size + SB_PREFIX_SIZE > item_size_max) {
+    for (; i < n && (out[i] = large_alloc(size + SB_PREFIX_SIZE)); i++);
+    return i;
+  }
+  if (unlikely(mem_limit == 0))
+    return 0;
+
+  size_t newsize = size + SB_PREFIX_SIZE;
+  unsigned int id = slabs_clsid(newsize);
+  lock();
+  for (; i < n && (out[i] = do_slabs_alloc(newsize, id)); i++);
+  unlock();
+  return i;
+}
+
 /*sb_aligned_malloc是SlabAllocator类中的一个内存分配函数，用于分配对齐的内存块。它的主要功能包括：
 1.分配指定大小的内存块，并确保内存地址对齐到指定的边界(block)
-2.支持分配大于默认最大块大小(item_size_max)的内存(如果启用了DHT宏)
+2.支持分配大于默认最大块大小(item_size_max)的内存(按页从区间分配器分配)
 3.通过SLab分配器管理内存，减少内存碎片并提高分配效率
 参数：
 1.size:需要分配的内存大小（以字节为单位）
@@ -473,23 +595,12 @@ void * SlabAllocator::sb_malloc(size_t size) {
 */
 void * SlabAllocator::sb_aligned_malloc(size_t size, size_t block) {
 
-#ifdef DHT
-	/*
-	 * enable to allocate memory larger than 1M
-	 * FIXME: not support free of large block for now
-	 */
-	if(size > item_size_max) {
-		epicLog(LOG_WARNING, "allocate memory %lu, larger than default max %lu", size, item_size_max);
-		lock();
-		void* ret = memory_allocate(size);
-		epicAssert((uint64_t)ret % BLOCK_SIZE == 0);
-		bigblock_map[ret] = size;
-		unlock();
-		return ret;
-	}
-#endif
+  //大于最大slab块的对象按页分配，页对齐(item_size_max)满足任意不超过BLOCK_SIZE的对齐要求
+  if (ALIGN(size + SB_PREFIX_SIZE, block) > item_size_max) {
+    epicAssert(block <= BLOCK_SIZE);
+    return large_alloc(size + SB_PREFIX_SIZE);
+  }
 
-  lock();
   /*
    * if the slab-allocator isn't initiated, we use the default malloc()!
    */
@@ -504,13 +615,22 @@ void * SlabAllocator::sb_aligned_malloc(size_t size, size_t block) {
   newsize = ALIGN(newsize, block);//使用ALIGN宏将newsize对齐到指定的块大小block的倍数。
   //确定Slab类ID
   unsigned int id = slabs_clsid(newsize); //根据新的内存大小newsize计算Slab类ID，slabs_clsid函数返回对应的Slab类ID。每个Slab类对应不同大小的内存块
+  //只有块大小是block整数倍的类才能保证对齐(最大的类大小为item_size_max)，
+  //它可能比slabs_clsid(newsize)大，所以释放时以页描述符中的类为准
+  while (slabclass[id].size % block && id < power_largest) id++;
   //item * ret = (item *)slabs_alloc(newsize, id); //sep
   //return ret == NULL ? NULL : ITEM_key(ret); //sep
-  void* ret = slabs_alloc(newsize, id);  //调用slabs_alloc函数，从指定的Slab类中分配内存，
-  epicAssert(ret);//如果分配失败，epicAssert(ret)会触发断言，表示分配失败。分配成功后，ret指向分配的内存块。 
+  void* ret;  //从指定的Slab类中分配内存，小块走线程缓存，不需要加锁
+  if (slabclass[id].size <= SLAB_MAGAZINE_MAX_CHUNK) {
+    ret = cache_alloc(newsize, id);
+  } else {
+    lock();
+    ret = slabs_alloc(newsize, id);
+    unlock();
+  }
+  //如果分配失败(类在等待slab mover给它新页面)，返回NULL。分配成功后，ret指向分配的内存块。
   epicLog(LOG_DEBUG, "ret = %lx, newsize = %d", ret, newsize);
   epicAssert((uint64_t )ret % block == 0); //确保分配的内存地址对齐到指定的块大小block的倍数 
-  unlock(); //解锁分配器，允许其他线程进行内存分配
   return ret; //返回分配的内存地址
 }
 
@@ -576,70 +696,68 @@ void *SlabAllocator::sb_realloc(void * ptr, size_t size) {
   if (ptr == NULL)
     return sb_malloc(size);
 
+  //moving from/to the large-object tier
+  size_t osize = get_size(ptr);
+  if (osize > item_size_max || size + SB_PREFIX_SIZE > item_size_max) {
+    void* ret = sb_malloc(size);
+    if (!ret) return NULL;  //ptr is left as it is
+    memcpy(ret, ptr, osize < size ? osize : size);
+    sb_free(ptr);
+    return ret;
+  }
+
   lock();
-  //item * it1 = (item *) ((char*)ptr-SB_PREFIX_SIZE); //sep
-  epicAssert(stats_map.count(ptr));  //sep
-  item* it1 = stats_map.at(ptr);  //sep
-  unsigned int id1 = it1->slabs_clsid;
-  int size1 = it1->size;
-  epicAssert(id1 == slabs_clsid(size1));
+  uint32_t& size1 = chunk_req_size(ptr);
+  unsigned int id1 = chunk_page(ptr).id;
+  epicAssert(size1 && size1 <= slabclass[id1].size);  //an aligned chunk may be in a bigger class
 
   size_t size2 = size + SB_PREFIX_SIZE;
   unsigned int id2 = slabs_clsid(size2);
   void* ret = nullptr;
   if (id1 == id2) {
-    it1->size = size2;
     slabs_adjust_mem_requested(id1, size1, size2);
+    size1 = size2;
     ret = ptr;
   } else {
     epicAssert(size1 != size2);
-    //item * it2 = (item *)slabs_alloc(size2, id2); //sep
-    void* ptr = slabs_alloc(size2, id2);  //sep
-    epicAssert(stats_map.count(ptr));  //sep
-    item* it2 = stats_map.at(ptr);  //sep
+    ret = slabs_alloc(size2, id2);
+    if (!ret) {  //ptr is left as it is
+      unlock();
+      return NULL;
+    }
 
     if (size2 < size1)
-      memcpy(ITEM_key(it2), ptr, size);
+      memcpy(ret, ptr, size);
     else
-      memcpy(ITEM_key(it2), ptr, size1 - SB_PREFIX_SIZE);
+      memcpy(ret, ptr, size1 - SB_PREFIX_SIZE);
 
-    //need to clear the clsid as the original memcached implementation check this in free function
-    it1->slabs_clsid = 0;
-    //slabs_free(it1, size1, id1); //sep
-    slabs_free(it1->data, size1, id1);  //sep
-    ret = ITEM_key(it2);
+    size_t osize = size1;
+    size1 = 0;
+    slabs_free(ptr, osize, id1);
   }
   unlock();
-  epicAssert(ret);
   return ret;
 }
 
 bool SlabAllocator::is_free(void* ptr) {
-  lock();
-  epicAssert(stats_map.count(ptr));  //sep
-  item* it = stats_map.at(ptr);  //sep
-  bool ret = it->slabs_clsid == 0 ? true : false;
-  unlock();
-  return ret;
+  return get_size(ptr) == 0;
 }
 
 size_t SlabAllocator::get_size(void* ptr) {
-  epicAssert(stats_map.count(ptr));
-  item* it = stats_map[ptr];
-  return it->size;
+  slab_page_t& pg = pages[((char*)ptr - mem_base) >> SLAB_PAGE_SHIFT];
+  if (!pg.sizes)
+    return pg.large;
+  return chunk_req_size(ptr);
 }
 
-size_t SlabAllocator::sb_free(void *ptr) {
-  lock();
-
-#ifdef DHT
-	if(bigblock_map.count(ptr)) {
-		epicLog(LOG_WARNING, "not support free of big block for now");
-		unlock();
-		return 0;
-	}
-#endif
+size_t SlabAllocator::get_chunk_size(void* ptr) {
+  slab_page_t& pg = page_of(ptr);
+  if (!pg.sizes)
+    return pg.large;
+  return slabclass[pg.id].size;
+}
 
+size_t SlabAllocator::sb_free(void *ptr) {
   /*
    * if the slab-allocator isn't initiated, we use the default free()!
    */
@@ -648,22 +766,147 @@ size_t SlabAllocator::sb_free(void *ptr) {
     return 0;
   }
 
-  //item * it = (item *) ((char*)ptr-SB_PREFIX_SIZE); //sep
-  epicAssert(stats_map.count(ptr));  //sep
-  item* it = stats_map.at(ptr);  //sep
-  unsigned int id = it->slabs_clsid;
-  size_t size = it->size;
+  slab_page_t& pg = pages[((char*)ptr - mem_base) >> SLAB_PAGE_SHIFT];
+  if (unlikely(!pg.sizes))
+    return large_free(ptr);
+  unsigned int id = pg.id;
+  uint32_t& csize = pg.sizes[(((char*)ptr - mem_base) & (item_size_max - 1)) / slabclass[id].size];
+  size_t size = csize;
 
-  assert(id == slabs_clsid(it->size));
-  it->slabs_clsid = 0;
-  it->size = 0;
-  //slabs_free(it, it->size, id); //sep
+  assert(size && size <= slabclass[id].size);  //an aligned chunk may be in a bigger class
+  csize = 0;
   //FIXME: remove below
-  memset(it->data, 0, size);
-  slabs_free(it->data, size, id);
-  unlock();
+  memset(ptr, 0, size);
+  if (slabclass[id].size <= SLAB_MAGAZINE_MAX_CHUNK) {
+    cache_free(ptr, id);
+  } else {
+    lock();
+    slabs_free(ptr, size, id);
+    unlock();
+  }
   return size;
 }
+
+namespace {
+/*the thread caches of the calling thread (one for each allocator it uses)*/
+struct ThreadCaches {
+  std::vector<SlabThreadCache*> list;
+  SlabThreadCache* last = nullptr;  //the most recently used one
+
+  ~ThreadCaches() {
+    for (SlabThreadCache* c : list) {
+      SlabAllocator* owner = c->owner.load();
+      if (owner) owner->release_cache(c);
+      delete[] c->mags;
+      delete c;
+    }
+  }
+};
+thread_local ThreadCaches tcaches;
+}
+
+SlabThreadCache* SlabAllocator::get_cache() {
+  SlabThreadCache* c = tcaches.last;
+  if (likely(c && c->owner.load(std::memory_order_relaxed) == this))
+    return c;
+  for (SlabThreadCache* t : tcaches.list) {
+    if (t->owner.load(std::memory_order_relaxed) == this) {
+      tcaches.last = t;
+      return t;
+    }
+  }
+
+  c = new SlabThreadCache();
+  c->owner = this;
+  c->mags = new slab_magazine_t[power_largest + 1]();
+  c->allocated = 0;
+  lock();
+  caches.push_back(c);
+  unlock();
+  tcaches.list.push_back(c);
+  tcaches.last = c;
+  return c;
+}
+
+/*
+ * take (up to) half a magazine of chunks off the freelist of class id,
+ * with the lock held
+ */
+void SlabAllocator::cache_refill(SlabThreadCache* c, unsigned int id) {
+  slabclass_t* p = &slabclass[id];
+  slab_magazine_t& m = c->mags[id];
+  while (m.n < SLAB_MAGAZINE_SIZE / 2) {
+    if (p->sl_curr == 0 && do_slabs_newslab(id) == 0) break;
+    void* ptr = p->slots;
+    freelist_unlink(p, ptr);
+    m.chunks[m.n++] = ptr;
+  }
+}
+
+/*
+ * put the top n chunks of the magazine back to the freelist of class id,
+ * with the lock held; the same as do_slabs_free without the accounting,
+ * which is done by the thread cache
+ */
+void SlabAllocator::cache_spill(SlabThreadCache* c, unsigned int id, unsigned int n) {
+  slabclass_t* p = &slabclass[id];
+  slab_magazine_t& m = c->mags[id];
+  epicAssert(n <= m.n);
+  while (n--) {
+    freelist_push(p, m.chunks[--m.n]);
+  }
+}
+
+void* SlabAllocator::cache_alloc(size_t size, unsigned int id) {
+  if (id < POWER_SMALLEST || id > power_largest)
+    return NULL;
+  SlabThreadCache* c = get_cache();
+  slab_magazine_t& m = c->mags[id];
+  if (unlikely(m.n == 0)) {
+    lock();
+    cache_refill(c, id);
+    unlock();
+    if (m.n == 0) {
+      MEMCACHED_SLABS_ALLOCATE_FAILED(size, id);
+      return NULL;
+    }
+  }
+  void* ptr = m.chunks[--m.n];
+  //the links of a chunk in a magazine are stale, clear them as the rest of the chunk
+  SLAB_LINK(ptr, slabclass[id].size) = 0;
+  SLAB_PREV(ptr, slabclass[id].size) = 0;
+  chunk_req_size(ptr) = size;
+  c->allocated.store(c->allocated.load(std::memory_order_relaxed) + slabclass[id].size,
+                     std::memory_order_relaxed);
+  return ptr;
+}
+
+void SlabAllocator::cache_free(void* ptr, unsigned int id) {
+  SlabThreadCache* c = get_cache();
+  slab_magazine_t& m = c->mags[id];
+  if (unlikely(m.n == SLAB_MAGAZINE_SIZE)) {
+    lock();
+    cache_spill(c, id, SLAB_MAGAZINE_SIZE / 2);
+    unlock();
+  }
+  m.chunks[m.n++] = ptr;
+  c->allocated.store(c->allocated.load(std::memory_order_relaxed) - slabclass[id].size,
+                     std::memory_order_relaxed);
+}
+
+void SlabAllocator::release_cache(SlabThreadCache* c) {
+  lock();
+  for (int id = POWER_SMALLEST; id <= power_largest; id++)
+    cache_spill(c, id, c->mags[id].n);
+  mem_free -= c->allocated.load();
+  for (auto it = caches.begin(); it != caches.end(); ++it) {
+    if (*it == c) {
+      caches.erase(it);
+      break;
+    }
+  }
+  unlock();
+}
 /*用于从指定的Slab类中分配内存块。
 参数：需要分配的内存大小size；指定的Slab类ID，表示从哪个Slab类中分配内存*/
 void *SlabAllocator::slabs_alloc(size_t size, unsigned int id) {
@@ -707,7 +950,351 @@ void SlabAllocator::slabs_adjust_mem_requested(unsigned int id, size_t old,
   ////pthread_mutex_unlock(&slabs_lock);
 }
 
+/*
+ * best fit among the free extents, or carve from mem_current;
+ * with the lock held
+ */
+char* SlabAllocator::page_alloc(size_t n) {
+  auto it = free_extents_by_len.lower_bound(n);
+  if (it == free_extents_by_len.end())
+    return (char*) memory_allocate(n * item_size_max);
+
+  char* start = it->second;
+  size_t len = it->first;
+  free_extents_by_len.erase(it);
+  free_extents.erase(start);
+  if (len > n)
+    add_extent(start + n * item_size_max, len - n);
+  return start;
+}
+
+void SlabAllocator::add_extent(char* start, size_t n) {
+  free_extents[start] = n;
+  free_extents_by_len.insert(std::make_pair(n, start));
+}
+
+void SlabAllocator::del_extent(std::map<char*, size_t>::iterator it) {
+  auto range = free_extents_by_len.equal_range(it->second);
+  for (auto i = range.first; i != range.second; ++i) {
+    if (i->second == it->first) {
+      free_extents_by_len.erase(i);
+      break;
+    }
+  }
+  free_extents.erase(it);
+}
+
+/*
+ * give back n pages at ptr, coalesced with the free neighbours;
+ * with the lock held
+ */
+void SlabAllocator::page_free(char* ptr, size_t n) {
+  auto next = free_extents.find(ptr + n * item_size_max);
+  if (next != free_extents.end()) {
+    n += next->second;
+    del_extent(next);
+  }
+  auto prev = free_extents.lower_bound(ptr);
+  if (prev != free_extents.begin()) {
+    --prev;
+    if (prev->first + prev->second * item_size_max == ptr) {
+      ptr = prev->first;
+      n += prev->second;
+      del_extent(prev);
+    }
+  }
+
+  if (ptr + n * item_size_max == mem_current) {
+    //the last extent carved from the region
+    mem_current = ptr;
+    mem_avail += n * item_size_max;
+  } else {
+    add_extent(ptr, n);
+  }
+}
+
+void* SlabAllocator::large_alloc(size_t size) {
+  if (unlikely(mem_limit == 0)) {
+    dbprintf("sb_mallocator is not initiated. Use default malloc\n");
+    return NULL;
+  }
+  size_t n = (size + item_size_max - 1) / item_size_max;
+  lock();
+  char* ret = page_alloc(n);
+  if (!ret && slabs_grow(n * item_size_max))
+    ret = page_alloc(n);
+  if (likely(ret)) {
+    slab_page_t& pg = pages[(ret - mem_base) >> SLAB_PAGE_SHIFT];
+    epicAssert(!pg.sizes && !pg.large);
+    pg.large = size;
+    large_objects++;
+    large_pages += n;
+    mem_free -= n * item_size_max;
+  } else {
+    epicLog(LOG_WARNING, "no free extent of %lu pages for a large object of %lu bytes", n, size);
+  }
+  unlock();
+  epicLog(LOG_DEBUG, "allocate large object of %lu bytes at %p", size, ret);
+  return ret;
+}
+
+size_t SlabAllocator::large_free(void* ptr) {
+  char* p = (char*) ptr;
+  epicAssert((p - mem_base) % item_size_max == 0);
+  slab_page_t& pg = pages[(p - mem_base) >> SLAB_PAGE_SHIFT];
+  size_t size = pg.large;
+  epicAssert(size > item_size_max);
+  size_t n = (size + item_size_max - 1) / item_size_max;
+  //FIXME: remove below (keep freed memory zeroed as the slab chunks)
+  memset(ptr, 0, size);
+
+  lock();
+  pg.large = 0;
+  pg.ref = 0;
+  page_free(p, n);
+  large_objects--;
+  large_pages -= n;
+  mem_free += n * item_size_max;
+  unlock();
+  return size;
+}
+
+/*
+ * add max(size, grow_step) bytes at the end of the region (as far as mem_max allows),
+ * backing them first if they are beyond map_end; with the lock held.
+ * The new bytes are carved from mem_current as the rest of the region,
+ * as mem_current + mem_avail is always the end of the region.
+ */
+bool SlabAllocator::slabs_grow(size_t size) {
+  if (!mem_base || mem_limit >= mem_max)
+    return false;
+  size = ALIGN(size > grow_step ? size : grow_step, item_size_max);
+  if (mem_limit + size > mem_max)
+    size = mem_max - mem_limit;
+  char* start = mem_base + mem_limit;
+  if (start + size > map_end && mmap_range(map_end, start + size - map_end) < 0) {
+    epicLog(LOG_WARNING, "cannot grow the region by %lu bytes", size);
+    return false;
+  }
+  regions.push_back(std::make_pair(start, size));
+  mem_limit += size;
+  mem_free += size;
+  mem_avail += size;
+  epicLog(LOG_INFO, "grew the region by %lu bytes to %lu (max = %lu)", size, mem_limit, mem_max);
+  return true;
+}
+
+size_t SlabAllocator::scan_cold(size_t min_size, size_t max, std::vector<void*>& out) {
+  lock();
+  size_t n = mem_limit / item_size_max, i;
+  for (i = 0; i < n && out.size() < max; i++) {
+    if (clock_hand >= n) clock_hand = 0;
+    slab_page_t& pg = pages[clock_hand];
+    char* start = mem_base + clock_hand * item_size_max;
+    if (pg.large) {
+      if (__atomic_load_n(&pg.ref, __ATOMIC_RELAXED))
+        __atomic_store_n(&pg.ref, 0, __ATOMIC_RELAXED);
+      else if (pg.large >= min_size)
+        out.push_back(start);
+    } else if (pg.sizes && slabclass[pg.id].size >= min_size) {
+      //resume in the page where the last pass stopped
+      unsigned int size = slabclass[pg.id].size, perslab = slabclass[pg.id].perslab;
+      for (; clock_chunk < perslab && out.size() < max; clock_chunk++) {
+        unsigned int j = clock_chunk;
+        if (!pg.sizes[j]) continue;
+        uint64_t bit = 1UL << (j % 64);
+        if (__atomic_load_n(&pg.refs[j / 64], __ATOMIC_RELAXED) & bit)
+          __atomic_fetch_and(&pg.refs[j / 64], ~bit, __ATOMIC_RELAXED);
+        else
+          out.push_back(start + j * size);
+      }
+      if (clock_chunk < perslab) {  //out is full: the next pass resumes in this page
+        i++;
+        break;
+      }
+    }
+    clock_hand++;
+    clock_chunk = 0;
+  }
+  unlock();
+  return i;
+}
+
+void SlabAllocator::scan_range(void* start, size_t len, std::vector<std::pair<void*, size_t>>& out) {
+  lock();
+  char* end = std::min((char*)start + len, mem_base + mem_limit);
+  for (char* page = (char*)start; page < end; page += item_size_max) {
+    slab_page_t& pg = pages[(page - mem_base) >> SLAB_PAGE_SHIFT];
+    if (pg.large) {
+      out.push_back(std::make_pair((void*)page, pg.large));
+    } else if (pg.sizes) {
+      unsigned int size = slabclass[pg.id].size;
+      for (unsigned int j = 0; j < slabclass[pg.id].perslab; j++) {
+        if (pg.sizes[j]) out.push_back(std::make_pair((void*)(page + j * size), (size_t)size));
+      }
+    }
+  }
+  unlock();
+}
+
+std::vector<std::pair<char*, size_t>> SlabAllocator::get_regions() {
+  lock();
+  std::vector<std::pair<char*, size_t>> ret = regions;
+  unlock();
+  return ret;
+}
+
+SlabAllocator::ExtentStats SlabAllocator::get_extent_stats() {
+  ExtentStats st = {};
+  lock();
+  st.objects = large_objects;
+  st.used_pages = large_pages;
+  st.free_extents = free_extents.size();
+  for (auto& e : free_extents) {
+    st.free_pages += e.second;
+    if (e.second > st.largest_free) st.largest_free = e.second;
+  }
+  st.unused_pages = mem_avail / item_size_max;
+  unlock();
+  return st;
+}
+
+/*
+ * release up to max pages of class id whose chunks are all in the freelist
+ * (by the nfree of the page descriptors), with the lock held.
+ * Chunks in the thread caches keep their pages.
+ */
+size_t SlabAllocator::slabs_evacuate(unsigned int id, size_t max) {
+  slabclass_t* p = &slabclass[id];
+  size_t moved = 0;
+  for (unsigned int i = 0; i < p->slabs && moved < max;) {
+    char* pg = (char*)p->slab_list[i];
+    slab_page_t& d = page_of(pg);
+    if (d.nfree != p->perslab) {
+      i++;
+      continue;
+    }
+    //unlink the chunks of the page from the (doubly linked) freelist
+    for (unsigned int j = 0; j < p->perslab; j++)
+      freelist_unlink(p, pg + j * p->size);
+    epicAssert(d.nfree == 0);
+    p->slab_list[i] = p->slab_list[--p->slabs];
+    delete[] d.sizes;
+    delete[] d.refs;
+    d.sizes = nullptr;
+    d.refs = nullptr;
+    d.id = 0;
+    page_free(pg, 1);
+    mem_malloced -= item_size_max;
+    moved++;
+  }
+  if (!moved)
+    return 0;
+  p->moved += moved;
+  epicLog(LOG_INFO, "slab mover: released %lu pages of class %u (chunk size %u, %u pages left)",
+      moved, id, p->size, p->slabs);
+  return moved;
+}
+
+/*
+ * move up to want pages to the pool, from the classes with the most
+ * spare free chunks first; with the lock held
+ */
+size_t SlabAllocator::slabs_reclaim(size_t want) {
+  std::vector<std::pair<size_t, unsigned int>> donors;  //spare pages -> class
+  for (int id = POWER_SMALLEST; id <= power_largest; id++) {
+    slabclass_t* p = &slabclass[id];
+    if (!p->perslab) continue;
+    size_t spare = p->sl_curr / p->perslab;
+    if (spare > SLAB_REBALANCE_KEEP_PAGES)
+      donors.push_back(std::make_pair(spare - SLAB_REBALANCE_KEEP_PAGES, id));
+  }
+  std::sort(donors.rbegin(), donors.rend());
+
+  size_t moved = 0;
+  for (auto& d : donors) {
+    if (moved >= want) break;
+    moved += slabs_evacuate(d.second, std::min(d.first, want - moved));
+  }
+  return moved;
+}
+
+size_t SlabAllocator::slabs_rebalance() {
+  if (unlikely(mem_limit == 0))
+    return 0;
+  lock();
+  size_t pool = mem_avail / item_size_max;
+  for (auto& e : free_extents)
+    pool += e.second;
+  size_t moved = 0;
+  if (pool < SLAB_REBALANCE_RESERVE)
+    moved = slabs_reclaim(SLAB_REBALANCE_RESERVE - pool);
+
+  //give the starving classes a page in advance
+  for (int id = POWER_SMALLEST; id <= power_largest; id++) {
+    slabclass_t* p = &slabclass[id];
+    if (!p->starved) continue;
+    epicLog(LOG_INFO, "slab mover: class %u (chunk size %u) starved %u times",
+        id, p->size, p->starved);
+    p->starved = 0;
+    if (p->sl_curr == 0)
+      do_slabs_newslab(id);
+  }
+  unlock();
+  return moved;
+}
+
+std::vector<SlabAllocator::SlabClassStats> SlabAllocator::get_class_stats() {
+  std::vector<SlabClassStats> ret;
+  lock();
+  for (int id = POWER_SMALLEST; id <= power_largest; id++) {
+    slabclass_t* p = &slabclass[id];
+    if (!p->slabs && !p->moved) continue;
+    SlabClassStats st = {};
+    st.id = id;
+    st.size = p->size;
+    st.pages = p->slabs;
+    st.free = p->sl_curr;
+    for (SlabThreadCache* c : caches)
+      st.cached += c->mags[id].n;  //racy read of the other threads, good enough for stats
+    st.used = (size_t)p->slabs * p->perslab - st.free - st.cached;
+    st.starved = p->starved;
+    st.moved = p->moved;
+    ret.push_back(st);
+  }
+  unlock();
+  return ret;
+}
+
+size_t SlabAllocator::get_metadata() {
+  lock();
+  size_t ret = npages * sizeof(slab_page_t);
+  ret += free_extents.size() * 2 * (sizeof(char*) + sizeof(size_t) + 4 * sizeof(void*));  //map nodes
+  for (size_t i = 0; i < npages; i++) {
+    if (pages[i].sizes)
+      ret += slabclass[pages[i].id].perslab * sizeof(uint32_t)
+          + (slabclass[pages[i].id].perslab + 63) / 64 * sizeof(uint64_t);
+  }
+  for (SlabThreadCache* c : caches)
+    ret += sizeof(SlabThreadCache) + (power_largest + 1) * sizeof(slab_magazine_t);
+  unlock();
+  return ret;
+}
+
 SlabAllocator::~SlabAllocator() {
+  //the thread caches are freed by their threads
+  lock();
+  for (SlabThreadCache* c : caches)
+    c->owner = nullptr;
+  caches.clear();
+  unlock();
+  if (pages) {
+    for (size_t i = 0; i < npages; i++) {
+      delete[] pages[i].sizes;
+      delete[] pages[i].refs;
+    }
+    free(pages);
+  }
   if (mem_base)
     mmap_free(mem_base);
 }
@@ -0,0 +1,581 @@
+// Copyright (c) 2018 The GAM Authors
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "tcp_transport.h"
+#include "rdma.h"
+#include "anet.h"
+#include "zmalloc.h"
+#include "kernel.h"
+#include "log.h"
+
+static void TcpAcceptHandle(aeEventLoop *el, int fd, void *data, int mask) {
+  ((TcpResource*)data)->Accept();
+}
+
+static void TcpHelloHandle(aeEventLoop *el, int fd, void *data, int mask) {
+  ((TcpResource*)data)->ReadHello(fd);
+}
+
+static void TcpWriteHandle(aeEventLoop *el, int fd, void *data, int mask) {
+  ((TcpContext*)data)->OnWritable();
+}
+
+static void TcpReadHandle(aeEventLoop *el, int fd, void *data, int mask) {
+  TcpContext* ctx = (TcpContext*)data;
+  if (ctx->OnReadable()) ctx->SetRecvFd(-1);
+}
+
+TcpResource::TcpResource(bool master, const std::string& host)
+    : isForMaster(master), port(0), ip(0), base(nullptr), size(0),
+      id_counter(0), context_counter(0) {
+  char neterr[ANET_ERR_LEN];
+  char ipstr[IP_STR_LEN];
+  char* bind_addr = nullptr;
+
+  if (host.length()) {
+    if (anetResolve(neterr, const_cast<char*>(host.c_str()), ipstr, sizeof(ipstr)) == ANET_ERR) {
+      epicLog(LOG_FATAL, "Unable to resolve %s (%s)", host.c_str(), neterr);
+      throw TCP_RESOURCE_EXCEPTION;
+    }
+    bind_addr = ipstr;
+  }
+
+  //data port is an ephemeral one, it is exchanged in the conn string
+  lfd = anetTcpServer(neterr, 0, bind_addr, TCP_BACKLOG);
+  if (lfd == ANET_ERR) {
+    epicLog(LOG_FATAL, "Unable to open the data port (%s)", neterr);
+    throw TCP_RESOURCE_EXCEPTION;
+  }
+  anetNonBlock(neterr, lfd);
+  anetSockName(lfd, ipstr, sizeof(ipstr), &port);
+  if (inet_pton(AF_INET, ipstr, &ip) != 1 || ip == INADDR_ANY) {
+    epicLog(LOG_WARNING, "data port is bound to %s, which is not reachable by the peers", ipstr);
+  }
+
+  efd = eventfd(0, EFD_NONBLOCK);
+  if (efd < 0) {
+    epicLog(LOG_FATAL, "Unable to create the event fd (%d:%s)", errno, strerror(errno));
+    throw TCP_RESOURCE_EXCEPTION;
+  }
+
+  epicLog(LOG_INFO, "new tcp resource, data port %s:%d\n", ipstr, port);
+}
+
+TcpResource::~TcpResource() {
+  if (el) Unwatch(lfd, AE_READABLE);
+  for (auto& a : accepting) {
+    if (el) Unwatch(a.first, AE_READABLE);
+    close(a.first);
+  }
+  close(lfd);
+  close(efd);
+}
+
+void TcpResource::SetEventLoop(aeEventLoop* el) {
+  this->el = el;
+  if (Watch(lfd, AE_READABLE, TcpAcceptHandle, this)) {
+    epicLog(LOG_FATAL, "Unable to watch the data port");
+  }
+}
+
+bool TcpResource::GetCompEvent() const {
+  uint64_t v;
+  if (read(efd, &v, sizeof(v)) != sizeof(v) && errno != EAGAIN) {
+    epicLog(LOG_FATAL, "Failed to get tcp event (%d:%s)\n", errno, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void TcpResource::Notify() {
+  uint64_t v = 1;
+  if (write(efd, &v, sizeof(v)) != sizeof(v)) {
+    epicLog(LOG_DEBUG, "eventfd write failed (%d:%s)", errno, strerror(errno));
+  }
+}
+
+int TcpResource::Watch(int fd, int mask, aeFileProc* proc, void* data) {
+  epicAssert(el);
+  //two streams per peer: grow the loop instead of capping the cluster size
+  if (fd >= aeGetSetSize(el) && aeResizeSetSize(el, fd + EVENTLOOP_FDSET_INCR) == AE_ERR) {
+    epicLog(LOG_WARNING, "Unable to grow the event loop for fd %d", fd);
+    return -1;
+  }
+  if (aeCreateFileEvent(el, fd, mask, proc, data) == AE_ERR) {
+    epicLog(LOG_WARNING, "Unable to create the file event for fd %d (%d:%s)", fd, errno, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+void TcpResource::Unwatch(int fd, int mask) {
+  aeDeleteFileEvent(el, fd, mask);
+}
+
+/*
+ * a peer connects to our data port; the stream is handed to its context
+ * once the peer tells which one it is for (see ReadHello)
+ */
+void TcpResource::Accept() {
+  char neterr[ANET_ERR_LEN];
+  char cip[IP_STR_LEN];
+  int cport;
+  for (;;) {
+    int fd = anetTcpAccept(neterr, lfd, cip, sizeof(cip), &cport);
+    if (fd == ANET_ERR) {
+      if (errno != EWOULDBLOCK && errno != EAGAIN)
+        epicLog(LOG_WARNING, "Accepting data stream: %s", neterr);
+      return;
+    }
+    anetNonBlock(neterr, fd);
+    if (Watch(fd, AE_READABLE, TcpHelloHandle, this)) {
+      close(fd);
+      continue;
+    }
+    accepting[fd] = Hello();
+    epicLog(LOG_DEBUG, "Accepted data stream %s:%d", cip, cport);
+  }
+}
+
+void TcpResource::ReadHello(int fd) {
+  Hello& h = accepting[fd];
+  ssize_t n = read(fd, (char*)&h.target + h.got, sizeof(h.target) - h.got);
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+  if (n <= 0) {
+    epicLog(LOG_WARNING, "Unable to read the target context of data stream %d", fd);
+    goto fail;
+  }
+  h.got += n;
+  if (h.got < sizeof(h.target)) return;
+
+  {
+    uint32_t target = ntohl(h.target);
+    auto it = contexts.find(target);
+    if (unlikely(it == contexts.end())) {
+      epicLog(LOG_WARNING, "cannot find the target context %u of data stream %d", target, fd);
+      goto fail;
+    }
+    Unwatch(fd, AE_READABLE);
+    accepting.erase(fd);
+    it->second->SetRecvFd(fd);
+    epicLog(LOG_INFO, "data stream %d is for context %u", fd, target);
+    return;
+  }
+
+fail:
+  Unwatch(fd, AE_READABLE);
+  accepting.erase(fd);
+  close(fd);
+}
+
+/*
+ * the frames are read into cq by the file events of the streams; here the
+ * server only takes them
+ */
+int TcpResource::PollCompletion(int n, ibv_wc* wc) {
+  int i = 0;
+  while (i < n && !cq.empty()) {
+    wc[i++] = cq.front();
+    cq.pop_front();
+  }
+  return i;
+}
+
+int TcpResource::RegLocalMemory(void *base, size_t sz) {
+  if (isForMaster) {
+    epicLog(LOG_WARNING, "I am a master\n");
+    return -1;
+  }
+  if (this->base) {
+    //a region grown at runtime right after the registered ones, nothing is exposed to the peers
+    epicAssert((char*)base == (char*)this->base + this->size);
+    this->size += sz;
+  } else {
+    this->base = base;
+    this->size = sz;
+  }
+  epicLog(LOG_INFO, "registered local memory region at %p with size %ld\n", base, sz);
+  return 0;
+}
+
+int TcpResource::Receive(uint32_t qpn, const char* src, size_t len, uint32_t imm) {
+  int s = slots.Get();
+  if (unlikely(s < 0)) return -1;
+  memcpy(slots.Addr(s), src, len);
+
+  ibv_wc wc = {};
+  wc.wr_id = s;
+  wc.status = IBV_WC_SUCCESS;
+  wc.opcode = IBV_WC_RECV;
+  wc.byte_len = len;
+  wc.qp_num = qpn;
+  wc.wc_flags = IBV_WC_WITH_IMM;
+  wc.imm_data = htonl(imm);
+  cq.push_back(wc);
+  Notify();
+  return 0;
+}
+
+void TcpResource::PushCompletion(const ibv_wc& wc) {
+  cq.push_back(wc);
+  Notify();
+}
+
+int TcpResource::PostRecv(int n) {
+  slots.Recycle(n);
+  return n;
+}
+
+TransportContext* TcpResource::NewContext(bool isForMaster) {
+  context_counter++;
+  uint32_t id = ++id_counter;
+  TcpContext* ctx = new TcpContext(this, isForMaster, id);
+  contexts[id] = ctx;
+  epicLog(LOG_DEBUG, "new TcpContext: %d\n", context_counter);
+  return ctx;
+}
+
+void TcpResource::DeleteContext(TransportContext* ctx) {
+  context_counter--;
+  contexts.erase(ctx->GetQP());
+  epicLog(LOG_DEBUG, "delete TcpContext: %d\n", context_counter);
+  delete ctx;
+}
+
+TcpContext::TcpContext(TcpResource* res, bool master, uint32_t id)
+    : resource(res), isForMaster(master), id(id), ring(master) {
+  epicAssert(IsMaster() || IsMaster() == res->IsMaster());
+  rbuf = (char*)zmalloc(TCP_RECV_BUF_SIZE);
+  if (unlikely(!rbuf)) {
+    epicLog(LOG_WARNING, "Unable to allocate memeory\n");
+    throw RDMA_CONTEXT_EXCEPTION;
+  }
+}
+
+TcpContext::~TcpContext() {
+  if (sfd >= 0) {
+    if (connecting || want_write) resource->Unwatch(sfd, AE_WRITABLE);
+    close(sfd);
+  }
+  SetRecvFd(-1);
+  for (TcpFrame& f : outq) {
+    if (f.owned) zfree((void*)f.data);
+  }
+  zfree(rbuf);
+  zfree(msg);
+}
+
+const char* TcpContext::GetRdmaConnString() {
+  if (!msg) {
+    msg = (char *) zmalloc(
+        (IsMaster() ? MASTER_RDMA_CONN_STRLEN : WORKER_RDMA_CONN_STRLEN) + 1);
+    if (unlikely(!msg)) {
+      epicLog(LOG_WARNING, "Unable to allocate memory\n");
+      return nullptr;
+    }
+  }
+
+  if (IsMaster()) {
+    sprintf(msg, "%04x:%08x:%08x", resource->GetPort(), id, ntohl(resource->GetIP()));
+  } else {
+    sprintf(msg, "%04x:%08x:%08x:%08x:%016lx", resource->GetPort(), id,
+        ntohl(resource->GetIP()), 0, (uintptr_t)resource->GetBase());
+  }
+  epicLog(LOG_DEBUG, "msg = %s\n", msg);
+  return msg;
+}
+
+/*
+ * start connecting the send stream; it is finished by OnWritable (connected,
+ * then the hello telling the peer's context id is sent), and the frames
+ * queued meanwhile are sent after the hello
+ */
+int TcpContext::SetRemoteConnParam(const char *conn) {
+  uint32_t rport, rid, rip, rrkey;
+  uint64_t rvaddr;
+  if (IsMaster()) {
+    sscanf(conn, "%x:%x:%x", &rport, &rid, &rip);
+  } else {
+    sscanf(conn, "%x:%x:%x:%x:%lx", &rport, &rid, &rip, &rrkey, &rvaddr);
+    this->vaddr = rvaddr;
+  }
+
+  char neterr[ANET_ERR_LEN];
+  char ipstr[INET_ADDRSTRLEN];
+  struct in_addr addr;
+  addr.s_addr = htonl(rip);
+  inet_ntop(AF_INET, &addr, ipstr, sizeof(ipstr));
+
+  sfd = anetTcpNonBlockConnect(neterr, ipstr, rport);
+  if (sfd == ANET_ERR) {
+    epicLog(LOG_WARNING, "Connecting to data port %s:%d (%s)", ipstr, rport, neterr);
+    sfd = -1;
+    return 1;
+  }
+  anetEnableTcpNoDelay(neterr, sfd);
+  hello = htonl(rid);
+  hello_off = 0;
+  connecting = true;
+  if (resource->Watch(sfd, AE_WRITABLE, TcpWriteHandle, this)) {
+    close(sfd);
+    sfd = -1;
+    connecting = false;
+    return 1;
+  }
+  epicLog(LOG_INFO, "connecting data stream to %s:%d (context %u)", ipstr, rport, rid);
+  return 0;
+}
+
+void TcpContext::WantWrite(bool want) {
+  if (want == want_write || connecting) return;
+  if (want) {
+    if (resource->Watch(sfd, AE_WRITABLE, TcpWriteHandle, this)) return;
+  } else {
+    resource->Unwatch(sfd, AE_WRITABLE);
+  }
+  want_write = want;
+}
+
+void TcpContext::OnWritable() {
+  if (connecting) {
+    if (!hello_off) {
+      int err = 0;
+      socklen_t elen = sizeof(err);
+      if (getsockopt(sfd, SOL_SOCKET, SO_ERROR, &err, &elen) || err) {
+        epicLog(LOG_WARNING, "Connecting data stream of context %u (%s)", id, strerror(err));
+        Fail();
+        return;
+      }
+    }
+    ssize_t n = send(sfd, (char*)&hello + hello_off, sizeof(hello) - hello_off, MSG_NOSIGNAL);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (n <= 0) {
+      epicLog(LOG_WARNING, "Unable to send hello of context %u (%s)", id, strerror(errno));
+      Fail();
+      return;
+    }
+    hello_off += n;
+    if (hello_off < sizeof(hello)) return;
+    connecting = false;
+    want_write = true;  //the writable event stays armed for the frames queued so far
+    epicLog(LOG_INFO, "connected data stream of context %u", id);
+  }
+  if (Flush()) Fail();
+}
+
+void TcpContext::SetRecvFd(int fd) {
+  if (rfd >= 0) {
+    resource->Unwatch(rfd, AE_READABLE);
+    close(rfd);
+  }
+  rlen = 0;
+  rfd = fd;
+  if (fd >= 0 && resource->Watch(fd, AE_READABLE, TcpReadHandle, this)) {
+    close(fd);
+    rfd = -1;
+  }
+}
+
+void TcpContext::Complete(const TcpFrame& f, bool ok) {
+  if (f.owned) zfree((void*)f.data);
+  uint64_t wr_id;
+  if (ring.Complete(f.id, f.signaled, f.slot, wr_id)) {
+    ibv_wc wc = {};
+    wc.wr_id = wr_id;
+    wc.status = ok ? IBV_WC_SUCCESS : IBV_WC_WR_FLUSH_ERR;
+    wc.opcode = IBV_WC_SEND;
+    wc.qp_num = id;
+    //the server skips failed completions, so that the slots are given back here
+    if (!ok) ring.SendComp(wc);
+    resource->PushCompletion(wc);
+  }
+}
+
+/*
+ * the send stream is broken: stop watching it, and fail the frames queued
+ * to it and the ones sent later, giving their send slots back
+ */
+void TcpContext::Fail() {
+  if (sfd >= 0) {
+    if (connecting || want_write) resource->Unwatch(sfd, AE_WRITABLE);
+    close(sfd);
+    sfd = -1;
+  }
+  connecting = want_write = false;
+  broken = true;
+  epicLog(LOG_WARNING, "data stream of context %u is broken, fail %lu queued msgs", id, outq.size());
+  while (!outq.empty()) {
+    Complete(outq.front(), false);
+    outq.pop_front();
+  }
+  //the unsignaled frames completed before are given back too
+  uint64_t wr_id;
+  ring.Complete(0, true, false, wr_id);
+  ibv_wc wc = {};
+  wc.wr_id = wr_id;
+  ring.SendComp(wc);
+}
+
+ssize_t TcpContext::SendWithImm(const void* ptr, size_t len, uint32_t imm, unsigned int id, bool signaled) {
+  if (len > MAX_REQUEST_SIZE) {
+    epicLog(LOG_WARNING, "len = %d, MAX_REQUEST_SIZE = %d\n", len, MAX_REQUEST_SIZE);
+    epicAssert(false);
+  }
+
+  TcpFrame f;
+  f.slot = ring.IsRegistered(ptr);
+  if (unlikely(broken)) {
+    f.id = id;
+    f.signaled = signaled;
+    f.owned = !f.slot && len > MAX_RDMA_INLINE_SIZE;
+    f.data = (const char*)ptr;
+    Complete(f, false);
+    return -2;
+  }
+  f.hdr[0] = htonl(len);
+  f.hdr[1] = htonl(imm);
+  f.len = len;
+  f.off = 0;
+  f.id = id;
+  f.signaled = signaled;
+  if (f.slot || len > MAX_RDMA_INLINE_SIZE) {
+    //slots stay valid until the completion; other large buffers are taken over
+    f.data = (const char*)ptr;
+    f.owned = !f.slot;
+  } else {
+    //inline semantics: the caller may reuse the buffer right after the call
+    char* copy = (char*)zmalloc(len ? len : 1);
+    memcpy(copy, ptr, len);
+    f.data = copy;
+    f.owned = true;
+  }
+  outq.push_back(f);
+
+  if (connecting || sfd < 0) {
+    //sent once the stream is connected
+  } else if (outq.size() >= TCP_MAX_BATCH) {
+    if (Flush()) {
+      Fail();
+      return -2;
+    }
+  } else {
+    //flush when the event loop finds the socket writable, batching the msgs of this round
+    WantWrite(true);
+  }
+  return len;
+}
+
+int TcpContext::Flush() {
+  if (unlikely(sfd < 0 || connecting)) return 0;
+
+  while (!outq.empty()) {
+    struct iovec iov[2 * TCP_MAX_BATCH];
+    int cnt = 0;
+    for (auto it = outq.begin(); it != outq.end() && cnt < 2 * TCP_MAX_BATCH; ++it) {
+      size_t off = it->off;
+      if (off < TCP_FRAME_HDR_SIZE) {
+        iov[cnt].iov_base = (char*)it->hdr + off;
+        iov[cnt].iov_len = TCP_FRAME_HDR_SIZE - off;
+        cnt++;
+        off = TCP_FRAME_HDR_SIZE;
+      }
+      if (it->len) {
+        iov[cnt].iov_base = (char*)it->data + off - TCP_FRAME_HDR_SIZE;
+        iov[cnt].iov_len = it->len + TCP_FRAME_HDR_SIZE - off;
+        cnt++;
+      }
+    }
+
+    //no SIGPIPE if the peer has closed the stream, the error is returned instead
+    struct msghdr mh = {};
+    mh.msg_iov = iov;
+    mh.msg_iovlen = cnt;
+    ssize_t n = sendmsg(sfd, &mh, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      if (errno == EINTR) continue;
+      epicLog(LOG_WARNING, "sendmsg failed (%d:%s)", errno, strerror(errno));
+      return -1;
+    }
+
+    while (n > 0 && !outq.empty()) {
+      TcpFrame& f = outq.front();
+      size_t left = f.len + TCP_FRAME_HDR_SIZE - f.off;
+      if ((size_t)n >= left) {
+        n -= left;
+        Complete(f);
+        outq.pop_front();
+      } else {
+        f.off += n;
+        n = 0;
+      }
+    }
+  }
+
+  WantWrite(!outq.empty());
+  return 0;
+}
+
+int TcpContext::OnReadable() {
+  for (;;) {
+    ssize_t n = read(rfd, rbuf + rlen, TCP_RECV_BUF_SIZE - rlen);
+    if (n == 0) {
+      epicLog(LOG_INFO, "data stream of context %u closed by peer", id);
+      return -1;
+    } else if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      if (errno == EINTR) continue;
+      epicLog(LOG_WARNING, "read failed (%d:%s)", errno, strerror(errno));
+      return -1;
+    }
+    rlen += n;
+
+    size_t p = 0;
+    while (rlen - p >= TCP_FRAME_HDR_SIZE) {
+      uint32_t len, imm;
+      memcpy(&len, rbuf + p, sizeof(len));
+      memcpy(&imm, rbuf + p + sizeof(len), sizeof(imm));
+      len = ntohl(len);
+      if (unlikely(len > MAX_REQUEST_SIZE)) {
+        epicLog(LOG_WARNING, "corrupted frame of len %u on context %u", len, id);
+        return -1;
+      }
+      if (rlen - p < TCP_FRAME_HDR_SIZE + len) break;
+      if (resource->Receive(id, rbuf + p + TCP_FRAME_HDR_SIZE, len, ntohl(imm))) return -1;
+      p += TCP_FRAME_HDR_SIZE + len;
+    }
+    if (p) {
+      memmove(rbuf, rbuf + p, rlen - p);
+      rlen -= p;
+    }
+  }
+  return 0;
+}
+
+char* TcpContext::RecvComp(ibv_wc& wc) {
+  char* ret = resource->GetSlot(wc.wr_id);
+  resource->ClearSlot(wc.wr_id);
+  return ret;
+}
+
+ssize_t TcpContext::Write(raddr dest, raddr src, size_t len, unsigned int id, bool signaled) {
+  epicLog(LOG_WARNING, "unsupported RDMA OP");
+  return -1;
+}
+
+ssize_t TcpContext::WriteWithImm(raddr dest, raddr src, size_t len, uint32_t imm, unsigned int id, bool signaled) {
+  epicLog(LOG_WARNING, "unsupported RDMA OP");
+  return -1;
+}
+
+ssize_t TcpContext::Read(raddr dest, raddr src, size_t len, unsigned int id, bool signaled) {
+  epicLog(LOG_WARNING, "unsupported RDMA OP");
+  return -1;
+}
@@ -0,0 +1,144 @@
+// Copyright (c) 2018 The GAM Authors
+
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tier.h"
+#include "settings.h"
+#include "kernel.h"
+#include "log.h"
+
+TierStore::TierStore(const std::string& path) {
+  fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    epicLog(LOG_FATAL, "Unable to open the tier file %s (%d:%s)", path.c_str(), errno, strerror(errno));
+    throw TIER_EXCEPTION;
+  }
+  if (unlink(path.c_str())) {
+    epicLog(LOG_WARNING, "cannot unlink the tier file %s (%d:%s)", path.c_str(), errno, strerror(errno));
+  }
+  epicLog(LOG_INFO, "opened the tier file %s", path.c_str());
+}
+
+TierStore::~TierStore() {
+  close(fd);
+}
+
+/*best fit among the free extents, or append to the file; with the lock held*/
+off_t TierStore::alloc(size_t n) {
+  auto it = free_extents_by_len.lower_bound(n);
+  if (it == free_extents_by_len.end()) {
+    off_t ret = end;
+    end += n * TIER_BLOCK_SIZE;
+    return ret;
+  }
+
+  off_t start = it->second;
+  size_t len = it->first;
+  free_extents_by_len.erase(it);
+  free_extents.erase(start);
+  if (len > n)
+    add_extent(start + n * TIER_BLOCK_SIZE, len - n);
+  return start;
+}
+
+void TierStore::add_extent(off_t start, size_t n) {
+  free_extents[start] = n;
+  free_extents_by_len.insert(std::make_pair(n, start));
+}
+
+void TierStore::del_extent(std::map<off_t, size_t>::iterator it) {
+  auto range = free_extents_by_len.equal_range(it->second);
+  for (auto i = range.first; i != range.second; ++i) {
+    if (i->second == it->first) {
+      free_extents_by_len.erase(i);
+      break;
+    }
+  }
+  free_extents.erase(it);
+}
+
+off_t TierStore::Put(const char* data, size_t len) {
+  size_t n = ALIGN(len, TIER_BLOCK_SIZE) / TIER_BLOCK_SIZE;
+  off_t off;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    off = alloc(n);
+  }
+
+  size_t done = 0;
+  while (done < len) {
+    ssize_t ret = pwrite(fd, data + done, len - done, off + done);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret <= 0) {
+      epicLog(LOG_WARNING, "cannot write %lu bytes to the tier file (%d:%s)", len, errno, strerror(errno));
+      std::lock_guard<std::mutex> lock(lock_);
+      add_extent(off, n);
+      return -1;
+    }
+    done += ret;
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  objects++;
+  bytes += len;
+  return off;
+}
+
+int TierStore::Get(off_t off, char* buf, size_t len) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (off < 0 || off % TIER_BLOCK_SIZE || off + (off_t)len > end)
+      return -1;
+  }
+
+  size_t done = 0;
+  while (done < len) {
+    ssize_t ret = pread(fd, buf + done, len - done, off + done);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret == 0) return -1;  //truncated by a release meanwhile
+    if (ret < 0) {
+      epicLog(LOG_WARNING, "cannot read %lu bytes from the tier file (%d:%s)", len, errno, strerror(errno));
+      return -1;
+    }
+    done += ret;
+  }
+  return 0;
+}
+
+/*
+ * coalesce with the free neighbours; an extent at the end of the file
+ * is given back to the file system
+ */
+void TierStore::Release(off_t off, size_t len) {
+  size_t n = ALIGN(len, TIER_BLOCK_SIZE) / TIER_BLOCK_SIZE;
+  std::lock_guard<std::mutex> lock(lock_);
+  objects--;
+  bytes -= len;
+
+  auto next = free_extents.find(off + n * TIER_BLOCK_SIZE);
+  if (next != free_extents.end()) {
+    n += next->second;
+    del_extent(next);
+  }
+  auto prev = free_extents.lower_bound(off);
+  if (prev != free_extents.begin()) {
+    --prev;
+    if (prev->first + (off_t)(prev->second * TIER_BLOCK_SIZE) == off) {
+      off = prev->first;
+      n += prev->second;
+      del_extent(prev);
+    }
+  }
+
+  if (off + (off_t)(n * TIER_BLOCK_SIZE) == end) {
+    end = off;
+    if (ftruncate(fd, end)) {
+      epicLog(LOG_WARNING, "cannot truncate the tier file (%d:%s)", errno, strerror(errno));
+    }
+  } else {
+    add_extent(off, n);
+  }
+}
@@ -0,0 +1,166 @@
+// Copyright (c) 2018 The GAM Authors
+
+#include <climits>
+#include "transport.h"
+#include "rdma.h"
+#include "shm.h"
+#include "tcp_transport.h"
+#include "zmalloc.h"
+#include "kernel.h"
+#include "log.h"
+
+SendRing::SendRing(bool isForMaster) {
+  max_pending_msg = isForMaster ? MAX_MASTER_PENDING_MSG : MAX_WORKER_PENDING_MSG;
+  buf_size = isForMaster ? MASTER_BUFFER_SIZE : WORKER_BUFFER_SIZE;
+  send_buf = (char*)zmalloc(buf_size);
+  if (unlikely(!send_buf)) {
+    epicLog(LOG_WARNING, "Unable to allocate memeory\n");
+    throw RDMA_CONTEXT_EXCEPTION;
+  }
+  slot_head = slot_tail = 0;
+  full = false;
+  max_unsignaled_msg = MAX_UNSIGNALED_MSG > max_pending_msg ?
+    max_pending_msg : MAX_UNSIGNALED_MSG;
+  epicAssert(max_unsignaled_msg <= USHRT_MAX);
+}
+
+SendRing::~SendRing() {
+  zfree(send_buf);
+}
+
+char* SendRing::GetFreeSlot() {
+  int avail = RMINUS(slot_tail, slot_head, max_pending_msg);
+  if (!avail && !full) avail = max_pending_msg;
+  if (avail <= 0 || pending_msg >= max_pending_msg) {
+    epicLog(LOG_INFO, "all the slots are busy\n");
+    return nullptr;
+  }
+  char* s = send_buf + slot_head*MAX_REQUEST_SIZE;
+  if (++slot_head == max_pending_msg) slot_head = 0;
+  if (slot_head == slot_tail) full = true;
+  return s;
+}
+
+bool SendRing::IsRegistered(const void* addr) {
+  return (uintptr_t)addr >= (uintptr_t)send_buf
+    && (uintptr_t)addr < (uintptr_t)send_buf + buf_size;
+}
+
+/*
+ * the same selective signaling as RdmaContext::Rdma:
+ * higher to lower bits of wr_id: send_msg(16), w_r_msg(16), id(32)
+ */
+bool SendRing::Complete(unsigned int id, bool signaled, bool slot, uint64_t& wr_id) {
+  pending_msg++;
+  if (slot) pending_send_msg++;
+  uint16_t curr_to_signaled_send_msg = pending_send_msg - to_signaled_send_msg;
+  uint16_t curr_to_signaled_w_r_msg = pending_msg - pending_send_msg - to_signaled_w_r_msg;
+  if (curr_to_signaled_send_msg + curr_to_signaled_w_r_msg == max_unsignaled_msg || signaled) {
+    to_signaled_send_msg += curr_to_signaled_send_msg;
+    to_signaled_w_r_msg += curr_to_signaled_w_r_msg;
+    wr_id = (id & HALF_BITS) + ((uint64_t)(curr_to_signaled_send_msg & QUARTER_BITS) << 48)
+      + ((uint64_t)(curr_to_signaled_w_r_msg & QUARTER_BITS) << 32);
+    return true;
+  }
+  return false;
+}
+
+unsigned int SendRing::SendComp(ibv_wc& wc) {
+  unsigned int id = wc.wr_id & HALF_BITS;
+  uint16_t curr_to_signaled_send_msg = wc.wr_id >> 48;
+  uint16_t curr_to_signaled_w_r_msg = wc.wr_id >> 32 & QUARTER_BITS;
+
+  slot_tail += curr_to_signaled_send_msg;
+  if (slot_tail >= max_pending_msg) slot_tail -= max_pending_msg;
+  to_signaled_send_msg -= curr_to_signaled_send_msg;
+  to_signaled_w_r_msg -= curr_to_signaled_w_r_msg;
+  pending_msg -= (curr_to_signaled_send_msg + curr_to_signaled_w_r_msg);
+  pending_send_msg -= curr_to_signaled_send_msg;
+  epicAssert(to_signaled_send_msg + to_signaled_w_r_msg <= pending_msg);
+  if (full && curr_to_signaled_send_msg) full = false;
+  return id;
+}
+
+RecvSlots::~RecvSlots() {
+  for (char* buf : comm_buf) zfree(buf);
+}
+
+int RecvSlots::Get() {
+  if (free_slots.empty()) {
+    //grow by RECV_SLOT_STEP slots, the same step as RdmaResource::RegCommSlot
+    char* buf = (char*)zmalloc(RECV_SLOT_STEP * MAX_REQUEST_SIZE);
+    if (unlikely(!buf)) {
+      epicLog(LOG_WARNING, "Unable to allocate recv slots\n");
+      return -1;
+    }
+    int first = comm_buf.size() * RECV_SLOT_STEP;
+    comm_buf.push_back(buf);
+    for (int s = first + RECV_SLOT_STEP - 1; s >= first; s--)
+      free_slots.push_back(s);
+  }
+  int s = free_slots.back();
+  free_slots.pop_back();
+  return s;
+}
+
+char* RecvSlots::Addr(int s) {
+  return comm_buf.at(BPOS(s)) + BOFF(s);
+}
+
+/*
+ * slots are allocated on demand by Get(),
+ * so here we only recycle the ones consumed since the last call
+ */
+void RecvSlots::Recycle(int n) {
+  int m = n < cleared_slots.size() ? n : cleared_slots.size();
+  for (int i = 0; i < m; i++) {
+    free_slots.push_back(cleared_slots.back());
+    cleared_slots.pop_back();
+  }
+}
+
+static TransportResource* NewShmResource(bool isMaster) {
+  try {
+    return new ShmResource(isMaster);
+  } catch (int err) {
+    epicLog(LOG_FATAL, "Unable to get shm resource");
+    return nullptr;
+  }
+}
+
+static TransportResource* NewTcpResource(bool isMaster, const std::string& ip) {
+  try {
+    return new TcpResource(isMaster, ip);
+  } catch (int err) {
+    epicLog(LOG_FATAL, "Unable to get tcp resource");
+    return nullptr;
+  }
+}
+
+TransportResource* TransportResourceFactory::getMasterResource(const Conf& conf) {
+  switch (conf.transport) {
+    case TRANSPORT_SHM:
+      return NewShmResource(true);
+    case TRANSPORT_TCP:
+      return NewTcpResource(true, conf.master_ip);
+    case TRANSPORT_RDMA:
+      return RdmaResourceFactory::getMasterRdmaResource();
+    default:
+      epicLog(LOG_FATAL, "unknown transport %d", conf.transport);
+      return nullptr;
+  }
+}
+
+TransportResource* TransportResourceFactory::getWorkerResource(const Conf& conf) {
+  switch (conf.transport) {
+    case TRANSPORT_SHM:
+      return NewShmResource(false);
+    case TRANSPORT_TCP:
+      return NewTcpResource(false, conf.worker_ip);
+    case TRANSPORT_RDMA:
+      return RdmaResourceFactory::getWorkerRdmaResource();
+    default:
+      epicLog(LOG_FATAL, "unknown transport %d", conf.transport);
+      return nullptr;
+  }
+}
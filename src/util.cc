@@ -10,6 +10,8 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
 #include "util.h"
 
 template <>
@@ -115,5 +117,32 @@ char* get_ipbyname(char* name) {
   return ip;
 }
 
-
-
+/*
+ * pin the thread to the cpus of a NUMA node (as listed in sysfs, e.g. "0-7,16-23")
+ * return 0 on success
+ */
+int bind_to_numa_node(pthread_t thread, int node) {
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+  FILE* f = fopen(path, "r");
+  if (!f) return -1;
+  char buf[1024];
+  char* ok = fgets(buf, sizeof(buf), f);
+  fclose(f);
+  if (!ok) return -1;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  int ncpus = 0;
+  for (char* p = buf; *p && *p != '\n';) {
+    char* end;
+    long lo = strtol(p, &end, 10), hi = lo;
+    if (end == p) return -1;
+    if (*end == '-') hi = strtol(end + 1, &end, 10);
+    for (long c = lo; c <= hi && c < CPU_SETSIZE; c++, ncpus++)
+      CPU_SET(c, &set);
+    p = *end == ',' ? end + 1 : end;
+  }
+  if (!ncpus) return -1;
+  return pthread_setaffinity_np(thread, sizeof(set), &set);
+}
@@ -1,6 +1,8 @@
 // Copyright (c) 2018 The GAM Authors 
 
 #include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
 #include <utility>
 #include <queue>
 #include "rdma.h"
@@ -33,31 +35,40 @@ void Worker::ProcessLocalRequest(aeEventLoop *el, int fd, void *data, int mask)
   Worker* w = (Worker*)data; //获取Worker对象指针w，通过将data转换为Worker*类型，可以在ProcessLocalRequest函数中访问当前Worker对象的成员变量和方法
   WorkRequest* wr; //定义一个WorkRequest指针wr
   int i = 0;
+  w->FarmDeferResume();
   while(w->wqueue->pop(wr)) { //从工作队列中取出一个工作请求wr并处理，如果取出成功，执行循环体
     i++;
     epicLog(LOG_DEBUG, "wr->code = %d, wr->flag = %d, wr->addr = %lx, wr->size = %d, wr->fd = %d\n",
         wr->op, wr->flag, wr->addr, wr->size, wr->fd);
     w->FarmProcessLocalRequest(wr); //调用FarmProcessLocalRequest处理工作请求wr 
   }
+  w->FarmFlushResume(); //一次性发送本轮产生的消息
   if(!i) epicLog(LOG_DEBUG, "pop %d from work queue", i);
 }
 /*该函数完成了Worker对象的初始化，包括配置设置、资源获取、事件循环创建、套接字绑定和事件注册、内存初始化、与主节点的连接以及服务线程的启动。*/
-Worker::Worker(const Conf& conf, RdmaResource* res):
+Worker::Worker(const Conf& conf, TransportResource* res):
   st(), wr_psn(),  //初始化st和wr_psn
-  wqueue(new boost::lockfree::queue<WorkRequest*>(INIT_WORKQ_SIZE))  //创建一个无锁队列wqueue，用于存储工作请求
+  wqueue(new boost::lockfree::queue<WorkRequest*>(INIT_WORKQ_SIZE)),  //创建一个无锁队列wqueue，用于存储工作请求
+  kvs([this](size_t size) {return sb.sb_malloc(size);},  //KV的值放在slab区域中
+      [this](void* ptr) {sb.sb_free(ptr);},
+      [this](void* ptr) {return sb.get_chunk_size(ptr);}),
+  placement_(Placement::Create(conf))  //无地址提示的分配的放置策略
 {
   epicAssert(wqueue->is_lock_free()); //确保工作队列是无锁的
   this->conf = &conf;//将配置对象的地址复制给成员变量
 
   //get the RDMA resource 获取RDMA资源
-  if(res) { //如果传入的res不为空，则使用传入的res；否则通过RdmaResourceFactory::getWorkerRdmaResource()获取RDMA资源
+  if(res) { //如果传入的res不为空，则使用传入的res；否则根据conf.transport获取传输资源
     resource = res;
   } else {
-    resource = RdmaResourceFactory::getWorkerRdmaResource();
+    resource = TransportResourceFactory::getWorkerResource(conf);
   }
+  //Master and the other workers: the credit windows are sized for them all
+  resource->SetExpectedPeers(conf.no_node);
 
   //create the event loop 创建事件循环
   el = aeCreateEventLoop(conf.maxthreads+conf.maxclients+EVENTLOOP_FDSET_INCR);
+  resource->SetEventLoop(el);  //the sockets of the tcp transport are file events of the loop
 
   //open the socket for listening to the connections from workers to exch rdma resouces
   //打开套接字以监听来自其他工作节点的连接，用于交换RDMA资源
@@ -92,9 +103,16 @@ Worker::Worker(const Conf& conf, RdmaResource* res):
   /*调用sb.slabs_init初始化本地内存空间。
   使用epicAssert确保内存地址对齐。
   调用RegisterMemory注册内存。*/
-  void* addr = sb.slabs_init(conf.size, conf.factor, true);
+  void* addr = sb.slabs_init(conf.size, conf.factor, true, conf.hugepage, conf.numa_node,
+      conf.size_max, conf.size_step);
   epicAssert((ptr_t)addr == TOBLOCK(addr));
+  if (sb.get_backing() != conf.hugepage)
+    epicLog(LOG_WARNING, "the region is backed by %d pages instead of %d", sb.get_backing(), conf.hugepage);
   RegisterMemory(addr, conf.size);
+  size_t reserved = std::max((size_t)conf.size, (size_t)conf.size_max);
+  if (reserved > (1L << EPOCH_SHIFT))
+    epicPanic("%lu bytes of memory cannot be addressed with the reuse epochs", reserved);
+  farm_epochs_.reset(new uint8_t[(reserved >> REGION_SHIFT) + 1]());
 
   //connect to the master
   //连接到主节点
@@ -104,7 +122,8 @@ Worker::Worker(const Conf& conf, RdmaResource* res):
   调用SyncMaster发送本地状态到主节点。
   调用SyncMaster(FETCH_MEM_STATS)获取其他工作节点的内存状态。*/
   master = this->NewClient(true);
-  master->ExchConnParam(conf.master_ip.c_str(), conf.master_port, this);
+  if (!master || master->ExchConnParam(conf.master_ip.c_str(), conf.master_port, this))
+    epicPanic("Unable to join the cluster through master %s:%d", conf.master_ip.c_str(), conf.master_port);
   SyncMaster(); //send the local stats to master  发送本地状态到主节点 
   SyncMaster(FETCH_MEM_STATS); //fetch the mem states of other workers from master  从主节点获取其他工作节点的内存状态
 
@@ -113,6 +132,32 @@ Worker::Worker(const Conf& conf, RdmaResource* res):
     epicPanic("Unrecoverable error creating time event.");
   }
 #endif
+  //周期性地把空闲的slab页面迁移给缺页的slab类
+  if (conf.slab_rebalance_interval > 0
+      && aeCreateTimeEvent(el, conf.slab_rebalance_interval, SlabRebalancer, this, NULL) == AE_ERR) {
+    epicPanic("Unrecoverable error creating time event.");
+  }
+  //内存区域可增长时，周期性地注册新增的区域并通告给其他工作节点
+  if (conf.size_max > conf.size
+      && aeCreateTimeEvent(el, conf.region_sync_interval, RegionSyncer, this, NULL) == AE_ERR) {
+    epicPanic("Unrecoverable error creating time event.");
+  }
+  //配置了二级存储时，周期性地把冷对象移到文件中
+  if (!conf.tier_path.empty()) {
+    tier = new TierStore(conf.tier_path);
+    if (aeCreateTimeEvent(el, conf.tier_interval, TierDemoter, this, NULL) == AE_ERR) {
+      epicPanic("Unrecoverable error creating time event.");
+    }
+  }
+  //周期性地把空闲的租约对象归还给它们的工作节点
+  if (aeCreateTimeEvent(el, FARM_LEASE_RETURN_INTERVAL, LeaseReturner, this, NULL) == AE_ERR) {
+    epicPanic("Unrecoverable error creating time event.");
+  }
+  //gossip模式下周期性地把已知的内存统计信息发给随机的工作节点
+  if (conf.stats_mode == STATS_GOSSIP
+      && aeCreateTimeEvent(el, conf.gossip_interval, Gossiper, this, NULL) == AE_ERR) {
+    epicPanic("Unrecoverable error creating time event.");
+  }
   //记录日志，表示工作节点已启动
   epicLog(LOG_INFO, "worker %d started\n", GetWorkerId());
   epicLog(LOG_WARNING, "LRU eviction is enabled, max cache lines = %d, "
@@ -125,6 +170,10 @@ Worker::Worker(const Conf& conf, RdmaResource* res):
 #else
   this->st = new thread(startEventLoop, el);
 #endif
+  //keep the worker thread on the node of its memory
+  if (conf.numa_node >= 0 && bind_to_numa_node(st->native_handle(), conf.numa_node)) {
+    epicLog(LOG_WARNING, "cannot bind the worker thread to numa node %d", conf.numa_node);
+  }
 }
 
 void Worker::StartService(Worker* w) {
@@ -159,11 +208,13 @@ void Worker::StartService(Worker* w) {
 #else
     for(volatile int* buf: w->nbufs) {
       if(*buf == 1) {
+        w->FarmDeferResume();
         while(w->wqueue->pop(wr)) {
           epicLog(LOG_DEBUG, "wr->code = %d, wr->flag = %d, wr->addr = %lx, wr->size = %d, wr->fd = %d\n",
               wr->op, wr->flag, wr->addr, wr->size, wr->fd);
           w->FarmProcessLocalRequest(wr);
         }
+        w->FarmFlushResume();
       }
     }
 #endif
@@ -180,42 +231,121 @@ void Worker::StartService(Worker* w) {
  *
  */
 int Worker::PostConnectMaster(int fd, void* data) {
-  char inmsg[MAX_WORKERS_STRLEN+1]; //定义一个字符数组inmsg，用于存储从主节点读取的工作节点列表
   char outmsg[MAX_IPPORT_STRLEN+1]; //定义一个字符数组outmsg，用于存储当前工作节点的IP和端口信息
 
   epicLog(LOG_DEBUG, "waiting for master reply with worker list");
 
-  /* waiting for server's response */
-  int n = read(fd, inmsg, MAX_WORKERS_STRLEN);  //从主节点读取已注册的工作节点列表(IP和端口)
-  if (n <= 0) { //如果读取失败，记录警告日志并返回错误码 
+  /*
+   * waiting for server's response: [uint32_t len][wid:ip:port,...], and
+   * the owners of the moved regions: [uint64_t epoch][uint32_t n][n records]
+   */
+  uint32_t len;
+  if (anetRead(fd, (char*)&len, sizeof(len)) != sizeof(len)) {  //从主节点读取已注册的工作节点列表(ID、IP和端口)
+    epicLog(LOG_WARNING, "Failed to read worker ip/ports (%s)\n", strerror(errno));
+    return -1;
+  }
+  string inmsg(len, '\0');  //存储主节点发送的工作节点列表
+  if (len && anetRead(fd, &inmsg[0], len) != (int)len) {
     epicLog(LOG_WARNING, "Failed to read worker ip/ports (%s)\n", strerror(errno));
     return -1;
   }
-  inmsg[n] = '\0'; //存储主节点发送的工作节点列表，将读取的字符串以'\0'结尾，确保字符串正确终止
-  epicLog(LOG_DEBUG, "inmsg = %s (n = %d, MAX_WORKERS_STRLEN = %d)", inmsg, n, MAX_WORKERS_STRLEN); 
+  epicLog(LOG_DEBUG, "inmsg = %s (len = %u)", inmsg.c_str(), len); 
 
-  n = sprintf(outmsg, "%s:%d", this->GetIP().c_str(), this->GetPort()); //构造当前工作节点的IP和端口信息
+  uint32_t nregions;
+  if (anetRead(fd, (char*)&region_epoch_, sizeof(region_epoch_)) != sizeof(region_epoch_)
+      || anetRead(fd, (char*)&nregions, sizeof(nregions)) != sizeof(nregions)) {
+    epicLog(LOG_WARNING, "Failed to read region owners (%s)\n", strerror(errno));
+    return -1;
+  }
+  if (nregions) {
+    string owners(nregions * REGION_RECORD_SIZE, '\0');
+    if (anetRead(fd, &owners[0], owners.length()) != (int)owners.length()) {
+      epicLog(LOG_WARNING, "Failed to read region owners (%s)\n", strerror(errno));
+      return -1;
+    }
+    uint64_t region;
+    int wid;
+    uint32_t seq;
+    char* p = &owners[0];
+    for (uint32_t i = 0; i < nregions; i++) {
+      p += readInteger(p, region, wid, seq);
+      regions.SetOwner(region, wid, seq);
+    }
+  }
+
+  int n = sprintf(outmsg, "%s:%d", this->GetIP().c_str(), this->GetPort()); //构造当前工作节点的IP和端口信息
   if(n != write(fd, outmsg, n)) { //将当前工作节点的IP和端口信息发送给主节点 
     epicLog(LOG_WARNING, "send worker ip/port failed (%s)\n", strerror(errno));
     return -2;
   }
-  epicLog(LOG_DEBUG, "send: %s; received: %s\n", outmsg, inmsg);
+  epicLog(LOG_DEBUG, "send: %s; received: %s\n", outmsg, inmsg.c_str());
   //解析主节点发送的工作节点列表
   vector<string> splits;
-  Split(inmsg, splits, ','); //将主节点发送的工作节点列表按逗号分隔，解析出每个工作节点的IP和端口信息 
+  Split(inmsg, splits, ','); //将主节点发送的工作节点列表按逗号分隔，解析出每个工作节点的ID、IP和端口信息 
   for(string s: splits) {
-    if(s.length() < 9) continue;
-    vector<string> ip_port;
-    Split(s, ip_port, ':');
-    epicLog(LOG_INFO, "ip_port = %s", s.c_str());
-    epicAssert(ip_port.size() == 2);
-    //与已注册的工作节点建立RDMA连接
-    Client* c = this->NewClient(); //为每个工作节点创建一个新的Client对象。this指针指向当前调用的Worker::PostConnectMaster函数的Worker类实例
-    c->ExchConnParam(ip_port[0].c_str(), atoi(ip_port[1].c_str()), this); //与目标工作节点交换RDMA连接参数
+    size_t p = s.find(':');
+    if(p == string::npos) continue;
+    epicLog(LOG_INFO, "wid:ip_port = %s", s.c_str());
+    AddPeer(atoi(s.substr(0, p).c_str()), s.substr(p + 1));
+  }
+  //与已注册的工作节点建立连接：所有连接同时进行，由事件循环驱动完成(lazy模式下在第一次使用时才建立)
+  if (!conf->lazy_connect) {
+    for (auto& peer : peers)
+      ConnectWorker(peer.first);
   }
   return 0;
 }
 
+void Worker::AddPeer(int wid, string ipport) {
+  vector<string> ip_port;
+  Split(ipport, ip_port, ':');
+  epicAssert(ip_port.size() == 2);
+  Peer& peer = peers[wid];
+  peer.ip = ip_port[0];
+  peer.port = atoi(ip_port[1].c_str());
+  auto g = gossip_stats_.find(wid);  //gossiped before its WORKER_JOIN came
+  if (g != gossip_stats_.end()) {
+    peer.total = g->second.total;
+    peer.free = g->second.free;
+  }
+  placement_dirty_ = true;
+}
+
+/*
+ * start connecting to worker wid, known from Master; the returned client is
+ * used (and work queued to it) right away, and is connected once
+ * PostConnectWorker is called
+ */
+Client* Worker::ConnectWorker(int wid) {
+  auto it = peers.find(wid);
+  if (it == peers.end() || wid == GetWorkerId()) return nullptr;
+
+  Client* c = this->NewClient(); //为目标工作节点创建一个新的Client对象
+  if (!c) return nullptr;
+  if (c->ExchConnParamAsync(it->second.ip.c_str(), it->second.port, wid, this)) { //与目标工作节点交换连接参数
+    RmClient(c);
+    delete c;
+    return nullptr;
+  }
+  c->SetMemStat(it->second.total, it->second.free);
+  UpdateWidMap();
+  if (!widCliMap.count(wid)) widCliMap[wid] = c;
+  epicLog(LOG_INFO, "connecting to worker %d at %s:%d", wid, it->second.ip.c_str(), it->second.port);
+  return c;
+}
+
+int Worker::PostConnectWorker(Client* c) {
+  int wid = c->GetWorkerId();
+  UpdateWidMap();
+  if (!widCliMap.count(wid)) widCliMap[wid] = c;
+  auto it = peers.find(wid);
+  if (it != peers.end() && c->GetTotalMem() == 0)
+    c->SetMemStat(it->second.total, it->second.free);
+  epicLog(LOG_INFO, "connected to worker %d", wid);
+  FarmResumeTxn(c);  //the work queued before the connection is made
+  return 0;
+}
+
 void Worker::RegisterMemory(void* addr, Size s) {
   base = addr;
   size = s;
@@ -252,15 +382,115 @@ int Worker::LocalRequestChecker(struct aeEventLoop *eventLoop, long long id, voi
   Worker* w = (Worker*)clientData;
   WorkRequest* wr;
   int i = 0;
+  w->FarmDeferResume();
   while(w->wqueue->pop(wr)) {
     i++;
     epicLog(LOG_DEBUG, "wr->code = %d, wr->flag = %d, wr->addr = %lx, wr->size = %d, wr->fd = %d\n",
         wr->op, wr->flag, wr->addr, wr->size, wr->fd);
     w->FarmProcessLocalRequest(wr);
   }
+  w->FarmFlushResume();
   if(i) epicLog(LOG_DEBUG, "pop %d from work queue", i);
   return w->conf->timeout;
 }
+
+int Worker::SlabRebalancer(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+  Worker* w = (Worker*)clientData;
+  size_t moved = w->sb.slabs_rebalance();
+  if (moved) epicLog(LOG_INFO, "slab mover moved %lu pages back to the pool", moved);
+  return w->conf->slab_rebalance_interval;
+}
+
+int Worker::RegionSyncer(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+  Worker* w = (Worker*)clientData;
+  w->FarmSyncRegions();
+  return w->conf->region_sync_interval;
+}
+
+void Worker::FarmProcessLocalBarrier(WorkRequest* wr) {
+  barrier_waiters.push_back(wr);
+  if ((int)barrier_waiters.size() < wr->counter) return;  //wait for the other local callers
+
+  barrier_round++;
+  if (!FarmSubmitBarrier() && !barrier_checking) {
+    if (aeCreateTimeEvent(el, 1, BarrierChecker, this, NULL) == AE_ERR) {
+      epicPanic("Unrecoverable error creating time event.");
+    }
+    barrier_checking = true;
+  }
+}
+
+bool Worker::FarmSubmitBarrier() {
+  if (barrier_sent == barrier_round) return true;
+  //ready only when connected to all the other workers (known to all of them with lazy connections)
+  if (!conf->lazy_connect) {
+    UpdateWidMap();
+    int connected = 0;
+    for (auto& e : widCliMap)
+      if (e.second->IsConnected()) connected++;
+    if (connected < conf->no_node - 1) return false;
+  } else if ((int)peers.size() < conf->no_node - 1) {
+    return false;
+  }
+
+  WorkRequest wr;
+  wr.op = BARRIER;
+  wr.id = barrier_round;
+  if (FarmSubmitRequest(master, &wr) < 0) return false;  //no free slot
+  barrier_sent = barrier_round;
+  epicLog(LOG_INFO, "worker %d entered barrier %u", GetWorkerId(), barrier_round);
+  return true;
+}
+
+int Worker::BarrierChecker(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+  Worker* w = (Worker*)clientData;
+  if (w->FarmSubmitBarrier()) {
+    w->barrier_checking = false;
+    return AE_NOMORE;
+  }
+  return 1;
+}
+
+int Worker::TierDemoter(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+  Worker* w = (Worker*)clientData;
+  size_t moved = w->FarmTierDemote();
+  if (moved) epicLog(LOG_INFO, "tier demoter moved %lu bytes to the second tier", moved);
+  return w->conf->tier_interval;
+}
+
+/*
+ * the region grows in whichever thread runs out of memory (see SlabAllocator::slabs_grow),
+ * here the new parts are registered to the transport and told to every worker
+ * with an ADD_REGION msg, so that they can be read one-sided.
+ * Until then a peer reads them with FARM_READ msgs. The workers joining later
+ * are told all the parts but the first one, which is in the conn string.
+ */
+void Worker::FarmSyncRegions() {
+  auto regions = sb.get_regions();
+  for (; nregions < regions.size(); nregions++) {
+    if (resource->RegLocalMemory(regions[nregions].first, regions[nregions].second)) {
+      epicLog(LOG_WARNING, "cannot register the region at %p", regions[nregions].first);
+      break;
+    }
+    size = sb.get_limit();
+  }
+
+  UpdateWidMap();
+  for (auto& e : widCliMap) {
+    if (!e.second->IsConnected()) continue;
+    size_t& n = announced_regions[e.first];
+    if (n == 0) n = 1;
+    for (; n < nregions; n++) {
+      WorkRequest wr;
+      wr.op = ADD_REGION;
+      wr.id = resource->GetRegionKey(regions[n].first);
+      wr.addr = regions[n].first - (char*)base;
+      wr.size = regions[n].second;
+      if (FarmSubmitRequest(e.second, &wr) < 0)
+        break;  //no free slot, try again next time
+    }
+  }
+}
 /* 功能：用于工作节点与主节点同步状态
    参数：op-操作类型，默认值为UPDATE_MEM_STATS，表示更新内存统计信息；
    parent-父工作请求指针，默认为nullptr，用于关联当前请求与之前的请求。
@@ -275,8 +505,9 @@ void Worker::SyncMaster(Work op, WorkRequest* parent) { //默认情况下op的
   wr->op = op;  //设置工作请求的操作类型为传入的参数op
   //根据操作类型处理请求
   if(UPDATE_MEM_STATS == op) { //当操作类型为UPDATE_MEM_STATS时，工作节点将其内存统计信息(总内存和空闲内存)同步到主节点
-    wr->size = conf->size; //设置工作请求的size为配置中的总内存大小(conf->size)
-    wr->free = sb.get_avail(); //设置工作请求的free为当前可用内存大小(sb.get_avail()) 
+    //the room the region can still grow by counts as free, so that the remote allocations come here as well
+    wr->size = sb.get_max_limit(); //设置工作请求的size为内存区域可增长到的总大小
+    wr->free = sb.get_avail() + sb.get_max_limit() - sb.get_limit(); //设置工作请求的free为当前可用内存大小(含可增长的部分)
     ret = FarmSubmitRequest(master, wr);//调用FarmSubmitRequest向主节点master提交工作请求wr，返回值存储在ret中 
 
     //TODO: whether needs to do it in a callback func?
@@ -292,29 +523,136 @@ void Worker::SyncMaster(Work op, WorkRequest* parent) { //默认情况下op的
   delete wr;  //释放工作请求对象wr的内存，避免内存泄漏
 }
 
+/*
+ * the local allocations since the last sync passed conf->ghost_th: tell
+ * Master, or with gossip nothing to do, as the record of this worker is
+ * taken anew whenever it is sent (see FarmAppendGossip)
+ */
+void Worker::FarmSyncStats() {
+  if (conf->stats_mode == STATS_GOSSIP)
+    ghost_size = 0;
+  else
+    SyncMaster();
+}
+
+void Worker::FarmUpdateMemStats(int wid, Size total, Size free) {
+  Client* cli = FindClientWid(wid, false);  //not connected for the stats
+  if(cli) {
+    cli->SetMemStat(total, free);
+  } else if (peers.count(wid)) { //尚未连接的工作节点，连接时再设置
+    peers[wid].total = total;
+    peers[wid].free = free;
+  } else { //如果目标工作节点未注册，记录警告日志
+    epicLog(LOG_WARNING, "worker %d not registered yet", wid);
+  }
+  placement_dirty_ = true;
+}
+
+int Worker::FarmAppendGossip(char* buf, int wid) {
+  GossipStats& g = gossip_stats_[wid];
+  if (wid == GetWorkerId()) {
+    Size total = sb.get_max_limit();
+    Size free = sb.get_avail() + sb.get_max_limit() - sb.get_limit();
+    uint32_t load = local_txns_.size() + remote_txns_.size();
+    if (!g.version || g.total != total || g.free != free || g.load != load) {
+      g.version++;
+      g.total = total;
+      g.free = free;
+      g.load = load;
+    }
+  }
+  return appendInteger(buf, wid, g.version, g.total, g.free, g.load);
+}
+
+/*
+ * [uint32_t n][n records]: the record of this worker and the next one of
+ * the others in turn, so that the stats spread with the traffic as well
+ */
+int Worker::FarmAppendPiggyback(char* buf) {
+  uint32_t n = 1;
+  int len = sizeof(n) + FarmAppendGossip(buf + sizeof(n), GetWorkerId());
+  if (!gossip_wids_.empty()) {
+    len += FarmAppendGossip(buf + len, gossip_wids_[gossip_next_++ % gossip_wids_.size()]);
+    n++;
+  }
+  appendInteger(buf, n);
+  return len;
+}
+
+void Worker::FarmMergeGossip(const char* p, int n) {
+  int wid;
+  uint64_t version;
+  Size total, free;
+  uint32_t load;
+  for (int i = 0; i < n; i++) {
+    p += readInteger((char*)p, wid, version, total, free, load);
+    if (wid == GetWorkerId() || wid == 0) continue;
+    auto it = gossip_stats_.find(wid);
+    if (it == gossip_stats_.end()) {
+      it = gossip_stats_.emplace(wid, GossipStats()).first;
+      gossip_wids_.push_back(wid);
+    }
+    GossipStats& g = it->second;
+    if (version <= g.version) continue;
+    g.version = version;
+    g.total = total;
+    g.free = free;
+    g.load = load;
+    //a worker whose WORKER_JOIN is yet to come gets it then (see AddPeer)
+    if (peers.count(wid) || widCliMap.count(wid))
+      FarmUpdateMemStats(wid, total, free);
+  }
+}
+
+/*
+ * push all the known records to a random connected worker (the ones of
+ * lazy connections are not connected for it); with one push per interval
+ * by every worker, a change reaches all of them in O(log #workers) intervals
+ */
+void Worker::FarmGossip() {
+  UpdateWidMap();
+  std::vector<Client*> clis;
+  for (auto& e : widCliMap)
+    if (e.second->IsConnected()) clis.push_back(e.second);
+  if (clis.empty()) return;
+  Client* c = clis[rand() % clis.size()];
+
+  char buf[MAX_GOSSIP_RECORDS * GOSSIP_RECORD_SIZE];
+  int n = 1;
+  int len = FarmAppendGossip(buf, GetWorkerId());
+  size_t start = gossip_wids_.empty() ? 0 : rand() % gossip_wids_.size();
+  for (size_t i = 0; i < gossip_wids_.size() && n < MAX_GOSSIP_RECORDS; i++) {
+    int wid = gossip_wids_[(start + i) % gossip_wids_.size()];
+    if (wid == c->GetWorkerId() || !gossip_stats_[wid].version) continue;
+    len += FarmAppendGossip(buf + len, wid);
+    n++;
+  }
+
+  WorkRequest wr;
+  wr.op = GOSSIP;
+  wr.size = n;
+  wr.ptr = buf;
+  FarmSubmitRequest(c, &wr);  //no free slot, skip this round
+}
+
+int Worker::Gossiper(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+  Worker* w = (Worker*)clientData;
+  w->FarmGossip();
+  return w->conf->gossip_interval;
+}
+
 Client* Worker::GetClient(GAddr addr) {
   Client* cli = nullptr;
   int wid = 0;
-  UpdateWidMap();
-  if(widCliMap.size() == 0) {
+  if(widCliMap.size() == 0 && peers.size() == 0) {
     epicLog(LOG_WARNING, "#remote workers is 0!");
   } else {
     if(addr) {
-      epicAssert(!IsLocal(addr));
-      wid = WID(addr);
+      wid = regions.Owner(addr);
     } else {
       //epicLog(LOG_DEBUG, "select a random server to allocate");
       //while ((wid = rand() % widCliMap.size() + 1) == GetWorkerId());
-      epicLog(LOG_DEBUG, "select the server with most free memory to allocate");
-      Size max = 0;
-      for(auto& entry: widCliMap) {
-        epicLog(LOG_DEBUG, "worker %d, have %ld free out of %ld",
-            entry.second->GetWorkerId(), entry.second->GetFreeMem(), entry.second->GetTotalMem());
-        if(max < entry.second->GetFreeMem()) {
-          max = entry.second->GetFreeMem();
-          wid = entry.first;
-        }
-      }
+      wid = FarmPlace(0, true);
     }
     cli = FindClientWid(wid);
     if(!cli) {
@@ -324,6 +662,85 @@ Client* Worker::GetClient(GAddr addr) {
   return cli;
 }
 
+/*
+ * rebuild the placement targets if the mem stats or the known workers have
+ * changed since, and take the current stats of this worker and the loads
+ */
+void Worker::FarmUpdatePlacementTargets() {
+  UpdateWidMap();
+  if(!placement_dirty_ && placement_nclients_ == widCliMap.size()) {
+    FarmUpdatePlacementLoads();
+    return;
+  }
+  placement_targets_.clear();
+  placement_clients_.clear();
+  placement_targets_.push_back(PlacementTarget{GetWorkerId(), 0, 0, 0});  //filled by FarmUpdatePlacementLoads
+  placement_clients_.push_back(nullptr);
+  for(auto& entry: widCliMap) {
+    if(left_.count(entry.first)) continue;
+    Client* c = entry.second;
+    placement_targets_.push_back(PlacementTarget{entry.first, c->GetTotalMem(), c->GetFreeMem(), 0});
+    placement_clients_.push_back(c);
+  }
+  //the workers not connected yet (lazy connections)
+  for(auto& entry: peers) {
+    if(entry.first == GetWorkerId() || widCliMap.count(entry.first) || left_.count(entry.first)) continue;
+    placement_targets_.push_back(PlacementTarget{entry.first, entry.second.total, entry.second.free, 0});
+    placement_clients_.push_back(nullptr);
+  }
+  placement_nclients_ = widCliMap.size();
+  placement_dirty_ = false;
+  epicLog(LOG_DEBUG, "%lu placement targets", placement_targets_.size());
+  FarmUpdatePlacementLoads();
+}
+
+void Worker::FarmUpdatePlacementLoads() {
+  PlacementTarget& local = placement_targets_[0];
+  local.total = sb.get_max_limit();
+  local.free = sb.get_avail() + sb.get_max_limit() - sb.get_limit();
+  for(size_t i = 1; i < placement_targets_.size(); i++) {
+    Client* c = placement_clients_[i];
+    auto it = c ? client_tasks_.find(c) : client_tasks_.end();
+    placement_targets_[i].load = it == client_tasks_.end() ? 0 : it->second.size();
+    //with gossip, the txns in flight at the worker as well
+    auto g = gossip_stats_.find(placement_targets_[i].wid);
+    if (g != gossip_stats_.end()) placement_targets_[i].load += g->second.load;
+  }
+}
+
+/*
+ * the worker to allocate size bytes at by the policy of conf->alloc_policy,
+ * this one or a remote one (only remote ones if remote_only); if none has
+ * the room, this one (or 0 if remote_only).
+ * The free memory of the picked remote worker is lowered by size until its
+ * next mem stats come.
+ */
+int Worker::FarmPlace(Size size, bool remote_only) {
+  FarmUpdatePlacementTargets();
+  if(remote_only) placement_targets_[0].free = 0;
+
+  int i = placement_->Place(placement_targets_, size);
+  if(i < 0) {
+    //the stats may be behind, try here anyway
+    epicLog(LOG_DEBUG, "no worker has %lu bytes free", size);
+    return remote_only ? 0 : GetWorkerId();
+  }
+  if(i > 0) placement_targets_[i].free -= std::min(size, placement_targets_[i].free);
+  epicLog(LOG_DEBUG, "place %lu bytes at worker %d", size, placement_targets_[i].wid);
+  return placement_targets_[i].wid;
+}
+
+int Worker::FarmPlaceGroup(uint64_t group, Size size) {
+  FarmUpdatePlacementTargets();
+  int i = Placement::PlaceGroup(placement_targets_, group, size);
+  if(i < 0) {
+    epicLog(LOG_DEBUG, "no worker has %lu bytes free for group %lu", size, group);
+    return GetWorkerId();
+  }
+  if(i > 0) placement_targets_[i].free -= std::min(size, placement_targets_[i].free);
+  return placement_targets_[i].wid;
+}
+
 int Worker::Notify(WorkRequest* wr) {
   /*wr->flag表示工作请求的标志位，可能包含多个标志(例如同步或异步标志)。ASYNC一个标志位，用于指示工作请求是否是异步请求。此处通过按位与操作检查ASYNC标志是否被设置。*/
   if(!(wr->flag & ASYNC)) {//条件成立，表示ASYNC标志未被设置，即工作请求是同步请求 
@@ -355,14 +772,14 @@ Worker::~Worker() {
   aeDeleteEventLoop(el);
   delete wqueue;
   delete st;
+  delete tier;
 }
-/* 功能：向指定客户端Client提交工作请求WorkRequest。
+/* 功能：向指定客户端Client提交工作请求WorkRequest(单条消息独占一个发送槽，用于master)。
  *    1.获取发送缓冲区槽
- *    2.根据工作请求的操作类型生成消息
+ *    2.根据工作请求的操作类型生成消息(FarmGenerateMsg)
  *    3.将消息发送到目标客户端
  *    4.返回请求的处理状态
  * 
- *    操作类型：支持FARM_READ_REPLY、PREPARE、VLIDATE、ACKNOWLEDGE等操作类型，根据操作类型生成不同的消息。
  * 参数：cli：目标客户端，用于发送请求。wr：工作请求对象，包含请求的操作类型、数据地址、大小等信息。
  * 返回值：1-请求处理完成。0-请求未完成，需要继续处理。-1-资源不可用，需要等待。
  */
@@ -374,49 +791,94 @@ int Worker::FarmSubmitRequest(Client* cli, WorkRequest* wr) {
     return -1;
   }
 
+  //远程读优先使用单边读，传输层不支持时退回到FARM_READ消息(复用已获取的槽)
+  if (FarmOneSided(wr)) {
+    if (FarmSubmitRemoteRead(cli, wr, sbuf) == 0)
+      return 1;
+  }
+
+  int len;
+  int finished = FarmGenerateMsg(cli, wr, sbuf, MAX_REQUEST_SIZE, len);
+  epicAssert(finished >= 0);
+
+  //发送请求
+  int ret = cli->Send(sbuf, len); //调用Clien::Send方法，将序列化后的请求发送到目标客户端
+
+  epicLog(LOG_DEBUG, "Worker %d sends a %d:%s msg with wr_id %d, size %d, to Worker %d", 
+      this->GetWorkerId(), wr->op, workToStr(wr->op), wr->id, len, cli->GetWorkerId());
+  epicAssert(ret == len); //检查发送的字节数是否与序列化后的长度一致
+
+  return finished;
+}
+
+/* 功能：将工作请求wr对应的消息生成到buf中(最多room字节)
+ *    操作类型：支持FARM_READ_REPLY、PREPARE、VLIDATE、ACKNOWLEDGE等操作类型，根据操作类型生成不同的消息。
+ * 返回值：1-请求处理完成。0-请求未完成(PREPARE/VALIDATE的对象未全部放下)，需要继续处理。
+ *        -2-剩余空间放不下该消息，此时没有生成任何内容，也没有修改任何状态。
+ */
+int Worker::FarmGenerateMsg(Client* cli, WorkRequest* wr, char* sbuf, int room, int& len) {
+  if (room < FARM_MSG_HDR_SIZE) return -2;
+
   char buf[MAX_REQUEST_SIZE];
   //处理FARM_READ_REPLY操作
   if (wr->op == FARM_READ_REPLY) {
-    epicAssert(IsLocal(wr->addr));
-    char* local = (char*)ToLocal(wr->addr);
-    version_t before, after;
-    osize_t size;  
-    int len = 0;
-
-    // lock-free read
-    after = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
-    do {
-      before = after;
-      while(is_version_wlocked(before))
-        before = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
-      runlock_version(&before);
-      readInteger(local + sizeof(before), size);
-      len = appendInteger(buf, before, size);
-      memcpy(buf + len, local + len, size);
-      after = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
-    } while (is_version_diff(before, after));
-
-    if (unlikely(before == 0 || size == -1)) { //如果地址无效或数据读取失败，设置状态为READ_ERROR
-      epicLog(LOG_INFO, "Address %lx is not allocated or has been free'ed", wr->addr);
-      wr->status = Status::READ_ERROR;
-    } else {
-      wr->status = Status::SUCCESS; //否则设置状态为SUCCESS
-      wr->size = sizeof(before) + sizeof(size) + size;
+    int olen;
+    if (!IsLocal(wr->addr)) {
+      //the region has been moved away: tell the reader where it is now
+      wr->status = Status::MOVED;
+      wr->wid = regions.Owner(wr->addr);
+      wr->counter = regions.Seq(REGION_OF(wr->addr));
+    } else if ((wr->status = FarmReadObject(wr->addr, buf, olen)) == Status::SUCCESS) {
+      wr->size = olen;
       epicAssert(wr->size <= MAX_REQUEST_SIZE);
       wr->ptr = buf;
+      if (FARM_MSG_HDR_SIZE + wr->size > room) return -2;
     }
+  } else if (wr->op == FARM_MALLOC_REPLY && wr->counter > 1) {
+    //allocate the objects only now, so that nothing is kept for the reply
+    osize_t size = wr->size;
+    int n = wr->counter;
+    epicAssert(n <= FARM_MALLOC_MANY_MAX);
+    int hlen = sizeof(osize_t) + n * sizeof(GAddr);
+    if (FARM_MSG_HDR_SIZE + hlen > room) return -2;
+    GAddr addrs[FARM_MALLOC_MANY_MAX];
+    n = leaving_ ? 0 : FarmMallocMany(size, n, addrs);
+    hlen = appendInteger(buf, size);
+    memcpy(buf + hlen, addrs, n * sizeof(GAddr));
+    hlen += n * sizeof(GAddr);
+    ghost_size += n * size;
+    wr->status = n ? Status::SUCCESS : Status::ALLOC_ERROR;
+    wr->addr = n ? addrs[0] : Gnullptr;
+    wr->size = hlen;
+    wr->ptr = buf;
+    if (ghost_size > conf->ghost_th) FarmSyncStats();
+  } else if (wr->op == PUT && FARM_MSG_HDR_SIZE + wr->size > room) {
+    return -2;
+  } else if (wr->op == KV_PUT || wr->op == KV_GET_REPLY) {
+    if (FarmGenerateKVChunk(wr, room)) return -2;
+  } else if (wr->op == MIGRATE) {
+    int n = FarmGenerateMigrate(wr, buf, room - FARM_MSG_HDR_SIZE);
+    if (n < 0) return -2;
+    wr->size = n;
+    wr->ptr = buf;
+  } else if (wr->op == PREPARE || wr->op == VALIDATE) {
+    //wr is queued to all the participants at once, each msg carries the count of its own
+    uint16_t cid = cli->GetWorkerId();
+    TxnContext* tx = local_txns_[wr->id];
+    wr->nobj = wr->op == PREPARE ? tx->getNumWobjForWid(cid) : tx->getNumRobjForWid(cid);
   }
   //序列化工作请求
-  int len; //表示序列化后的数据长度
   wr->Ser(sbuf, len);  //调用WorkRequest::Ser方法，将工作请求序列化到发送缓冲区sbuf中
   int finished = 1;
   //处理不同的操作类型
   if (wr->op == PREPARE) { //PREPARE操作
     uint16_t cid = cli->GetWorkerId();
-    len += local_txns_[wr->id]->generatePrepareMsg(cid,
-        sbuf + len, MAX_REQUEST_SIZE - len,
+    int n = local_txns_[wr->id]->generatePrepareMsg(cid,
+        sbuf + len, room - len,
         tx_status_[wr->id]->progress_[cid]);
+    if (n == 0) return -2; //一个对象都放不下
 
+    len += n;
     if (local_txns_[wr->id]->getNumWobjForWid(cid) > tx_status_[wr->id]->progress_[cid]) {
       finished = 0;
     }
@@ -428,10 +890,12 @@ int Worker::FarmSubmitRequest(Client* cli, WorkRequest* wr) {
 
   } else if (wr->op == VALIDATE) {  //VALIDATE操作
     uint16_t cid = cli->GetWorkerId();
-    len += local_txns_[wr->id]->generateValidateMsg(cid,
-        sbuf + len, MAX_REQUEST_SIZE - len,
+    int n = local_txns_[wr->id]->generateValidateMsg(cid,
+        sbuf + len, room - len,
         tx_status_[wr->id]->progress_[cid]);
+    if (n == 0) return -2;
 
+    len += n;
     if (local_txns_[wr->id]->getNumRobjForWid(cid) > tx_status_[wr->id]->progress_[cid]) {
       finished = 0;
     }
@@ -447,24 +911,140 @@ int Worker::FarmSubmitRequest(Client* cli, WorkRequest* wr) {
     epicLog(LOG_DEBUG, "finalize for txn %lx", txn_id);
     remote_txns_.erase(txn_id);
     nobj_processed.erase(txn_id);
+  } else if (wr->op == KV_PUT || wr->op == KV_GET_REPLY) {
+    Size sent = wr->offset + wr->counter;
+    if (sent < wr->size && (wr->op == KV_PUT || wr->status == SUCCESS)) {
+      kv_transfers_[wr].offset = sent;
+      finished = 0;
+    } else {
+      auto it = kv_transfers_.find(wr);
+      if (it != kv_transfers_.end()) {
+        if (it->second.value) kvs.Release(it->second.value);
+        kv_transfers_.erase(it);
+      }
+    }
+  } else if (wr->op == MIGRATE) {
+    FarmMigration& m = farm_migrations_.front();
+    if (!m.ready.empty()) {
+      finished = 0;
+    } else {
+      m.queued = false;
+      if (wr->flag & REQUEST_DONE) m.waiting = true;
+    }
   }
-  //发送请求
-  int ret = cli->Send(sbuf, len); //调用Clien::Send方法，将序列化后的请求发送到目标客户端
 
-  epicLog(LOG_DEBUG, "Worker %d sends a %d:%s msg with wr_id %d, size %d, to Worker %d", 
-      this->GetWorkerId(), wr->op, workToStr(wr->op), wr->id, len, cli->GetWorkerId());
-  epicAssert(ret == len); //检查发送的字节数是否与序列化后的长度一致
+  if ((wr->op == KV_GET_REPLY && finished) || wr->op == PUT_REPLY
+      || wr->op == MIGRATE_REPLY || wr->op == MIGRATE_PULL_REPLY) {
+    // the reply ends a remote KV (or migration) request
+    uint64_t txn_id = cli->GetWorkerId();
+    txn_id = (txn_id<<32) | wr->id;
+    remote_txns_.erase(txn_id);
+    nobj_processed.erase(txn_id);
+  } else if (wr->op == VALIDATE_REPLY) {
+    uint64_t txn_id = cli->GetWorkerId();
+    txn_id = (txn_id<<32) | wr->id;
+    if (remote_txns_.at(txn_id)->getNumWobjForWid(GetWorkerId()) == 0) {
+      // Finalize this txn as I won't receive commit/abort
+      // messages
+      remote_txns_.erase(txn_id);
+      nobj_processed.erase(txn_id);
+    }
+  }
+  // NOTE: wr may have been free'ed along with the remote txn here
 
   //返回结果，请求完成返回1；请求未完成，需要继续吹返回0. 
-  if (finished)
-    return 1;
-  else
-    return 0;
+  return finished;
+}
+
+/**
+ * @brief pack as many pending msgs to worker @param c as possible into one
+ * send slot: [FARM_BATCH][n] followed by n [len][msg], which is unpacked by
+ * FarmProcessRemoteRequest on the other side. With gossip, the stats go in
+ * front of the msgs: [FARM_BATCH_GOSSIP][n][k][k records], unless the first
+ * msg needs the room. Msgs are taken in order from
+ * client_tasks_[c], and the ones fully generated are popped.
+ *
+ * @return the number of msgs sent (a one-sided read counts as one);
+ * -1 if there is no free send slot
+ */
+int Worker::FarmSubmitBatch(Client* c) {
+  std::list<TxnContext*>& tasks = client_tasks_[c];
+  char* sbuf = c->GetFreeSlot();
+  if (unlikely(sbuf == nullptr)) return -1;
+
+  WorkRequest* wr = tasks.front()->wr_;
+  if (FarmOneSided(wr)) {
+    if (FarmSubmitRemoteRead(c, wr, sbuf) == 0) {
+      tasks.pop_front();
+      return 1;
+    }
+  }
+
+  bool gossip = conf->stats_mode == STATS_GOSSIP;
+  int len = FARM_BATCH_HDR_SIZE, n = 0, mlen, ret;
+  if (gossip) len += FarmAppendPiggyback(sbuf + len);
+  while (!tasks.empty()) {
+    wr = tasks.front()->wr_;
+    // a one-sided read lands in a slot of its own
+    if (n && FarmOneSided(wr)) break;
+
+    Work op = wr->op;
+    uint32_t id = wr->id;
+    ret = FarmGenerateMsg(c, wr, sbuf + len + sizeof(uint32_t),
+        MAX_REQUEST_SIZE - len - sizeof(uint32_t), mlen);
+    if (ret == -2 && n == 0 && gossip) {
+      //the msg takes the whole slot, send it without the stats
+      gossip = false;
+      len = FARM_BATCH_HDR_SIZE;
+      continue;
+    }
+    if (ret == -2) break;
+
+    appendInteger(sbuf + len, (uint32_t)mlen);
+    len += sizeof(uint32_t) + mlen;
+    n++;
+    epicLog(LOG_DEBUG, "Worker %d packs a %d:%s msg with wr_id %d, size %d, to Worker %d",
+        this->GetWorkerId(), op, workToStr(op), id, mlen, c->GetWorkerId());
+
+    if (ret == 1) tasks.pop_front();
+  }
+  epicAssert(n > 0);
+
+  wtype bop = gossip ? FARM_BATCH_GOSSIP : FARM_BATCH;
+  appendInteger(sbuf, bop, (uint32_t)n);
+  ret = c->Send(sbuf, len);
+  epicAssert(ret == len);
+  return n;
 }
 
 void Worker::FarmAddTask(Client* c, TxnContext* tx) {
   client_tasks_[c].push_back(tx);
-  if (client_tasks_[c].size() == 1)
+  c->RecordQueueDepth(client_tasks_[c].size());
+  if (client_tasks_[c].size() == 1) {
+    if (farm_defer_resume_)
+      farm_deferred_clients_.insert(c);
+    else
+      FarmResumeTxn(c);
+  }
+}
+
+/*
+ * between FarmDeferResume and FarmFlushResume, the msgs generated for a client
+ * are only queued, so that they can be sent together in one slot;
+ * used around the processing of a received batch or of the local work queue
+ */
+void Worker::FarmDeferResume() {
+  farm_defer_resume_++;
+}
+
+void Worker::FarmFlushResume() {
+  epicAssert(farm_defer_resume_ > 0);
+  if (--farm_defer_resume_) return;
+  if (farm_deferred_clients_.empty()) return;
+
+  std::unordered_set<Client*> clients;
+  clients.swap(farm_deferred_clients_);
+  for (Client* c: clients)
     FarmResumeTxn(c);
 }
 
@@ -490,41 +1070,36 @@ void Worker::FarmProcessLocalRequest(WorkRequest *wr) {
     case FARM_READ: //处理读取请求
       this->FarmProcessLocalRead(wr);
       break;
+    case FARM_READ_MANY:
+      this->FarmProcessLocalReadMany(wr);
+      break;
     case COMMIT: //处理提交请求
       this->FarmProcessLocalCommit(wr);
       break;
     case PUT:
     case GET:  //处理PUT和GET请求，将任务添加到主节点的任务队列中
+    case COORD_BARRIER:
+    case WATCH:
+    case FETCH_ADD: //协调服务请求同样由主节点处理
       FarmAddTask(master, local_txns_[wr->id]);
       break;
+    case BARRIER:
+      this->FarmProcessLocalBarrier(wr);
+      break;
     case KV_PUT:
     case KV_GET://处理KV_PUT和KV_GET请求
-      {
-        epicAssert(wr->counter);
-        if(wr->counter == GetWorkerId()) {//检查请求的计数器是否等于当前工作节点的ID
-          if (wr->op == KV_PUT) {  //处理相应请求
-            void* ptr = zmalloc(wr->size);
-            memcpy(ptr, wr->ptr, wr->size);
-            kvs[wr->key] = pair<void*, Size>(ptr, wr->size);
-            wr->status = SUCCESS;
-          } else {
-            if(kvs.count(wr->key)) {
-              wr->size = kvs.at(wr->key).second;
-              memcpy(wr->ptr, kvs.at(wr->key).first, wr->size);
-              wr->status = SUCCESS;
-            } else { //找到对应的客户端并将任务添加到客户端的任务队列中
-              wr->status = NOT_EXIST;
-              epicLog(LOG_INFO, "not exist locally");
-            }
-          }
-          Notify(wr); //调用Notify函数通知请求发起方
-        } else {
-          Client* cli = FindClientWid(wr->counter);
-          epicAssert(cli);
-          FarmAddTask(cli, local_txns_[wr->id]);
-        }
-        break;
-      }
+      this->FarmProcessLocalKV(wr);
+      break;
+    case KV_GET_MANY:
+    case KV_PUT_MANY:
+      this->FarmProcessLocalKVMany(wr);
+      break;
+    case MIGRATE_PULL:
+      this->FarmProcessLocalMigratePull(wr);
+      break;
+    case WORKER_LEAVE:
+      this->FarmProcessLocalLeave(wr);
+      break;
     default://处理未知操作类型，记录警告日志
       epicLog(LOG_WARNING, "Unknown op code %d", wr->op);
       break;
@@ -550,6 +1125,29 @@ void Worker::FarmProcessRemoteRequest(Client* c, const char* msg, uint32_t size)
   epicLog(LOG_DEBUG, "Worker %d receives a %s message (wr_id %d, size %d bytes) from Worker %d", 
       this->GetWorkerId(), workToStr(op), wr_id, size, c->GetWorkerId());
 
+  //拆分合并发送的消息：[FARM_BATCH][n] + n * [len][msg]，其中n即wr_id字段(FARM_BATCH_GOSSIP在消息前带有内存统计信息)
+  if (op == FARM_BATCH || op == FARM_BATCH_GOSSIP) {
+    const char* p = msg + sizeof(wt) + sizeof(wr_id);
+    uint32_t mlen;
+    if (op == FARM_BATCH_GOSSIP) {
+      uint32_t k;
+      readInteger((char*)p, k);
+      p += sizeof(k);
+      FarmMergeGossip(p, k);
+      p += k * GOSSIP_RECORD_SIZE;
+    }
+    FarmDeferResume();
+    for (uint32_t i = 0; i < wr_id; i++) {
+      readInteger((char*)p, mlen);
+      p += sizeof(mlen);
+      FarmProcessRemoteRequest(c, p, mlen);
+      p += mlen;
+    }
+    epicAssert(p == msg + size);
+    FarmFlushResume();
+    return;
+  }
+
   TxnContext *tx;
   //特殊操作类型处理
   if (op == FETCH_MEM_STATS_REPLY || op == BROADCAST_MEM_STATS) { //如果操作类型是FETCH_MEM_STATS_REPLY或BROADCAST_MEM_STATS，解析消息内容并更新内存统计信息
@@ -557,26 +1155,97 @@ void Worker::FarmProcessRemoteRequest(Client* c, const char* msg, uint32_t size)
     WorkRequest wr;
     wr.Deser(msg, len);
 
+    //broadcasts are deltas numbered by the master, a gap means one was lost, so fetch the whole picture again
+    if (op == BROADCAST_MEM_STATS && stats_epoch && wr.key != stats_epoch + 1) {
+      epicLog(LOG_INFO, "mem stats jump from epoch %lu to %lu, fetch them all", stats_epoch, wr.key);
+      SyncMaster(FETCH_MEM_STATS);
+    }
+    if (wr.key > stats_epoch) stats_epoch = wr.key;
+
     int wid;
     Size mtotal, mfree;
-    vector<Size> stats;
-    Split<Size>((char*)wr.ptr, stats);
-    epicLog(LOG_DEBUG, "nr_nodes = %d, stats.size = %d", wr.size, stats.size());
-    epicAssert(stats.size() == wr.size*3);
+    char* p = (char*)wr.ptr;
+    epicLog(LOG_DEBUG, "nr_nodes = %d, epoch = %lu", wr.size, wr.key);
     for(int i = 0; i < wr.size; i++) {
-      wid = stats[i*3];
-      mtotal = stats[i*3+1];
-      mfree =stats[i*3+2];
+      p += readInteger(p, wid, mtotal, mfree);
       if(GetWorkerId() == wid) { //忽略当前工作节点的统计信息
         epicLog(LOG_DEBUG, "Ignore self information");
         continue;
       }
-      Client* cli = FindClientWid(wid);
-      if(cli) {
-        cli->SetMemStat(mtotal, mfree);
-      } else { //如果目标工作节点未注册，记录警告日志
-        epicLog(LOG_WARNING, "worker %d not registered yet", wid);
+      //with gossip, Master only has the stats of the join, older than any gossiped ones
+      auto g = gossip_stats_.find(wid);
+      if (g != gossip_stats_.end() && g->second.version) continue;
+      FarmUpdateMemStats(wid, mtotal, mfree);
+    }
+    return;
+  }
+  if (op == BARRIER_RELEASE) { //所有工作节点都进入了这一轮屏障，唤醒本地的等待者
+    WorkRequest wr;
+    wr.Deser(msg, len);
+    epicAssert(wr.id == barrier_round);
+    epicLog(LOG_INFO, "barrier %u released", wr.id);
+    for (WorkRequest* w : barrier_waiters) {
+      w->status = SUCCESS;
+      Notify(w);
+    }
+    barrier_waiters.clear();
+    return;
+  }
+  if (op == WORKER_JOIN) { //新加入的工作节点，记录其地址(它会主动连接我们，或在lazy模式下按需连接)
+    WorkRequest wr;
+    wr.Deser(msg, len);
+    AddPeer(wr.id, string((char*)wr.ptr, wr.size));
+    epicLog(LOG_INFO, "worker %u joined at %s:%d", wr.id, peers[wr.id].ip.c_str(), peers[wr.id].port);
+    return;
+  }
+  if (op == GOSSIP) { //随机的工作节点发来的内存统计信息
+    WorkRequest wr;
+    wr.Deser(msg, len);
+    FarmMergeGossip((char*)wr.ptr, wr.size);
+    return;
+  }
+  if (op == ADD_REGION) { //对端新增的内存区域，之后可以单边读取
+    WorkRequest wr;
+    wr.Deser(msg, len);
+    c->AddRemoteRegion(wr.addr, wr.size, wr.id);
+    epicLog(LOG_INFO, "worker %d grew a region of %lu bytes at offset %lx",
+        c->GetWorkerId(), wr.size, wr.addr);
+    return;
+  }
+  if (op == REGION_MAP) { //主节点通告的区域迁移(增量)或完整的区域映射
+    WorkRequest wr;
+    wr.Deser(msg, len);
+    FarmProcessRegionMap(&wr);
+    return;
+  }
+  if (op == FARM_FREE) { //远程节点归还的租约对象(从未写过)，直接释放
+    WorkRequest wr;
+    wr.Deser(msg, len);
+    FarmProcessFree(&wr);
+    return;
+  }
+  if (op == MIGRATE_DONE) { //迁移源已交出该区域，可以在这里加锁了
+    WorkRequest wr;
+    wr.Deser(msg, len);
+    regions.Unfreeze(wr.key);
+    FarmMigrateReleaseChunks();
+    epicLog(LOG_INFO, "region %lx is taken over from worker %d", wr.key, c->GetWorkerId());
+    return;
+  }
+  if (op == WORKER_LEAVE) { //其他工作节点正在退出(不再向它分配)；或主节点确认本节点已退出
+    WorkRequest wr;
+    wr.Deser(msg, len);
+    if (wr.flag & REQUEST_DONE) {
+      if (farm_leave_wr_) {
+        farm_leave_wr_->status = SUCCESS;
+        Notify(farm_leave_wr_);
+        farm_leave_wr_ = nullptr;
       }
+      epicLog(LOG_INFO, "worker %d left", GetWorkerId());
+    } else {
+      left_.insert(wr.id);
+      placement_dirty_ = true;
+      epicLog(LOG_INFO, "worker %d is leaving", wr.id);
     }
     return;
   }
@@ -591,8 +1260,9 @@ void Worker::FarmProcessRemoteRequest(Client* c, const char* msg, uint32_t size)
 
     // this is a new transaction
     if (this->remote_txns_.count(txn_id) == 0) { //如果为新事务，创建事务上下文并初始化处理状态
-      this->remote_txns_[txn_id] = 
-        std::unique_ptr<TxnContext>(new TxnContext);
+      TxnContext* rtx = new TxnContext;
+      rtx->setBucket(GetWorkerId());  //only the objects owned here are sent here
+      this->remote_txns_[txn_id] = std::unique_ptr<TxnContext>(rtx);
       this->nobj_processed[txn_id] = 0;
     }
 
@@ -613,6 +1283,7 @@ void Worker::FarmProcessRemoteRequest(Client* c, const char* msg, uint32_t size)
     case FARM_MALLOC_REPLY:
       this->FarmProcessMallocReply(c, tx);
       break;
+
     case FARM_READ:  //数据读取相关操作：处理数据读取请求和回复
       this->FarmProcessRead(c, tx);
       break;
@@ -641,43 +1312,54 @@ void Worker::FarmProcessRemoteRequest(Client* c, const char* msg, uint32_t size)
       this->FarmProcessAcknowledge(c, tx);
       break;
     case GET_REPLY:
-    case PUT_REPLY:
+    case COORD_REPLY:
       Notify(tx->wr_);
       break;
+    case PUT_REPLY:
+      FarmNotifyRead(tx->wr_);
+      break;
     case KV_PUT: //键值存储相关操作：处理键值存储的PUT和GET操作
-      {
-        void* ptr = zmalloc(wr->size);
-        memcpy(ptr, wr->ptr, wr->size);
-        kvs[wr->key] = pair<void*, Size>(ptr, wr->size);
-
-
-        // send reply back
-        wr->op = PUT_REPLY;
-        wr->status = SUCCESS;
-        FarmAddTask(c, tx);
-        break;
-      }
+      this->FarmProcessKVPut(c, tx);
+      break;
     case KV_GET:
-      {
-        if(kvs.count(wr->key)) {
-          wr->ptr = kvs.at(wr->key).first;
-          wr->size = kvs.at(wr->key).second;
-          wr->op = GET_REPLY;
-          wr->status = SUCCESS;
-        } else {
-          wr->op = GET_REPLY;
-          wr->status = NOT_EXIST;
-          epicLog(LOG_INFO, "not exist remotely");
-        }
-        FarmAddTask(c, tx);
-        break;
-      }
+      //the value is looked up when the reply is generated (see FarmGenerateKVChunk)
+      wr->op = KV_GET_REPLY;
+      wr->status = SUCCESS;
+      FarmAddTask(c, tx);
+      break;
+    case KV_GET_REPLY: //the chunk has been copied by Deser
+      if (wr->status != SUCCESS || wr->offset + wr->counter == wr->size)
+        FarmNotifyRead(wr);
+      break;
+    case MIGRATE: //区域迁移：迁入的对象
+      this->FarmProcessMigrate(c, tx);
+      break;
+    case MIGRATE_REPLY:
+      this->FarmProcessMigrateReply(c, tx);
+      break;
+    case MIGRATE_PULL: //新节点拉取本节点的区域
+      this->FarmProcessMigratePull(c, tx);
+      break;
+    case MIGRATE_PULL_REPLY:
+      Notify(wr);
+      break;
     default: //未知操作类型：如果操作类型未知，记录警告日志
       epicLog(LOG_WARNING, "Unknown op code %d", tx->wr_->op);
       break;
   }
 }
 
+/*
+ * size class of a leased object: sizes are rounded up to 1/8 of their
+ * power of two (16 bytes at least), which wastes at most 12.5%
+ */
+static inline osize_t FarmLeaseClass(Size size) {
+  if (size <= 128) return ALIGN(size, 16);
+  Size step = 1;
+  while ((step << 4) <= size) step <<= 1;  //size / 16 < step <= size / 8
+  return ALIGN(size, step);
+}
+
 /**函数用于处理本地应用线程发出的内存分配请求
  * @brief process malloc request issued by local application threads
  *
@@ -686,34 +1368,84 @@ void Worker::FarmProcessRemoteRequest(Client* c, const char* msg, uint32_t size)
 void Worker::FarmProcessLocalMalloc(WorkRequest *wr) {
   epicAssert(wr->op == FARM_MALLOC); //断言操作类型，确保工作请求的操作类型为FARM_MALLOC
   TxnContext* tx = local_txns_[wr->id]; //从local_txns_数组中获取与请求ID对应的事务上下文tx
+  int n = wr->counter > 1 ? wr->counter : 1;  //txAllocMany asks for n objects put into wr->ptr
+
+  //no address: the worker is picked by the placement policy (this one or a remote one)
+  if (wr->flag & AFFINITY) {
+    wr->addr = EMPTY_GLOB(FarmPlaceGroup(wr->key, wr->size * n));
+    wr->flag &= ~(AFFINITY);
+  } else if (!wr->addr) {
+    wr->addr = EMPTY_GLOB(FarmPlace(wr->size * n, leaving_));
+  }
+  //nothing is allocated at a leaving worker, not even near an address of it
+  if (left_.count(WID(wr->addr)) || (leaving_ && WID(wr->addr) == GetWorkerId())) {
+    wr->addr = EMPTY_GLOB(FarmPlace(wr->size * n, leaving_));
+  }
 
   bool remote = true; //初始化Remote标志为true，表示默认情况下请求时远程分配
-  if (!wr->addr || IsLocal(wr->addr)) { //如果请求的地址为空或是本地地址，则进行本地内存分配
-    /* local malloc */
-    void *addr;
-    if (wr->flag & ALIGNED) 
-      addr = FarmMalloc(wr->size, true); //调用FarmMalloc函数分配内存
-    else
-      addr = FarmMalloc(wr->size);
-
-    if (likely(addr)) {
-      memset(addr, 0, wr->size); //ensure it is not locked  使用memset将分配的内存初始化为0
-      wr->addr = TO_GLOB(addr, base, GetWorkerId()); //将分配的地址转换为全局地址并赋值给wr->addr
-      remote = false; //设置remote标志为false，表示请求时本地分配
-      wr->status = SUCCESS;  //设置请求状态为SUCCESS
-      this->ghost_size += wr->size; //更新ghost_size
-      wr->op = FARM_MALLOC_REPLY; //设置工作请求的操作类型为FARM_MALLOC_REPLY
-      /*ghost_size表示当前工作节点(Worker)中已分配但未与主节点同步的内存大小，conf->ghost_th表示一个阈值，从配置中读取，用于限制ghost_size的最大值*/
-      if (ghost_size > conf->ghost_th) SyncMaster(); //检查是否需要同步主节点
+  //at the worker of the address (not the owner of its region: a new object goes to a chunk of that worker)
+  if (WID(wr->addr) == GetWorkerId()) { //如果请求的地址是本地地址，则进行本地内存分配
+    if (n > 1) {
+      /* local bulk malloc: the objects are taken from the slab allocator in one pass */
+      int got = FarmMallocMany(wr->size, n, (GAddr*)wr->ptr);
+      if (likely(got)) {
+        wr->counter = got;
+        remote = false;
+        wr->status = SUCCESS;
+        this->ghost_size += got * wr->size;
+        wr->op = FARM_MALLOC_REPLY;
+        if (ghost_size > conf->ghost_th) FarmSyncStats();
+      } else {
+        wr->addr = EMPTY_GLOB(FarmPlace(wr->size * n, true));
+      }
     } else {
-      wr->addr = Gnullptr; //如果内存分配失败，将请求地址设置为Gnullptr
+      /* local malloc */
+      void *addr;
+      if (wr->flag & ALIGNED) 
+        addr = FarmMalloc(wr->size, true); //调用FarmMalloc函数分配内存
+      else
+        addr = FarmMalloc(wr->size);
+
+      if (likely(addr)) {
+        memset(addr, 0, wr->size); //ensure it is not locked  使用memset将分配的内存初始化为0
+        wr->addr = ToGlobal(addr); //将分配的地址转换为全局地址并赋值给wr->addr
+        remote = false; //设置remote标志为false，表示请求时本地分配
+        wr->status = SUCCESS;  //设置请求状态为SUCCESS
+        this->ghost_size += wr->size; //更新ghost_size
+        wr->op = FARM_MALLOC_REPLY; //设置工作请求的操作类型为FARM_MALLOC_REPLY
+        /*ghost_size表示当前工作节点(Worker)中已分配但未与主节点同步的内存大小，conf->ghost_th表示一个阈值，从配置中读取，用于限制ghost_size的最大值*/
+        if (ghost_size > conf->ghost_th) FarmSyncStats(); //检查是否需要同步主节点
+      } else {
+        wr->addr = EMPTY_GLOB(FarmPlace(wr->size, true)); //如果内存分配失败，改为在远程工作节点上分配
+      }
     }
   }
 
   if (remote) { //如果请求是远程分配
     /* remote allocation */
-    Client *cli = GetClient(wr->addr); //获取相应客户端并将任务添加到客户端的任务队列中
+    Client *cli = WID(wr->addr) ? FindClientWid(WID(wr->addr)) : GetClient(); //获取相应客户端并将任务添加到客户端的任务队列中
     if (likely(cli)) {
+      if (n > 1) {
+        //one FARM_MALLOC carries the count
+        farm_bulk_allocs_[wr->id] = (GAddr*)wr->ptr;
+      } else if (!(wr->flag & ALIGNED) && wr->size <= FARM_LEASE_MAX_SIZE) {
+        //serve it from the lease of this worker, or lease a new batch
+        osize_t cls = FarmLeaseClass(wr->size);
+        FarmLease& lease = farm_leases_[FARM_LEASE_KEY(cli->GetWorkerId(), cls)];
+        lease.last_used = get_time();
+        if (!lease.addrs.empty()) {
+          wr->addr = lease.addrs.back();
+          lease.addrs.pop_back();
+          wr->status = SUCCESS;
+          wr->op = FARM_MALLOC_REPLY;
+          if(Notify(wr)) {
+            epicLog(LOG_WARNING, "cannot wake up the app thread");
+          }
+          return;
+        }
+        wr->counter = FARM_LEASE_BATCH;
+        wr->size = cls;
+      }
       FarmAddTask(cli, tx);
       return;
     } else {
@@ -740,17 +1472,18 @@ void Worker::FarmProcessMalloc(Client* c, TxnContext* tx) {
   epicLog(LOG_DEBUG, "Worker %d receives a local %s msg", GetWorkerId(), workToStr(wr->op));
   wr->op = FARM_MALLOC_REPLY;
 
-  void *addr;
-  if (wr->flag & ALIGNED) {
-    addr = sb.sb_aligned_malloc(wr->size);
-  } else {
-    addr = sb.sb_malloc(wr->size);
+  if (wr->counter > 1) {
+    //a lease or a txAllocMany: the objects are allocated when the reply is generated
+    FarmAddTask(c, tx);
+    return;
   }
 
+  //the [version][size] header is zeroed by FarmMalloc; a leaving worker takes no new objects
+  void *addr = leaving_ ? nullptr : FarmMalloc(wr->size);
+
   if (likely(addr)) {
-    memset(addr, 0, wr->size); //ensure it is not locked
     wr->status = SUCCESS;
-    wr->addr = TO_GLOB(addr, base, GetWorkerId());
+    wr->addr = ToGlobal(addr);
     ghost_size += wr->size;
   } else {
     wr->status = ALLOC_ERROR;
@@ -759,13 +1492,101 @@ void Worker::FarmProcessMalloc(Client* c, TxnContext* tx) {
   FarmAddTask(c, tx);
 
   //TODO: adapt to Farm
-  if (ghost_size > conf->ghost_th) SyncMaster();
+  if (ghost_size > conf->ghost_th) FarmSyncStats();
 }
 
+/*
+ * a reply to a request of many objects carries [osize_t size][GAddr]*:
+ * they are either all for a txAllocMany, or the first one is returned
+ * to the app thread and the others are kept in the lease of the worker
+ */
 void Worker::FarmProcessMallocReply(Client* c, TxnContext* tx) {
-  // nothing to do but just notify of app thread
-  epicAssert (tx->wr_->status == SUCCESS || tx->wr_->status == READ_ERROR);
-  Notify(tx->wr_);
+  WorkRequest* wr = tx->wr_;
+  epicAssert (wr->status == SUCCESS || wr->status == READ_ERROR || wr->status == ALLOC_ERROR);
+  auto it = farm_bulk_allocs_.find(wr->id);
+  if (wr->status == SUCCESS && wr->size) {
+    char* p = (char*)wr->ptr;
+    osize_t size;
+    p += readInteger(p, size);
+    int n = (wr->size - sizeof(osize_t)) / sizeof(GAddr);
+    epicAssert(n > 0);
+    if (it != farm_bulk_allocs_.end()) {
+      memcpy(it->second, p, n * sizeof(GAddr));
+      wr->counter = n;
+    } else {
+      FarmLease& lease = farm_leases_[FARM_LEASE_KEY(c->GetWorkerId(), size)];
+      GAddr addr;
+      p += sizeof(GAddr);  //the first one is in wr->addr
+      for (int i = 1; i < n; i++) {
+        p += readInteger(p, addr);
+        lease.addrs.push_back(addr);
+      }
+      epicLog(LOG_DEBUG, "leased %d objects of size %d from worker %d", n, size, c->GetWorkerId());
+    }
+  } else if (it != farm_bulk_allocs_.end()) {
+    wr->counter = 0;
+  }
+  if (it != farm_bulk_allocs_.end()) farm_bulk_allocs_.erase(it);
+  Notify(wr);
+}
+
+/*
+ * give the idle leases back to their workers, one FARM_FREE msg per lease;
+ * the objects have never been written, so that no txn is involved.
+ * A lease whose msg finds no free slot is given back next time.
+ */
+void Worker::FarmReturnLeases() {
+  long now = get_time();
+  for (auto& p: farm_leases_) {
+    FarmLease& lease = p.second;
+    if (lease.addrs.empty() || now - lease.last_used < FARM_LEASE_IDLE_TIME)
+      continue;
+    int wid = p.first >> 32;
+    Client* cli = FindClientWid(wid, false);
+    if (!cli || !cli->IsConnected()) continue;
+    WorkRequest wr;
+    wr.op = FARM_FREE;
+    wr.size = lease.addrs.size();
+    wr.ptr = lease.addrs.data();
+    if (FarmSubmitRequest(cli, &wr) < 0) continue;
+    epicLog(LOG_INFO, "return %lu leased objects of size %u to worker %d",
+        lease.addrs.size(), (uint32_t)p.first, wid);
+    lease.addrs.clear();
+  }
+}
+
+int Worker::LeaseReturner(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+  Worker* w = (Worker*)clientData;
+  w->FarmReturnLeases();
+  return FARM_LEASE_RETURN_INTERVAL;
+}
+
+/*
+ * free the leased objects given back by a remote worker; those in a region
+ * moved away since they were leased go on to its new owner
+ */
+void Worker::FarmProcessFree(WorkRequest* wr) {
+  std::unordered_map<int, std::vector<GAddr>> moved;
+  char* p = (char*)wr->ptr;
+  for (int i = 0; i < wr->size; i++) {
+    GAddr a;
+    p += readInteger(p, a);
+    if (!IsLocal(a)) {
+      moved[regions.Owner(a)].push_back(a);
+      continue;
+    }
+    if (unlikely(tier != nullptr)) FarmTierRelease((char*)ToLocal(a));
+    FarmFree(a);
+  }
+  for (auto& e: moved) {
+    Client* cli = FindClientWid(e.first);
+    WorkRequest fwr;
+    fwr.op = FARM_FREE;
+    fwr.size = e.second.size();
+    fwr.ptr = e.second.data();
+    if (!cli || FarmSubmitRequest(cli, &fwr) < 0)
+      epicLog(LOG_WARNING, "cannot pass %lu freed objects on to worker %d", e.second.size(), e.first);
+  }
 }
 
 
@@ -779,8 +1600,19 @@ void Worker::FarmProcessLocalRead(WorkRequest* wr) {
 
   TxnContext* tx = this->local_txns_[wr->id];
 
-  epicAssert(!IsLocal(wr->addr));
-  
+  //the region has been moved here since the app thread looked it up
+  auto pending = to_serve_local_requests.find(wr->addr);
+  if ((pending == to_serve_local_requests.end() || pending->second.empty()) && IsLocal(wr->addr)) {
+    char buf[MAX_REQUEST_SIZE];
+    int len;
+    wr->op = FARM_READ_REPLY;
+    wr->status = FarmReadObject(wr->addr, buf, len);
+    if (wr->status == SUCCESS)
+      local_txns_[(wr->parent ? wr->parent : wr)->id]->createReadableObject(wr->addr)->deserialize(buf);
+    FarmNotifyRead(wr);
+    return;
+  }
+
   /* remote read: forward request to designated worker */
   Client *c = GetClient(wr->addr);
   if (unlikely(!c)) {
@@ -792,37 +1624,427 @@ void Worker::FarmProcessLocalRead(WorkRequest* wr) {
     return;
   }
 
-  if(Notify(wr)) {
-    epicLog(LOG_WARNING, "cannot wake up the app thread");
+  FarmNotifyRead(wr);
+}
+
+/**
+ * @brief read the objects of a local txn in parallel (see Farm::txReadMany):
+ * each address is read by a reader context of the txn, so that all of them
+ * are in flight at once and get coalesced per worker by FarmSubmitBatch.
+ * The objects go into the read set of the txn, which is notified once the
+ * last read completes.
+ *
+ * @param wr: [ptr] the remote addresses, [size] the number of them
+ */
+void Worker::FarmProcessLocalReadMany(WorkRequest* wr) {
+  TxnContext* tx = local_txns_[wr->id];
+  GAddr* addrs = (GAddr*)wr->ptr;
+  int n = wr->size;
+
+  wr->status = SUCCESS;
+  // one more so that wr is not notified before all the reads are issued
+  wr->counter = n + 1;
+  for (int i = 0; i < n; i++) {
+    WorkRequest* rwr = tx->getReader(i)->wr_;
+    rwr->op = FARM_READ;
+    rwr->addr = addrs[i];
+    rwr->status = SUCCESS;
+    rwr->parent = wr;
+    FarmAllocateTxnId(rwr);
+    FarmProcessLocalRead(rwr);
+  }
+
+  if (--wr->counter == 0 && Notify(wr)) {
+    epicLog(LOG_WARNING, "cannot wake up the app thread");
+  }
+}
+
+void Worker::FarmNotifyRead(WorkRequest* wr) {
+  if (wr->parent) {
+    // a sub-request of FarmProcessLocalReadMany or FarmProcessLocalKVMany
+    wr = wr->parent;
+    if (--wr->counter > 0) return;
+  }
+
+  if(Notify(wr)) {
+    epicLog(LOG_WARNING, "cannot wake up the app thread");
+  }
+}
+
+/**
+ * @brief a KV_PUT or KV_GET of the app, or of FarmProcessLocalKVMany:
+ * served from the local kvs if [counter] is this worker, otherwise sent to
+ * worker [counter]
+ */
+void Worker::FarmProcessLocalKV(WorkRequest* wr) {
+  epicAssert(wr->counter);
+  if (wr->counter != GetWorkerId()) {
+    Client* cli = FindClientWid(wr->counter);
+    epicAssert(cli);
+    FarmAddTask(cli, local_txns_[wr->id]);
+    return;
+  }
+
+  if (wr->op == KV_PUT) {
+    wr->status = leaving_ || kvs.Put(wr->key, wr->ptr, wr->size) ? ALLOC_ERROR : SUCCESS;
+  } else {
+    Size size;
+    char* v = kvs.Get(wr->key, size);
+    if (v) {
+      wr->size = size;
+      memcpy(wr->ptr, v, size);
+      wr->status = SUCCESS;
+    } else {
+      wr->status = NOT_EXIST;
+      epicLog(LOG_INFO, "not exist locally");
+    }
+  }
+  FarmNotifyRead(wr);
+}
+
+/**
+ * @brief the KVItems of a kv_get_many/kv_put_many, each one by a reader
+ * context of the txn as in FarmProcessLocalReadMany, so that the requests
+ * to a worker are sent together by FarmSubmitBatch. The caller takes the
+ * results from the readers once notified.
+ *
+ * @param wr: [ptr] the KVItems, [size] the number of them
+ */
+void Worker::FarmProcessLocalKVMany(WorkRequest* wr) {
+  TxnContext* tx = local_txns_[wr->id];
+  KVItem* items = (KVItem*)wr->ptr;
+  int n = wr->size;
+  Work op = wr->op == KV_GET_MANY ? KV_GET : KV_PUT;
+
+  wr->status = SUCCESS;
+  wr->counter = n + 1;
+  for (int i = 0; i < n; i++) {
+    WorkRequest* rwr = tx->getReader(i)->wr_;
+    rwr->op = op;
+    rwr->key = items[i].key;
+    rwr->ptr = items[i].value;
+    rwr->size = items[i].size;
+    rwr->counter = items[i].node_id;
+    rwr->status = SUCCESS;
+    rwr->parent = wr;
+    FarmAllocateTxnId(rwr);
+    FarmProcessLocalKV(rwr);
+  }
+
+  if (--wr->counter == 0 && Notify(wr)) {
+    epicLog(LOG_WARNING, "cannot wake up the app thread");
+  }
+}
+
+/**
+ * @brief the next chunk of the value of a KV_PUT or KV_GET_REPLY @param wr
+ * to be put in a msg of @param room bytes: [offset] and [counter] are set
+ * for WorkRequest::Ser. The value of a KV_GET_REPLY is looked up at its
+ * first chunk, and copied if it takes more than one msg, so that later
+ * puts to the key do not change it in between.
+ *
+ * @return 0, or -1 if the chunk would be too small to be worth it
+ */
+int Worker::FarmGenerateKVChunk(WorkRequest* wr, int room) {
+  auto it = kv_transfers_.find(wr);
+  Size offset = it == kv_transfers_.end() ? 0 : it->second.offset;
+  // one more byte for the '\0' put by WorkRequest::Ser
+  long space = (long)room - FARM_MSG_HDR_SIZE - 1;
+  if (space <= 0) return -1;
+
+  if (wr->op == KV_GET_REPLY && it == kv_transfers_.end()) {
+    Size size;
+    char* v = kvs.Get(wr->key, size);
+    if (!v) {
+      epicLog(LOG_INFO, "not exist remotely");
+      wr->status = NOT_EXIST;
+      wr->size = wr->offset = wr->counter = 0;
+      return 0;
+    }
+    wr->status = SUCCESS;
+    wr->size = size;
+    wr->ptr = v;
+  }
+
+  Size left = wr->size - offset;
+  if (left > space && space < FARM_KV_MIN_CHUNK) return -1;
+
+  if (wr->op == KV_GET_REPLY && it == kv_transfers_.end() && left > space) {
+    char* copy = kvs.Alloc(wr->size);
+    if (!copy) {
+      wr->status = ALLOC_ERROR;
+      wr->size = wr->offset = wr->counter = 0;
+      return 0;
+    }
+    memcpy(copy, wr->ptr, wr->size);
+    wr->ptr = copy;
+    kv_transfers_[wr].value = copy;
+  }
+
+  wr->offset = offset;
+  wr->counter = std::min(left, (Size)space);
+  return 0;
+}
+
+/**
+ * @brief a chunk of a KV_PUT from @param c: a value of one msg is put
+ * right away (in place if it fits), a larger one is gathered in a new
+ * block and installed with the last chunk, so that the gets in between
+ * see the old value. PUT_REPLY is sent once the value is in.
+ */
+void Worker::FarmProcessKVPut(Client* c, TxnContext* tx) {
+  WorkRequest* wr = tx->wr_;
+
+  //the KV pairs are not moved away by a leave, so that none is taken then
+  if (wr->offset == 0 && wr->counter == wr->size) {
+    wr->status = leaving_ || kvs.Put(wr->key, wr->ptr, wr->size) ? ALLOC_ERROR : SUCCESS;
+  } else {
+    KVTransfer& t = kv_transfers_[wr];
+    if (wr->offset == 0) t.value = leaving_ ? nullptr : kvs.Alloc(wr->size);
+    if (t.value) memcpy(t.value + wr->offset, wr->ptr, wr->counter);
+    if (wr->offset + wr->counter < wr->size) return;  //more to come
+
+    wr->status = t.value ? SUCCESS : ALLOC_ERROR;
+    if (t.value) kvs.Install(wr->key, t.value);
+    kv_transfers_.erase(wr);
+  }
+
+  wr->op = PUT_REPLY;
+  FarmAddTask(c, tx);
+}
+
+/**
+ * @brief process a read request from client @param c
+ *
+ * @param c
+ * @param tx
+ * @param wr
+ *
+ * @return 
+ */
+void Worker::FarmProcessRead(Client* c, TxnContext* tx) {
+  WorkRequest* wr = tx->wr_;
+  //the object is read when the reply is generated, or the reader is told the owner (see FarmGenerateMsg)
+  wr->op = FARM_READ_REPLY;
+
+  FarmAddTask(c, tx);
+}
+
+/*
+ * a MOVED reply tells the owner of the region of the object as known by @param c:
+ * the read goes on there, or here if the region has come here meanwhile
+ */
+void Worker::FarmProcessReadReply(Client* c, TxnContext* tx) {
+  WorkRequest* wr = tx->wr_;
+  epicAssert (wr->status == SUCCESS || wr->status == READ_ERROR || wr->status == MOVED);
+
+  char buf[MAX_REQUEST_SIZE];
+  if (wr->status == MOVED) {
+    bool newer = regions.SetOwner(REGION_OF(wr->addr), wr->wid, wr->counter);
+    epicLog(LOG_INFO, "%lx has been moved from worker %d to worker %d (seq %d)",
+        wr->addr, c->GetWorkerId(), wr->wid, wr->counter);
+    if (IsLocal(wr->addr)) {
+      int len;
+      wr->status = FarmReadObject(wr->addr, buf, len);
+      wr->ptr = buf;
+    } else if (!newer && regions.Owner(wr->addr) == c->GetWorkerId()) {
+      //we know of no newer owner than the one that says it is not
+      wr->status = READ_ERROR;
+    } else {
+      Client* cli = GetClient(wr->addr);
+      if (likely(cli)) {
+        wr->op = FARM_READ;
+        FarmAddTask(cli, tx);
+        return;
+      }
+      wr->status = READ_ERROR;
+    }
+  }
+
+  //Notify(wr);
+  FarmProcessPendingReads(wr);
+}
+
+/*
+ * the lock-free read of the object at @param addr (owned here) into @param buf,
+ * as [version][size][data] of @param len bytes; from the second tier if it is there
+ */
+Status Worker::FarmReadObject(GAddr addr, char* buf, int& len) {
+  char* local = (char*)ToLocal(addr);
+  version_t before, after;
+  osize_t size;
+  int hlen = 0;
+  int tiered = 0;
+
+  if (unlikely(tier != nullptr)) {
+    sb.touch(local);
+    //the data is in the second tier: bring it back, or read it through if a txn holds the object
+    std::string data;
+    if (FarmTierDemoted(local) && !FarmTierPromote(local)
+        && (tiered = FarmTierRead(local, before, data)) > 0) {
+      size = data.size();
+      hlen = appendInteger(buf, before, size);
+      memcpy(buf + hlen, data.data(), size);
+    }
+  }
+
+  // lock-free read (objects are only demoted by this thread, so it sees no tombstone)
+  if (tiered == 0) {
+    after = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
+    do {
+      before = after;
+      while(is_version_wlocked(before))
+        before = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
+      runlock_version(&before);
+      readInteger(local + sizeof(before), size);
+      hlen = appendInteger(buf, before, size);
+      if (size > 0) memcpy(buf + hlen, local + hlen, size);
+      after = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
+    } while (is_version_diff(before, after));
+  }
+
+  if (unlikely(tiered < 0 || before == 0 || size == -1)) { //如果地址无效或数据读取失败，返回READ_ERROR
+    epicLog(LOG_INFO, "Address %lx is not allocated or has been free'ed", addr);
+    return Status::READ_ERROR;
   }
+  len = sizeof(before) + sizeof(size) + size;
+  return Status::SUCCESS;
 }
 
+
 /**
- * @brief process a read request from client @param c
- *
- * @param c
- * @param tx
- * @param wr
+ * @brief issue the next one-sided read of @param wr into the send slot
+ * @param sbuf, without involving the owner's CPU.
  *
- * @return 
+ * @return 0 if the read is posted; -1 if the transport cannot do it, and the
+ * caller should send a FARM_READ msg with @param sbuf instead
  */
-void Worker::FarmProcessRead(Client* c, TxnContext* tx) {
-  WorkRequest* wr = tx->wr_;
-  epicAssert(IsLocal(wr->addr));
-  wr->op = FARM_READ_REPLY;
+int Worker::FarmSubmitRemoteRead(Client* cli, WorkRequest* wr, char* sbuf) {
+  FarmRemoteRead& r = farm_rreads_[wr->id];
+  char* remote = (char*)cli->ToLocal(wr->addr);
+  size_t hlen = sizeof(version_t) + sizeof(osize_t);
+  size_t len = 0;
+
+  switch (r.stage) {
+    case FARM_RREAD_MSG:
+      epicLog(LOG_DEBUG, "read %lx of Worker %d with a FARM_READ msg",
+          wr->addr, cli->GetWorkerId());
+      if (r.buf) zfree(r.buf);
+      farm_rreads_.erase(wr->id);
+      return -1;
+    case FARM_RREAD_HEADER:
+      len = hlen;
+      break;
+    case FARM_RREAD_DATA:
+      remote += hlen;
+      len = r.size;
+      break;
+    case FARM_RREAD_VERIFY:
+      len = sizeof(version_t);
+      break;
+  }
 
-  FarmAddTask(c, tx);
+  r.slot = sbuf;
+  ssize_t ret = cli->Read(sbuf, remote, len, wr->id, true);
+  if (unlikely(ret < 0)) {
+    if (ret == -1) {
+      epicLog(LOG_INFO, "one-sided read is not supported by the transport, use FARM_READ msgs instead");
+      farm_rdma_read = false;
+    } else {
+      epicLog(LOG_WARNING, "one-sided read of %lx failed, retry with a FARM_READ msg", wr->addr);
+    }
+    if (r.buf) zfree(r.buf);
+    farm_rreads_.erase(wr->id);
+    return -1;
+  }
+
+  epicLog(LOG_DEBUG, "Worker %d reads %lx (stage %d, %lu bytes) from Worker %d",
+      GetWorkerId(), wr->addr, r.stage, len, cli->GetWorkerId());
+  return 0;
 }
 
-void Worker::FarmProcessReadReply(Client* c, TxnContext* tx) {
+/**
+ * @brief a one-sided read of txn @param id completes; validate what we got
+ * in the send slot with the same seqlock logic as the local path of
+ * Farm::txRead, and either issue the next read, restart, fall back to a
+ * FARM_READ msg, or hand the object to the pending reads of the address.
+ * This must run before the send slot is reused (i.e., before FarmResumeTxn).
+ */
+void Worker::FarmProcessRdmaRead(Client* c, unsigned int id) {
+  auto it = farm_rreads_.find(id);
+  if (unlikely(it == farm_rreads_.end())) {
+    epicLog(LOG_WARNING, "cannot find the one-sided read of txn %u", id);
+    return;
+  }
+
+  FarmRemoteRead& r = it->second;
+  TxnContext* tx = local_txns_.at(id);
   WorkRequest* wr = tx->wr_;
-  epicAssert (wr->status == SUCCESS || wr->status == READ_ERROR);
+  version_t v;
+  osize_t s;
 
-  //Notify(wr);
+  switch (r.stage) {
+    case FARM_RREAD_HEADER:
+      readInteger(r.slot, v, s);
+      if (is_version_wlocked(v)) {
+        // being written: the owner serves the msg once it is done
+        r.stage = FARM_RREAD_MSG;
+        break;
+      }
+      runlock_version(&v);
+      if (unlikely(v == 0 || s == -1)) {
+        epicLog(LOG_INFO, "Address %lx is not allocated or has been free'ed", wr->addr);
+        wr->status = Status::READ_ERROR;
+        goto finish;
+      }
+      if (s == FARM_OBJECT_DEMOTED) {
+        // only the owner can get it from its second tier
+        r.stage = FARM_RREAD_MSG;
+        break;
+      }
+      if (unlikely(s < 0 || sizeof(v) + sizeof(s) + s > MAX_REQUEST_SIZE)) {
+        epicLog(LOG_WARNING, "object %lx of size %d cannot be read", wr->addr, s);
+        wr->status = Status::READ_ERROR;
+        goto finish;
+      }
+      r.version = v;
+      r.size = s;
+      r.stage = s ? FARM_RREAD_DATA : FARM_RREAD_VERIFY;
+      r.buf = (char*)zmalloc(sizeof(v) + sizeof(s) + s);
+      // the version without the read lock bit, as the local path does
+      appendInteger(r.buf, v, s);
+      break;
+    case FARM_RREAD_DATA:
+      memcpy(r.buf + sizeof(v) + sizeof(s), r.slot, r.size);
+      r.stage = FARM_RREAD_VERIFY;
+      break;
+    case FARM_RREAD_VERIFY:
+      readInteger(r.slot, v);
+      if (is_version_diff(r.version, v)) {
+        // torn read; start over, or let the owner serve it if it keeps changing
+        zfree(r.buf);
+        r.buf = nullptr;
+        r.stage = ++r.retries < FARM_RREAD_MAX_RETRY ? FARM_RREAD_HEADER : FARM_RREAD_MSG;
+        break;
+      }
+      wr->status = Status::SUCCESS;
+      wr->ptr = r.buf;
+      goto finish;
+    case FARM_RREAD_MSG:
+      epicAssert(false);
+      break;
+  }
+
+  FarmAddTask(c, tx);
+  return;
+
+finish:
+  char* buf = r.buf;
+  farm_rreads_.erase(it);
   FarmProcessPendingReads(wr);
+  if (buf) zfree(buf);
 }
 
-
 /**
  * @brief perform twp-phase commit on behalf of an application thread
  *处理本地事务的提交请求。它根据事务的类型（本地或分布式）初始化事务状态，并启动两阶段提交协议的准备阶段（Prepare Phase）。
@@ -857,29 +2079,27 @@ void Worker::FarmProcessLocalCommit(WorkRequest* wr) {
  * @param c client with free slots
  */
 void Worker::FarmResumeTxn(Client* c) {
+  if (unlikely(!c->IsConnected())) return;  //resumed in PostConnectWorker
+  std::list<TxnContext*>& tasks = client_tasks_[c];
 
-  if (this->client_tasks_[c].empty()) return;
-
-  TxnContext* tx = this->client_tasks_[c].front();
-
-  //if (unlikely(c == nullptr)) {
-  //    epicAssert(wr->op == FARM_READ);
-  //    FarmProcessLocalRead(wr);
-  //    return;
-  //}
+  while (!tasks.empty()) {
+    if (c != master) {
+      // coalesce the pending msgs to a worker into one send slot
+      if (FarmSubmitBatch(c) == -1)
+        return;
+      continue;
+    }
 
-  int ret = FarmSubmitRequest(c, tx->wr_);
-  if (ret == 1) {
-    // this work request has been completed; 
-    // continue to process next one
-    client_tasks_[c].pop_front();
-  } else {
-    if (ret == -1)
+    int ret = FarmSubmitRequest(c, tasks.front()->wr_);
+    if (ret == 1) {
+      // this work request has been completed; 
+      // continue to process next one
+      tasks.pop_front();
+    } else if (ret == -1) {
       // should not retry if there is no free send slot
       return;
+    }
   }
-
-  FarmResumeTxn(c);
 }
 
 /**
@@ -966,18 +2186,19 @@ void Worker::FarmResumePrepare(TxnContext* tx, TxnCommitStatus* ts) {
     osize_t s;
     char* local;
     for (auto& e: wset) {  //遍历写集合中的每个对象
-      local = (char*)(ToLocal(e.first));
-      //readInteger(local, v, s);
-      readInteger(local+sizeof(v), s);
+      //locked first: the region of the object may have been moved away since it was read
       if (FarmRLock(e.first)) {//调用FarmRLock尝试加读锁，确保对象未被其他事务锁定 检查写集合中的每个对象是否被锁定或发生更改
         ++locked; 
-        if ( s == -1 || FarmAllocSize(local) < e.second->getTotalSize()) //检查对象的大小是否有效，且分配的内存足够
+        local = (char*)(ToLocal(e.first));
+        //readInteger(local, v, s);
+        readInteger(local+sizeof(v), s);
+        if ( s == -1 || FarmAllocSize(e.first, local) < e.second->getTotalSize()) //检查对象的大小是否有效，且分配的内存足够
         {
           //v = __atomic_load_n((version_t*)ToLocal(e.first), __ATOMIC_RELAXED);
           epicLog(LOG_DEBUG, "Address %lx, version = %lx, size = %d, allocated size = %d, objcet size = %d ",
               e.first, e.second->getVersion(),
               s,
-              FarmAllocSize(local),
+              FarmAllocSize(e.first, local),
               e.second->getTotalSize());
           goto abort;//如果发生冲突或异常，跳转到中止事务
         }
@@ -1030,7 +2251,7 @@ void Worker::FarmPrepare(Client* c, TxnContext* tx) {
   char* msg;
   int nobj, len, offset;
 
-  wr->nobj = tx->getNumWobjForWid(wid);
+  //wr is shared by all the participants, nobj is set per msg by FarmGenerateMsg
   wr->op = PREPARE;
   FarmAddTask(c, tx);
 }
@@ -1073,19 +2294,18 @@ void Worker::FarmProcessPrepare(Client* c, TxnContext* tx) {
 
     int locked = 0;
     for (auto& p: wid) {
-      local = (char*)(ToLocal(p.first));
-      readInteger(local + sizeof(ver), s);
-
       // TODO: check if this address is valid or not
       if (FarmRLock(p.first)) {
         ++locked;
-        if ( s == -1 || FarmAllocSize(local) < p.second->getTotalSize()) 
+        local = (char*)(ToLocal(p.first));
+        readInteger(local + sizeof(ver), s);
+        if ( s == -1 || FarmAllocSize(p.first, local) < p.second->getTotalSize()) 
         {
           /* this transaction should be abort;
            * no writable objects are locked by this txn
            */
           epicLog(LOG_INFO, "Address %lx, new version = %d, locked = %d, size= %d, allocated size = %d, objcet size = %d ",
-              p.first, p.second->getVersion(), is_version_locked(ver), s, FarmAllocSize(local), p.second->getTotalSize());
+              p.first, p.second->getVersion(), is_version_locked(ver), s, FarmAllocSize(p.first, local), p.second->getTotalSize());
           break;
         }
       } else {
@@ -1214,7 +2434,9 @@ void Worker::FarmValidate(TxnContext* tx, TxnCommitStatus* ts) {
     version_t v, rv;
     for (auto& e: rset) { //遍历读集合中的每个对象
 
-      v = __atomic_load_n((version_t*)ToLocal(e.first), __ATOMIC_RELAXED); //获取对象的当前版本号 
+      //an object of a region moved away since it was read cannot be validated
+      v = IsLocal(e.first) ?
+        __atomic_load_n((version_t*)ToLocal(e.first), __ATOMIC_RELAXED) : 0; //获取对象的当前版本号 
 
       version_t v1 = e.second->getVersion(); //获取事务开始时记录的版本号
       epicAssert(v1 != 0 && !is_version_locked(v1)); //确保版本号有效且未被锁定
@@ -1266,11 +2488,7 @@ void Worker::FarmValidate(Client* c, TxnContext* tx) {
 
   epicAssert(tx->wr_->op == VALIDATE || tx->wr_->op == VALIDATE_REPLY);
 
-  int nobj = tx->getNumRobjForWid(c->GetWorkerId());
-
-  /* messages are for remote clients */
-  tx->wr_->nobj = nobj;
-
+  /* messages are for remote clients, nobj is set per msg by FarmGenerateMsg */
   FarmAddTask(c, tx);
 }
 
@@ -1329,7 +2547,7 @@ void Worker::FarmProcessValidate(Client* c, TxnContext* tx) {
 
     nobj_processed[txn_id]++;
 
-    v2 = __atomic_load_n((version_t*)ToLocal(a), __ATOMIC_RELAXED);
+    v2 = IsLocal(a) ? __atomic_load_n((version_t*)ToLocal(a), __ATOMIC_RELAXED) : 0;
     //runlock_version(&v2);
 
     // if versions do not match or object has been free'ed or locked, abort
@@ -1351,13 +2569,9 @@ void Worker::FarmProcessValidate(Client* c, TxnContext* tx) {
   }
 
 reply:
+  // if there is no writable object here, the txn is finalized once the reply
+  // is generated (see FarmGenerateMsg), as the reply may be held back for coalescing
   FarmAddTask(c, tx);
-  if (tx->getNumWobjForWid(GetWorkerId()) == 0) {
-    // Finalize this txn as I won't receive commit/abort
-    // messages
-    remote_txns_.erase(txn_id);
-    nobj_processed.erase(txn_id);
-  }
 }
 
 
@@ -1463,7 +2677,12 @@ void Worker::FarmWrite(std::unordered_map<GAddr, std::shared_ptr<Object>>& wset)
 
   for (auto& p: wset) { //遍历写集合中的每个对象
     Object *o = p.second.get();
-    char* local = (char*)ToLocal(o->getAddr()) + sizeof(version_t);
+    char* local = (char*)ToLocal(o->getAddr());
+    if (unlikely(tier != nullptr)) {
+      FarmTierRelease(local);  //the new data (or the free) replaces what is in the second tier
+      sb.touch(local);
+    }
+    local += sizeof(version_t);
     local += appendInteger(local, o->getSize());
     if (o->getSize() >= 0) {//如果对象的大小大于等于0
       o->writeTo(local, 0, o->getSize()); //将对象的内容写入到本地内存中
@@ -1526,8 +2745,6 @@ void Worker::FarmFinalizeTxn(Client* c, TxnContext* tx) {
 }
 
 void Worker::FarmProcessPendingReads(WorkRequest* wr) {
-  epicAssert(!IsLocal(wr->addr));
-
   queue<WorkRequest*>& q = to_serve_local_requests[wr->addr];
   WorkRequest* twr;
   while(!q.empty()) {
@@ -1541,19 +2758,20 @@ void Worker::FarmProcessPendingReads(WorkRequest* wr) {
 
     twr->status = wr->status;
     if (wr->status == SUCCESS) {
-      local_txns_[twr->id]->createReadableObject(twr->addr)->deserialize((char*)wr->ptr);
+      // the readers of FarmProcessLocalReadMany fill the read set of their txn
+      local_txns_[(twr->parent ? twr->parent : twr)->id]->createReadableObject(twr->addr)->deserialize((char*)wr->ptr);
     }
 
-    Notify(twr);
+    FarmNotifyRead(twr);
     q.pop();
   }
 
   //make sure wr is lastly notified; otherwise its ptr may be changed before
   //other pending wrs read it
   if (wr->status == SUCCESS) {
-    local_txns_[wr->id]->createReadableObject(wr->addr)->deserialize((char*)wr->ptr);
+    local_txns_[(wr->parent ? wr->parent : wr)->id]->createReadableObject(wr->addr)->deserialize((char*)wr->ptr);
   }
-  Notify(wr);
+  FarmNotifyRead(wr);
 }
 
 void Worker::FarmProcessPendingReads(TxnContext* tx) {
@@ -1570,8 +2788,8 @@ void Worker::FarmProcessPendingReads(TxnContext* tx) {
   std::unordered_map<GAddr, std::shared_ptr<Object>>& wset = tx->getWriteSet(GetWorkerId());
   for (auto& a: wset) {
     if (IsLocal(a.first)) {
-      if (unlikely(to_serve_local_requests.count(a.first) > 0))
-        FarmProcessPendingReads(to_serve_local_requests[a.first].front());
+      //a local read in flight (of a region just moved here) is served by its reply
+      continue;
     } else {
       if (likely(to_serve_requests.count(a.first) == 0)) continue;
 
@@ -1591,46 +2809,215 @@ void Worker::FarmProcessPendingReads(TxnContext* tx) {
   }
 }
 
+/*
+ * the chunk of an object of a region moved here goes back to the slab as
+ * well (see RegionMap). An object of a region being moved is sent anyway, and
+ * is freed by its new owner (or here if the move fails) once the move is done.
+ */
 void Worker::FarmFree(GAddr addr) {
-  char* local = (char*)ToLocal(addr);
-  uint8_t offset = 0;
-  local -= sizeof(uint8_t) + sizeof(osize_t);
-  readInteger(local, offset);
-  sb.sb_free(local - offset);
+  if (unlikely(regions.Frozen(addr))) {
+    farm_frozen_frees_.push_back(addr);
+    return;
+  }
+  if (!regions.Moved(addr)) {
+    sb.sb_free(ToLocal(addr));
+  } else if (char* chunk = regions.Free(addr)) {
+    sb.sb_free(chunk);
+  }
 }
 
-//函数用于分配内存，并确保分配的内存地址对齐
-void* Worker::FarmMalloc(osize_t size, osize_t align) { //size：要分配的内存大小； align：对齐要求，如果为0则不进行对齐
-  char* addr; //指向分配的内存地址
-  int sbits = sizeof(osize_t); //表示osize_t类型的大小
-  int vbits = sizeof(version_t); //表示version_t类型的大小
-  int obits = sizeof(uint8_t);  //表示uint8_t类型的大小
-  uint8_t offset;  //用于存储内存对齐的偏移量
-  osize_t rsize = size + sbits + vbits;  //实际分配的内存大小，包括size、sbits、vbits
+/*
+ * second tier
+ *
+ * a demoted object keeps its address, its version word and a tombstone of
+ * [version][FARM_OBJECT_DEMOTED][file offset][size] in its chunk, and the
+ * pages of the rest of the chunk are given back to the OS. Demotion and
+ * promotion take the object lock as a writer (which bumps the version), so that
+ * the lock-free readers, the one-sided ones included, either see the whole
+ * object or the whole tombstone, and the txns reading it fail validation.
+ *
+ * recency is tracked per object (see SlabAllocator::touch), by the local
+ * reads, the FARM_READ msgs and the writes; one-sided reads are not seen.
+ */
+size_t Worker::FarmTierDemote() {
+  size_t budget = conf->size * conf->tier_th;
+  size_t used = sb.get_limit() - sb.get_avail();
+  size_t resident = used > tier->GetBytes() ? used - tier->GetBytes() : 0;
+  if (resident <= budget) return 0;
+
+  size_t excess = resident - budget, moved = 0, passed = 0;
+  size_t npages = sb.get_limit() / ITEM_SIZE_MAX;
+  std::vector<void*> cold;
+  //two passes at most: the first one may only clear the ref bits
+  while (moved < excess && passed < 2 * npages) {
+    cold.clear();
+    size_t n = sb.scan_cold(conf->tier_min_size, FARM_TIER_BATCH, cold);
+    if (n == 0) break;
+    passed += n;
+    for (void* p : cold) {
+      //the objects of a moved region (and the blocks of those moved here) stay resident
+      if (regions.IsChunk(p) || FarmRetired((char*)p)) continue;
+      moved += FarmTierDemoteObject((char*)p);
+      if (moved >= excess) break;
+    }
+  }
+  return moved;
+}
+
+size_t Worker::FarmTierDemoteObject(char* local) {
+  version_t v = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
+  osize_t s;
+  readInteger(local + sizeof(version_t), s);
+  //never written, held by a txn, freed or demoted (size < 0), or too small
+  if (v == 0 || is_version_locked(v) || s < (osize_t)conf->tier_min_size)
+    return 0;
+  if (!rlock_object(local)) return 0;
+  while (!wlock_object(local));
+
+  off_t off = tier->Put(local + FARM_OBJECT_HEADER_SIZE, s);
+  if (off < 0) {
+    wunlock_object(local);
+    return 0;
+  }
+  appendInteger(local + FARM_OBJECT_HEADER_SIZE, (uint64_t)off, s);
+  appendInteger(local + sizeof(version_t), (osize_t)FARM_OBJECT_DEMOTED);
+
+  //give back the pages after the tombstone; a later write faults in new ones
+  size_t align = getpagesize();
+  if (sb.get_backing() == HUGEPAGE_2M) align = HUGEPAGE_2M_SIZE;
+  else if (sb.get_backing() == HUGEPAGE_1G) align = HUGEPAGE_1G_SIZE;
+  uintptr_t start = ALIGN((uintptr_t)local + FARM_TOMBSTONE_SIZE, align);
+  uintptr_t end = ((uintptr_t)local + FARM_OBJECT_HEADER_SIZE + s) / align * align;
+  if (end > start && madvise((void*)start, end - start, MADV_DONTNEED)) {
+    epicLog(LOG_WARNING, "cannot release the pages of %p (%d:%s)", local, errno, strerror(errno));
+  }
+
+  wunlock_object(local);
+  epicLog(LOG_DEBUG, "demoted %p of size %d to %ld", local, s, off);
+  return s;
+}
 
-  if (align > 0) { //根据align参数决定是否对齐
-    addr = (char*)sb.sb_aligned_malloc(rsize, align); //进行对齐分配
+bool Worker::FarmTierPromote(char* local) {
+  version_t v;
+  for (;;) {
+    v = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
+    if (is_version_wlocked(v)) continue;  //being promoted or written
+    if (!FarmTierDemoted(local)) return true;
+    if (is_version_rlocked(v)) return false;
+    if (rlock_object(local)) break;
+  }
+  while (!wlock_object(local));
+
+  //check again, it may have been promoted before we got the lock
+  if (FarmTierDemoted(local)) {
+    uint64_t off;
+    osize_t s;
+    readInteger(local + FARM_OBJECT_HEADER_SIZE, off, s);
+    //the data overwrites the tombstone, so read it aside first
+    char* buf = (char*)zmalloc(s);
+    if (tier->Get(off, buf, s)) {
+      epicPanic("cannot read object %p of size %d from the second tier", local, s);
+    }
+    memcpy(local + FARM_OBJECT_HEADER_SIZE, buf, s);
+    zfree(buf);
+    appendInteger(local + sizeof(version_t), s);
+    tier->Release(off, s);
   }
+
+  wunlock_object(local);
+  return true;
+}
+
+int Worker::FarmTierRead(char* local, version_t& v, std::string& data) {
+  version_t after = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
+  uint64_t off;
+  osize_t s;
+  int ret;
+  do {
+    v = after;
+    while (is_version_wlocked(v))
+      v = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
+    runlock_version(&v);
+    if (!FarmTierDemoted(local)) return 0;
+    readInteger(local + FARM_OBJECT_HEADER_SIZE, off, s);
+    ret = -1;
+    //the tombstone may be torn, check it before using it
+    if (s >= 0 && FARM_OBJECT_HEADER_SIZE + s <= FarmAllocSize(local)) {
+      data.resize(s);
+      if (tier->Get(off, &data[0], s) == 0) ret = 1;
+    }
+    after = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
+  } while (is_version_diff(v, after));
+
+  if (ret < 0)
+    epicLog(LOG_WARNING, "cannot read object %p from the second tier", local);
+  return ret;
+}
+
+void Worker::FarmTierRelease(char* local) {
+  if (!FarmTierDemoted(local)) return;
+  uint64_t off;
+  osize_t s;
+  readInteger(local + FARM_OBJECT_HEADER_SIZE, off, s);
+  tier->Release(off, s);
+}
+
+/*
+ * compact object layout: an object is a whole chunk of [version][size][data],
+ * the allocated size is implied by the slab class (or the large object) of the chunk,
+ * so that nothing is put in front of the object.
+ * chunks are CHUNK_ALIGN_BYTES aligned, which is enough for the atomic version word;
+ * aligned objects are put in the cache-line aligned classes.
+ */
+void* Worker::FarmMalloc(osize_t size, bool aligned) { //size：对象大小(包括[version][size]头)
+  char* addr; //指向分配的内存地址
+
+  //超过ITEM_SIZE_MAX的对象由SlabAllocator按页从区间分配器分配，释放后可合并复用
+  if (aligned)
+    addr = (char*)sb.sb_aligned_malloc(size, HARDWARE_CACHE_LINE); //进行对齐分配
   else
-    addr = (char*)sb.sb_aligned_malloc(rsize); //进行普通分配
+    addr = (char*)sb.sb_malloc(size); //进行普通分配
 
-  if (likely(addr)) { //如果内存分配成功，进行内存对齐和初始化
-    uintptr_t p = (uintptr_t)addr + sbits + obits;
-    offset = (vbits - p % vbits) % vbits; //计算内存对齐的偏移量offset
-    addr += offset; //将内存地址addr加上偏移量offset，得到对齐后的内存地址
-    epicAssert(offset + obits <= vbits); //确保偏移量和obits的和不超过vbits
-    size += (vbits - offset - obits); //更新size，包括对齐后的大小
-    addr += appendInteger(addr, offset, size); //调用appendInteger函数将偏移量和大小存储在内存中，方便后续使用
-    memset(addr, 0, size); //使用memset将分配的内存初始化为0
-    epicAssert((uintptr_t)addr % vbits == 0); //确保内存地址addr对齐到vbits
-    //__atomic_store_n((version_t*)addr, 0, __ATOMIC_RELAXED);
+  //a free chunk of a region being moved is held until the move is done: its address may go to the new owner
+  while (unlikely(addr && FarmRetired(addr))) {
+    farm_held_chunks_.push_back(addr);
+    addr = (char*)(aligned ? sb.sb_aligned_malloc(size, HARDWARE_CACHE_LINE) : sb.sb_malloc(size));
   }
 
+  if (likely(addr))
+    addr = FarmInitObject(addr);
+
   return addr; //返回分配的内存地址
 }
 
+/*
+ * the objects of a txAllocMany: the chunks are taken from the slab allocator
+ * in one pass and their headers are written in a row
+ */
+int Worker::FarmMallocMany(osize_t size, int n, GAddr* out) {
+  static_assert(sizeof(void*) == sizeof(GAddr), "chunks are put in the output array");
+  void** chunks = (void**)out;
+  int got = sb.sb_malloc_many(size, n, chunks), kept = 0;
+  for (int i = 0; i < got; i++) {
+    if (unlikely(FarmRetired((char*)chunks[i]))) {  //see FarmMalloc
+      farm_held_chunks_.push_back((char*)chunks[i]);
+      continue;
+    }
+    out[kept++] = ToGlobal(FarmInitObject((char*)chunks[i]));
+  }
+  return kept;
+}
+
+char* Worker::FarmInitObject(char* addr) {
+  epicAssert((uintptr_t)addr % sizeof(version_t) == 0); //确保内存地址addr对齐到version_t
+  memset(addr, 0, FARM_OBJECT_HEADER_SIZE); //version和size均为0
+  return addr;
+}
+
 inline bool Worker::FarmRLock(GAddr addr) {
   epicLog(LOG_DEBUG, "rlock object %lx", addr);
+  //no new locks in a region being moved (see FarmMigratePump)
+  if (!regions.Writable(addr, GetWorkerId())) return false;
   return rlock_object(ToLocal(addr));
 }
 
@@ -1662,3 +3049,496 @@ inline bool Worker::FarmAddressWLocked(GAddr addr) {
 }
 
 
+/*
+ * a chunk of a home region being moved is not given out: its GAddr may go to
+ * the new owner. Once the region is moved away, the chunk is of the next
+ * reuse epoch (see FarmMigrateHandOver), unless they are all used up.
+ */
+bool Worker::FarmRetired(char* chunk) {
+  GAddr a = ToGlobal(chunk);
+  return regions.Moved(a) || regions.Frozen(a);
+}
+
+void Worker::FarmMigrateSchedule() {
+  if (farm_migrator_) return;
+  if (aeCreateTimeEvent(el, FARM_MIGRATE_INTERVAL, Migrator, this, NULL) == AE_ERR) {
+    epicLog(LOG_WARNING, "cannot schedule the migrator");
+    return;
+  }
+  farm_migrator_ = true;
+}
+
+int Worker::Migrator(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+  Worker* w = (Worker*)clientData;
+  w->FarmSendNotices();
+  w->FarmMigrateKick();
+  if (w->farm_migrations_.empty() && w->farm_notices_.empty()) {
+    w->farm_migrator_ = false;
+    return AE_NOMORE;
+  }
+  return FARM_MIGRATE_INTERVAL;
+}
+
+void Worker::FarmPostNotice(Work op, int to, uint64_t key, int counter, uint32_t seq,
+    Flag flag, uint32_t id) {
+  farm_notices_.push_back(FarmNotice{op, to, key, counter, seq, flag, id});
+  FarmMigrateSchedule();
+}
+
+/*the notices go out in order, the rest of them in the next round if there is no free slot*/
+void Worker::FarmSendNotices() {
+  while (!farm_notices_.empty()) {
+    FarmNotice& n = farm_notices_.front();
+    Client* c = n.to ? FindClientWid(n.to) : master;
+    if (!c || !c->IsConnected()) return;
+
+    WorkRequest wr;
+    wr.op = n.op;
+    wr.key = n.key;
+    wr.counter = n.counter;
+    wr.offset = n.seq;
+    wr.flag = n.flag;
+    wr.id = n.id;
+    if (FarmSubmitRequest(c, &wr) < 0) return;
+    farm_notices_.pop_front();
+  }
+}
+
+/*
+ * the region with the most live bytes among the home regions of this worker
+ * (but the chunks of regions moved here) and the regions moved here
+ */
+uint64_t Worker::FarmPickRegion(const std::unordered_set<uint64_t>& skip) {
+  uint64_t best = 0;
+  size_t most = 0;
+  std::vector<std::pair<void*, size_t>> chunks;
+
+  size_t limit = sb.get_limit();
+  for (size_t off = 0; off < limit; off += REGION_SIZE) {
+    char* start = (char*)base + off;
+    uint64_t region = REGION_OF(ToGlobal(start));
+    if (skip.count(region) || regions.Moved(REGION_BASE(region)) || regions.Frozen(REGION_BASE(region)))
+      continue;
+    chunks.clear();
+    sb.scan_range(start, REGION_SIZE, chunks);
+    size_t bytes = 0;
+    for (auto& c : chunks)
+      if (!regions.IsChunk(c.first)) bytes += c.second;
+    if (bytes > most) {
+      most = bytes;
+      best = region;
+    }
+  }
+
+  std::vector<uint64_t> held;
+  regions.GetHeld(held);
+  RegionMap::Region r;
+  for (uint64_t region : held) {
+    if (skip.count(region) || !regions.Get(region, r) || r.frozen) continue;
+    size_t bytes = 0;
+    for (auto& o : r.objects) bytes += o.second;
+    if (bytes > most) {
+      most = bytes;
+      best = region;
+    }
+  }
+  return best;
+}
+
+/*
+ * freeze @param region and list its objects for @param m, false if it cannot
+ * be moved (it is not picked again). The region is frozen on a later
+ * Migrator tick if an app thread is in a RegionMap::Guard.
+ */
+bool Worker::FarmMigrateStart(FarmMigration& m, uint64_t region) {
+  m.region = region;
+  m.freezing = !regions.Freeze(region);
+  if (m.freezing) return true;
+
+  m.objects.clear();
+  m.chunks.clear();
+  RegionMap::Region r;
+  m.home = !regions.Get(region, r) || !r.held;
+  if (!m.home) {
+    m.objects.swap(r.objects);
+    m.chunks.swap(r.chunks);
+  } else {
+    char* start = (char*)ToLocal(REGION_BASE(region));
+    std::vector<std::pair<void*, size_t>> chunks;
+    std::unordered_set<void*> values;
+    if (kvs.GetCount()) kvs.GetBlocks(values);
+    sb.scan_range(start, REGION_SIZE, chunks);
+    for (auto& c : chunks) {
+      if (regions.IsChunk(c.first) || values.count(c.first)) continue;
+      uint32_t off = (char*)c.first - start;
+      m.objects[off] = c.second;
+      m.chunks[off] = (char*)c.first;
+    }
+  }
+  m.extent = 0;
+  for (auto& o : m.objects) m.extent += o.second;
+
+  m.seq = regions.Seq(region) + 1;
+  m.dest = m.leave ? FarmPlace(m.extent, true) : m.to;
+  m.dest_client = m.dest && m.dest != GetWorkerId() ? FindClientWid(m.dest) : nullptr;
+  if (m.objects.empty() || !m.dest_client) {
+    epicLog(LOG_WARNING, "cannot move region %lx to worker %d", region, m.dest);
+    regions.Unfreeze(region);
+    m.failed.insert(region);
+    return false;
+  }
+
+  m.deferred.clear();
+  m.ready.clear();
+  for (auto& o : m.objects) m.deferred.push_back(o.first);
+  m.pos = 0;
+  m.queued = m.waiting = false;
+  m.active = true;
+
+  if (!farm_mtx_) {
+    farm_mtx_.reset(new TxnContext);
+    farm_mtx_->reset();
+    FarmAllocateTxnId(farm_mtx_->wr_);
+  }
+  epicLog(LOG_INFO, "moving region %lx (%lu objects, %lu bytes) to worker %d",
+      region, m.objects.size(), m.extent, m.dest);
+  return true;
+}
+
+/*
+ * the objects no longer locked are ready to be sent; the region is frozen, so
+ * that they stay unlocked. Objects in the second tier are brought back first.
+ */
+void Worker::FarmMigratePump(FarmMigration& m) {
+  size_t n = m.deferred.size();
+  for (size_t i = 0; i < n; i++) {
+    uint32_t off = m.deferred.front();
+    m.deferred.pop_front();
+    char* local = m.chunks[off];
+    version_t v = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
+    if (is_version_locked(v) || (tier && FarmTierDemoted(local) && !FarmTierPromote(local)))
+      m.deferred.push_back(off);
+    else
+      m.ready.push_back(off);
+  }
+}
+
+/*called by Migrator: start the next move, or send the objects ready*/
+void Worker::FarmMigrateKick() {
+  if (farm_migrations_.empty()) return;
+  FarmMigration& m = farm_migrations_.front();
+  if (m.freezing) {
+    if (!FarmMigrateStart(m, m.region)) FarmMigrateNext();
+    return;
+  }
+  if (!m.active) {
+    FarmMigrateNext();
+    return;
+  }
+  if (m.handing) {
+    FarmMigrateHandOver(m, true);
+    return;
+  }
+  if (m.queued || m.waiting) return;
+
+  FarmMigratePump(m);
+  if (!m.ready.empty() || m.deferred.empty()) {
+    WorkRequest* wr = farm_mtx_->wr_;
+    wr->op = MIGRATE;
+    wr->key = m.region;
+    wr->offset = m.extent;
+    wr->pid = m.seq;
+    wr->flag = 0;
+    wr->counter = 0;
+    wr->status = SUCCESS;
+    m.queued = true;
+    FarmAddTask(m.dest_client, farm_mtx_.get());
+  }
+}
+
+/*
+ * the records of the objects ready into @param buf (at most @param room bytes),
+ * [counter] of them; REQUEST_DONE once all the objects are sent.
+ * The data of a free'ed or never written object is not sent.
+ */
+int Worker::FarmGenerateMigrate(WorkRequest* wr, char* buf, int room) {
+  FarmMigration& m = farm_migrations_.front();
+  if (!m.ready.empty() && room < (int)(FARM_MIGRATE_RECORD_HDR + FARM_MIGRATE_MIN_CHUNK))
+    return -1;
+
+  int len = 0, n = 0;
+  while (!m.ready.empty()) {
+    uint32_t off = m.ready.front();
+    uint32_t alloc = m.objects[off];
+    char* local = m.chunks[off];
+    version_t v = __atomic_load_n((version_t*)local, __ATOMIC_ACQUIRE);
+    osize_t s;
+    readInteger(local + sizeof(version_t), s);
+    if (m.pos == 0 && is_version_locked(v)) {
+      m.ready.pop_front();
+      m.deferred.push_back(off);
+      continue;
+    }
+
+    uint32_t total = FARM_OBJECT_HEADER_SIZE;
+    if (v != 0 && s >= 0) total += s;
+    if (total > alloc) total = alloc;
+    int left = room - len - (int)FARM_MIGRATE_RECORD_HDR;
+    int c = std::min((int)(total - m.pos), left);
+    if (c <= 0 || (c < FARM_MIGRATE_MIN_CHUNK && c < (int)(total - m.pos))) break;
+
+    len += appendInteger(buf + len, off, alloc, m.pos, (uint32_t)c);
+    memcpy(buf + len, local + m.pos, c);
+    len += c;
+    n++;
+    m.pos += c;
+    if (m.pos == total) {
+      m.ready.pop_front();
+      m.pos = 0;
+    }
+  }
+
+  wr->counter = n;
+  wr->flag = m.ready.empty() && m.deferred.empty() ? REQUEST_DONE : 0;
+  return len;
+}
+
+/*
+ * the objects of region [key] come into slab chunks of their own, looked up
+ * by their offsets in the region; the region is installed when all of them
+ * are here
+ */
+void Worker::FarmProcessMigrate(Client* c, TxnContext* tx) {
+  WorkRequest* wr = tx->wr_;
+  FarmIncoming& in = farm_incoming_[wr->key];
+  //a leaving worker takes no regions
+  if (leaving_) in.failed = true;
+
+  char* p = (char*)wr->ptr;
+  uint32_t off, alloc, pos, n;
+  for (int i = 0; i < wr->counter; i++) {
+    p += readInteger(p, off, alloc, pos, n);
+    if (!in.failed && pos == 0) {
+      char* chunk = (char*)sb.sb_malloc(alloc);
+      if (chunk) {
+        memset(chunk, 0, FARM_OBJECT_HEADER_SIZE);
+        in.objects[off] = alloc;
+        in.chunks[off] = chunk;
+        in.extent += alloc;
+      } else {
+        in.extent += alloc;
+        in.failed = true;
+      }
+    }
+    if (!in.failed && pos + n <= in.objects[off]) memcpy(in.chunks[off] + pos, p, n);
+    p += n;
+  }
+
+  if (!(wr->flag & REQUEST_DONE)) return;
+
+  if (in.failed) {
+    epicLog(LOG_WARNING, "no room for region %lx of %lu bytes", wr->key, in.extent);
+    for (auto& ch : in.chunks) sb.sb_free(ch.second);
+    wr->status = ALLOC_ERROR;
+  } else {
+    regions.Install(wr->key, GetWorkerId(), wr->pid, in.objects, in.chunks);
+    ghost_size += in.extent;
+    wr->status = SUCCESS;
+    epicLog(LOG_INFO, "region %lx is moved here from worker %d", wr->key, c->GetWorkerId());
+  }
+  farm_incoming_.erase(wr->key);
+  wr->op = MIGRATE_REPLY;
+  FarmAddTask(c, tx);
+  if (ghost_size > conf->ghost_th) FarmSyncStats();
+}
+
+/*the new owner has all the objects, or has no room for them*/
+void Worker::FarmProcessMigrateReply(Client* c, TxnContext* tx) {
+  WorkRequest* wr = tx->wr_;
+  epicAssert(!farm_migrations_.empty());
+  FarmMigration& m = farm_migrations_.front();
+  epicAssert(m.active && m.region == wr->key);
+  FarmMigrateHandOver(m, wr->status == SUCCESS);
+}
+
+/*
+ * hand the region over to the new owner, and tell Master (and thus the
+ * other workers) and the new owner; the chunks of the objects here are
+ * freed. A home region is given out again under the next reuse epoch of
+ * its memory. The hand-over is retried by Migrator if an app thread is in
+ * a RegionMap::Guard.
+ */
+void Worker::FarmMigrateHandOver(FarmMigration& m, bool success) {
+  if (success) {
+    m.handing = !regions.MoveOut(m.region, m.dest);
+    if (m.handing) return;
+
+    uint8_t* epoch = &farm_epochs_[((char*)ToLocal(REGION_BASE(m.region)) - (char*)base) >> REGION_SHIFT];
+    if (!m.home) {
+      //a region moved here before: its chunks are anywhere in the memory
+    } else if (*epoch < MAX_EPOCH) {
+      __atomic_add_fetch(epoch, 1, __ATOMIC_RELEASE);
+    } else {
+      //out of epochs: the chunks stay allocated, so that the old addresses are not given out again
+      epicLog(LOG_WARNING, "the memory of region %lx cannot be reused any more", m.region);
+      m.chunks.clear();
+    }
+    for (auto& c : m.chunks) {
+      if (unlikely(tier != nullptr)) FarmTierRelease(c.second);
+      sb.sb_free(c.second);
+    }
+    FarmPostNotice(REGION_MOVE, 0, m.region, m.dest, m.seq);
+    FarmPostNotice(MIGRATE_DONE, m.dest, m.region);
+    m.moved++;
+    epicLog(LOG_INFO, "region %lx is moved to worker %d (seq %u)", m.region, m.dest, m.seq);
+  } else {
+    regions.Unfreeze(m.region);
+    m.failed.insert(m.region);
+  }
+
+  m.active = false;
+  m.objects.clear();
+  m.chunks.clear();
+  m.deferred.clear();
+  m.ready.clear();
+  m.pos = 0;
+  m.queued = m.waiting = false;
+  FarmMigrateReleaseChunks();
+  FarmMigrateNext();
+}
+
+/*
+ * once a region is no longer frozen (moved away, taken over or failed to
+ * move): the chunks held meanwhile are free again, and the objects freed
+ * meanwhile are freed here, or by their new owner
+ */
+void Worker::FarmMigrateReleaseChunks() {
+  bool moving = !farm_migrations_.empty()
+    && (farm_migrations_.front().active || farm_migrations_.front().freezing);
+  size_t kept = 0;
+  for (char* c : farm_held_chunks_) {
+    if (!FarmRetired(c))
+      sb.sb_free(c);
+    else if (moving)
+      farm_held_chunks_[kept++] = c;
+    //otherwise the epochs of its memory are used up, and it stays allocated
+  }
+  farm_held_chunks_.resize(kept);
+
+  std::vector<GAddr> frees;
+  kept = 0;
+  for (GAddr a : farm_frozen_frees_) {
+    if (regions.Frozen(a))
+      farm_frozen_frees_[kept++] = a;
+    else
+      frees.push_back(a);
+  }
+  farm_frozen_frees_.resize(kept);
+  if (frees.empty()) return;
+  WorkRequest wr;
+  wr.size = frees.size();
+  wr.ptr = frees.data();
+  FarmProcessFree(&wr);
+}
+
+/*start the next region of the current move, or finish it*/
+void Worker::FarmMigrateNext() {
+  while (!farm_migrations_.empty()) {
+    FarmMigration& m = farm_migrations_.front();
+    while (m.n < 0 || m.moved < m.n) {
+      uint64_t region = FarmPickRegion(m.failed);
+      if (!region) break;
+      if (FarmMigrateStart(m, region)) return;
+    }
+    FarmMigrateFinish();
+  }
+}
+
+void Worker::FarmMigrateFinish() {
+  FarmMigration m = std::move(farm_migrations_.front());
+  farm_migrations_.pop_front();
+  epicLog(LOG_INFO, "moved %d regions away, %lu cannot be moved", m.moved, m.failed.size());
+
+  if (m.reply) {
+    WorkRequest* wr = m.reply->wr_;
+    wr->op = MIGRATE_PULL_REPLY;
+    wr->counter = m.moved;
+    wr->status = SUCCESS;
+    FarmAddTask(m.client, m.reply);
+  } else if (m.leave) {
+    if (m.failed.empty()) {
+      //Master drops this worker and confirms (see the WORKER_LEAVE in FarmProcessRemoteRequest)
+      FarmPostNotice(WORKER_LEAVE, 0, 0, 0, 0, REQUEST_DONE, GetWorkerId());
+    } else if (farm_leave_wr_) {
+      //still nothing is allocated here; the leave can be retried
+      farm_leave_wr_->status = ALLOC_ERROR;
+      farm_leave_wr_->counter = m.moved;
+      Notify(farm_leave_wr_);
+      farm_leave_wr_ = nullptr;
+    }
+  }
+}
+
+/*a new worker pulls [size] regions of this one*/
+void Worker::FarmProcessMigratePull(Client* c, TxnContext* tx) {
+  FarmMigration m;
+  m.to = c->GetWorkerId();
+  m.n = tx->wr_->size;
+  m.client = c;
+  m.reply = tx;
+  farm_migrations_.push_back(std::move(m));
+  FarmMigrateSchedule();
+}
+
+void Worker::FarmProcessLocalMigratePull(WorkRequest* wr) {
+  Client* cli = wr->counter == GetWorkerId() ? nullptr : FindClientWid(wr->counter);
+  if (unlikely(!cli)) {
+    wr->status = ALLOC_ERROR;
+    Notify(wr);
+    return;
+  }
+  FarmAddTask(cli, local_txns_[wr->id]);
+}
+
+/*
+ * the others stop allocating here, and all the regions are moved away; the
+ * app is notified once Master has dropped this worker
+ */
+void Worker::FarmProcessLocalLeave(WorkRequest* wr) {
+  //only the regions are moved, the KV pairs here would be lost
+  if (farm_leave_wr_ || kvs.GetCount()) {
+    if (kvs.GetCount())
+      epicLog(LOG_WARNING, "cannot leave with %lu KV pairs here", kvs.GetCount());
+    wr->status = ALLOC_ERROR;
+    Notify(wr);
+    return;
+  }
+  leaving_ = true;
+  farm_leave_wr_ = wr;
+  placement_dirty_ = true;
+  FarmPostNotice(WORKER_LEAVE, 0, 0, 0, 0, 0, GetWorkerId());
+
+  FarmMigration m;
+  m.leave = true;
+  farm_migrations_.push_back(std::move(m));
+  FarmMigrateSchedule();
+}
+
+/*
+ * a move told by Master, or the whole map; a gap in the epochs means a move
+ * was missed, and the whole map is fetched
+ */
+void Worker::FarmProcessRegionMap(WorkRequest* wr) {
+  if (wr->key > region_epoch_ + 1) FarmPostNotice(REGION_MAP, 0, 0);
+  if (wr->key > region_epoch_) region_epoch_ = wr->key;
+
+  char* p = (char*)wr->ptr;
+  uint64_t region;
+  int wid;
+  uint32_t seq;
+  for (Size i = 0; i < wr->size; i++) {
+    p += readInteger(p, region, wid, seq);
+    if (regions.SetOwner(region, wid, seq))
+      epicLog(LOG_DEBUG, "region %lx is owned by worker %d (seq %u)", region, wid, seq);
+  }
+}
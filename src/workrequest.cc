@@ -19,20 +19,37 @@ int WorkRequest::Ser(char* buf, int& len) {
       break;
     case FETCH_MEM_STATS_REPLY:
     case BROADCAST_MEM_STATS:
-      len = appendInteger(buf, op, size);
-      memcpy(buf + len, ptr, strlen((char*)ptr));
-      len += strlen((char*)ptr);
+      //[key = epoch][size = number of records][records of MEM_STATS_RECORD_SIZE]
+      len = appendInteger(buf, op, key, size);
+      memcpy(buf + len, ptr, size * MEM_STATS_RECORD_SIZE);
+      len += size * MEM_STATS_RECORD_SIZE;
+      break;
+    case GOSSIP:
+      len = appendInteger(buf, lop, size);
+      memcpy(buf + len, ptr, size * GOSSIP_RECORD_SIZE);
+      len += size * GOSSIP_RECORD_SIZE;
       break;
     case GET:
     case KV_GET:
       len = appendInteger(buf, op, id, key);
       break;
     case PUT:
-    case KV_PUT:
       len = appendInteger(buf, op, id, key, size);
       memcpy(buf+len, ptr, size);
       len += size;
       break;
+    case KV_PUT:
+      len = appendInteger(buf, lop, id, key, size, offset, counter);
+      memcpy(buf+len, (char*)ptr + offset, counter);
+      len += counter;
+      break;
+    case KV_GET_REPLY:
+      len = appendInteger(buf, lop, id, key, size, lstatus, offset, counter);
+      if (static_cast<Status>(lstatus) == Status::SUCCESS) {
+        memcpy(buf+len, (char*)ptr + offset, counter);
+        len += counter;
+      }
+      break;
     case GET_REPLY:
       len = appendInteger(buf, op, id, key, size, lstatus);
       if (static_cast<Status>(lstatus) == Status::SUCCESS) {
@@ -43,13 +60,35 @@ int WorkRequest::Ser(char* buf, int& len) {
     case PUT_REPLY:
       len = appendInteger(buf, op, id, key, lstatus);
       break;
+    case WORKER_JOIN:
+      len = appendInteger(buf, lop, id, size);
+      memcpy(buf + len, ptr, size);
+      len += size;
+      break;
+    case COORD_BARRIER:
+    case WATCH:
+    case FETCH_ADD:
+      len = appendInteger(buf, lop, id, key, size, counter);
+      break;
+    case COORD_REPLY:
+      len = appendInteger(buf, lop, id, key, size, lstatus);
+      if (static_cast<Status>(lstatus) == Status::SUCCESS && size) {
+        memcpy(buf+len, ptr, size);
+        len += size;
+      }
+      break;
 
     case FARM_MALLOC:
       //len = sprintf(buf, "%x:%x:%lx:%x:", op, id, size, flag);
-      len = appendInteger(buf, lop, id, size);
+      len = appendInteger(buf, lop, id, size, counter);  //counter: number of objects
       break;
     case FARM_MALLOC_REPLY:
       len = appendInteger(buf, lop, id, addr, lstatus);
+      if (counter > 1 && static_cast<Status>(lstatus) == Status::SUCCESS) {
+        //[osize_t size][GAddr]* of the objects allocated
+        memcpy(buf + len, this->ptr, this->size);
+        len += this->size;
+      }
       break;
     case FARM_READ:
       len = appendInteger(buf, lop, id, addr);
@@ -60,6 +99,8 @@ int WorkRequest::Ser(char* buf, int& len) {
       {
         memcpy(buf + len, this->ptr, this->size);
         len += this->size;
+      } else if (static_cast<Status>(lstatus) == Status::MOVED) {
+        len += appendInteger(buf + len, wid, counter);
       }
       break;
     case PREPARE:
@@ -73,11 +114,52 @@ int WorkRequest::Ser(char* buf, int& len) {
     case ABORT:
       len = appendInteger(buf, lop, id);
       break;
+    case ADD_REGION:
+      len = appendInteger(buf, lop, id, addr, size);
+      break;
+    case BARRIER:
+    case BARRIER_RELEASE:
+      len = appendInteger(buf, lop, id);
+      break;
     case VALIDATE_REPLY:
     case PREPARE_REPLY:
     case ACKNOWLEDGE:
       len = appendInteger(buf, lop, id, lstatus);
       break;
+    case MIGRATE:
+      //the records are put by Worker::FarmGenerateMigrate
+      len = appendInteger(buf, lop, id, key, offset, counter, pid, flag);
+      memcpy(buf + len, ptr, size);
+      len += size;
+      break;
+    case MIGRATE_REPLY:
+      len = appendInteger(buf, lop, id, key, lstatus);
+      break;
+    case MIGRATE_DONE:
+      len = appendInteger(buf, lop, id, key);
+      break;
+    case MIGRATE_PULL:
+      len = appendInteger(buf, lop, id, size);
+      break;
+    case MIGRATE_PULL_REPLY:
+      len = appendInteger(buf, lop, id, counter, lstatus);
+      break;
+    case REGION_MOVE:
+      len = appendInteger(buf, lop, key, counter, offset);
+      break;
+    case REGION_MAP:
+      len = appendInteger(buf, lop, key, size);
+      memcpy(buf + len, ptr, size * REGION_RECORD_SIZE);
+      len += size * REGION_RECORD_SIZE;
+      break;
+    case WORKER_LEAVE:
+      len = appendInteger(buf, lop, id, flag);
+      break;
+    case FARM_FREE:
+      len = appendInteger(buf, lop, size);
+      memcpy(buf + len, ptr, size * sizeof(GAddr));
+      len += size * sizeof(GAddr);
+      break;
 
     default:
       epicLog(LOG_WARNING, "unrecognized op code");
@@ -104,9 +186,14 @@ int WorkRequest::Deser (const char* buf, int& len) {
       break;
     case FETCH_MEM_STATS_REPLY:
     case BROADCAST_MEM_STATS:
+      p += readInteger(p, key, size);
+      ptr = p;
+      len = size * MEM_STATS_RECORD_SIZE;
+      break;
+    case GOSSIP:
       p += readInteger(p, size);
       ptr = p;
-      len = strlen((char*)ptr);
+      len = size * GOSSIP_RECORD_SIZE;
       break;
     case GET:
     case KV_GET:
@@ -120,17 +207,48 @@ int WorkRequest::Deser (const char* buf, int& len) {
       len = size;
       break;
     case PUT:
-    case KV_PUT:
       p += readInteger(p, id, key, size);
       ptr = p;
       len = size;
       break;
+    case KV_PUT:
+      p += readInteger(p, id, key, size, offset, counter);
+      ptr = p;
+      len = counter;
+      break;
+    case KV_GET_REPLY:
+      //the chunk goes right into the buffer of the caller
+      p += readInteger(p, id, key, size, s, offset, counter);
+      this->status = s;
+      if (status == SUCCESS) {
+        memcpy((char*)ptr + offset, p, counter);
+        len = counter;
+      }
+      break;
     case PUT_REPLY:
       p += readInteger(p, id, key, s);
       status = s;
       break;
-    case FARM_MALLOC:
+    case WORKER_JOIN:
       p += readInteger(p, id, size);
+      ptr = p;
+      len = size;
+      break;
+    case COORD_BARRIER:
+    case WATCH:
+    case FETCH_ADD:
+      p += readInteger(p, id, key, size, counter);
+      break;
+    case COORD_REPLY:
+      p += readInteger(p, id, key, size, s);
+      status = s;
+      if (status == SUCCESS && size) {
+        memcpy(ptr, p, size);
+        len = size;
+      }
+      break;
+    case FARM_MALLOC:
+      p += readInteger(p, id, size, counter);
       break;
     case FARM_MALLOC_REPLY:
       p += readInteger(p, id, addr, s);
@@ -142,6 +260,7 @@ int WorkRequest::Deser (const char* buf, int& len) {
     case FARM_READ_REPLY:
       p += readInteger(p, id, s);
       status = s;
+      if (status == MOVED) p += readInteger(p, wid, counter);
       break;
     case PREPARE:
     case VALIDATE:
@@ -152,12 +271,52 @@ int WorkRequest::Deser (const char* buf, int& len) {
     case ABORT: 
       p += readInteger(p, id);
       break;
+    case ADD_REGION:
+      p += readInteger(p, id, addr, size);
+      break;
+    case BARRIER:
+    case BARRIER_RELEASE:
+      p += readInteger(p, id);
+      break;
     case VALIDATE_REPLY:
     case PREPARE_REPLY:
     case ACKNOWLEDGE:
       p += readInteger(p, id, s);
       status = s;
       break;
+    case MIGRATE:
+      p += readInteger(p, id, key, offset, counter, pid, flag);
+      break;
+    case MIGRATE_REPLY:
+      p += readInteger(p, id, key, s);
+      status = s;
+      break;
+    case MIGRATE_DONE:
+      p += readInteger(p, id, key);
+      break;
+    case MIGRATE_PULL:
+      p += readInteger(p, id, size);
+      break;
+    case MIGRATE_PULL_REPLY:
+      p += readInteger(p, id, counter, s);
+      status = s;
+      break;
+    case REGION_MOVE:
+      p += readInteger(p, key, counter, offset);
+      break;
+    case REGION_MAP:
+      p += readInteger(p, key, size);
+      ptr = p;
+      len = size * REGION_RECORD_SIZE;
+      break;
+    case WORKER_LEAVE:
+      p += readInteger(p, id, flag);
+      break;
+    case FARM_FREE:
+      p += readInteger(p, size);
+      ptr = p;
+      len = size * sizeof(GAddr);
+      break;
     default:
       epicLog(LOG_WARNING, "unrecognized op code %d", op);
       break;
@@ -178,7 +337,7 @@ bool WorkRequest::operator==(const WorkRequest& wr) {
     && wr.flag == this->flag && wr.free == this->free && wr.id == this->id
     && wr.next == this->next && wr.op == this->op && wr.parent == this->parent
     && wr.pid == this->pid && wr.ptr == this->ptr && wr.pwid == this->pwid
-    && wr.size == this->size && wr.status == this->status && wr.wid == this->wid;
+    && wr.size == this->size && wr.offset == this->offset && wr.status == this->status && wr.wid == this->wid;
 }
 
 const char* workToStr(Work op) {
@@ -194,6 +353,7 @@ const char* workToStr(Work op) {
     case FARM_READ:
       strcpy(s, "FARM_READ");
       break;
+
     case FARM_READ_REPLY:
       strcpy(s, "FARM_READ_REPLY");
       break;
@@ -215,6 +375,57 @@ const char* workToStr(Work op) {
     case ABORT:
       strcpy(s, "FARM_ABORT");
       break;
+    case FARM_BATCH:
+      strcpy(s, "FARM_BATCH");
+      break;
+    case FARM_BATCH_GOSSIP:
+      strcpy(s, "FARM_BATCH_GOSSIP");
+      break;
+    case GOSSIP:
+      strcpy(s, "GOSSIP");
+      break;
+    case ADD_REGION:
+      strcpy(s, "ADD_REGION");
+      break;
+    case BARRIER:
+      strcpy(s, "BARRIER");
+      break;
+    case BARRIER_RELEASE:
+      strcpy(s, "BARRIER_RELEASE");
+      break;
+    case WORKER_JOIN:
+      strcpy(s, "WORKER_JOIN");
+      break;
+    case COORD_BARRIER:
+      strcpy(s, "COORD_BARRIER");
+      break;
+    case WATCH:
+      strcpy(s, "WATCH");
+      break;
+    case FETCH_ADD:
+      strcpy(s, "FETCH_ADD");
+      break;
+    case FARM_READ_MANY:
+      strcpy(s, "FARM_READ_MANY");
+      break;
+    case KV_GET_MANY:
+      strcpy(s, "KV_GET_MANY");
+      break;
+    case KV_PUT_MANY:
+      strcpy(s, "KV_PUT_MANY");
+      break;
+    case KV_PUT:
+      strcpy(s, "KV_PUT");
+      break;
+    case KV_GET:
+      strcpy(s, "KV_GET");
+      break;
+    case KV_GET_REPLY:
+      strcpy(s, "KV_GET_REPLY");
+      break;
+    case COORD_REPLY:
+      strcpy(s, "COORD_REPLY");
+      break;
     case ACKNOWLEDGE:
       strcpy(s, "FARM_ACKNOWLEDGE");
       break;
@@ -242,6 +453,33 @@ const char* workToStr(Work op) {
     case GET:
       strcpy(s, "GET");
       break;
+    case MIGRATE:
+      strcpy(s, "MIGRATE");
+      break;
+    case MIGRATE_REPLY:
+      strcpy(s, "MIGRATE_REPLY");
+      break;
+    case MIGRATE_DONE:
+      strcpy(s, "MIGRATE_DONE");
+      break;
+    case MIGRATE_PULL:
+      strcpy(s, "MIGRATE_PULL");
+      break;
+    case MIGRATE_PULL_REPLY:
+      strcpy(s, "MIGRATE_PULL_REPLY");
+      break;
+    case REGION_MOVE:
+      strcpy(s, "REGION_MOVE");
+      break;
+    case REGION_MAP:
+      strcpy(s, "REGION_MAP");
+      break;
+    case WORKER_LEAVE:
+      strcpy(s, "WORKER_LEAVE");
+      break;
+    case FARM_FREE:
+      strcpy(s, "FARM_FREE");
+      break;
   }
 
   return s;
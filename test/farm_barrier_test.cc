@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The GAM Authors
+//就绪屏障测试：两个worker互相连接后屏障才放行，代替固定的启动等待，不需要RDMA设备
+//usage: farm_barrier_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker1);
+  Farm* f3 = new Farm(worker2);
+
+  //readiness barrier: released once both workers are connected to each other
+  long bstart = get_time();
+  std::thread bt([&] {assert(f3->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+  fprintf(stdout, "%s cluster ready in %ld us\n", argc > 1 ? argv[1] : "shm", (get_time() - bstart) / 1000);
+  //a round of worker1 is entered by its two threads
+  for (int round = 0; round < 2; round++) {
+    std::thread bt1([&] {assert(f2->barrier(2) == 0);});
+    std::thread bt2([&] {assert(f3->barrier() == 0);});
+    assert(f1->barrier(2) == 0);
+    bt1.join();
+    bt2.join();
+  }
+  fprintf(stdout, "%s barrier rounds succeed\n", argc > 1 ? argv[1] : "shm");
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
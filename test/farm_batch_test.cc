@@ -0,0 +1,99 @@
+// Copyright (c) 2018 The GAM Authors
+//发往同一个peer的协议消息合并成一次发送的测试：跨两个远程参与者(对象数不同)的事务，三个worker，不需要RDMA设备
+//usage: farm_batch_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+#define NWORKERS 3
+#define OBJ_SIZE 256
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = NWORKERS;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  Worker* workers[NWORKERS];
+  for (int i = 0; i < NWORKERS; i++) {
+    conf = new Conf();
+    conf->loglevel = level;
+    conf->transport = transport;
+    conf->size = 1024 * 1024 * 128L;
+    conf->worker_port += i;
+    conf->no_node = NWORKERS;
+    workers[i] = new Worker(*conf);
+  }
+
+  Farm* fs[NWORKERS];
+  for (int i = 0; i < NWORKERS; i++) fs[i] = new Farm(workers[i]);
+  std::vector<std::thread> ths;
+  for (int i = 1; i < NWORKERS; i++) ths.emplace_back([&, i] {assert(fs[i]->barrier() == 0);});
+  assert(fs[0]->barrier() == 0);
+  for (auto& th : ths) th.join();
+
+  int wids[NWORKERS];
+  for (int i = 0; i < NWORKERS; i++) wids[i] = workers[i]->GetWorkerId();
+
+  //a txn writing a different number of objects at each of the two remote
+  //participants: the prepare/validate msgs are generated after both are
+  //queued, and each must carry the count of its own participant
+  int counts[NWORKERS] = {0, 3, 40};
+  std::vector<GAddr> objs;
+  char buf[OBJ_SIZE];
+  fs[0]->txBegin();
+  for (int i = 1; i < NWORKERS; i++) {
+    for (int j = 0; j < counts[i]; j++) {
+      GAddr o = fs[0]->txAlloc(OBJ_SIZE, EMPTY_GLOB(wids[i]));
+      assert(o && WID(o) == wids[i]);
+      *(long*)buf = objs.size();
+      fs[0]->txWrite(o, buf, OBJ_SIZE);
+      objs.push_back(o);
+    }
+  }
+  assert(fs[0]->txCommit() == SUCCESS);
+  //read-modify-write of all of them, validated and prepared at both
+  fs[0]->txBegin();
+  for (size_t i = 0; i < objs.size(); i++) {
+    assert(fs[0]->txRead(objs[i], buf, OBJ_SIZE) == OBJ_SIZE);
+    assert(*(long*)buf == (long)i);
+    *(long*)buf += 1000;
+    fs[0]->txWrite(objs[i], buf, OBJ_SIZE);
+  }
+  assert(fs[0]->txCommit() == SUCCESS);
+  fs[1]->txBegin();
+  for (size_t i = 0; i < objs.size(); i++) {
+    assert(fs[1]->txRead(objs[i], buf, OBJ_SIZE) == OBJ_SIZE);
+    assert(*(long*)buf == (long)i + 1000);
+  }
+  assert(fs[1]->txCommit() == SUCCESS);
+  fprintf(stdout, "txn over two remote participants (%d and %d objects) succeed\n",
+      counts[1], counts[2]);
+
+  fprintf(stdout, "%s batch test succeed\n", argc > 1 ? argv[1] : "shm");
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -0,0 +1,175 @@
+// Copyright (c) 2018 The GAM Authors
+//分布式B+树(FarmBTree)的点查、插入和范围扫描测试，两个worker，不需要RDMA设备
+//usage: farm_btree_benchmark [shm|tcp] [#keys] [#threads per worker]
+
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "farm_btree.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+#define NLOOKUPS 5000  //per thread
+#define NSCANS 200  //per thread
+#define SCAN_LEN 100
+
+//distinct keys for distinct i (an odd multiplier), so that they are inserted in random order
+static uint64_t key_of(uint64_t i) {
+  return i * 0x9E3779B97F4A7C15ULL;
+}
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp] [#keys] [#threads per worker]\n", argv[0]);
+    return 1;
+  }
+  int nkeys = argc > 2 ? atoi(argv[2]) : 20000;
+  int nthreads = argc > 3 ? atoi(argv[3]) : 2;
+
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 256L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  Worker* workers[2];
+  for (int i = 0; i < 2; i++) {
+    conf = new Conf();
+    conf->loglevel = level;
+    conf->transport = transport;
+    conf->size = 1024 * 1024 * 256L;
+    conf->worker_port += i;
+    conf->no_node = 2;
+    workers[i] = new Worker(*conf);
+  }
+
+  //one Farm per thread, one cache per worker
+  int n = 2 * nthreads;
+  std::vector<Farm*> fs;
+  std::vector<FarmBTreeCache*> caches = {new FarmBTreeCache, new FarmBTreeCache};
+  for (int t = 0; t < n; t++) fs.push_back(new Farm(workers[t % 2]));
+  std::thread bt([&] {assert(fs[1]->barrier() == 0);});
+  assert(fs[0]->barrier() == 0);
+  bt.join();
+
+  std::vector<uint16_t> wids = {(uint16_t)workers[0]->GetWorkerId(), (uint16_t)workers[1]->GetWorkerId()};
+  FarmBTree creator(fs[0], caches[0]);
+  GAddr meta = creator.Create(sizeof(uint64_t), wids);
+  assert(meta);
+
+  std::vector<FarmBTree*> ts;
+  for (int t = 0; t < n; t++) {
+    ts.push_back(new FarmBTree(fs[t], caches[t % 2]));
+    assert(ts[t]->Open(meta) == 0);
+  }
+
+  auto run = [&](std::function<void(int)> fn) {
+    std::vector<std::thread> ths;
+    long start = get_time();
+    for (int t = 0; t < n; t++) ths.emplace_back(fn, t);
+    for (auto& th : ths) th.join();
+    return get_time() - start;
+  };
+
+  //inserts, one key per txn
+  std::atomic<long> aborts(0);
+  long ns = run([&](int t) {
+    for (uint64_t i = t; i < nkeys; i += n) {
+      uint64_t k = key_of(i), v = ~k;
+      do {
+        fs[t]->txBegin();
+        assert(ts[t]->Put(k, &v) == 0);
+      } while (ts[t]->Commit() != SUCCESS && ++aborts);
+    }
+  });
+  fprintf(stdout, "%s insert: %d keys by %d threads, %.0f ops/s, %ld retries\n",
+      argc > 1 ? argv[1] : "shm", nkeys, n, nkeys * 1e9 / ns, aborts.load());
+
+  //every key can be found, and a full scan gets them in order
+  std::vector<uint64_t> keys;
+  for (uint64_t i = 0; i < nkeys; i++) keys.push_back(key_of(i));
+  std::sort(keys.begin(), keys.end());
+  fs[0]->txBegin();
+  int i = 0;
+  for (FarmBTreeIterator it(ts[0], 0); it.Valid(); it.Next(), i++) {
+    assert(it.Key() == keys[i]);
+    assert(*(uint64_t*)it.Value() == ~keys[i]);
+  }
+  assert(i == nkeys);
+  assert(ts[0]->Commit() == SUCCESS);
+
+  //point lookups, one key per read-only txn
+  uint64_t hits = caches[0]->hits + caches[1]->hits, misses = caches[0]->misses + caches[1]->misses;
+  ns = run([&](int t) {
+    unsigned int seed = t;
+    for (int j = 0; j < NLOOKUPS; j++) {
+      uint64_t k = key_of(rand_r(&seed) % nkeys), v;
+      do {
+        fs[t]->txBegin();
+        assert(ts[t]->Get(k, &v) == 0 && v == ~k);
+      } while (ts[t]->Commit() != SUCCESS);
+    }
+  });
+  hits = caches[0]->hits + caches[1]->hits - hits;
+  misses = caches[0]->misses + caches[1]->misses - misses;
+  fprintf(stdout, "%s lookup: %.0f ops/s, %.1f%% of the internal nodes from the cache\n",
+      argc > 1 ? argv[1] : "shm", n * NLOOKUPS * 1e9 / ns, hits * 100.0 / (hits + misses));
+
+  //range scans of SCAN_LEN keys
+  ns = run([&](int t) {
+    unsigned int seed = t;
+    for (int j = 0; j < NSCANS; j++) {
+      int from = rand_r(&seed) % nkeys;
+      int cnt;
+      do {
+        cnt = 0;
+        fs[t]->txBegin();
+        for (FarmBTreeIterator it(ts[t], keys[from]); it.Valid() && cnt < SCAN_LEN; it.Next(), cnt++) {
+          assert(it.Key() == keys[from + cnt]);
+        }
+      } while (ts[t]->Commit() != SUCCESS);
+      assert(cnt == std::min(SCAN_LEN, nkeys - from));
+    }
+  });
+  fprintf(stdout, "%s scan: %.0f scans/s of %d keys\n", argc > 1 ? argv[1] : "shm",
+      n * NSCANS * 1e9 / ns, SCAN_LEN);
+
+  //updates and removes are seen by the others
+  fs[0]->txBegin();
+  uint64_t v = 1;
+  assert(ts[0]->Put(keys[0], &v) == 0);
+  assert(ts[0]->Remove(keys[1]) == 0);
+  assert(ts[0]->Remove(keys[1]) == -1);
+  assert(ts[0]->Commit() == SUCCESS);
+  fs[1]->txBegin();
+  assert(ts[1]->Get(keys[0], &v) == 0 && v == 1);
+  assert(ts[1]->Get(keys[1], &v) == -1);
+  FarmBTreeIterator it(ts[1], keys[0], keys[2]);
+  assert(it.Valid() && it.Key() == keys[0]);
+  it.Next();
+  assert(it.Valid() && it.Key() == keys[2]);
+  it.Next();
+  assert(!it.Valid());
+  assert(ts[1]->Commit() == SUCCESS);
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2018 The GAM Authors
+//批量分配测试：txAllocMany在本地一次slab遍历、在远程一次消息分配多个对象，不需要RDMA设备
+//usage: farm_bulk_alloc_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  //bulk allocation: one slab pass locally, one FARM_MALLOC per chunk remotely
+  const int nbulk = 2000;
+  std::vector<GAddr> bulk(nbulk);
+  for (GAddr hint: {(GAddr)0, EMPTY_GLOB(worker1->GetWorkerId())}) {
+    Farm* bf = hint ? f2 : f1;
+    bf->txBegin();
+    long start = get_time();
+    assert(bf->txAllocMany(64, nbulk, bulk.data(), hint) == nbulk);
+    long end = get_time();
+    for (int i = 0; i < nbulk; i++) {
+      assert(WID(bulk[i]) == worker1->GetWorkerId());
+      bf->txWrite(bulk[i], (char*)&i, sizeof(int));
+    }
+    assert(bf->txCommit() == SUCCESS);
+    fprintf(stdout, "%s %s bulk alloc latency of 64 bytes = %ld ns\n",
+        argc > 1 ? argv[1] : "shm", hint ? "remote" : "local", (end-start)/nbulk);
+
+    for (int i = 0; i < nbulk; i += 97) {
+      int v = -1;
+      f1->txBegin();
+      assert(f1->txRead(bulk[i], (char*)&v, sizeof(int)) == sizeof(int) && v == i);
+      f1->txCommit();
+    }
+    std::sort(bulk.begin(), bulk.end());
+    assert(std::unique(bulk.begin(), bulk.end()) == bulk.end());
+    bf->txBegin();
+    for (int i = 0; i < nbulk; i++)
+      bf->txFree(bulk[i]);
+    assert(bf->txCommit() == SUCCESS);
+  }
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -32,7 +32,6 @@ int no_thread = 10;
 int no_node = 1;
 int node_id = 0;
 int write_ratio = 50;
-int sync_key; 
 int iteration = 5000;
 int txn_nobj = 40;
 Conf conf;
@@ -42,20 +41,7 @@ char *v; //定义一个字符指针，用于指向动态分配的字符数组
 
 static void sync(int phase, int tid) {  //定义一个静态函数sync，参数为阶段phase和线程ID
   fprintf(stdout, "Thread %d leaves phase %d, start snyc now\n", tid, phase); //打印线程离开上一阶段并开始同步的信息
-  uint64_t base = num_obj * no_node * no_thread; //计算base的值，基于对象数量、节点数量和线程数量
-  sync_key = base + node_id * no_thread + tid;  //计算同步键，基于base、节点ID和线程ID
-  alloc[tid]->Put(sync_key, &phase, sizeof(int)); //将当前阶段值存储到同步键位置
-  if (phase != DONE || is_master) //如果阶段不是DONE或当前节点不是主节点
-    for (int i = 0; i < no_thread * no_node; ++i) //遍历所有线程和节点
-    {
-      //if (i == node_id * no_thread + tid) continue;
-      int t; //定义一个整形变量t
-      do {//开始一个循环
-        alloc[tid]->Get(base + i, &t); //从base地址加i位置获取阶段值并存储到t
-        if (t == DONE) break; //如果t等于DONE，跳出循环
-        usleep(50000); //休眠50毫秒
-      } while(t != phase); //如果t不等于当前阶段，继续循环
-    }
+  alloc[tid]->Barrier(no_thread); //所有节点的所有线程都到达后返回
 }
 
 
@@ -218,7 +204,7 @@ int main(int argc, char* argv[]) {
     //&conf是一个Conf*类型的指针，它指向一个Conf对象，即表示conf对象的地址，用于初始化GAlloc对象
   }
 
-  sleep(2);
+  alloc[0]->Barrier(); //wait for all the nodes to connect to each other
 
   thread* th[no_thread];
   for (int i = 0; i < no_thread; ++i)
@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The GAM Authors
+//合并发送测试：多个线程向同一个peer并发提交事务，消息合并到同一个发送槽，不需要RDMA设备
+//usage: farm_coalesce_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  //many concurrent txns to the same peer, so that their msgs get coalesced
+  const int nthreads = 8, ntxns = 2000;
+  std::vector<GAddr> objs(nthreads);
+  for (int t = 0; t < nthreads; t++) {
+    f1->txBegin();
+    objs[t] = f1->txAlloc(sizeof(long));
+    long zero = 0;
+    f1->txWrite(objs[t], (char*)&zero, sizeof(long));
+    assert(f1->txCommit() == SUCCESS);
+  }
+  std::vector<std::thread> ths;
+  long start = get_time();
+  for (int t = 0; t < nthreads; t++) {
+    ths.emplace_back([&, t]() {
+      Farm f(worker2);
+      long v;
+      for (int i = 0; i < ntxns; i++) {
+        f.txBegin();
+        assert(sizeof(long) == f.txRead(objs[t], (char*)&v, sizeof(long)));
+        v++;
+        f.txWrite(objs[t], (char*)&v, sizeof(long));
+        assert(f.txCommit() == SUCCESS);
+      }
+    });
+  }
+  for (auto& th: ths) th.join();
+  long end = get_time();
+  for (int t = 0; t < nthreads; t++) {
+    long v = 0;
+    f2->txBegin();
+    f2->txRead(objs[t], (char*)&v, sizeof(long));
+    f2->txCommit();
+    assert(v == ntxns);
+  }
+  fprintf(stdout, "%s concurrent remote txn throughput = %lf\n",
+      argc > 1 ? argv[1] : "shm",
+      (double)nthreads*ntxns/((double)(end-start)/1000/1000/1000));
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
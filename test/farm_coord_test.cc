@@ -0,0 +1,112 @@
+// Copyright (c) 2018 The GAM Authors
+//协调服务测试：master提供的命名屏障、watch和计数器，不需要RDMA设备
+//usage: farm_coord_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker1);
+  Farm* f3 = new Farm(worker2);
+  std::thread bt([&] {assert(f3->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  //named barrier of three participants on two workers, used for two rounds
+  const uint64_t name = 1UL << 40;
+  for (int round = 0; round < 2; round++) {
+    std::thread c1([&] {assert(f2->coord_barrier(name, 3) == 0);});
+    std::thread c2([&] {assert(f3->coord_barrier(name, 3) == 0);});
+    assert(f1->coord_barrier(name, 3) == 0);
+    c1.join();
+    c2.join();
+  }
+
+  //a watch is woken up by the put of another worker
+  const uint64_t key = 1UL << 41;
+  int value = 0;
+  uint64_t version = 0;
+  assert(f3->watch(key, &value, version, 20) == -1);  //nothing put yet
+  std::thread w([&] {
+    int v = 0;
+    uint64_t ver = 0;
+    assert(f3->watch(key, &v, ver) == sizeof(int));
+    assert(v == 42 && ver == 1);
+    assert(f3->coord_barrier(name + 1, 2) == 0);
+    assert(f3->watch(key, &v, ver) == sizeof(int));
+    assert(v == 43 && ver == 2);
+  });
+  value = 42;
+  f1->put(key, &value, sizeof(int));
+  assert(f1->coord_barrier(name + 1, 2) == 0);
+  value = 43;
+  f1->put(key, &value, sizeof(int));
+  w.join();
+  version = 0;
+  assert(f2->watch(key, &value, version) == sizeof(int));  //already newer
+  assert(value == 43 && version == 2);
+
+  //counters from threads of both workers
+  const int adds = 1000;
+  std::thread a1([&] {for (int i = 0; i < adds; i++) f2->fetch_add(key, 1);});
+  std::thread a2([&] {for (int i = 0; i < adds; i++) f3->fetch_add(key, 2);});
+  long start = get_time();
+  for (int i = 0; i < adds; i++)
+    f1->fetch_add(key, -1);
+  long end = get_time();
+  a1.join();
+  a2.join();
+  assert(f1->fetch_add(key, 0) == 2 * adds);
+  fprintf(stdout, "%s coordination succeed, fetch_add latency = %ld ns\n",
+      argc > 1 ? argv[1] : "shm", (end - start) / adds);
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
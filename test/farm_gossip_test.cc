@@ -0,0 +1,107 @@
+// Copyright (c) 2018 The GAM Authors
+//gossip模式下内存统计信息的传播测试：不经过master，三个worker，不需要RDMA设备
+//usage: farm_gossip_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+#define NWORKERS 3
+#define OBJ_SIZE 4000
+#define NOBJS 4000  //about 16MB, many times conf->ghost_th
+#define TIMEOUT_MS 3000
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = NWORKERS;
+  conf->stats_mode = STATS_GOSSIP;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  Worker* workers[NWORKERS];
+  for (int i = 0; i < NWORKERS; i++) {
+    conf = new Conf();
+    conf->loglevel = level;
+    conf->transport = transport;
+    conf->size = 1024 * 1024 * 128L;
+    conf->worker_port += i;
+    conf->no_node = NWORKERS;
+    conf->stats_mode = STATS_GOSSIP;
+    conf->gossip_interval = 20;
+    workers[i] = new Worker(*conf);
+  }
+
+  Farm* fs[NWORKERS];
+  for (int i = 0; i < NWORKERS; i++) fs[i] = new Farm(workers[i]);
+  std::vector<std::thread> ths;
+  for (int i = 1; i < NWORKERS; i++) ths.emplace_back([&, i] {assert(fs[i]->barrier() == 0);});
+  assert(fs[0]->barrier() == 0);
+  for (auto& th : ths) th.join();
+  usleep(200 * 1000);  //the stats of the joins
+
+  int w1 = workers[0]->GetWorkerId();
+  uint64_t epoch = master->GetStatsEpoch();
+  //the view of worker 1 from worker 3, which never talks to it in this test
+  Client* cli = workers[2]->FindClientWid(w1);
+  assert(cli);
+  Size before = cli->GetFreeMem();
+
+  //worker 1 takes a lot of its own memory
+  char buf[OBJ_SIZE] = "gossip";
+  for (int i = 0; i < NOBJS; i += 100) {
+    fs[0]->txBegin();
+    for (int j = 0; j < 100; j++) {
+      GAddr a = fs[0]->txAlloc(OBJ_SIZE, EMPTY_GLOB(w1));
+      assert(a);
+      fs[0]->txWrite(a, buf, OBJ_SIZE);
+    }
+    assert(fs[0]->txCommit() == SUCCESS);
+  }
+
+  //worker 3 learns it from the gossip
+  long start = get_time();
+  while (cli->GetFreeMem() + (Size)OBJ_SIZE * NOBJS > before) {
+    assert(get_time() - start < TIMEOUT_MS * 1000000L);
+    usleep(1000);
+  }
+  fprintf(stdout, "free memory of worker %d seen by worker %d in %ld ms: %lu -> %lu\n",
+      w1, workers[2]->GetWorkerId(), (get_time() - start) / 1000000, before, cli->GetFreeMem());
+  //and Master has not broadcast anything since the joins
+  assert(master->GetStatsEpoch() == epoch);
+
+  //traffic between workers 2 and 1 carries the stats as well
+  GAddr a;
+  fs[1]->txBegin();
+  assert((a = fs[1]->txAlloc(OBJ_SIZE, EMPTY_GLOB(w1))));
+  fs[1]->txWrite(a, buf, OBJ_SIZE);
+  assert(fs[1]->txCommit() == SUCCESS);
+  fs[1]->txBegin();
+  assert(fs[1]->txRead(a, buf, OBJ_SIZE) == OBJ_SIZE && !strcmp(buf, "gossip"));
+  assert(fs[1]->txCommit() == SUCCESS);
+
+  fprintf(stdout, "%s gossip test succeed\n", argc > 1 ? argv[1] : "shm");
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2018 The GAM Authors
+//内存增长测试：worker的页面用完后在运行时注册新的区域，不需要RDMA设备
+//usage: farm_growth_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  conf->size_max = 1024 * 1024 * 512L;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  int sz = 1000;
+  char buf[sz];
+  for (int i = 0; i < sz; ++i) {
+    buf[i] = 'a';
+  }
+  buf[sz-1] = 0;
+  char mbuf[sz];
+
+  //runtime growth: worker1 grows beyond conf->size once it runs out of pages,
+  //and the objects in the grown part are accessed remotely as any other one
+  const osize_t lsz = 3 * 1024 * 1024;
+  std::vector<char> lbuf(lsz, 'l');
+  const size_t initial = worker1->sb.get_limit();
+  std::vector<GAddr> grown;
+  while (worker1->sb.get_limit() == initial) {
+    f1->txBegin();
+    GAddr ga = f1->txAlloc(lsz);
+    assert(ga);
+    f1->txWrite(ga, lbuf.data(), lsz);
+    assert(f1->txCommit() == SUCCESS);
+    grown.push_back(ga);
+  }
+  assert(worker1->sb.get_regions().size() == 2);
+  //objects small enough to be read remotely, until one is in the grown part
+  std::vector<GAddr> small;
+  do {
+    f1->txBegin();
+    small.push_back(f1->txAlloc(sz));
+    assert(small.back());
+    f1->txWrite(small.back(), buf, sz);
+    assert(f1->txCommit() == SUCCESS);
+  } while (OFF(small.back()) < initial);
+  sleep(1);  //announced to the peers
+  memset(mbuf, 0, sz);
+  f2->txBegin();
+  assert(f2->txRead(small.back(), mbuf, sz) == sz);
+  assert(!strcmp(buf, mbuf));
+  mbuf[0] = 'g';
+  f2->txWrite(small.back(), mbuf, sz);
+  assert(f2->txCommit() == SUCCESS);
+  memset(mbuf, 0, sz);
+  f1->txBegin();
+  assert(f1->txRead(small.back(), mbuf, sz) == sz);
+  assert(mbuf[0] == 'g' && !strcmp(buf+1, mbuf+1));
+  for (GAddr ga: small)
+    f1->txFree(ga);
+  for (GAddr ga: grown)
+    f1->txFree(ga);
+  assert(f1->txCommit() == SUCCESS);
+  fprintf(stdout, "%s grew the region from %lu to %lu bytes\n",
+      argc > 1 ? argv[1] : "shm", initial, worker1->sb.get_limit());
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -0,0 +1,207 @@
+// Copyright (c) 2018 The GAM Authors
+//分布式哈希表(FarmHash)测试，两个worker，不需要RDMA设备
+//usage: farm_hash_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "farm_hash.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+#define VSIZE 16
+#define NKEYS 28
+#define NTHREADS 3
+#define NINSERTS 200
+#define NINCRS 100
+#define COUNTER_KEY 0xC0FFEE
+
+static void value_of(uint64_t key, int round, char* v) {
+  memset(v, 0, VSIZE);
+  snprintf(v, VSIZE, "%lu:%d", key, round);
+}
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  Worker* worker1 = new Worker(*conf);
+
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  Worker* worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  std::vector<uint16_t> wids = {(uint16_t)worker1->GetWorkerId(), (uint16_t)worker2->GetWorkerId()};
+  char v[VSIZE], rv[VSIZE];
+
+  //a small table, so that inserts have to displace entries
+  FarmHash h1(f1), h2(f2);
+  GAddr root = h1.Create(32, VSIZE, wids, 1);
+  assert(root);
+  assert(h2.Open(root) == 0);
+  assert(h2.GetValueSize() == VSIZE);
+
+  for (uint64_t k = 1; k <= NKEYS; k++) {
+    value_of(k, 0, v);
+    f1->txBegin();
+    assert(h1.Put(k, v, strlen(v) + 1) == 0);
+    assert(f1->txCommit() == SUCCESS);
+  }
+
+  //read back from the other worker, half of the buckets are remote
+  f2->txBegin();
+  for (uint64_t k = 1; k <= NKEYS; k++) {
+    value_of(k, 0, v);
+    assert(h2.Get(k, rv) == strlen(v) + 1);
+    assert(!strcmp(v, rv));
+  }
+  assert(h2.Get(NKEYS + 1, rv) == -1);
+  assert(f2->txCommit() == SUCCESS);
+
+  //update the odd keys and remove the even ones in one txn
+  f2->txBegin();
+  for (uint64_t k = 1; k <= NKEYS; k++) {
+    if (k % 2) {
+      value_of(k, 1, v);
+      assert(h2.Put(k, v, strlen(v) + 1) == 0);
+    } else {
+      assert(h2.Remove(k) == 0);
+    }
+  }
+  assert(h2.Remove(NKEYS + 1) == -1);
+  assert(f2->txCommit() == SUCCESS);
+
+  //bulk lookup of all of them and a missing one
+  uint64_t keys[NKEYS + 1];
+  char values[(NKEYS + 1) * VSIZE];
+  int lens[NKEYS + 1];
+  for (int i = 0; i <= NKEYS; i++) keys[i] = i + 1;
+  f1->txBegin();
+  assert(h1.MultiGet(NKEYS + 1, keys, values, lens) == NKEYS / 2);
+  assert(f1->txCommit() == SUCCESS);
+  for (int i = 0; i <= NKEYS; i++) {
+    if (keys[i] > NKEYS || keys[i] % 2 == 0) {
+      assert(lens[i] == -1);
+      continue;
+    }
+    value_of(keys[i], 1, v);
+    assert(lens[i] == strlen(v) + 1);
+    assert(!strcmp(v, values + i * VSIZE));
+  }
+
+  //a lookup conflicting with an update fails at commit
+  f1->txBegin();
+  assert(h1.Get(1, rv) > 0);
+  f2->txBegin();
+  value_of(1, 2, v);
+  assert(h2.Put(1, v, strlen(v) + 1) == 0);
+  assert(f2->txCommit() == SUCCESS);
+  assert(f1->txCommit() != SUCCESS);
+  fprintf(stdout, "hash basic test succeed\n");
+
+  //concurrent inserts and read-modify-writes of a counter from both workers
+  FarmHash h(f1);
+  root = h.Create(1024, sizeof(uint64_t), wids);
+  assert(root);
+  uint64_t zero = 0;
+  f1->txBegin();
+  assert(h.Put(COUNTER_KEY, &zero, sizeof(zero)) == 0);
+  assert(f1->txCommit() == SUCCESS);
+
+  Farm* fs[NTHREADS] = {f1, f2, new Farm(worker1)};
+  std::vector<std::thread> ts;
+  long start = get_time();
+  for (int t = 0; t < NTHREADS; t++) {
+    ts.emplace_back([&, t] {
+      FarmHash th(fs[t]);
+      assert(th.Open(root) == 0);
+      for (uint64_t i = 0; i < NINSERTS; i++) {
+        uint64_t k = (t + 1) * 100000 + i;
+        do {
+          fs[t]->txBegin();
+          assert(th.Put(k, &k, sizeof(k)) == 0);
+        } while (fs[t]->txCommit() != SUCCESS);
+      }
+      for (int i = 0; i < NINCRS; i++) {
+        uint64_t c;
+        do {
+          fs[t]->txBegin();
+          assert(th.Get(COUNTER_KEY, &c) == sizeof(c));
+          c++;
+          assert(th.Put(COUNTER_KEY, &c, sizeof(c)) == 0);
+        } while (fs[t]->txCommit() != SUCCESS);
+      }
+    });
+  }
+  for (auto& t : ts) t.join();
+  long end = get_time();
+
+  std::vector<uint64_t> all;
+  for (int t = 0; t < NTHREADS; t++)
+    for (uint64_t i = 0; i < NINSERTS; i++)
+      all.push_back((t + 1) * 100000 + i);
+  all.push_back(COUNTER_KEY);
+  std::vector<uint64_t> vals(all.size());
+  std::vector<int> ls(all.size());
+
+  FarmHash r2(f2);
+  assert(r2.Open(root) == 0);
+  long mstart = get_time();
+  f2->txBegin();
+  assert(r2.MultiGet(all.size(), all.data(), vals.data(), ls.data()) == all.size());
+  assert(f2->txCommit() == SUCCESS);
+  long mend = get_time();
+  for (int i = 0; i < NTHREADS * NINSERTS; i++)
+    assert(vals[i] == all[i]);
+  assert(vals.back() == NTHREADS * NINCRS);
+
+  long gstart = get_time();
+  f2->txBegin();
+  for (int i = 0; i < all.size(); i++)
+    assert(r2.Get(all[i], &vals[i]) == sizeof(uint64_t));
+  assert(f2->txCommit() == SUCCESS);
+  long gend = get_time();
+
+  fprintf(stdout, "%s hash concurrent test succeed in %ld us, %lu lookups: %ld us in bulk, %ld us one by one\n",
+      argc > 1 ? argv[1] : "shm", (end - start) / 1000, all.size(), (mend - mstart) / 1000, (gend - gstart) / 1000);
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2018 The GAM Authors
+//对象头布局测试：小对象之间只有对象头和大小类的取整，不需要RDMA设备
+//usage: farm_header_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+#include "kernel.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  //compact layout: nothing but the header and the size class rounding in front of/after an object
+  const int nobj = 2000, osz = 64;
+  std::vector<GAddr> objs(nobj);
+  f1->txBegin();
+  for (int i = 0; i < nobj; i++) {
+    objs[i] = f1->txAlloc(osz);
+    assert(objs[i]);
+    f1->txWrite(objs[i], (char*)&i, sizeof(int));
+  }
+  assert(f1->txCommit() == SUCCESS);
+  //the headers are read remotely as well
+  for (int i = 0; i < nobj; i += 97) {
+    int v = -1;
+    f2->txBegin();
+    assert(f2->txRead(objs[i], (char*)&v, sizeof(int)) == sizeof(int) && v == i);
+    f2->txCommit();
+  }
+  std::vector<GAddr> sorted = objs;
+  std::sort(sorted.begin(), sorted.end());
+  GAddr stride = sorted[1] - sorted[0];
+  for (int i = 1; i < nobj; i++) {
+    assert(sorted[i] % sizeof(version_t) == 0);
+    stride = std::min(stride, sorted[i] - sorted[i-1]);
+  }
+  assert(stride <= ALIGN(osz + FARM_OBJECT_HEADER_SIZE, 16));
+  f1->txBegin();
+  for (int i = 0; i < nobj; i++)
+    f1->txFree(objs[i]);
+  assert(f1->txCommit() == SUCCESS);
+  fprintf(stdout, "%s %d objects of %d bytes, %lu bytes apart\n",
+      argc > 1 ? argv[1] : "shm", nobj, osz, stride);
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The GAM Authors
+//大页和NUMA测试：worker的区域由大页备份(没有预留大页时退回THP)，不需要RDMA设备
+//usage: farm_hugepage_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  conf->hugepage = HUGEPAGE_2M;  //falls back to THP if no hugepages are reserved
+  conf->numa_node = 0;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  const char* backings[] = {"4KB", "THP", "2MB", "1GB"};
+  int backing = worker1->sb.get_backing();
+  assert(backing >= HUGEPAGE_THP && backing <= HUGEPAGE_2M);
+
+  //objects all over the hugepage backed region, written locally and read remotely
+  const int osz = 4000, nobj = 10000, ntx = 100;
+  std::vector<GAddr> objs(nobj);
+  for (int i = 0; i < nobj; i += ntx) {
+    f1->txBegin();
+    for (int j = i; j < i + ntx; j++) {
+      objs[j] = f1->txAlloc(osz);
+      assert(objs[j]);
+      f1->txWrite(objs[j], (char*)&j, sizeof(int));
+    }
+    assert(f1->txCommit() == SUCCESS);
+  }
+  for (int i = 0; i < nobj; i += 7) {
+    int v = -1;
+    f2->txBegin();
+    assert(f2->txRead(objs[i], (char*)&v, sizeof(int)) == sizeof(int) && v == i);
+    f2->txCommit();
+  }
+  for (int i = 0; i < nobj; i += ntx) {
+    f1->txBegin();
+    for (int j = i; j < i + ntx; j++)
+      f1->txFree(objs[j]);
+    assert(f1->txCommit() == SUCCESS);
+  }
+  fprintf(stdout, "%s region backed by %s pages succeed\n",
+      argc > 1 ? argv[1] : "shm", backings[backing]);
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -0,0 +1,167 @@
+// Copyright (c) 2018 The GAM Authors
+//工作节点键值存储(kv_put/kv_get及多键版本)测试，两个worker，不需要RDMA设备
+//usage: farm_kv_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+#define LARGE_SIZE (300 * 1024)  //takes tens of msgs
+#define NITEMS 64
+#define NKEYS 2000
+#define BATCH 100
+
+static void fill(char* buf, Size size, uint64_t seed) {
+  for (Size i = 0; i < size; i++) buf[i] = (char)(seed * 31 + i * 7);
+}
+
+static bool check(const char* buf, Size size, uint64_t seed) {
+  for (Size i = 0; i < size; i++)
+    if (buf[i] != (char)(seed * 31 + i * 7)) return false;
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  Worker* worker1 = new Worker(*conf);
+
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  Worker* worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  int w1 = worker1->GetWorkerId(), w2 = worker2->GetWorkerId();
+  char v[64], rv[64];
+
+  //small values, local and remote, and a missing key
+  strcpy(v, "local");
+  assert(f1->kv_put(1, v, strlen(v) + 1, w1) == strlen(v) + 1);
+  strcpy(v, "remote");
+  assert(f1->kv_put(2, v, strlen(v) + 1, w2) == strlen(v) + 1);
+  assert(f1->kv_get(1, rv, w1) == strlen("local") + 1 && !strcmp(rv, "local"));
+  assert(f1->kv_get(2, rv, w2) == strlen("remote") + 1 && !strcmp(rv, "remote"));
+  assert(f2->kv_get(2, rv, w2) == strlen("remote") + 1 && !strcmp(rv, "remote"));
+  assert(f2->kv_get(1, rv, w1) == strlen("local") + 1 && !strcmp(rv, "local"));
+  assert(f1->kv_get(3, rv, w2) == -1);
+  assert(f2->kv_get(3, rv, w2) == -1);
+
+  //overwrites: in place, smaller, and larger
+  strcpy(v, "remotE");
+  assert(f1->kv_put(2, v, strlen(v) + 1, w2) > 0);
+  assert(f1->kv_get(2, rv, w2) == strlen(v) + 1 && !strcmp(rv, v));
+  strcpy(v, "r");
+  assert(f1->kv_put(2, v, strlen(v) + 1, w2) > 0);
+  assert(f1->kv_get(2, rv, w2) == 2 && !strcmp(rv, "r"));
+  memset(v, 'x', sizeof(v) - 1);
+  v[sizeof(v) - 1] = 0;
+  assert(f1->kv_put(2, v, sizeof(v), w2) > 0);
+  assert(f2->kv_get(2, rv, w2) == sizeof(v) && !strcmp(rv, v));
+
+  //values larger than a msg, both ways
+  char* large = (char*)malloc(LARGE_SIZE);
+  char* rlarge = (char*)malloc(LARGE_SIZE);
+  fill(large, LARGE_SIZE, 10);
+  assert(f1->kv_put(10, large, LARGE_SIZE, w2) == LARGE_SIZE);
+  memset(rlarge, 0, LARGE_SIZE);
+  assert(f1->kv_get(10, rlarge, w2) == LARGE_SIZE && check(rlarge, LARGE_SIZE, 10));
+  memset(rlarge, 0, LARGE_SIZE);
+  assert(f2->kv_get(10, rlarge, w2) == LARGE_SIZE && check(rlarge, LARGE_SIZE, 10));
+  fill(large, LARGE_SIZE / 2, 11);
+  assert(f2->kv_put(10, large, LARGE_SIZE / 2, w2) == LARGE_SIZE / 2);
+  assert(f1->kv_get(10, rlarge, w2) == LARGE_SIZE / 2 && check(rlarge, LARGE_SIZE / 2, 11));
+  fprintf(stdout, "kv basic test succeed\n");
+
+  //many keys at once over both workers, some of them large
+  std::vector<KVItem> items(NITEMS);
+  std::vector<std::vector<char>> bufs(NITEMS);
+  for (int i = 0; i < NITEMS; i++) {
+    Size size = i % 16 == 0 ? LARGE_SIZE / 4 : 8 + i;
+    bufs[i].resize(size);
+    fill(bufs[i].data(), size, 100 + i);
+    items[i] = KVItem{100 + (uint64_t)i, i % 2 ? w2 : w1, -1, bufs[i].data(), size};
+  }
+  assert(f1->kv_put_many(items.data(), NITEMS) == NITEMS);
+  for (auto& it : items) assert(it.status == SUCCESS);
+
+  items.push_back(KVItem{99, w2, -1, nullptr, 0});  //missing
+  for (int i = 0; i < NITEMS; i++) {
+    memset(bufs[i].data(), 0, bufs[i].size());
+    items[i].size = 0;
+  }
+  assert(f2->kv_get_many(items.data(), items.size()) == NITEMS);
+  for (int i = 0; i < NITEMS; i++) {
+    assert(items[i].status == SUCCESS && items[i].size == bufs[i].size());
+    assert(check(bufs[i].data(), bufs[i].size(), 100 + i));
+  }
+  assert(items[NITEMS].status == NOT_EXIST);
+  fprintf(stdout, "kv multi-key test succeed\n");
+
+  //remote gets one by one and in batches
+  uint64_t val;
+  for (uint64_t k = 0; k < NKEYS; k++) {
+    val = k * k;
+    assert(f2->kv_put(1000 + k, &val, sizeof(val), w2) == sizeof(val));
+  }
+  long start = get_time();
+  for (uint64_t k = 0; k < NKEYS; k++) {
+    assert(f1->kv_get(1000 + k, &val, w2) == sizeof(val) && val == k * k);
+  }
+  long single = get_time() - start;
+
+  std::vector<uint64_t> vals(BATCH);
+  std::vector<KVItem> batch(BATCH);
+  start = get_time();
+  for (uint64_t k = 0; k < NKEYS; k += BATCH) {
+    for (int i = 0; i < BATCH; i++)
+      batch[i] = KVItem{1000 + k + i, w2, -1, &vals[i], 0};
+    assert(f1->kv_get_many(batch.data(), BATCH) == BATCH);
+    for (int i = 0; i < BATCH; i++)
+      assert(vals[i] == (k + i) * (k + i));
+  }
+  long batched = get_time() - start;
+  fprintf(stdout, "%s kv test succeed, %d remote gets: %ld us one by one, %ld us in batches of %d\n",
+      argc > 1 ? argv[1] : "shm", NKEYS, single / 1000, batched / 1000, BATCH);
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2018 The GAM Authors
+//大对象测试：超过ITEM_SIZE_MAX的对象按页从区间分配器分配并真正释放，不需要RDMA设备
+//usage: farm_large_object_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  //large local objects are allocated from and freed to the extent allocator
+  const osize_t lsz = 3 * 1024 * 1024;
+  std::vector<char> lbuf(lsz, 'l'), lread(lsz);
+  const size_t avail = worker1->sb.get_avail();
+  for (int i = 0; i < 4; i++) {
+    f1->txBegin();
+    GAddr la = f1->txAlloc(lsz);
+    assert(la);
+    f1->txWrite(la, lbuf.data(), lsz);
+    assert(f1->txCommit() == SUCCESS);
+    f1->txBegin();
+    assert(f1->txRead(la, lread.data(), lsz) == lsz);
+    assert(lread == lbuf);
+    f1->txFree(la);
+    assert(f1->txCommit() == SUCCESS);
+  }
+  assert(worker1->sb.get_avail() == avail);
+  fprintf(stdout, "large object succeed\n");
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -0,0 +1,131 @@
+// Copyright (c) 2018 The GAM Authors
+//加入集群测试：新worker并行建立连接，或在第一次使用时才连接其他worker，不需要RDMA设备
+//usage: farm_lazy_join_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  int sz = 1000;
+  char buf[sz];
+  for (int i = 0; i < sz; ++i) {
+    buf[i] = 'a';
+  }
+  buf[sz-1] = 0;
+  char mbuf[sz];
+
+  //a worker joining with lazy connections: the other workers are connected only when first used
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 2;
+  conf->no_node = 2;
+  conf->lazy_connect = true;
+  long jstart = get_time();
+  Worker* worker3 = new Worker(*conf);
+  long jend = get_time();
+  Farm* f3 = new Farm(worker3);
+  //Master tells the join to the others before it answers them
+  const uint64_t key = 1UL << 42;
+  f1->fetch_add(key, 1);
+  f2->fetch_add(key, 1);
+
+  //an object of each worker
+  GAddr objs[3];
+  Farm* fs[3] = {f1, f2, f3};
+  for (int i = 0; i < 3; i++) {
+    fs[i]->txBegin();
+    objs[i] = fs[i]->txAlloc(sz);
+    assert(sz == fs[i]->txWrite(objs[i], buf, sz));
+    assert(fs[i]->txCommit() == SUCCESS);
+  }
+  assert(WID(objs[2]) == worker3->GetWorkerId());
+
+  //every worker reads the others' objects at the same time,
+  //so that worker3 and the others connect to each other both ways at once
+  std::vector<std::thread> rs;
+  for (int i = 0; i < 3; i++) {
+    rs.emplace_back([&, i] {
+      for (int j = 0; j < 3; j++) {
+        if (i == j) continue;
+        char rbuf[sz];
+        memset(rbuf, 0, sz);
+        fs[i]->txBegin();
+        assert(sz == fs[i]->txRead(objs[j], rbuf, sz));
+        assert(!strcmp(buf, rbuf));
+        assert(fs[i]->txCommit() == SUCCESS);
+      }
+    });
+  }
+  for (auto& t : rs) t.join();
+
+  //remote alloc from worker3 on worker1
+  memset(mbuf, 0, sz);
+  f3->txBegin();
+  GAddr a5 = f3->txAlloc(sz, EMPTY_GLOB(WID(objs[0])));
+  assert(WID(a5) == WID(objs[0]));
+  assert(sz == f3->txWrite(a5, buf, sz));
+  assert(f3->txCommit() == SUCCESS);
+  f1->txBegin();
+  assert(sz == f1->txRead(a5, mbuf, sz));
+  assert(!strcmp(buf, mbuf));
+  assert(f1->txCommit() == SUCCESS);
+  fprintf(stdout, "%s lazy join succeed in %ld us\n", argc > 1 ? argv[1] : "shm", (jend - jstart) / 1000);
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
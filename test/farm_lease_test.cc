@@ -0,0 +1,104 @@
+// Copyright (c) 2018 The GAM Authors
+//租约测试：远程的小对象分配由本地租到的地址区间完成，空闲的租约自动归还，不需要RDMA设备
+//usage: farm_lease_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  //population: small remote allocations are served from leases,
+  //the ones above FARM_LEASE_MAX_SIZE cost a round trip each
+  const int ntx = 100;
+  const GAddr hint = EMPTY_GLOB(worker1->GetWorkerId());
+  std::vector<GAddr> pop(20000);
+  size_t avail0 = worker1->sb.get_avail();
+  for (osize_t psz: {64, FARM_LEASE_MAX_SIZE + 1}) {
+    const int npop = psz > FARM_LEASE_MAX_SIZE ? 2000 : pop.size();
+    long alloc_time = 0;
+    for (int i = 0; i < npop; i += ntx) {
+      f2->txBegin();
+      long start = get_time();
+      for (int j = i; j < i + ntx; j++) {
+        pop[j] = f2->txAlloc(psz, hint);
+        assert(pop[j] && WID(pop[j]) == worker1->GetWorkerId());
+      }
+      alloc_time += get_time() - start;
+      for (int j = i; j < i + ntx; j++)
+        f2->txWrite(pop[j], (char*)&j, sizeof(int));
+      assert(f2->txCommit() == SUCCESS);
+    }
+    for (int i = 0; i < npop; i += 997) {
+      int v = -1;
+      f1->txBegin();
+      assert(f1->txRead(pop[i], (char*)&v, sizeof(int)) == sizeof(int) && v == i);
+      f1->txCommit();
+    }
+    for (int i = 0; i < npop; i += ntx) {
+      f2->txBegin();
+      for (int j = i; j < i + ntx; j++)
+        f2->txFree(pop[j]);
+      assert(f2->txCommit() == SUCCESS);
+    }
+    fprintf(stdout, "%s remote alloc latency of %d bytes = %ld ns\n",
+        argc > 1 ? argv[1] : "shm", psz, alloc_time / npop);
+  }
+  //the rest of the idle lease is given back by worker2 on its own, without a txn
+  sleep(2);
+  assert(worker1->sb.get_avail() == avail0);
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
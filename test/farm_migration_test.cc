@@ -0,0 +1,250 @@
+// Copyright (c) 2018 The GAM Authors
+//弹性成员测试：新worker加入后接管已有worker的区域(在线迁移，同时有并发的事务)，然后原worker退出，数据仍可读写；存有KV的worker不能退出；不需要RDMA设备
+//usage: farm_migration_test [shm|tcp] (default: shm)
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+#define NWORKERS 3  //and one more joins
+#define OBJ_SIZE 1024
+#define NOBJS 24000  //about 24MB, two regions
+#define NCOUNTERS 16
+#define NINCS 300  //per thread
+
+static Conf* NewConf(int transport, int level, int i) {
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += i;
+  conf->no_node = NWORKERS;
+  return conf;
+}
+
+//the first 8 bytes of the object, -1 if it cannot be read
+static long ReadValue(Farm* f, GAddr a) {
+  char buf[OBJ_SIZE];
+  for (;;) {
+    f->txBegin();
+    if (f->txRead(a, buf, OBJ_SIZE) != OBJ_SIZE) {
+      f->txAbort();
+      return -1;
+    }
+    if (f->txCommit() == SUCCESS) return *(long*)buf;
+  }
+}
+
+static void Increment(Farm* f, GAddr a) {
+  char buf[OBJ_SIZE];
+  for (;;) {
+    f->txBegin();
+    if (f->txRead(a, buf, OBJ_SIZE) != OBJ_SIZE) {
+      //stale owner, the retry goes to the new one
+      f->txAbort();
+      continue;
+    }
+    (*(long*)buf)++;
+    f->txWrite(a, buf, OBJ_SIZE);
+    if (f->txCommit() == SUCCESS) return;
+  }
+}
+
+static void CheckAll(Farm* f, std::vector<GAddr>& objs, std::vector<long>& expected) {
+  for (size_t i = 0; i < objs.size(); i++) {
+    long v = ReadValue(f, objs[i]);
+    if (v != expected[i]) {
+      fprintf(stderr, "object %lx: %ld, expected %ld\n", objs[i], v, expected[i]);
+      assert(false);
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = NWORKERS;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  Worker* workers[NWORKERS + 1];
+  for (int i = 0; i < NWORKERS; i++) workers[i] = new Worker(*NewConf(transport, level, i));
+
+  Farm* fs[NWORKERS + 1];
+  for (int i = 0; i < NWORKERS; i++) fs[i] = new Farm(workers[i]);
+  std::vector<std::thread> ths;
+  for (int i = 1; i < NWORKERS; i++) ths.emplace_back([&, i] {assert(fs[i]->barrier() == 0);});
+  assert(fs[0]->barrier() == 0);
+  for (auto& th : ths) th.join();
+  ths.clear();
+
+  //worker 1 fills two regions of its own, object i holds i
+  int w1 = workers[0]->GetWorkerId();
+  std::vector<GAddr> objs;
+  std::vector<long> expected;
+  char buf[OBJ_SIZE] = {0};
+  for (int i = 0; i < NOBJS; i += 100) {
+    fs[0]->txBegin();
+    for (int j = i; j < i + 100; j++) {
+      GAddr a = fs[0]->txAlloc(OBJ_SIZE, EMPTY_GLOB(w1));
+      assert(a);
+      *(long*)buf = j;
+      fs[0]->txWrite(a, buf, OBJ_SIZE);
+      objs.push_back(a);
+      expected.push_back(j);
+    }
+    assert(fs[0]->txCommit() == SUCCESS);
+  }
+  std::vector<GAddr> counters;
+  for (int i = 0; i < NCOUNTERS; i++) counters.push_back(objs[i * (NOBJS / NCOUNTERS)]);
+
+  //a new worker joins and takes over a region of worker 1, while workers 2 and 3 update it
+  workers[NWORKERS] = new Worker(*NewConf(transport, level, NWORKERS));
+  fs[NWORKERS] = new Farm(workers[NWORKERS]);
+  int w4 = workers[NWORKERS]->GetWorkerId();
+  for (int i = 1; i < NWORKERS; i++) {
+    ths.emplace_back([&, i] {
+      Farm f(workers[i]);
+      for (int k = 0; k < NINCS; k++) Increment(&f, counters[k % NCOUNTERS]);
+    });
+  }
+  size_t avail1 = workers[0]->sb.get_avail();
+  long start = get_time();
+  int moved = fs[NWORKERS]->take_over(w1, 1);
+  fprintf(stdout, "worker %d took over %d region(s) of worker %d in %ld ms\n",
+      w4, moved, w1, (get_time() - start) / 1000000);
+  assert(moved == 1);
+  for (auto& th : ths) th.join();
+  ths.clear();
+  for (int i = 1; i < NWORKERS; i++)
+    for (int k = 0; k < NINCS; k++)
+      expected[(k % NCOUNTERS) * (NOBJS / NCOUNTERS)]++;
+
+  int here = 0;
+  for (GAddr a : objs)
+    if (workers[NWORKERS]->IsLocal(a)) here++;
+  fprintf(stdout, "%d of %d objects are at worker %d\n", here, NOBJS, w4);
+  assert(here > 0 && here < NOBJS);
+
+  //all the workers see the same data, wherever it is now
+  for (int i = 0; i <= NWORKERS; i++) CheckAll(fs[i], objs, expected);
+
+  //the chunks of the region moved away are free again at worker 1
+  size_t freed = workers[0]->sb.get_avail() - avail1;
+  fprintf(stdout, "%lu bytes are free again at worker %d\n", freed, w1);
+  assert(freed >= (size_t)here * OBJ_SIZE);
+
+  //and given out again under the next reuse epoch of their memory, so that the new objects stay at worker 1
+  std::vector<GAddr> fresh;
+  std::vector<long> fresh_expected;
+  int reused = 0;
+  for (int i = 0; i < here; i += 100) {
+    fs[0]->txBegin();
+    for (int j = i; j < i + 100; j++) {
+      GAddr a = fs[0]->txAlloc(OBJ_SIZE, EMPTY_GLOB(w1));
+      assert(a && workers[0]->IsLocal(a) && !workers[NWORKERS]->IsLocal(a));
+      if (OFF(a) >> EPOCH_SHIFT) reused++;
+      *(long*)buf = -j;
+      fs[0]->txWrite(a, buf, OBJ_SIZE);
+      fresh.push_back(a);
+      fresh_expected.push_back(-j);
+    }
+    assert(fs[0]->txCommit() == SUCCESS);
+  }
+  fprintf(stdout, "%d of %lu new objects reuse the memory of the region moved away\n", reused, fresh.size());
+  assert(reused > 0);
+  for (int i = 0; i <= NWORKERS; i++) {
+    CheckAll(fs[i], objs, expected);
+    CheckAll(fs[i], fresh, fresh_expected);
+  }
+
+  //an object freed at its new owner goes back to its slab
+  size_t f = 0;
+  while (!workers[NWORKERS]->IsLocal(objs[f]) || std::count(counters.begin(), counters.end(), objs[f])) f++;
+  size_t avail4 = workers[NWORKERS]->sb.get_avail();
+  fs[NWORKERS]->txBegin();
+  fs[NWORKERS]->txFree(objs[f]);
+  assert(fs[NWORKERS]->txCommit() == SUCCESS);
+  assert(workers[NWORKERS]->sb.get_avail() >= avail4 + OBJ_SIZE);
+  expected[f] = -1;
+  assert(ReadValue(fs[1], objs[f]) == -1);
+
+  //and update it concurrently without losing any update
+  for (int i = 0; i <= NWORKERS; i++) {
+    ths.emplace_back([&, i] {
+      Farm f(workers[i]);
+      for (int k = 0; k < NINCS; k++) Increment(&f, counters[(k + i) % NCOUNTERS]);
+    });
+  }
+  for (auto& th : ths) th.join();
+  ths.clear();
+  for (int i = 0; i <= NWORKERS; i++)
+    for (int k = 0; k < NINCS; k++)
+      expected[((k + i) % NCOUNTERS) * (NOBJS / NCOUNTERS)]++;
+  for (int i = 0; i <= NWORKERS; i++) CheckAll(fs[i], objs, expected);
+
+  //the KV pairs are not moved, so that a worker holding some cannot leave
+  Worker* kw = new Worker(*NewConf(transport, level, NWORKERS + 1));
+  Farm* kf = new Farm(kw);
+  int wk = kw->GetWorkerId();
+  long kv = 42;
+  assert(kf->kv_put(1, &kv, sizeof(kv), wk) == sizeof(kv));
+  assert(kf->leave() == -1);
+  kv = 0;
+  assert(fs[1]->kv_get(1, &kv, wk) == sizeof(kv) && kv == 42);
+
+  //worker 1 leaves: its regions go to the others, and it takes no more allocations
+  start = get_time();
+  assert(fs[0]->leave() == 0);
+  fprintf(stdout, "worker %d left in %ld ms\n", w1, (get_time() - start) / 1000000);
+  for (GAddr a : objs) assert(!workers[0]->IsLocal(a));
+  for (GAddr a : fresh) assert(!workers[0]->IsLocal(a));
+
+  for (int i = 1; i <= NWORKERS; i++) {
+    ths.emplace_back([&, i] {
+      Farm f(workers[i]);
+      for (int k = 0; k < NINCS; k++) Increment(&f, counters[(k + i) % NCOUNTERS]);
+    });
+  }
+  for (auto& th : ths) th.join();
+  for (int i = 1; i <= NWORKERS; i++)
+    for (int k = 0; k < NINCS; k++)
+      expected[((k + i) % NCOUNTERS) * (NOBJS / NCOUNTERS)]++;
+  for (int i = 1; i <= NWORKERS; i++) {
+    CheckAll(fs[i], objs, expected);
+    CheckAll(fs[i], fresh, fresh_expected);
+  }
+
+  GAddr a;
+  fs[1]->txBegin();
+  assert((a = fs[1]->txAlloc(OBJ_SIZE, EMPTY_GLOB(w1))));
+  assert(WID(a) != w1);
+  fs[1]->txWrite(a, buf, OBJ_SIZE);
+  assert(fs[1]->txCommit() == SUCCESS);
+
+  fprintf(stdout, "%s migration test succeed\n", argc > 1 ? argv[1] : "shm");
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
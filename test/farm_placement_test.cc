@@ -0,0 +1,138 @@
+// Copyright (c) 2018 The GAM Authors
+//无地址提示的分配放置策略(本地优先、两选一、亲和组)测试，三个worker，不需要RDMA设备
+//usage: farm_placement_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include <map>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+#define NWORKERS 3
+#define NALLOCS 600
+#define NGROUPS 64
+#define OBJ_SIZE 256
+
+//NALLOCS objects allocated by f, NALLOCS / 10 per txn, counted per worker
+static std::map<int, int> alloc_spread(Farm* f) {
+  std::map<int, int> spread;
+  char buf[OBJ_SIZE] = "placed";
+  for (int i = 0; i < NALLOCS; i += NALLOCS / 10) {
+    f->txBegin();
+    for (int j = 0; j < NALLOCS / 10; j++) {
+      GAddr a = f->txAlloc(OBJ_SIZE);
+      assert(a);
+      f->txWrite(a, buf, OBJ_SIZE);  //kept after the commit
+      spread[WID(a)]++;
+    }
+    assert(f->txCommit() == SUCCESS);
+  }
+  return spread;
+}
+
+static void print_spread(const char* name, std::map<int, int>& spread) {
+  fprintf(stdout, "%s:", name);
+  for (auto& e : spread) fprintf(stdout, " worker %d %d", e.first, e.second);
+  fprintf(stdout, "\n");
+}
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = NWORKERS;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker 0: local (the default); worker 1: two choices; worker 2: local-first
+  //with a threshold it is always below, so that it allocates elsewhere
+  Worker* workers[NWORKERS];
+  for (int i = 0; i < NWORKERS; i++) {
+    conf = new Conf();
+    conf->loglevel = level;
+    conf->transport = transport;
+    conf->size = 1024 * 1024 * 128L;
+    conf->worker_port += i;
+    conf->no_node = NWORKERS;
+    if (i == 1) conf->alloc_policy = ALLOC_TWO_CHOICES;
+    if (i == 2) {
+      conf->alloc_policy = ALLOC_LOCAL_FIRST;
+      conf->cache_th = 1.0;
+    }
+    workers[i] = new Worker(*conf);
+  }
+
+  Farm* fs[NWORKERS];
+  for (int i = 0; i < NWORKERS; i++) fs[i] = new Farm(workers[i]);
+  std::vector<std::thread> ths;
+  for (int i = 1; i < NWORKERS; i++) ths.emplace_back([&, i] {assert(fs[i]->barrier() == 0);});
+  assert(fs[0]->barrier() == 0);
+  for (auto& th : ths) th.join();
+  sleep(1);  //the mem stats of all the workers are broadcast by now
+
+  int wids[NWORKERS];
+  for (int i = 0; i < NWORKERS; i++) wids[i] = workers[i]->GetWorkerId();
+
+  //local: all of them here while there is room
+  std::map<int, int> spread = alloc_spread(fs[0]);
+  print_spread("local", spread);
+  assert(spread.size() == 1 && spread[wids[0]] == NALLOCS);
+
+  //below the threshold: over the other workers, and not all at the same one
+  spread = alloc_spread(fs[2]);
+  print_spread("local-first, below cache_th", spread);
+  assert(!spread.count(wids[2]));
+  assert(spread[wids[0]] > NALLOCS / 10 && spread[wids[1]] > NALLOCS / 10);
+
+  //two choices: over all the workers, this one included
+  spread = alloc_spread(fs[1]);
+  print_spread("two choices", spread);
+  for (int i = 0; i < NWORKERS; i++) assert(spread[wids[i]] > NALLOCS / 10);
+
+  //affinity groups: a group is at the same worker whoever allocates it, and
+  //the groups are spread over the workers
+  std::map<int, int> groups;
+  for (uint64_t g = 0; g < NGROUPS; g++) {
+    int wid = -1;
+    for (int i = 0; i < NWORKERS; i++) {
+      fs[i]->txBegin();
+      GAddr a = fs[i]->txAllocGroup(OBJ_SIZE, g);
+      assert(a);
+      assert(wid == -1 || WID(a) == wid);
+      wid = WID(a);
+      fs[i]->txAbort();
+    }
+    groups[wid]++;
+  }
+  print_spread("affinity groups", groups);
+  for (int i = 0; i < NWORKERS; i++) assert(groups[wids[i]] > NGROUPS / 10);
+
+  //an address still takes the object to its worker
+  fs[0]->txBegin();
+  GAddr a = fs[0]->txAlloc(OBJ_SIZE, EMPTY_GLOB(wids[2]));
+  assert(a && WID(a) == wids[2]);
+  fs[0]->txAbort();
+
+  fprintf(stdout, "%s placement test succeed\n", argc > 1 ? argv[1] : "shm");
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2018 The GAM Authors
+//远程读测试：单边读与本地写并发时不会读到不完整的对象，不需要RDMA设备
+//usage: farm_remote_read_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <string>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker1);
+  Farm* f3 = new Farm(worker2);
+  std::thread bt([&] {assert(f3->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  //remote reads racing with local writes: every version of the object is
+  //filled with a single char, so a torn read shows up as mixed chars. The
+  //object spans many cache lines, so that the copies of the writer and the
+  //readers overlap often
+  const int csz = 4096;
+  f1->txBegin();
+  GAddr ca = f1->txAlloc(csz);
+  std::string cbuf(csz, 'a');
+  f1->txWrite(ca, &cbuf[0], csz);
+  assert(f1->txCommit() == SUCCESS);
+  std::atomic<bool> stop(false);
+  std::thread writer([&]() {
+    std::string wbuf(csz, 'a');
+    char c = 'a';
+    while (!stop) {
+      c = c == 'z' ? 'a' : c + 1;
+      memset(&wbuf[0], c, csz);
+      f2->txBegin();
+      f2->txWrite(ca, &wbuf[0], csz);
+      f2->txCommit();
+    }
+  });
+  for (int i = 0; i < 10000; i++) {
+    f3->txBegin();
+    assert(csz == f3->txRead(ca, &cbuf[0], csz));
+    for (int j = 1; j < csz; j++)
+      assert(cbuf[j] == cbuf[0]);
+    f3->txCommit();
+  }
+  stop = true;
+  writer.join();
+  fprintf(stdout, "concurrent remote read succeed\n");
+
+  const int sz = 1000;
+  char buf[sz];
+  f1->txBegin();
+  GAddr a = f1->txAlloc(sz);
+  f1->txWrite(a, buf, sz);
+  assert(f1->txCommit() == SUCCESS);
+  long start = get_time();
+  int it = 100000;
+  for (int i = 0; i < it; i++) {
+    f3->txBegin();
+    f3->txRead(a, buf, sz);
+    f3->txCommit();
+  }
+  long end = get_time();
+  fprintf(stdout, "%s remote read latency = %ld ns\n",
+      argc > 1 ? argv[1] : "shm", (end-start)/it);
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
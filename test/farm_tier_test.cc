@@ -0,0 +1,132 @@
+// Copyright (c) 2018 The GAM Authors
+//二级存储测试：冷对象被移到worker的tier文件，本地或远程读时再移回来，不需要RDMA设备
+//usage: farm_tier_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include <string>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  conf->tier_path = "/tmp/farm_tier_" + std::to_string(getpid());
+  conf->tier_th = 1;  //nothing is moved out until the objects are written
+  conf->tier_interval = 10;
+  Conf* conf2 = conf;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  //second tier: the cold objects of worker2 are moved to its tier file,
+  //and come back when they are read locally or remotely
+  const int tsz = 8000, ntier = 8;
+  std::vector<char> tread(tsz);
+  std::vector<std::vector<char>> tbuf;
+  GAddr tobjs[ntier];
+  f2->txBegin();
+  for (int i = 0; i < ntier; i++) {
+    tbuf.emplace_back(tsz, 'A' + i);
+    tobjs[i] = f2->txAlloc(tsz);
+    assert(tobjs[i]);
+    f2->txWrite(tobjs[i], tbuf[i].data(), tsz);
+  }
+  assert(f2->txCommit() == SUCCESS);
+  auto demoted = [&](GAddr a) {return worker2->FarmTierDemoted((char*)worker2->ToLocal(a));};
+  conf2->tier_th = 0;
+  for (int t = 0; t < 500 && !std::all_of(tobjs, tobjs + ntier, demoted); t++)
+    usleep(10000);
+  conf2->tier_th = 1;
+  usleep(100000);  //let the last pass finish
+  assert(std::all_of(tobjs, tobjs + ntier, demoted));
+  const size_t tiered = worker2->tier->GetObjects();
+  assert(tiered >= ntier && worker2->tier->GetBytes() >= (size_t)ntier * tsz);
+
+  //remote read: the one-sided read finds the tombstone and asks the owner
+  f1->txBegin();
+  assert(f1->txRead(tobjs[0], tread.data(), tsz) == tsz);
+  assert(tread == tbuf[0]);
+  assert(f1->txCommit() == SUCCESS);
+  assert(!demoted(tobjs[0]));
+  //local read
+  f2->txBegin();
+  assert(f2->txRead(tobjs[1], tread.data(), tsz) == tsz);
+  assert(tread == tbuf[1]);
+  assert(f2->txCommit() == SUCCESS);
+  assert(!demoted(tobjs[1]));
+  //read through, as done when a txn holds the object
+  version_t tv;
+  std::string tdata;
+  assert(worker2->FarmTierRead((char*)worker2->ToLocal(tobjs[2]), tv, tdata) == 1);
+  assert(tv && tdata == std::string(tbuf[2].begin(), tbuf[2].end()));
+  assert(demoted(tobjs[2]));
+  //write over a demoted object
+  std::fill(tbuf[3].begin(), tbuf[3].end(), 'w');
+  f1->txBegin();
+  f1->txWrite(tobjs[3], tbuf[3].data(), tsz);
+  assert(f1->txCommit() == SUCCESS);
+  assert(!demoted(tobjs[3]));
+  f2->txBegin();
+  assert(f2->txRead(tobjs[3], tread.data(), tsz) == tsz);
+  assert(tread == tbuf[3]);
+  assert(f2->txCommit() == SUCCESS);
+  assert(worker2->tier->GetObjects() == tiered - 3);
+  //free the demoted ones
+  f2->txBegin();
+  for (int i = 0; i < ntier; i++)
+    f2->txFree(tobjs[i]);
+  assert(f2->txCommit() == SUCCESS);
+  assert(worker2->tier->GetObjects() == tiered - ntier);
+  fprintf(stdout, "%s second tier succeed, %lu objects moved out\n",
+      argc > 1 ? argv[1] : "shm", tiered);
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
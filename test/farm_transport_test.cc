@@ -0,0 +1,133 @@
+// Copyright (c) 2018 The GAM Authors
+//在非RDMA传输后端上运行的读写测试，不需要RDMA设备
+//usage: farm_transport_test [shm|tcp] (default: shm)
+
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include "structure.h"
+#include "worker.h"
+#include "settings.h"
+#include "master.h"
+#include "farm.h"
+#include "gallocator.h"
+#include "log.h"
+#include "util.h"
+
+int main(int argc, char* argv[]) {
+  int level = LOG_WARNING;
+  int transport = TRANSPORT_SHM;
+  if (argc > 1 && !strcmp(argv[1], "tcp")) {
+    transport = TRANSPORT_TCP;
+  } else if (argc > 1 && strcmp(argv[1], "shm")) {
+    fprintf(stderr, "usage: %s [shm|tcp]\n", argv[0]);
+    return 1;
+  }
+
+  //master
+  Conf* conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  GAllocFactory::SetConf(conf);
+  Master* master = new Master(*conf);
+
+  //worker1
+  Worker *worker1, *worker2;
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->no_node = 2;
+  worker1 = new Worker(*conf);
+
+  //worker2
+  conf = new Conf();
+  conf->loglevel = level;
+  conf->transport = transport;
+  conf->size = 1024 * 1024 * 128L;
+  conf->worker_port += 1;
+  conf->no_node = 2;
+  worker2 = new Worker(*conf);
+
+  Farm* f1 = new Farm(worker1);
+  Farm* f2 = new Farm(worker2);
+  std::thread bt([&] {assert(f2->barrier() == 0);});
+  assert(f1->barrier() == 0);
+  bt.join();
+
+  int sz = 1000;
+  char buf[sz];
+  for (int i = 0; i < sz; ++i) {
+    buf[i] = 'a';
+  }
+  buf[sz-1] = 0;
+  char mbuf[sz];
+  GAddr a2, a3;
+
+  //local txn
+  memset(mbuf, 0, sz);
+  f1->txBegin();
+  a3 = f1->txAlloc(sz);
+  f1->txWrite(a3, buf, sz);
+  f1->txRead(a3, mbuf, sz);
+  assert(!strcmp(buf, mbuf));
+  assert(f1->txCommit() == SUCCESS);
+
+  //remote read of an object written by the other worker
+  memset(mbuf, 0, sz);
+  f2->txBegin();
+  assert(sz == f2->txRead(a3, mbuf, sz));
+  assert(!strcmp(buf, mbuf));
+  assert(f2->txCommit() == SUCCESS);
+
+  //remote write
+  f2->txBegin();
+  a2 = f2->txAlloc(sz);
+  assert(sz == f2->txWrite(a2, buf, sz));
+  assert(f2->txCommit() == SUCCESS);
+
+  memset(mbuf, 0, sz);
+  f1->txBegin();
+  assert(sz == f1->txRead(a2, mbuf, sz));
+  assert(!strcmp(buf, mbuf));
+  mbuf[0] = 'b';
+  assert(sz == f1->txWrite(a2, mbuf, sz));
+  assert(f1->txCommit() == SUCCESS);
+
+  memset(mbuf, 0, sz);
+  f2->txBegin();
+  assert(sz == f2->txRead(a2, mbuf, sz));
+  assert(mbuf[0] == 'b' && !strcmp(buf+1, mbuf+1));
+  assert(f2->txCommit() == SUCCESS);
+
+  int vbuf;
+  for (int i = 0; i < 1000; i++) {
+    vbuf = 0;
+    f1->kv_put(i, &i, sizeof(int), i%2+1);
+    f1->kv_get(i, &vbuf, i%2+1);
+    epicAssert(i == vbuf);
+
+    vbuf = 0;
+    f2->kv_get(i, &vbuf, i%2+1);
+    epicAssert(i == vbuf);
+  }
+  fprintf(stdout, "put/get succeed\n");
+
+  int it = 100000;
+  long start = get_time();
+  for (int i = 0; i < it; i++) {
+    f1->kv_put(i, &i, sizeof(int), i%2+1);
+    f1->kv_get(i, &vbuf, i%2+1);
+    epicAssert(i == vbuf);
+  }
+  long end = get_time();
+  fprintf(stdout, "%s put/get throughput = %lf, latency = %ld ns\n",
+      argc > 1 ? argv[1] : "shm",
+      (double)it/((double)(end-start)/1000/1000/1000)*2, (end-start)/it/2);
+
+  epicLog(LOG_WARNING, "test done");
+  return 0;
+}
@@ -0,0 +1,246 @@
+// Copyright (c) 2018 The GAM Authors
+//多线程slab分配/释放微基准，报告随线程数的扩展性
+//usage: slab_benchmark [max_threads] (default: 8)
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <thread>
+#include <algorithm>
+#include <vector>
+#include "slabs.h"
+#include "structure.h"
+#include "gallocator.h"
+#include "kernel.h"
+#include "log.h"
+#include "util.h"
+
+#define SLAB_BENCH_MEM (1024 * 1024 * 1024L)
+#define SLAB_BENCH_ROUNDS 20000
+#define SLAB_BENCH_BATCH 64  //objects allocated before they are freed
+#define SLAB_BENCH_MAX_OBJ 2048
+#define SLAB_BENCH_NOBJ 1000000
+#define SLAB_BENCH_OBJ_SIZE 100
+#define SLAB_BENCH_MOVER_MEM (256 * 1024 * 1024L)
+#define SLAB_BENCH_MOVER_OBJ_SIZE 2000
+#define SLAB_BENCH_READ_MEM (512 * 1024 * 1024L)
+#define SLAB_BENCH_READ_OBJ_SIZE 4000
+#define SLAB_BENCH_READS 10000000
+
+static void print_class_stats(SlabAllocator& sb, const char* when) {
+  for (auto& c : sb.get_class_stats()) {
+    if (!c.used && !c.moved && c.pages <= 1) continue;
+    fprintf(stdout, "%s: class %u (%u bytes): %u pages, %lu used, %lu free, "
+        "%lu cached, %u pages moved\n", when, c.id, c.size, c.pages,
+        c.used, c.free, c.cached, c.moved);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+  Conf* conf = new Conf();
+  conf->loglevel = LOG_WARNING;
+  GAllocFactory::SetConf(conf);
+
+  SlabAllocator sb;
+  assert(sb.slabs_init(SLAB_BENCH_MEM, 1.25, true));
+  assert(sb.get_avail() == SLAB_BENCH_MEM);
+
+  double base = 0;
+  for (int nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+    std::vector<std::thread> ths;
+    long start = get_time();
+    for (int t = 0; t < nthreads; t++) {
+      ths.emplace_back([&sb, t]() {
+        unsigned int seed = t;
+        void* objs[SLAB_BENCH_BATCH];
+        for (int r = 0; r < SLAB_BENCH_ROUNDS; r++) {
+          for (int i = 0; i < SLAB_BENCH_BATCH; i++) {
+            size_t size = rand_r(&seed) % SLAB_BENCH_MAX_OBJ + 1;
+            objs[i] = sb.sb_malloc(size);
+            assert(objs[i]);
+            *(char*)objs[i] = t;
+          }
+          for (int i = 0; i < SLAB_BENCH_BATCH; i++) {
+            assert(*(char*)objs[i] == t);
+            sb.sb_free(objs[i]);
+          }
+        }
+      });
+    }
+    for (auto& th: ths) th.join();
+    long end = get_time();
+
+    //all the chunks cached by the exited threads are given back
+    assert(sb.get_avail() == SLAB_BENCH_MEM);
+
+    double ops = (double)nthreads * SLAB_BENCH_ROUNDS * SLAB_BENCH_BATCH * 2;
+    double tput = ops / ((double)(end - start) / 1000 / 1000 / 1000);
+    if (nthreads == 1) base = tput;
+    fprintf(stdout, "%d threads: %.0f alloc+free ops/s (%.2fx)\n",
+        nthreads, tput, tput / base);
+  }
+  //metadata and free latency with many small objects
+  std::vector<void*> objs(SLAB_BENCH_NOBJ);
+  for (int i = 0; i < SLAB_BENCH_NOBJ; i++) {
+    objs[i] = sb.sb_malloc(SLAB_BENCH_OBJ_SIZE);
+    assert(objs[i] && sb.get_size(objs[i]) == SLAB_BENCH_OBJ_SIZE);
+  }
+  fprintf(stdout, "metadata for %d objects of %d bytes = %lu bytes\n",
+      SLAB_BENCH_NOBJ, SLAB_BENCH_OBJ_SIZE, sb.get_metadata());
+  std::random_shuffle(objs.begin(), objs.end());
+  long start = get_time();
+  for (int i = 0; i < SLAB_BENCH_NOBJ; i++)
+    sb.sb_free(objs[i]);
+  long end = get_time();
+  for (int i = 0; i < SLAB_BENCH_NOBJ; i++)
+    assert(sb.is_free(objs[i]));
+  fprintf(stdout, "free latency = %ld ns\n", (end - start) / SLAB_BENCH_NOBJ);
+
+  //cache-line aligned objects take the aligned classes instead of whole blocks
+  for (size_t size = 16; size < BLOCK_SIZE; size += 40) {
+    void* p = sb.sb_aligned_malloc(size, HARDWARE_CACHE_LINE);
+    assert(p && (uintptr_t)p % HARDWARE_CACHE_LINE == 0);
+    assert(sb.get_chunk_size(p) == ALIGN(size, HARDWARE_CACHE_LINE));
+    sb.sb_free(p);
+  }
+  //and above BLOCK_SIZE, at most a growth factor bigger; they are freed and
+  //realloc'ed by the class of their page
+  for (size_t size = BLOCK_SIZE - 8; size < 64 * BLOCK_SIZE; size += 328) {
+    for (size_t block : {(size_t)HARDWARE_CACHE_LINE, (size_t)BLOCK_SIZE}) {
+      void* p = sb.sb_aligned_malloc(size, block);
+      assert(p && (uintptr_t)p % block == 0);
+      assert(sb.get_chunk_size(p) <= ALIGN(size, block) * 5 / 4 + block);
+      assert(!sb.is_free(p));
+      memset(p, 1, size);
+      void* q = sb.sb_aligned_malloc(size, block);
+      q = sb.sb_realloc(q, size + BLOCK_SIZE);
+      assert(q);
+      assert(sb.sb_free(p) == ALIGN(size, block));
+      assert(sb.is_free(p));
+      sb.sb_free(q);
+    }
+  }
+  fprintf(stdout, "aligned allocation succeed\n");
+
+  //large objects: freed extents are coalesced and reused
+  SlabAllocator::ExtentStats st = sb.get_extent_stats();
+  size_t unused = st.unused_pages;
+  const int nlarge = 64;
+  std::vector<void*> large(nlarge);
+  for (int r = 0; r < 10; r++) {
+    for (int i = 0; i < nlarge; i++) {
+      size_t size = ITEM_SIZE_MAX + 1 + rand() % (4 * ITEM_SIZE_MAX);
+      large[i] = sb.sb_malloc(size);
+      assert(large[i] && sb.get_size(large[i]) == size);
+      memset(large[i], i, size);
+    }
+    //free every other object, then the rest
+    for (int i = 0; i < nlarge; i += 2) sb.sb_free(large[i]);
+    st = sb.get_extent_stats();
+    assert(st.objects == nlarge / 2 && st.free_extents > 0);
+    fprintf(stdout, "round %d: %lu large objects in %lu pages, %lu free pages in %lu extents "
+        "(largest %lu, fragmentation %.2f)\n", r, st.objects, st.used_pages,
+        st.free_pages, st.free_extents, st.largest_free,
+        1 - (double)st.largest_free / st.free_pages);
+    for (int i = 1; i < nlarge; i += 2) {
+      assert(*((char*)large[i] + sb.get_size(large[i]) - 1) == (char)i);
+      sb.sb_free(large[i]);
+    }
+    st = sb.get_extent_stats();
+    assert(st.objects == 0 && st.free_pages == 0 && st.unused_pages == unused);
+  }
+  assert(sb.get_avail() == SLAB_BENCH_MEM);
+
+  //slab mover: the pages freed by one class are moved to another one
+  SlabAllocator mover;
+  assert(mover.slabs_init(SLAB_BENCH_MOVER_MEM, 1.25, true));
+  std::vector<void*> small, big;
+  while (mover.get_extent_stats().unused_pages) {  //until the page pool is empty
+    for (int i = 0; i < 1000; i++)
+      small.push_back(mover.sb_malloc(SLAB_BENCH_OBJ_SIZE));
+  }
+  for (void* p : small) mover.sb_free(p);
+  print_class_stats(mover, "after free");
+  size_t target = SLAB_BENCH_MOVER_MEM / 2, passes = 0;
+  start = get_time();
+  for (size_t total = 0; total < target; total += SLAB_BENCH_MOVER_OBJ_SIZE) {
+    void* p = mover.sb_malloc(SLAB_BENCH_MOVER_OBJ_SIZE);
+    while (!p) {  //the pool is empty: run the background mover (a timer of the worker) and retry
+      assert(mover.slabs_rebalance() > 0);
+      passes++;
+      p = mover.sb_malloc(SLAB_BENCH_MOVER_OBJ_SIZE);
+    }
+    big.push_back(p);
+  }
+  end = get_time();
+  print_class_stats(mover, "after realloc");
+  fprintf(stdout, "%lu objects of %d bytes after %lu of %d bytes freed: %ld ns per alloc "
+      "(%lu mover passes)\n", big.size(), SLAB_BENCH_MOVER_OBJ_SIZE, small.size(),
+      SLAB_BENCH_OBJ_SIZE, (end - start) / (long)big.size(), passes);
+  for (void* p : big) mover.sb_free(p);
+  size_t moved = mover.slabs_rebalance();
+  fprintf(stdout, "background pass moved %lu pages\n", moved);
+  st = mover.get_extent_stats();
+  assert(st.unused_pages + st.free_pages >= SLAB_REBALANCE_RESERVE);
+  assert(mover.get_avail() == SLAB_BENCH_MOVER_MEM);
+
+  //recency is per object: the touched chunks of a page get a second chance, the others are cold
+  {
+    SlabAllocator clock;
+    assert(clock.slabs_init(SLAB_BENCH_MOVER_MEM, 1.25, true));
+    std::vector<void*> objs, cold;
+    for (int i = 0; i < 16; i++) {
+      objs.push_back(clock.sb_malloc(SLAB_BENCH_MOVER_OBJ_SIZE));
+      if (i % 2 == 0) clock.touch(objs.back());
+    }
+    clock.scan_cold(0, objs.size(), cold);
+    std::sort(cold.begin(), cold.end());
+    std::vector<void*> untouched;
+    for (size_t i = 1; i < objs.size(); i += 2) untouched.push_back(objs[i]);
+    std::sort(untouched.begin(), untouched.end());
+    assert(cold == untouched);
+    cold.clear();
+    clock.scan_cold(0, objs.size(), cold);  //the second chance of the touched ones is used up
+    assert(cold.size() == objs.size());
+    for (void* p : objs) clock.sb_free(p);
+    fprintf(stdout, "scan_cold: %lu of %lu objects of a page cold after touching the others\n",
+        untouched.size(), objs.size());
+  }
+
+  //random reads over the whole region with each backing: a chain of dependent
+  //reads through the objects in random order, so that every read is a TLB miss
+  //unless the region is backed by hugepages
+  const char* backings[] = {"4KB", "THP", "2MB", "1GB"};
+  for (int hp = HUGEPAGE_NONE; hp <= HUGEPAGE_1G; hp++) {
+    SlabAllocator region;
+    assert(region.slabs_init(SLAB_BENCH_READ_MEM, 1.25, true, hp));
+    std::vector<void*> chain;
+    while (region.get_extent_stats().unused_pages) {
+      //one page at a time, so that the last round is served by the last unused page
+      for (int i = 0; i < ITEM_SIZE_MAX / SLAB_BENCH_READ_OBJ_SIZE; i++)
+        chain.push_back(region.sb_malloc(SLAB_BENCH_READ_OBJ_SIZE));
+    }
+    std::random_shuffle(chain.begin(), chain.end());
+    for (size_t i = 0; i < chain.size(); i++) {
+      void** next = (void**)((char*)chain[i] + (i * 64) % SLAB_BENCH_READ_OBJ_SIZE / 8 * 8);
+      size_t j = (i + 1) % chain.size();
+      *next = (char*)chain[j] + (j * 64) % SLAB_BENCH_READ_OBJ_SIZE / 8 * 8;
+    }
+    void* p = (char*)chain[0];
+    start = get_time();
+    for (int i = 0; i < SLAB_BENCH_READS; i++)
+      p = *(void**)p;
+    end = get_time();
+    assert(p);
+    fprintf(stdout, "random read with %s pages (backed by %s): %.0f reads/s, %ld ns per read\n",
+        backings[hp], backings[region.get_backing()],
+        (double)SLAB_BENCH_READS / ((double)(end - start) / 1000 / 1000 / 1000),
+        (end - start) / SLAB_BENCH_READS);
+    for (void* o : chain) region.sb_free(o);
+  }
+
+  fprintf(stdout, "slab benchmark done\n");
+  return 0;
+}